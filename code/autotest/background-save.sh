@@ -0,0 +1,118 @@
+#!/bin/sh
+#
+
+TNAME=`basename $0 .sh`
+export TNAME
+
+rm -f FAIL-$TNAME
+
+# Test that a background save writes out the buffer as it was when the
+# save was started, while editing carries on.
+
+# -+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-
+# Write out a file, and an rc to edit it, save it in the background
+# and carry on editing. exit-emacs waits for the save to finish.
+#
+cat >bgsave.tfile <<'EOD'
+line one
+line two
+EOD
+
+cat >bgsave-rc.tfile <<'EOD'
+find-file bgsave.tfile
+insert-string "START "
+save-file-background
+insert-string "MORE "
+end-of-file
+insert-string "line three"
+1 exit-emacs
+EOD
+
+# Do it...set the default uemacs if caller hasn't set one.
+[ -z "$UE2RUN" ] && UE2RUN="./uemacs -d etc"
+$UE2RUN -x ./bgsave-rc.tfile
+
+# -+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-
+# Write out the uemacs start-up file, that will run the tests
+#
+cat >uetest.rc <<'EOD'
+; Some uemacs code to run tests on background saves
+; Put test results into a specific buffer (test-reports)...
+; ...and switch to that buffer at the end.
+
+execute-file autotest/report-status.rc
+
+set %test_name &env TNAME
+
+select-buffer test-reports
+insert-string &cat %test_name " started"
+newline
+set %fail 0
+set %ok 0
+
+execute-file autotest/check-value.rc
+
+; -+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-
+; START running the code!
+;
+set %test-report "START: Background save tests"
+run report-status
+
+select-buffer saved
+read-file bgsave.tfile
+
+set %curtest "First line"
+beginning-of-file
+set %got $line
+set %expect "START line one"
+run check-value
+
+set %curtest "Last line"
+end-of-file
+previous-line
+set %got $line
+set %expect "line two"
+run check-value
+
+; -+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-
+; Show the final score
+;
+select-buffer test-reports
+newline
+insert-string &cat &cat "END: ok: " %ok &cat " fail: " %fail
+newline
+insert-string &cat %test_name " ended"
+EOD
+
+# If running them all, leave - but first write out the buffer if there
+# were any failures.
+#
+if [ "$1" = FULL-RUN ]; then
+    cat >>uetest.rc <<'EOD'
+!if &not &equ %fail 0
+    set $cfname &cat "FAIL-" %test_name
+    save-file
+!else
+    unmark-buffer
+!endif
+exit-emacs
+EOD
+# Just leave display showing if being run singly.
+else
+    cat >>uetest.rc <<'EOD'
+unmark-buffer
+-2 redraw-display
+EOD
+fi
+
+# Do it...set the default uemacs if caller hasn't set one.
+[ -z "$UE2RUN" ] && UE2RUN="./uemacs -d etc"
+$UE2RUN -x ./uetest.rc
+
+if [ "$1" = FULL-RUN ]; then
+    if [ -f FAIL-$TNAME ]; then
+        echo "$TNAME FAILed"
+    else
+        echo "$TNAME passed"
+    fi
+fi
@@ -0,0 +1,163 @@
+#!/bin/sh
+#
+
+TNAME=`basename $0 .sh`
+export TNAME
+
+rm -f FAIL-$TNAME
+
+# Test buffer name lookup, renaming and list ordering with enough
+# buffers to make the name index grow a few times.
+
+# -+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-
+# Write out the uemacs start-up file, that will run the tests
+#
+cat >uetest.rc <<'EOD'
+; Some uemacs code to run tests on buffer names
+; Put test results into a specific buffer (test-reports)...
+; ...and switch to that buffer at the end.
+
+execute-file autotest/report-status.rc
+
+set %test_name &env TNAME
+
+select-buffer test-reports
+insert-string &cat %test_name " started"
+newline
+set %fail 0
+set %ok 0
+
+execute-file autotest/check-value.rc
+
+; -+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-
+; START running the code!
+;
+set %test-report "START: Buffer name tests"
+run report-status
+
+; Create 600 buffers, in reverse order, so that each one has to
+; be inserted at the start of the (sorted) buffer list.
+;
+set %bc 600
+!while &gre %bc 0
+  select-buffer &cat "bn-" &rig &cat "0000" %bc 4
+  set %bc &sub %bc 1
+!endwhile
+
+set %curtest "Lookup of first buffer"
+set %got &exb "bn-0001"
+set %expect TRUE
+run check-value
+
+set %curtest "Lookup of last buffer"
+set %got &exb "bn-0600"
+set %expect TRUE
+run check-value
+
+set %curtest "Lookup of unknown buffer"
+set %got &exb "bn-0601"
+set %expect FALSE
+run check-value
+
+; The buffer list must still be in lexical order
+;
+select-buffer "bn-0299"
+next-buffer
+set %curtest "next-buffer ordering"
+set %got $cbufname
+set %expect "bn-0300"
+run check-value
+
+; Rename a buffer. The old name must go and the new name must be
+; found, and it must move to its new place in the list.
+;
+select-buffer "bn-0300"
+set $cbufname "bn-0450a"
+set %curtest "Old name gone after rename"
+set %got &exb "bn-0300"
+set %expect FALSE
+run check-value
+
+set %curtest "New name found after rename"
+set %got &exb "bn-0450a"
+set %expect TRUE
+run check-value
+
+select-buffer "bn-0299"
+next-buffer
+set %curtest "next-buffer skips renamed buffer"
+set %got $cbufname
+set %expect "bn-0301"
+run check-value
+
+select-buffer "bn-0450"
+next-buffer
+set %curtest "next-buffer reaches renamed buffer"
+set %got $cbufname
+set %expect "bn-0450a"
+run check-value
+
+; Renaming to an existing name must fail
+;
+!force set $cbufname "bn-0001"
+set %curtest "Rename to existing name"
+set %got $cbufname
+set %expect "bn-0450a"
+run check-value
+
+; Kill a buffer and check it has gone
+;
+select-buffer test-reports
+delete-buffer "bn-0123"
+set %curtest "Killed buffer gone"
+set %got &exb "bn-0123"
+set %expect FALSE
+run check-value
+
+set %curtest "Neighbour of killed buffer still there"
+set %got &exb "bn-0124"
+set %expect TRUE
+run check-value
+
+; -+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-
+; Show the final score
+;
+select-buffer test-reports
+newline
+insert-string &cat &cat "END: ok: " %ok &cat " fail: " %fail
+newline
+insert-string &cat %test_name " ended"
+EOD
+
+# If running them all, leave - but first write out the buffer if there
+# were any failures.
+#
+if [ "$1" = FULL-RUN ]; then
+    cat >>uetest.rc <<'EOD'
+!if &not &equ %fail 0
+    set $cfname &cat "FAIL-" %test_name
+    save-file
+!else
+    unmark-buffer
+!endif
+exit-emacs
+EOD
+# Just leave display showing if being run singly.
+else
+    cat >>uetest.rc <<'EOD'
+unmark-buffer
+-2 redraw-display
+EOD
+fi
+
+# Do it...set the default uemacs if caller hasn't set one.
+[ -z "$UE2RUN" ] && UE2RUN="./uemacs -d etc"
+$UE2RUN -x ./uetest.rc
+
+if [ "$1" = FULL-RUN ]; then
+    if [ -f FAIL-$TNAME ]; then
+        echo "$TNAME FAILed"
+    else
+        echo "$TNAME passed"
+    fi
+fi
@@ -0,0 +1,176 @@
+#!/bin/sh
+#
+
+TNAME=`basename $0 .sh`
+export TNAME
+
+rm -f FAIL-$TNAME
+
+# Test client/server mode.
+# A server (-z) only deals with requests while it is waiting for the
+# keyboard, so it is run under script(1) (which can't tell it a screen
+# size, so that is set), with its keyboard fed from here: a client (-w)
+# with no files, then one with a file which is edited and finished with
+# server-done, then one whose buffer is killed instead (which must also
+# release the file's lock) before the server exits.
+
+if ! script -qec true /dev/null >/dev/null 2>&1; then
+    echo "$TNAME skipped (needs util-linux script)"
+    exit 0
+fi
+
+# -+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-
+# A private socket directory, so as not to meet any real server.
+#
+XDG_RUNTIME_DIR=/tmp/uemacs-test-$$
+export XDG_RUNTIME_DIR
+rm -rf $XDG_RUNTIME_DIR
+mkdir -m 700 $XDG_RUNTIME_DIR
+
+echo "from the file" >server.tfile
+echo "to be killed" >server2.tfile
+rm -f server-status.tfile server2.tfile.lock~
+echo 'set $filock TRUE' >server-rc.tfile
+
+# Do it...set the default uemacs if caller hasn't set one.
+[ -z "$UE2RUN" ] && UE2RUN="./uemacs -d etc"
+
+# Anything the clients print would go to the server's keyboard.
+{
+    tries=0
+    while [ ! -S $XDG_RUNTIME_DIR/uemacs-server ] && [ $tries -lt 10 ]; do
+        sleep 1
+        tries=`expr $tries + 1`
+    done
+    $UE2RUN -w >/dev/null 2>&1
+    echo "no-files $?" >>server-status.tfile
+    $UE2RUN -w server.tfile >/dev/null 2>&1 &
+    cpid=$!
+    sleep 2
+    printf 'edited \033xserver-done\r'
+    wait $cpid
+    echo "one-file $?" >>server-status.tfile
+    $UE2RUN -w server2.tfile >/dev/null 2>&1 &
+    cpid=$!
+    sleep 2
+    [ -f server2.tfile.lock~ ] && lock=locked || lock=unlocked
+    echo "while-edited $lock" >>server-status.tfile
+    printf '\033xselect-buffer\rother\r\033xdelete-buffer\rserver2.tfile\r'
+    wait $cpid
+    echo "killed $?" >>server-status.tfile
+    sleep 1
+    [ -f server2.tfile.lock~ ] && lock=locked || lock=unlocked
+    echo "after-kill $lock" >>server-status.tfile
+    printf '\030\003'
+} | script -qec "stty rows 24 cols 80; $UE2RUN -x ./server-rc.tfile -z" \
+    /dev/null >/dev/null 2>&1
+rm -f server-rc.tfile server2.tfile.lock~
+
+rm -rf $XDG_RUNTIME_DIR
+
+# -+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-
+# Write out the uemacs start-up file, that will run the tests
+#
+cat >uetest.rc <<'EOD'
+; Some uemacs code to run tests on client/server mode
+; Put test results into a specific buffer (test-reports)...
+; ...and switch to that buffer at the end.
+
+execute-file autotest/report-status.rc
+
+set %test_name &env TNAME
+
+select-buffer test-reports
+insert-string &cat %test_name " started"
+newline
+set %fail 0
+set %ok 0
+
+execute-file autotest/check-value.rc
+
+; -+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-
+; START running the code!
+;
+set %test-report "START: client/server tests"
+run report-status
+
+find-file server-status.tfile
+beginning-of-file
+set %curtest "Client with no files"
+set %got $line
+set %expect "no-files 0"
+run check-value
+
+next-line
+set %curtest "Client with a file"
+set %got $line
+set %expect "one-file 0"
+run check-value
+
+next-line
+set %curtest "File locked while edited for a client"
+set %got $line
+set %expect "while-edited locked"
+run check-value
+
+next-line
+set %curtest "Client whose buffer was killed"
+set %got $line
+set %expect "killed 0"
+run check-value
+
+next-line
+set %curtest "Killed buffer's lock released"
+set %got $line
+set %expect "after-kill unlocked"
+run check-value
+
+find-file server.tfile
+beginning-of-file
+set %curtest "File edited and saved by the server"
+set %got $line
+set %expect "edited from the file"
+run check-value
+
+; -+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-
+; Show the final score
+;
+select-buffer test-reports
+newline
+insert-string &cat &cat "END: ok: " %ok &cat " fail: " %fail
+newline
+insert-string &cat %test_name " ended"
+EOD
+
+# If running them all, leave - but first write out the buffer if there
+# were any failures.
+#
+if [ "$1" = FULL-RUN ]; then
+    cat >>uetest.rc <<'EOD'
+!if &not &equ %fail 0
+    set $cfname &cat "FAIL-" %test_name
+    save-file
+!else
+    unmark-buffer
+!endif
+exit-emacs
+EOD
+# Just leave display showing if being run singly.
+else
+    cat >>uetest.rc <<'EOD'
+unmark-buffer
+-2 redraw-display
+EOD
+fi
+
+# Do it...set the default uemacs if caller hasn't set one.
+[ -z "$UE2RUN" ] && UE2RUN="./uemacs -d etc"
+$UE2RUN -x ./uetest.rc
+
+if [ "$1" = FULL-RUN ]; then
+    if [ -f FAIL-$TNAME ]; then
+        echo "$TNAME FAILed"
+    else
+        echo "$TNAME passed"
+    fi
+fi
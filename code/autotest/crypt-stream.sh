@@ -0,0 +1,147 @@
+#!/bin/sh
+#
+
+TNAME=`basename $0 .sh`
+export TNAME
+
+rm -f FAIL-$TNAME
+
+# Test the stream cipher crypt mode ($crypt_mode 0x8000).
+
+# -+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-
+# The plain text...
+#
+cat >stream.tfile <<'EOD'
+This is just a small test file to check that the stream cipher
+crypt mode reads back what it wrote.
+EOD
+
+# ...and it encrypted with ATestEncryptionString as the key.
+# This must stay readable.
+#
+base64 -d >stream.enc <<'EOD'
+AHVlQ0MyMArocPN3J/7f05Xw9D5rV/Zbv1W0vaCmUnK7PwwqqRxYS/h8zk0XT4QRCD7qVBpE4wwi
+kmXmEACZDnTzGk0tAew9ioX5Ky9QuRO9yOS1ntN9lvy5vVHgA8UTSpft6orN714oLVT7/CS8oW68
+uPQ=
+EOD
+
+# -+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-
+# Write out the uemacs start-up file, that will run the tests
+#
+cat >uetest.rc <<'EOD'
+; Some uemacs code to run tests on the stream cipher
+; Put test results into a specific buffer (test-reports)...
+; ...and switch to that buffer at the end.
+
+execute-file autotest/report-status.rc
+
+set %test_name &env TNAME
+
+select-buffer test-reports
+insert-string &cat %test_name " started"
+newline
+set %fail 0
+set %ok 0
+
+execute-file autotest/check-value.rc
+
+; Check the current buffer holds the plain text
+;
+store-procedure check-text
+  beginning-of-file
+  set %got $line
+  set %expect "This is just a small test file to check that the stream cipher"
+  run check-value
+  next-line
+  set %got $line
+  set %expect "crypt mode reads back what it wrote."
+  run check-value
+  end-of-file
+  set %got $curline
+  set %expect 3
+  run check-value
+!endm
+
+; -+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-
+; START running the code!
+;
+set %test-report "START: stream cipher tests"
+run report-status
+
+; The stream format is recognized whatever $crypt_mode is set to
+select-buffer FIXED
+set $crypt_mode 0x1
+add-mode Crypt
+read-file stream.enc ATestEncryptionString
+set %curtest "Read fixed file"
+run check-text
+
+; Write the plain text with the stream cipher
+find-file stream.tfile
+set $crypt_mode 0x8001
+add-mode Crypt
+set-encryption-key AnotherKey
+write-file stream1.enc
+write-file stream2.enc
+
+set %curtest "Header written"
+!force shell-command "printf '\0ueCC20\n' | cmp -s -n 8 - stream1.enc"
+set %got &equ $rval 0
+set %expect "TRUE"
+run check-value
+
+set %curtest "New nonce for each write"
+!force shell-command "cmp -s stream1.enc stream2.enc"
+set %got &equ $rval 0
+set %expect "FALSE"
+run check-value
+
+select-buffer READBACK
+add-mode Crypt
+read-file stream2.enc AnotherKey
+set %curtest "Read back"
+run check-text
+
+; -+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-
+; Show the final score
+;
+select-buffer test-reports
+newline
+insert-string &cat &cat "END: ok: " %ok &cat " fail: " %fail
+newline
+insert-string &cat %test_name " ended"
+EOD
+
+# If running them all, leave - but first write out the buffer if there
+# were any failures.
+#
+if [ "$1" = FULL-RUN ]; then
+    cat >>uetest.rc <<'EOD'
+!if &not &equ %fail 0
+    set $cfname &cat "FAIL-" %test_name
+    save-file
+!else
+    unmark-buffer
+!endif
+exit-emacs
+EOD
+# Just leave display showing if being run singly.
+else
+    cat >>uetest.rc <<'EOD'
+unmark-buffer
+-2 redraw-display
+EOD
+fi
+
+# Do it...set the default uemacs if caller hasn't set one.
+[ -z "$UE2RUN" ] && UE2RUN="./uemacs -d etc"
+$UE2RUN -x ./uetest.rc
+
+if [ "$1" = FULL-RUN ]; then
+    if [ -f FAIL-$TNAME ]; then
+        echo "$TNAME FAILed"
+    else
+        echo "$TNAME passed"
+        rm -f stream.tfile stream.enc stream1.enc stream2.enc
+    fi
+fi
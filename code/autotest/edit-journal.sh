@@ -0,0 +1,190 @@
+#!/bin/sh
+#
+
+TNAME=`basename $0 .sh`
+export TNAME
+
+rm -f FAIL-$TNAME
+
+# Test that the edit journal kept in Asave mode survives a crash, and
+# that recover-journal replays it to give the edited buffer.
+
+# -+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-
+# Write out a file, and an rc to edit it in Asave mode then kill
+# uemacs with a SIGTERM (which gets the journal onto the disk).
+# The signal handler's buffer dumps go to a private HOME.
+# The typing and backspacing at the end should go into just one text
+# and one delete record, so the journal stays small.
+#
+cat >ejournal.tfile <<'EOD'
+line one  
+line two
+line three
+EOD
+rm -f .ejournal.tfile.uej
+mkdir -p ejournal-home.d
+
+cat >ejournal-rc.tfile <<'EOD'
+find-file ejournal.tfile
+add-mode asave
+insert-string "START "
+newline
+end-of-line
+insert-string "abc"
+next-line
+beginning-of-line
+2 delete-next-character
+end-of-file
+insert-string "line four"
+insert-string "012345678901234567890123456789012345678901234567890123456789"
+set %n 50
+!while &gre %n 0
+  delete-previous-character
+  set %n &sub %n 1
+!endwhile
+beginning-of-file
+2 forward-character
+transpose-characters
+beginning-of-file
+4 trim-line
+shell-command "kill -TERM $PPID"
+EOD
+
+# Do it...set the default uemacs if caller hasn't set one.
+[ -z "$UE2RUN" ] && UE2RUN="./uemacs -d etc"
+HOME=`pwd`/ejournal-home.d $UE2RUN -P -x ./ejournal-rc.tfile 2>/dev/null
+rm -rf ejournal-home.d
+if [ -f .ejournal.tfile.uej ]; then
+    jnl_left=yes
+    if [ `wc -c <.ejournal.tfile.uej` -lt 1000 ]; then
+        jnl_small=yes
+    else
+        jnl_small=no
+    fi
+else
+    jnl_left=no
+    jnl_small=no
+fi
+
+# -+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-
+# Write out the uemacs start-up file, that will run the tests
+#
+cat >uetest.rc <<'EOD'
+; Some uemacs code to run tests on the edit journal
+; Put test results into a specific buffer (test-reports)...
+; ...and switch to that buffer at the end.
+
+execute-file autotest/report-status.rc
+
+set %test_name &env TNAME
+
+select-buffer test-reports
+insert-string &cat %test_name " started"
+newline
+set %fail 0
+set %ok 0
+
+execute-file autotest/check-value.rc
+
+; -+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-
+; START running the code!
+;
+set %test-report "START: Edit journal tests"
+run report-status
+
+set %curtest "Journal left by crash"
+set %got &env JNL_LEFT
+set %expect "yes"
+run check-value
+
+set %curtest "Journal is compact"
+set %got &env JNL_SMALL
+set %expect "yes"
+run check-value
+
+find-file ejournal.tfile
+!force recover-journal
+set %curtest "recover-journal"
+set %got $status
+set %expect "TRUE"
+run check-value
+
+set %curtest "Line 1"
+beginning-of-file
+set %got $line
+set %expect "TSART"
+run check-value
+
+set %curtest "Line 2"
+next-line
+set %got $line
+set %expect "line one  abc"
+run check-value
+
+set %curtest "Line 3"
+next-line
+set %got $line
+set %expect "ne two"
+run check-value
+
+set %curtest "Line 5"
+end-of-file
+previous-line
+set %got $line
+set %expect "line four0123456789"
+run check-value
+
+set %curtest "Line count"
+set %got $curline
+set %expect "5"
+run check-value
+
+; Saving it removes the journal
+save-file
+set %curtest "Journal gone after save"
+set %got &exi ".ejournal.tfile.uej"
+set %expect "FALSE"
+run check-value
+
+; -+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-
+; Show the final score
+;
+select-buffer test-reports
+newline
+insert-string &cat &cat "END: ok: " %ok &cat " fail: " %fail
+newline
+insert-string &cat %test_name " ended"
+EOD
+
+# If running them all, leave - but first write out the buffer if there
+# were any failures.
+#
+if [ "$1" = FULL-RUN ]; then
+    cat >>uetest.rc <<'EOD'
+!if &not &equ %fail 0
+    set $cfname &cat "FAIL-" %test_name
+    save-file
+!else
+    unmark-buffer
+!endif
+exit-emacs
+EOD
+# Just leave display showing if being run singly.
+else
+    cat >>uetest.rc <<'EOD'
+unmark-buffer
+-2 redraw-display
+EOD
+fi
+
+# Do it...set the default uemacs if caller hasn't set one.
+[ -z "$UE2RUN" ] && UE2RUN="./uemacs -d etc"
+JNL_LEFT=$jnl_left JNL_SMALL=$jnl_small $UE2RUN -x ./uetest.rc
+
+if [ "$1" = FULL-RUN ]; then
+    if [ -f FAIL-$TNAME ]; then
+        echo "$TNAME FAILed"
+    else
+        echo "$TNAME passed"
+    fi
+fi
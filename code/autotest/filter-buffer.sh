@@ -0,0 +1,137 @@
+#!/bin/sh
+#
+
+TNAME=`basename $0 .sh`
+export TNAME
+
+rm -f FAIL-$TNAME
+
+# Test filter-buffer, which streams the buffer through a command.
+
+# -+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-
+# Write out a file to filter.
+#
+cat >filter.tfile <<'EOD'
+one
+two
+three
+four
+five
+EOD
+
+# -+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-
+# Write out the uemacs start-up file, that will run the tests
+#
+cat >uetest.rc <<'EOD'
+; Some uemacs code to run tests on filter-buffer
+; Put test results into a specific buffer (test-reports)...
+; ...and switch to that buffer at the end.
+
+execute-file autotest/report-status.rc
+
+set %test_name &env TNAME
+
+select-buffer test-reports
+insert-string &cat %test_name " started"
+newline
+set %fail 0
+set %ok 0
+
+execute-file autotest/check-value.rc
+
+; -+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-
+; START running the code!
+;
+set %test-report "START: filter-buffer tests"
+run report-status
+
+find-file filter.tfile
+
+; A filter that fails leaves the buffer alone
+!force filter-buffer "sort; exit 3"
+set %curtest "Failing filter status"
+set %got &equ $rval 0
+set %expect "FALSE"
+run check-value
+
+set %curtest "Failing filter leaves text"
+beginning-of-file
+set %got $line
+set %expect "one"
+run check-value
+
+; One that stops reading early is fine
+filter-buffer "sort | head -3"
+set %curtest "Sorted first line"
+beginning-of-file
+set %got $line
+set %expect "five"
+run check-value
+
+set %curtest "Sorted line count"
+end-of-file
+set %got $curline
+set %expect "4"
+run check-value
+
+; Only the narrowed part is filtered
+beginning-of-file
+next-line
+set-mark
+next-line
+narrow-to-region
+filter-buffer "tr a-z A-Z"
+widen-from-region
+beginning-of-file
+set %curtest "Narrowed filter"
+set %got &cat $line " "
+next-line
+set %got &cat %got &cat $line " "
+next-line
+set %got &cat %got $line
+set %expect "five FOUR one"
+run check-value
+unmark-buffer
+
+; -+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-
+; Show the final score
+;
+select-buffer test-reports
+newline
+insert-string &cat &cat "END: ok: " %ok &cat " fail: " %fail
+newline
+insert-string &cat %test_name " ended"
+EOD
+
+# If running them all, leave - but first write out the buffer if there
+# were any failures.
+#
+if [ "$1" = FULL-RUN ]; then
+    cat >>uetest.rc <<'EOD'
+!if &not &equ %fail 0
+    set $cfname &cat "FAIL-" %test_name
+    save-file
+!else
+    unmark-buffer
+!endif
+exit-emacs
+EOD
+# Just leave display showing if being run singly.
+else
+    cat >>uetest.rc <<'EOD'
+unmark-buffer
+-2 redraw-display
+EOD
+fi
+
+# Do it...set the default uemacs if caller hasn't set one.
+[ -z "$UE2RUN" ] && UE2RUN="./uemacs -d etc"
+$UE2RUN -x ./uetest.rc
+
+if [ "$1" = FULL-RUN ]; then
+    if [ -f FAIL-$TNAME ]; then
+        echo "$TNAME FAILed"
+    else
+        echo "$TNAME passed"
+    fi
+fi
@@ -0,0 +1,162 @@
+#!/bin/sh
+#
+
+TNAME=`basename $0 .sh`
+export TNAME
+
+rm -f FAIL-$TNAME
+
+# Test case-insensitive searching for non-ASCII text, which uses the
+# case-folded literal scanner.
+
+# -+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-
+# Write out the test input file.
+# Line 3 ends with an e and a combining acute accent (U+0301).
+#
+printf 'Straße und STRASSE\nσοφία ΣΟΦΊΑ σοφίας\nrésumé RÉSUMÉ re\314\201sume\314\201\nſtar star STAR\nend é\n' \
+    >fold-search.tfile
+
+# -+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-
+# Write out the uemacs start-up file, that will run the tests
+#
+cat >uetest.rc <<'EOD'
+; Some uemacs code to run tests on case-folded searches
+; Put test results into a specific buffer (test-reports)...
+; ...and switch to that buffer at the end.
+
+execute-file autotest/report-status.rc
+
+set %test_name &env TNAME
+
+select-buffer test-reports
+insert-string &cat %test_name " started"
+newline
+set %fail 0
+set %ok 0
+
+; Search for %pat, in direction %dir, and compare where dot ends up
+; with %expect
+;
+store-procedure check-search
+  !if &equ %dir 1
+    !force search-forward %pat
+  !else
+    !force search-reverse %pat
+  !endif
+  set %got &cat &cat $curline ":" $curcol
+  !if &seq %got %expect
+    set %test-report &cat %curtest &cat " - OK: " %got
+    set %ok &add %ok 1
+  !else
+    set %test-report &cat %curtest &cat " - WRONG, got: " %got
+    set %test-report &cat %test-report &cat " - expected: " %expect
+    set %fail &add %fail 1
+  !endif
+  run report-status
+!endm
+
+; -+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-
+; START running the code!
+;
+set %test-report "START: case-folded search tests"
+run report-status
+
+find-file fold-search.tfile
+delete-mode Exact
+delete-mode Magic
+
+set %dir 1
+set %curtest "Folded ß"
+set %pat "STRAßE"
+set %expect "1:7"
+run check-search
+set %curtest "Greek"
+set %pat "ΣΟΦΊΑ"
+set %expect "2:6"
+run check-search
+set %curtest "Greek again"
+set %expect "2:12"
+run check-search
+set %curtest "Final sigma"
+set %pat "ΣΟΦΊΑΣ"
+set %expect "2:19"
+run check-search
+set %curtest "Precomposed"
+set %pat "RÉSUMÉ"
+set %expect "3:7"
+run check-search
+set %curtest "Precomposed again"
+set %expect "3:14"
+run check-search
+set %curtest "Not the decomposed"
+set %expect "3:14"
+run check-search
+set %curtest "Long s"
+set %pat "ſTAR"
+set %expect "4:5"
+run check-search
+set %curtest "Long s matches s"
+set %expect "4:10"
+run check-search
+
+end-of-file
+set %dir 0
+set %curtest "Reverse"
+set %pat "é"
+set %expect "5:5"
+run check-search
+set %curtest "Reverse past the decomposed"
+set %expect "3:13"
+run check-search
+set %curtest "Reverse, s doesn't match long s"
+set %pat "ſtar"
+set %expect "3:13"
+run check-search
+set %curtest "Reverse Greek"
+set %pat "ΣΟΦΊΑ"
+set %expect "2:13"
+run check-search
+
+; -+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-
+; Show the final score
+;
+select-buffer test-reports
+newline
+insert-string &cat &cat "END: ok: " %ok &cat " fail: " %fail
+newline
+insert-string &cat %test_name " ended"
+EOD
+
+# If running them all, leave - but first write out the buffer if there
+# were any failures.
+#
+if [ "$1" = FULL-RUN ]; then
+    cat >>uetest.rc <<'EOD'
+!if &not &equ %fail 0
+    set $cfname &cat "FAIL-" %test_name
+    save-file
+!else
+    unmark-buffer
+!endif
+exit-emacs
+EOD
+# Just leave display showing if being run singly.
+else
+    cat >>uetest.rc <<'EOD'
+unmark-buffer
+-2 redraw-display
+EOD
+fi
+
+# Do it...set the default uemacs if caller hasn't set one.
+[ -z "$UE2RUN" ] && UE2RUN="./uemacs -d etc"
+$UE2RUN -x ./uetest.rc
+
+if [ "$1" = FULL-RUN ]; then
+    if [ -f FAIL-$TNAME ]; then
+        echo "$TNAME FAILed"
+    else
+        echo "$TNAME passed"
+        rm -f fold-search.tfile
+    fi
+fi
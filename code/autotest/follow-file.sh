@@ -0,0 +1,155 @@
+#!/bin/sh
+#
+
+TNAME=`basename $0 .sh`
+export TNAME
+
+rm -f FAIL-$TNAME
+
+# Test follow-file.
+# A test can't wait for the idle checks, but asking to follow a buffer
+# that is already following checks its file at once.
+
+# -+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-
+# The file to follow, with an incomplete last line
+#
+printf 'line 1\nline 2\nline 3\npart' >follow.tfile
+
+# -+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-
+# Write out the uemacs start-up file, that will run the tests
+#
+cat >uetest.rc <<'EOD'
+; Some uemacs code to run tests on following a file
+; Put test results into a specific buffer (test-reports)...
+; ...and switch to that buffer at the end.
+
+execute-file autotest/report-status.rc
+
+set %test_name &env TNAME
+
+select-buffer test-reports
+insert-string &cat %test_name " started"
+newline
+set %fail 0
+set %ok 0
+
+execute-file autotest/check-value.rc
+
+; Check the number of lines and the last one
+;
+store-procedure check-end
+  select-buffer follow.tfile
+  end-of-file
+  set %got $curline
+  run check-value
+  previous-line
+  set %got $line
+  set %expect %last
+  run check-value
+!endm
+
+; -+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-
+; START running the code!
+;
+set %test-report "START: follow-file tests"
+run report-status
+
+find-file follow.tfile
+end-of-file
+follow-file
+set %curtest "Incomplete line dropped"
+set %expect 4
+set %last "line 3"
+run check-end
+
+set %curtest "View mode set"
+set %got &equ &band $cmode 16 16
+set %expect TRUE
+run check-value
+
+; With the hunt cache on, the search's matches are cached, so this
+; checks the appended lines are seen as a change. Running other
+; commands stops hunts, so that has to be put back.
+set $ggr_opts &bor $ggr_opts 0x10
+beginning-of-file
+search-forward "line"
+2 hunt-forward
+!force shell-command "printf 'ial line\nline 5\n' >>follow.tfile"
+1 follow-file
+set $srch_can_hunt 1
+!force hunt-forward
+set %curtest "Hunt into appended lines"
+set %got &cat $curline &cat "/" $curcol
+set %expect "4/13"
+run check-value
+set $ggr_opts &ban $ggr_opts &bno 0x10
+
+set %curtest "Appended lines"
+set %expect 6
+set %last "line 5"
+run check-end
+
+!force shell-command "printf 'new 1\nnew 2\n' >follow.tfile"
+1 follow-file
+set %curtest "Truncated"
+set %expect 3
+set %last "new 2"
+run check-end
+
+!force shell-command "mv follow.tfile follow.old; printf 'rot 1\n' >follow.tfile"
+1 follow-file
+set %curtest "Replaced"
+set %expect 2
+set %last "rot 1"
+run check-end
+
+0 follow-file
+!force shell-command "printf 'more\n' >>follow.tfile"
+set %curtest "Not read when stopped"
+set %expect 2
+set %last "rot 1"
+run check-end
+
+; -+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-
+; Show the final score
+;
+select-buffer test-reports
+newline
+insert-string &cat &cat "END: ok: " %ok &cat " fail: " %fail
+newline
+insert-string &cat %test_name " ended"
+EOD
+
+# If running them all, leave - but first write out the buffer if there
+# were any failures.
+#
+if [ "$1" = FULL-RUN ]; then
+    cat >>uetest.rc <<'EOD'
+!if &not &equ %fail 0
+    set $cfname &cat "FAIL-" %test_name
+    save-file
+!else
+    unmark-buffer
+!endif
+exit-emacs
+EOD
+# Just leave display showing if being run singly.
+else
+    cat >>uetest.rc <<'EOD'
+unmark-buffer
+-2 redraw-display
+EOD
+fi
+
+# Do it...set the default uemacs if caller hasn't set one.
+[ -z "$UE2RUN" ] && UE2RUN="./uemacs -d etc"
+$UE2RUN -x ./uetest.rc
+
+if [ "$1" = FULL-RUN ]; then
+    if [ -f FAIL-$TNAME ]; then
+        echo "$TNAME FAILed"
+    else
+        echo "$TNAME passed"
+        rm -f follow.tfile follow.old
+    fi
+fi
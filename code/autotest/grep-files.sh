@@ -0,0 +1,156 @@
+#!/bin/sh
+#
+
+TNAME=`basename $0 .sh`
+export TNAME
+
+rm -f FAIL-$TNAME
+
+# Test grep-files and goto-grep-match.
+
+# -+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-
+# Write out a directory tree to search.
+# It has a DOS file, a binary one and a hidden directory.
+#
+TDIR=grep-files.tdir
+rm -rf $TDIR
+mkdir -p $TDIR/d/sub $TDIR/.hid
+printf 'one Foo\ntwo\nfoo three foo\r\n' >$TDIR/a.txt
+printf 'nothing\n' >$TDIR/d/b.txt
+printf 'x\nFOO\nbar\nfoo\nbar\n' >$TDIR/d/sub/c.txt
+printf 'foo\n' >$TDIR/.hid/h.txt
+printf 'foo\0bin\n' >$TDIR/d/bin.dat
+
+# -+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-
+# Write out the uemacs start-up file, that will run the tests
+#
+cat >uetest.rc <<'EOD'
+; Some uemacs code to run tests on searching files
+; Put test results into a specific buffer (test-reports)...
+; ...and switch to that buffer at the end.
+
+execute-file autotest/report-status.rc
+
+set %test_name &env TNAME
+
+select-buffer test-reports
+insert-string &cat %test_name " started"
+newline
+set %fail 0
+set %ok 0
+
+execute-file autotest/check-value.rc
+
+; Search the files in %where for %pat and check what is in //Grep,
+; with the lines joined by |.
+;
+store-procedure check-grep
+  grep-files %pat %where
+  select-buffer //Grep
+  end-of-file
+  set %n $curline
+  beginning-of-file
+  set %got ""
+  !while &les $curline %n
+    set %got &cat %got &cat $line "|"
+    next-line
+  !endwhile
+  run check-value
+  select-buffer test-reports
+!endm
+
+; -+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-
+; START running the code!
+;
+set %test-report "START: grep-files tests"
+run report-status
+
+set %curtest "Literal"
+delete-mode Exact
+delete-mode Magic
+set %pat "foo"
+set %where "grep-files.tdir"
+set %expect "grep-files.tdir/a.txt:1:one Foo|grep-files.tdir/a.txt:3:foo three foo|grep-files.tdir/d/sub/c.txt:2:FOO|grep-files.tdir/d/sub/c.txt:4:foo|"
+run check-grep
+
+set %curtest "Exact, in order named"
+add-mode Exact
+set %where "grep-files.tdir/d grep-files.tdir/a.txt"
+set %expect "grep-files.tdir/d/sub/c.txt:4:foo|grep-files.tdir/a.txt:3:foo three foo|"
+run check-grep
+
+set %curtest "Across lines"
+set %pat "bar~nfoo"
+set %where "grep-files.tdir"
+set %expect "grep-files.tdir/d/sub/c.txt:3:bar|"
+run check-grep
+
+set %curtest "Magic"
+add-mode Magic
+set %pat "[of]o$"
+set %expect "grep-files.tdir/a.txt:1:one Foo|grep-files.tdir/a.txt:3:foo three foo|grep-files.tdir/d/sub/c.txt:4:foo|"
+run check-grep
+delete-mode Magic
+
+set %curtest "Open buffer"
+find-file grep-files.tdir/a.txt
+insert-string "foo mod "
+select-buffer test-reports
+set %pat "foo"
+set %expect "grep-files.tdir/a.txt:1:foo mod one Foo|grep-files.tdir/a.txt:3:foo three foo|grep-files.tdir/d/sub/c.txt:4:foo|"
+run check-grep
+
+set %curtest "Goto match"
+select-buffer //Grep
+beginning-of-file
+next-line
+goto-grep-match
+set %got &cat $cbufname &cat ":" $curline
+set %expect "a.txt:3"
+run check-value
+select-buffer a.txt
+unmark-buffer
+
+; -+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-
+; Show the final score
+;
+select-buffer test-reports
+newline
+insert-string &cat &cat "END: ok: " %ok &cat " fail: " %fail
+newline
+insert-string &cat %test_name " ended"
+EOD
+
+# If running them all, leave - but first write out the buffer if there
+# were any failures.
+#
+if [ "$1" = FULL-RUN ]; then
+    cat >>uetest.rc <<'EOD'
+!if &not &equ %fail 0
+    set $cfname &cat "FAIL-" %test_name
+    save-file
+!else
+    unmark-buffer
+!endif
+exit-emacs
+EOD
+# Just leave display showing if being run singly.
+else
+    cat >>uetest.rc <<'EOD'
+unmark-buffer
+-2 redraw-display
+EOD
+fi
+
+# Do it...set the default uemacs if caller hasn't set one.
+[ -z "$UE2RUN" ] && UE2RUN="./uemacs -d etc"
+$UE2RUN -x ./uetest.rc
+
+if [ "$1" = FULL-RUN ]; then
+    if [ -f FAIL-$TNAME ]; then
+        echo "$TNAME FAILed"
+    else
+        echo "$TNAME passed"
+        rm -rf $TDIR
+    fi
+fi
@@ -0,0 +1,200 @@
+#!/bin/sh
+#
+
+TNAME=`basename $0 .sh`
+export TNAME
+
+rm -f FAIL-$TNAME
+
+# Test that highlighting all of the matches on the screen (which runs
+# the search over the lines as they are displayed) leaves the state of
+# the last search alone.
+
+# -+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-
+# Write out the test input file.
+#
+cat >highlight-all.tfile <<'EOD'
+first key=123 and key=45
+nothing here
+key=6789 then KEY=0
+last line, key=77
+EOD
+
+# -+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-
+# Write out the uemacs start-up file, that will run the tests
+#
+cat >uetest.rc <<'EOD'
+; Some uemacs code to run tests on highlighting all matches
+; Put test results into a specific buffer (test-reports)...
+; ...and switch to that buffer at the end.
+
+execute-file autotest/report-status.rc
+
+set %test_name &env TNAME
+
+select-buffer test-reports
+insert-string &cat %test_name " started"
+newline
+set %fail 0
+set %ok 0
+
+execute-file autotest/check-value.rc
+
+; -+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-
+; START running the code!
+;
+set %test-report "START: highlight all tests"
+run report-status
+
+set %curtest "Default setting"
+set %got $highlight_all
+set %expect FALSE
+run check-value
+
+set %curtest "Switched on"
+set $highlight_all TRUE
+set %got $highlight_all
+set %expect TRUE
+run check-value
+
+; A literal search, then redraw with the matches highlighted.
+; Dot, the match and the next hunt must be unaffected.
+;
+find-file highlight-all.tfile
+add-mode Exact
+delete-mode Magic
+split-current-window
+end-of-file
+next-window
+beginning-of-file
+search-forward "key="
+update-screen
+set .pos &cat &cat $curline ":" $curcol
+set .match $match
+hunt-forward
+set .hunt &cat &cat $curline ":" $curcol
+set %curtest "Literal position"
+set %got .pos
+set %expect "1:11"
+run check-value
+set %curtest "Literal match"
+set %got .match
+set %expect "key="
+run check-value
+set %curtest "Literal hunt"
+set %got .hunt
+set %expect "1:23"
+run check-value
+
+; A magic search with groups. The redraw matches the other lines
+; with different group texts, which must not replace those of the
+; last search.
+;
+set %curtest "Magic groups"
+add-mode Magic
+delete-mode Exact
+beginning-of-file
+next-line
+search-forward "(k\w+)=(\d+)"
+update-screen
+set .pos &cat &cat $curline ":" $curcol
+set .match $match
+set .grp1 &grp 1
+set .grp2 &grp 2
+hunt-forward
+update-screen
+set .hmatch $match
+set .hgrp2 &grp 2
+set %got .pos
+set %expect "3:9"
+run check-value
+set %got .match
+set %expect "key=6789"
+run check-value
+set %got .grp1
+set %expect key
+run check-value
+set %got .grp2
+set %expect 6789
+run check-value
+set %got .hmatch
+set %expect "KEY=0"
+run check-value
+set %got .hgrp2
+set %expect 0
+run check-value
+
+; An edit must be shown, and still leave the match alone.
+;
+set %curtest "After an edit"
+beginning-of-file
+search-forward "nothing"
+search-forward "(k\w+)=(\d+)"
+end-of-line
+insert-string " key=1"
+update-screen
+search-reverse "(k\w+)=(\d+)"
+set .match $match
+set .grp2 &grp 2
+update-screen
+set %got .match
+set %expect "key=1"
+run check-value
+set %got .grp2
+set %expect 1
+run check-value
+
+set %curtest "Switched off"
+set $highlight_all FALSE
+update-screen
+set %got $highlight_all
+set %expect FALSE
+run check-value
+
+select-buffer highlight-all.tfile
+unmark-buffer
+delete-other-windows
+
+; -+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-
+; Show the final score
+;
+select-buffer test-reports
+newline
+insert-string &cat &cat "END: ok: " %ok &cat " fail: " %fail
+newline
+insert-string &cat %test_name " ended"
+EOD
+
+# If running them all, leave - but first write out the buffer if there
+# were any failures.
+#
+if [ "$1" = FULL-RUN ]; then
+    cat >>uetest.rc <<'EOD'
+!if &not &equ %fail 0
+    set $cfname &cat "FAIL-" %test_name
+    save-file
+!else
+    unmark-buffer
+!endif
+exit-emacs
+EOD
+# Just leave display showing if being run singly.
+else
+    cat >>uetest.rc <<'EOD'
+unmark-buffer
+-2 redraw-display
+EOD
+fi
+
+# Do it...set the default uemacs if caller hasn't set one.
+[ -z "$UE2RUN" ] && UE2RUN="./uemacs -d etc"
+$UE2RUN -x ./uetest.rc
+
+if [ "$1" = FULL-RUN ]; then
+    if [ -f FAIL-$TNAME ]; then
+        echo "$TNAME FAILed"
+    else
+        echo "$TNAME passed"
+        rm -f highlight-all.tfile
+    fi
+fi
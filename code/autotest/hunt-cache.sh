@@ -0,0 +1,256 @@
+#!/bin/sh
+#
+
+TNAME=`basename $0 .sh`
+export TNAME
+
+rm -f FAIL-$TNAME
+
+# Test that repeated hunts find the same matches, in both directions,
+# whether or not they come from the match cache, and that the cache
+# notices changes to the buffer.
+
+# -+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-
+# Write out the test input file.
+# Line 2 has an issi followed by a combining acute accent (U+0301),
+# which is not a match.
+#
+awk 'BEGIN {
+    for (i = 1; i <= 50; i++) {
+        printf "mississippi Mississippi\n"
+        printf "xissi\314\201x issi\n\nnothing here\n"
+        if (i % 10 == 0) printf "ISSISSI end\n"
+    }
+}' >hunt-cache.tfile
+
+# -+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-
+# Write out the uemacs start-up file, that will run the tests
+#
+cat >uetest.rc <<'EOD'
+; Some uemacs code to run tests on repeated hunts
+; Put test results into a specific buffer (test-reports)...
+; ...and switch to that buffer at the end.
+
+execute-file autotest/report-status.rc
+
+set %test_name &env TNAME
+
+select-buffer test-reports
+insert-string &cat %test_name " started"
+newline
+set %fail 0
+set %ok 0
+
+execute-file autotest/check-value.rc
+
+; Search for %pat from the start (%dir 1) or end of the buffer, then
+; hunt on until there are no more matches.
+; %trace gets where each match left dot, and %nhunt the number found.
+;
+store-procedure hunt-all
+  select-buffer hunt-cache.tfile
+  !if &equ %dir 1
+    beginning-of-file
+    !force search-forward %pat
+    set .found $force_status
+  !else
+    end-of-file
+    !force search-reverse %pat
+    set .found $force_status
+  !endif
+  set %trace ""
+  set %nhunt 0
+  !while &seq .found "PASSED"
+    set %trace &cat %trace &cat &cat $curline ":" &cat $curcol " "
+    set %nhunt &add %nhunt 1
+    !if &equ %dir 1
+      !force hunt-forward
+      set .found $force_status
+    !else
+      !force hunt-backward
+      set .found $force_status
+    !endif
+  !endwhile
+!endm
+
+; Hunt for %pat with the cache off and then on, checking the number of
+; matches (%expect) and that both found the same ones.
+;
+store-procedure compare-hunts
+  set .nexp %expect
+  set $ggr_opts &ban $ggr_opts &bno 0x10
+  run hunt-all
+  set .uncached %trace
+  set %got %nhunt
+  run check-value
+  set $ggr_opts &bor $ggr_opts 0x10
+  run hunt-all
+  set %got %nhunt
+  set %expect .nexp
+  run check-value
+  set %got &equ &len %trace &len .uncached
+  !if &seq %trace .uncached
+    set %got "same matches"
+  !else
+    set %got &cat "cached: " %trace
+  !endif
+  set %expect "same matches"
+  run check-value
+!endm
+
+; -+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-
+; START running the code!
+;
+set %test-report "START: hunt cache tests"
+run report-status
+
+find-file hunt-cache.tfile
+add-mode Exact
+delete-mode Magic
+set $ggr_opts &bor $ggr_opts 0x08
+
+set %curtest "Overlapping, forwards"
+set %pat "issi"
+set %dir 1
+set %expect 250
+run compare-hunts
+
+set %curtest "Overlapping, backwards"
+set %dir -1
+set %expect 250
+run compare-hunts
+
+set %curtest "Not overlapping, forwards"
+set $ggr_opts &ban $ggr_opts &bno 0x08
+set %dir 1
+set %expect 150
+run compare-hunts
+
+set %curtest "Not overlapping, backwards"
+set %dir -1
+set %expect 150
+run compare-hunts
+
+set %curtest "Folded case, forwards"
+select-buffer hunt-cache.tfile
+delete-mode Exact
+set $ggr_opts &bor $ggr_opts 0x08
+set %pat "Issi"
+set %dir 1
+set %expect 260
+run compare-hunts
+
+set %curtest "Folded case, backwards"
+set %dir -1
+set %expect 260
+run compare-hunts
+
+; An edit after the cache is made must be seen by the next hunt.
+;
+set %curtest "After an edit"
+select-buffer hunt-cache.tfile
+add-mode Exact
+set %pat "here"
+beginning-of-file
+search-forward %pat
+hunt-forward
+hunt-forward
+set .before $curline
+next-line
+beginning-of-line
+insert-string "here"
+previous-line
+end-of-line
+search-forward %pat
+set .first &cat &cat $curline ":" $curcol
+hunt-forward
+set .second $curline
+set %got .before
+set %expect 12
+run check-value
+set %got .first
+set %expect "13:5"
+run check-value
+set %got .second
+set %expect 16
+run check-value
+
+; ...as must a narrowing.
+;
+set %curtest "Narrowed"
+beginning-of-file
+search-forward %pat
+hunt-forward
+beginning-of-file
+set-mark
+5 next-line
+narrow-to-region
+beginning-of-file
+search-forward %pat
+!force hunt-forward
+set %got $force_status
+set %expect "FAILED"
+run check-value
+widen-from-region
+
+; Take the edit out again, and all of the matches should be as before.
+;
+set %curtest "Undo the edit"
+beginning-of-file
+search-forward "here"
+hunt-forward
+hunt-forward
+hunt-forward
+beginning-of-line
+4 delete-next-character
+set %pat "here"
+set %dir 1
+set %expect 50
+run compare-hunts
+
+select-buffer hunt-cache.tfile
+unmark-buffer
+
+; -+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-
+; Show the final score
+;
+select-buffer test-reports
+newline
+insert-string &cat &cat "END: ok: " %ok &cat " fail: " %fail
+newline
+insert-string &cat %test_name " ended"
+EOD
+
+# If running them all, leave - but first write out the buffer if there
+# were any failures.
+#
+if [ "$1" = FULL-RUN ]; then
+    cat >>uetest.rc <<'EOD'
+!if &not &equ %fail 0
+    set $cfname &cat "FAIL-" %test_name
+    save-file
+!else
+    unmark-buffer
+!endif
+exit-emacs
+EOD
+# Just leave display showing if being run singly.
+else
+    cat >>uetest.rc <<'EOD'
+unmark-buffer
+-2 redraw-display
+EOD
+fi
+
+# Do it...set the default uemacs if caller hasn't set one.
+[ -z "$UE2RUN" ] && UE2RUN="./uemacs -d etc"
+$UE2RUN -x ./uetest.rc
+
+if [ "$1" = FULL-RUN ]; then
+    if [ -f FAIL-$TNAME ]; then
+        echo "$TNAME FAILed"
+    else
+        echo "$TNAME passed"
+        rm -f hunt-cache.tfile
+    fi
+fi
@@ -315,6 +315,53 @@ beginning-of-file
 incremental-search
 clear-message-line
 
+;
+; -+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-
+; Now we test that backspace goes back to the previous match, whether
+; it undoes a repeat search or a search character.
+;
+
+store-procedure check1
+  set %test-report "  back over a repeat search"
+  run report-status
+  set %curtest Search-issi-back
+  set %expline 6
+  set %expcol 9
+  set %expchar &asc "p"
+  set %expmatchlen 4
+  run check-position-matchlen
+!endm
+store-procedure check2
+  set %test-report "  back to the first issi"
+  run report-status
+  set %curtest Search-issi-back-again
+  set %expline 6
+  set %expcol 6
+  set %expchar &asc "s"
+  set %expmatchlen 4
+  run check-position-matchlen
+!endm
+store-procedure check3
+  set %test-report "  back over a failing character"
+  run report-status
+  set %curtest Search-issis-back
+  set %expline 6
+  set %expcol 6
+  set %expchar &asc "s"
+  set %expmatchlen 4
+  run check-position-matchlen
+!endm
+
+simulate-incr "issi"
+simulate-incr &cat &chr 0x13 &cat &chr 0x13 &chr 0x08 "check1"
+simulate-incr &chr 0x08 "check2"
+simulate-incr &cat "s" &chr 0x08 "check3"
+simulate-incr &chr 0x07
+
+beginning-of-file
+incremental-search
+clear-message-line
+
 ;
 select-buffer test-reports
 newline
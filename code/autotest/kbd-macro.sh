@@ -0,0 +1,199 @@
+#!/bin/sh
+#
+
+TNAME=`basename $0 .sh`
+export TNAME
+
+rm -f FAIL-$TNAME
+
+# Test that a recorded keyboard macro replays correctly with a count,
+# both from its compiled form and (with $vismac set) from its
+# keystrokes, and that the compiled form runs what a key is bound to
+# when it is replayed, not when it was recorded.
+# Recording needs real keystrokes, so these are read from a file as
+# uemacs's input once the start-up file has run.
+# That means there is no interactive display at the end. If the test
+# is run singly the report is written out and shown instead.
+
+# -+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-
+# Write out the test input file
+#
+for l in a b c d e f g; do
+    echo "$l x"
+done >kbd-macro.tfile
+
+# -+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-
+# Write out the keystrokes.
+# The macro goes to the start of the line, types "> ", searches for
+# "x" (so has a prompt reply), types "!" and moves to the next line.
+# It is recorded on line 1, then run 3 times and checked (^XZ), which
+# also rebinds "!" and ^N.
+# It is run once more with those bindings, checked, and the bindings
+# put back (^XW).
+# Then it is run twice more from its keystrokes and checked (^XY).
+# ^XY leaves uemacs, but ^X^C is there in case a failure stopped that.
+#
+#      ^X(   ^A  >  sp ^S  x  CR  !  ^N  ^X)   ^U  3 ^Xe   ^XZ
+printf '\030(\001> \023x\r!\016\030)\0253\030e\030z' >kbd-macro-keys.tfile
+#      ^Xe   ^XW
+printf '\030e\030w' >>kbd-macro-keys.tfile
+#      ^U  2 ^Xe   ^XY  ^X^C    y
+printf '\0252\030e\030y\030\003y' >>kbd-macro-keys.tfile
+
+# -+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-
+# Write out the uemacs start-up file, that will run the tests
+#
+cat >uetest.rc <<'EOD'
+; Some uemacs code to run tests on keyboard macro replay
+; Put test results into a specific buffer (test-reports)...
+; ...and switch to that buffer at the end.
+
+execute-file autotest/report-status.rc
+
+set %test_name &env TNAME
+
+select-buffer test-reports
+insert-string &cat %test_name " started"
+newline
+set %fail 0
+set %ok 0
+
+execute-file autotest/check-value.rc
+
+; Check the text of lines 1 to 7, then the line and column of dot.
+; %exptext has the first character of each line that the macro
+; should have changed, %expdot the dot position as line/column.
+;
+store-procedure check-text
+  set .line $curline
+  set .col $curcol
+  set .text ""
+  beginning-of-file
+  !while &not &equ $curline 8
+    !if &seq &lef $line 2 "> "
+      !if &seq &rig $line 1 "!"
+        set .text &cat .text &mid $line 3 1
+      !endif
+    !endif
+    next-line
+  !endwhile
+  set %curtest &cat %what " - changed lines"
+  set %got .text
+  set %expect %exptext
+  run check-value
+  set %curtest &cat %what " - dot"
+  set %got &cat .line &cat "/" .col
+  set %expect %expdot
+  run check-value
+  goto-line .line
+  set $curcol .col
+!endm
+
+; -+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-
+; START running the code!
+;
+set %test-report "START: Keyboard macro tests"
+run report-status
+
+; After recording once and 3 runs from the compiled form
+;
+store-procedure compiled-checks
+  set %what "Compiled replay"
+  set %exptext "abcd"
+  set %expdot "5/4"
+  run check-text
+  bind-to-key beginning-of-file ^N
+  buffer-to-key insert-query "!"
+!endm
+buffer-to-key compiled-checks ^XZ
+
+store-procedure insert-query
+  insert-string "?"
+!endm
+
+; After 1 run from the compiled form with "!" and ^N rebound.
+; Line e ends with "?", so doesn't count as changed.
+;
+store-procedure rebound-checks
+  set %what "Compiled replay after rebinding"
+  set %exptext "abcd"
+  set %expdot "1/1"
+  run check-text
+  set %curtest "Compiled replay after rebinding - line e"
+  5 goto-line
+  set %got $line
+  set %expect "> e x?"
+  run check-value
+  unbind-key "!"
+  bind-to-key next-line ^N
+  6 goto-line
+  set $vismac TRUE
+!endm
+buffer-to-key rebound-checks ^XW
+
+; After 2 more runs from the keystrokes
+;
+store-procedure keystroke-checks
+  set %what "Keystroke replay"
+  set %exptext "abcdfg"
+  set %expdot "8/1"
+  run check-text
+  run final-score
+!endm
+buffer-to-key keystroke-checks ^XY
+
+find-file kbd-macro.tfile
+add-mode Exact
+delete-mode Wrap        ; So typed text is replayed as one insert
+
+; -+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-
+; Show the final score
+;
+store-procedure final-score
+  unmark-buffer kbd-macro.tfile
+  select-buffer test-reports
+  newline
+  insert-string &cat &cat "END: ok: " %ok &cat " fail: " %fail
+  newline
+  insert-string &cat %test_name " ended"
+EOD
+
+# If running them all, leave - but first write out the buffer if there
+# were any failures.
+#
+if [ "$1" = FULL-RUN ]; then
+    cat >>uetest.rc <<'EOD'
+  !if &not &equ %fail 0
+    set $cfname &cat "FAIL-" %test_name
+    save-file
+  !else
+    unmark-buffer
+  !endif
+  exit-emacs
+!endm
+EOD
+# Just write out the report if being run singly.
+else
+    cat >>uetest.rc <<'EOD'
+  set $cfname kbd-macro-report.tfile
+  save-file
+  exit-emacs
+!endm
+EOD
+fi
+
+# Do it...set the default uemacs if caller hasn't set one.
+[ -z "$UE2RUN" ] && UE2RUN="./uemacs -d etc"
+$UE2RUN -x ./uetest.rc <kbd-macro-keys.tfile
+
+if [ "$1" = FULL-RUN ]; then
+    if [ -f FAIL-$TNAME ]; then
+        echo "$TNAME FAILed"
+    else
+        echo "$TNAME passed"
+        rm -f kbd-macro.tfile kbd-macro-keys.tfile
+    fi
+else
+    cat kbd-macro-report.tfile
+    rm -f kbd-macro-report.tfile
+fi
@@ -0,0 +1,170 @@
+#!/bin/sh
+#
+
+TNAME=`basename $0 .sh`
+export TNAME
+
+rm -f FAIL-$TNAME
+
+# Test key binding lookups for default keys and for enough user-bound
+# keys to make the (non-default) binding lookup grow a few times.
+
+# -+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-
+# Write out the uemacs start-up file, that will run the tests
+#
+cat >uetest.rc <<'EOD'
+; Some uemacs code to run tests on key bindings
+; Put test results into a specific buffer (test-reports)...
+; ...and switch to that buffer at the end.
+
+execute-file autotest/report-status.rc
+
+set %test_name &env TNAME
+
+select-buffer test-reports
+insert-string &cat %test_name " started"
+newline
+set %fail 0
+set %ok 0
+
+execute-file autotest/check-value.rc
+
+; -+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-
+; START running the code!
+;
+set %test-report "START: Key binding tests"
+run report-status
+
+set %curtest "Default binding"
+set %got &bin "^A"
+set %expect "beginning-of-line"
+run check-value
+
+set %curtest "Default CtlX binding"
+set %got &bin "^X^F"
+set %expect "find-file"
+run check-value
+
+set %curtest "Unbound key"
+set %got &bin "^XFNA"
+set %expect "ERROR"
+run check-value
+
+; Bind 52 keys that have no default binding.
+; ^XFNA..^XFNZ and ^XFN^A..^XFN^Z
+;
+set %kc 65
+!while &les %kc 91
+  bind-to-key forward-character &cat "^XFN" &chr %kc
+  bind-to-key backward-character &cat "^XFN^" &chr %kc
+  set %kc &add %kc 1
+!endwhile
+
+set %curtest "First new binding"
+set %got &bin "^XFNA"
+set %expect "forward-character"
+run check-value
+
+set %curtest "Last new binding"
+set %got &bin "^XFN^Z"
+set %expect "backward-character"
+run check-value
+
+; Unbind every other one, then check they have gone and the rest remain.
+;
+set %kc 65
+!while &les %kc 91
+  unbind-key &cat "^XFN" &chr %kc
+  set %kc &add %kc 2
+!endwhile
+
+set %curtest "Unbound new key"
+set %got &bin "^XFNC"
+set %expect "ERROR"
+run check-value
+
+set %curtest "Kept new key"
+set %got &bin "^XFND"
+set %expect "forward-character"
+run check-value
+
+set %curtest "Kept new Ctl key"
+set %got &bin "^XFN^C"
+set %expect "backward-character"
+run check-value
+
+; Unbind, and rebind, a default key
+;
+unbind-key "^A"
+set %curtest "Unbound default key"
+set %got &bin "^A"
+set %expect "ERROR"
+run check-value
+
+set %curtest "Default key after an unbind"
+set %got &bin "^E"
+set %expect "end-of-line"
+run check-value
+
+bind-to-key end-of-line "^A"
+set %curtest "Rebound default key"
+set %got &bin "^A"
+set %expect "end-of-line"
+run check-value
+
+; Rebind a user key, which must replace (not add) the binding
+;
+bind-to-key end-of-line "^XFND"
+unbind-key "^XFND"
+set %curtest "Rebound user key unbound"
+set %got &bin "^XFND"
+set %expect "ERROR"
+run check-value
+
+set %curtest "Name lookup for command"
+set %got &bin "^X^S"
+set %expect "save-file"
+run check-value
+
+; -+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-
+; Show the final score
+;
+select-buffer test-reports
+newline
+insert-string &cat &cat "END: ok: " %ok &cat " fail: " %fail
+newline
+insert-string &cat %test_name " ended"
+EOD
+
+# If running them all, leave - but first write out the buffer if there
+# were any failures.
+#
+if [ "$1" = FULL-RUN ]; then
+    cat >>uetest.rc <<'EOD'
+!if &not &equ %fail 0
+    set $cfname &cat "FAIL-" %test_name
+    save-file
+!else
+    unmark-buffer
+!endif
+exit-emacs
+EOD
+# Just leave display showing if being run singly.
+else
+    cat >>uetest.rc <<'EOD'
+unmark-buffer
+-2 redraw-display
+EOD
+fi
+
+# Do it...set the default uemacs if caller hasn't set one.
+[ -z "$UE2RUN" ] && UE2RUN="./uemacs -d etc"
+$UE2RUN -x ./uetest.rc
+
+if [ "$1" = FULL-RUN ]; then
+    if [ -f FAIL-$TNAME ]; then
+        echo "$TNAME FAILed"
+    else
+        echo "$TNAME passed"
+    fi
+fi
@@ -0,0 +1,126 @@
+#!/bin/sh
+#
+
+TNAME=`basename $0 .sh`
+export TNAME
+
+rm -f FAIL-$TNAME
+
+# Test reading files large enough to use the pipelined loader.
+
+# -+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-
+# Write out the files to read. Lines will cross the block boundaries.
+#
+awk 'BEGIN { for (i = 1; i <= 300000; i++)
+    printf "line %d of the large test file\n", i }' >large.tfile
+awk 'BEGIN { for (i = 1; i <= 300000; i++)
+    printf "dos line %d of the large test file\r\n", i;
+    printf "no newline" }' >large-dos.tfile
+
+# -+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-
+# Write out the uemacs start-up file, that will run the tests
+#
+cat >uetest.rc <<'EOD'
+; Some uemacs code to run tests on reading large files
+; Put test results into a specific buffer (test-reports)...
+; ...and switch to that buffer at the end.
+
+execute-file autotest/report-status.rc
+
+set %test_name &env TNAME
+
+select-buffer test-reports
+insert-string &cat %test_name " started"
+newline
+set %fail 0
+set %ok 0
+
+execute-file autotest/check-value.rc
+
+; -+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-
+; START running the code!
+;
+set %test-report "START: large file tests"
+run report-status
+
+find-file large.tfile
+set %curtest "Line count"
+end-of-file
+set %got $curline
+set %expect 300001
+run check-value
+
+set %curtest "Mid-file line"
+goto-line 123457
+set %got $line
+set %expect "line 123457 of the large test file"
+run check-value
+
+set %curtest "Last line"
+goto-line 300000
+set %got $line
+set %expect "line 300000 of the large test file"
+run check-value
+
+find-file large-dos.tfile
+set %curtest "DOS line count"
+end-of-file
+set %got $curline
+set %expect 300002
+run check-value
+
+set %curtest "DOS line"
+goto-line 250000
+set %got $line
+set %expect "dos line 250000 of the large test file"
+run check-value
+
+set %curtest "Line without newline"
+goto-line 300001
+set %got $line
+set %expect "no newline"
+run check-value
+
+; -+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-
+; Show the final score
+;
+select-buffer test-reports
+newline
+insert-string &cat &cat "END: ok: " %ok &cat " fail: " %fail
+newline
+insert-string &cat %test_name " ended"
+EOD
+
+# If running them all, leave - but first write out the buffer if there
+# were any failures.
+#
+if [ "$1" = FULL-RUN ]; then
+    cat >>uetest.rc <<'EOD'
+!if &not &equ %fail 0
+    set $cfname &cat "FAIL-" %test_name
+    save-file
+!else
+    unmark-buffer
+!endif
+exit-emacs
+EOD
+# Just leave display showing if being run singly.
+else
+    cat >>uetest.rc <<'EOD'
+unmark-buffer
+-2 redraw-display
+EOD
+fi
+
+# Do it...set the default uemacs if caller hasn't set one.
+[ -z "$UE2RUN" ] && UE2RUN="./uemacs -d etc"
+$UE2RUN -x ./uetest.rc
+
+if [ "$1" = FULL-RUN ]; then
+    if [ -f FAIL-$TNAME ]; then
+        echo "$TNAME FAILed"
+    else
+        echo "$TNAME passed"
+    fi
+fi
+rm -f large.tfile large-dos.tfile
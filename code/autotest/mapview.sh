@@ -0,0 +1,231 @@
+#!/bin/sh
+#
+
+TNAME=`basename $0 .sh`
+export TNAME
+
+rm -f FAIL-$TNAME
+
+# Test viewing a file through a mapped view, where only a part of it is
+# in the buffer at any time.
+
+# -+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-
+# Write out the files to view. Each is several times the part of it
+# that is in the buffer.
+#
+awk 'BEGIN { for (i = 1; i <= 300000; i++) printf "line %d\n", i }' \
+    >mapview.tfile
+cp mapview.tfile mapview-cut.tfile
+awk 'BEGIN { for (i = 1; i <= 300000; i++) printf "dos line %d\r\n", i;
+    printf "no newline" }' >mapview-dos.tfile
+
+# -+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-
+# Write out the uemacs start-up file, that will run the tests
+#
+cat >uetest.rc <<'EOD'
+; Some uemacs code to run tests on mapped file views
+; Put test results into a specific buffer (test-reports)...
+; ...and switch to that buffer at the end.
+
+execute-file autotest/report-status.rc
+
+set %test_name &env TNAME
+
+select-buffer test-reports
+insert-string &cat %test_name " started"
+newline
+set %fail 0
+set %ok 0
+
+execute-file autotest/check-value.rc
+
+; Check the line number and text of dot
+;
+store-procedure check-dot
+  set %got &cat &cat $curline ":" $line
+  run check-value
+!endm
+
+; -+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-
+; START running the code!
+;
+set %test-report "START: mapped view tests"
+run report-status
+
+1 view-file mapview.tfile
+set %curtest "Mapped in View mode"
+set %got &band $cmode 16
+set %expect 16
+run check-value
+set %curtest "Start"
+set %expect "1:line 1"
+run check-dot
+
+250000 goto-line
+set %curtest "goto-line"
+set %expect "250000:line 250000"
+run check-dot
+
+; Line moves across the part in the buffer, keeping the column
+beginning-of-file
+3 forward-character
+120000 next-line
+set %curtest "next-line"
+set %expect "120001:line 120001"
+run check-dot
+set %curtest "next-line column"
+set %got $curcol
+set %expect 4
+run check-value
+-100000 previous-line
+set %curtest "previous-line"
+set %expect "220001:line 220001"
+run check-dot
+-200000 next-line
+set %curtest "next-line back"
+set %expect "20001:line 20001"
+run check-dot
+
+; Searches that need other parts of the file
+search-forward "line 299998"
+set %curtest "search-forward"
+set %expect "299998:line 299998"
+run check-dot
+search-reverse "line 12"
+set %curtest "search-reverse"
+set %expect "129999:line 129999"
+run check-dot
+!force search-forward "not there"
+set %curtest "Failed search"
+set %expect "129999:line 129999"
+run check-dot
+beginning-of-file
+add-mode Magic
+search-forward "line 29999[0-9]$"
+delete-mode Magic
+set %curtest "Magic search"
+set %expect "299990:line 299990"
+run check-dot
+
+end-of-file
+previous-line
+set %curtest "end-of-file"
+set %expect "300000:line 300000"
+run check-dot
+beginning-of-file
+set %curtest "beginning-of-file"
+set %expect "1:line 1"
+run check-dot
+
+; It can't be changed or written
+set %curtest "No insert"
+!force insert-string "x"
+set %got $force_status
+set %expect FAILED
+run check-value
+set %curtest "No View mode removal"
+!force delete-mode View
+set %got &band $cmode 16
+set %expect 16
+run check-value
+set %curtest "No write"
+!force save-file
+set %got $force_status
+set %expect FAILED
+run check-value
+
+; A file cut short under the view (as logrotate's copytruncate does)
+; stops the view, rather than SIGBUS ending the editor. What was in the
+; buffer stays there.
+1 view-file mapview-cut.tfile
+250000 goto-line
+!force shell-command ": >mapview-cut.tfile"
+!force 10 goto-line
+set %curtest "Cut short - goto-line fails"
+set %got $force_status
+set %expect FAILED
+run check-value
+set %curtest "Cut short - View mode kept"
+set %got &band $cmode 16
+set %expect 16
+run check-value
+beginning-of-file
+set %curtest "Cut short - lines kept"
+set %got &cat &cat $curline ":" &lef $line 5
+set %expect "1:line "
+run check-value
+
+; A DOS file, with no final newline
+1 view-file mapview-dos.tfile
+set %curtest "DOS mode"
+set %got &band $cmode 1024
+set %expect 1024
+run check-value
+200000 goto-line
+set %curtest "DOS goto-line"
+set %expect "200000:dos line 200000"
+run check-dot
+end-of-file
+set %curtest "DOS last line"
+set %expect "300002:"
+run check-dot
+previous-line
+set %curtest "DOS no newline"
+set %expect "300001:no newline"
+run check-dot
+; A pattern over a line end isn't in the bytes (which have CRLF)
+beginning-of-file
+search-forward "line 250000~ndos line 250001"
+set %curtest "DOS search over line end"
+set %expect "250001:dos line 250001"
+run check-dot
+
+; -+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-
+; Show the final score
+;
+select-buffer test-reports
+newline
+insert-string &cat &cat "END: ok: " %ok &cat " fail: " %fail
+newline
+insert-string &cat %test_name " ended"
+EOD
+
+# If running them all, leave - but first write out the buffer if there
+# were any failures.
+#
+if [ "$1" = FULL-RUN ]; then
+    cat >>uetest.rc <<'EOD'
+!if &not &equ %fail 0
+    set $cfname &cat "FAIL-" %test_name
+    save-file
+!else
+    unmark-buffer
+!endif
+exit-emacs
+EOD
+# Just leave display showing if being run singly.
+else
+    cat >>uetest.rc <<'EOD'
+unmark-buffer
+-2 redraw-display
+EOD
+fi
+
+# Do it...set the default uemacs if caller hasn't set one.
+[ -z "$UE2RUN" ] && UE2RUN="./uemacs -d etc"
+$UE2RUN -x ./uetest.rc
+# A signal (such as the SIGBUS of reading a mapping past the end of a
+# file cut short) ends it with that status, with no FAIL file written.
+status=$?
+if [ "$1" = FULL-RUN ] && [ $status -ne 0 ]; then
+    echo "uemacs exited with status $status" >FAIL-$TNAME
+fi
+
+if [ "$1" = FULL-RUN ]; then
+    if [ -f FAIL-$TNAME ]; then
+        echo "$TNAME FAILed"
+    else
+        echo "$TNAME passed"
+        rm -f mapview.tfile mapview-dos.tfile mapview-cut.tfile
+    fi
+fi
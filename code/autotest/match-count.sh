@@ -0,0 +1,167 @@
+#!/bin/sh
+#
+
+TNAME=`basename $0 .sh`
+export TNAME
+
+rm -f FAIL-$TNAME
+
+# Test list-matches and replace-string over a buffer large enough to be
+# scanned in several chunks.
+
+# -+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-
+# Write out the test input file.
+# It repeats three lines - xabababx, yaaay and an empty one.
+#
+awk 'BEGIN { for (i = 1; i <= 100000; i++) printf "yaaay\n\nxabababx\n" }' \
+    >match-count.tfile
+
+# -+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-
+# Write out the uemacs start-up file, that will run the tests
+#
+cat >uetest.rc <<'EOD'
+; Some uemacs code to run tests on whole-buffer match lists
+; Put test results into a specific buffer (test-reports)...
+; ...and switch to that buffer at the end.
+
+execute-file autotest/report-status.rc
+
+set %test_name &env TNAME
+
+select-buffer test-reports
+insert-string &cat %test_name " started"
+newline
+set %fail 0
+set %ok 0
+
+execute-file autotest/check-value.rc
+
+; List the matches for %pat and check the first line of the list, the
+; number of lines in it and the last one.
+;
+store-procedure check-list
+  select-buffer match-count.tfile
+  list-matches %pat
+  select-buffer //Matches
+  beginning-of-file
+  set %got $line
+  set %expect %exphead
+  run check-value
+  end-of-file
+  previous-line
+  set %got &cat $curline &cat " " $line
+  set %expect %explast
+  run check-value
+!endm
+
+; -+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-
+; START running the code!
+;
+set %test-report "START: match list tests"
+run report-status
+
+find-file match-count.tfile
+add-mode Exact
+delete-mode Magic
+
+set %curtest "Literal"
+set %pat "aba"
+set %exphead "100000 matches for ~"aba~" in match-count.tfile"
+set %explast "100001 300000: xabababx"
+run check-list
+
+set %curtest "Across lines"
+set %pat "y~n~nx"
+set %exphead "100000 matches for ~"y<NL><NL>x~" in match-count.tfile"
+set %explast "100001 299998: yaaay"
+run check-list
+
+set %curtest "Folded case"
+select-buffer match-count.tfile
+delete-mode Exact
+set %pat "BaB"
+set %exphead "100000 matches for ~"BaB~" in match-count.tfile"
+set %explast "100001 300000: xabababx"
+run check-list
+
+set %curtest "Magic"
+select-buffer match-count.tfile
+add-mode Magic
+set %pat "a+"
+set %exphead "400000 matches for ~"a+~" in match-count.tfile"
+set %explast "200001 300000: xabababx"
+run check-list
+
+set %curtest "Replace"
+select-buffer match-count.tfile
+delete-mode Magic
+add-mode Exact
+beginning-of-file
+2 forward-character
+set-mark
+beginning-of-file
+replace-string "aa" "Q"
+set %got &cat $curline &cat ":" $curcol
+set %expect "299998:3"
+run check-value
+set %curtest "Replace - mark in a match"
+exchange-point-and-mark
+set %got &cat $curline &cat ":" $curcol
+set %expect "1:2"
+run check-value
+set %curtest "Replace"
+beginning-of-file
+set %got $line
+set %expect "yQay"
+run check-value
+set %pat "aa"
+set %exphead "0 matches for ~"aa~" in match-count.tfile"
+set %explast "1 0 matches for ~"aa~" in match-count.tfile"
+run check-list
+
+select-buffer match-count.tfile
+unmark-buffer
+
+; -+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-
+; Show the final score
+;
+select-buffer test-reports
+newline
+insert-string &cat &cat "END: ok: " %ok &cat " fail: " %fail
+newline
+insert-string &cat %test_name " ended"
+EOD
+
+# If running them all, leave - but first write out the buffer if there
+# were any failures.
+#
+if [ "$1" = FULL-RUN ]; then
+    cat >>uetest.rc <<'EOD'
+!if &not &equ %fail 0
+    set $cfname &cat "FAIL-" %test_name
+    save-file
+!else
+    unmark-buffer
+!endif
+exit-emacs
+EOD
+# Just leave display showing if being run singly.
+else
+    cat >>uetest.rc <<'EOD'
+unmark-buffer
+-2 redraw-display
+EOD
+fi
+
+# Do it...set the default uemacs if caller hasn't set one.
+[ -z "$UE2RUN" ] && UE2RUN="./uemacs -d etc"
+$UE2RUN -x ./uetest.rc
+
+if [ "$1" = FULL-RUN ]; then
+    if [ -f FAIL-$TNAME ]; then
+        echo "$TNAME FAILed"
+    else
+        echo "$TNAME passed"
+        rm -f match-count.tfile
+    fi
+fi
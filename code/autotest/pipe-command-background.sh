@@ -0,0 +1,156 @@
+#!/bin/sh
+#
+
+TNAME=`basename $0 .sh`
+export TNAME
+
+rm -f FAIL-$TNAME
+
+# Test that pipe-command-background collects a command's output while
+# uemacs waits for keys, and that kill-pipe-command stops one.
+# The output is only read while waiting for the first key of a
+# command, so the checks are bound to keys which are sent (after a
+# pause each) through a pipe once the start-up file has run.
+# That means there is no interactive display at the end. If the test
+# is run singly the report is written out and shown instead.
+
+# -+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-
+# Write out the uemacs start-up file, that will run the tests
+#
+cat >uetest.rc <<'EOD'
+; Some uemacs code to run tests on background pipe-commands
+; Put test results into a specific buffer (test-reports)...
+; ...and switch to that buffer at the end.
+
+execute-file autotest/report-status.rc
+
+set %test_name &env TNAME
+
+select-buffer test-reports
+insert-string &cat %test_name " started"
+newline
+set %fail 0
+set %ok 0
+
+execute-file autotest/check-value.rc
+
+; -+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-
+; START running the code!
+;
+set %test-report "START: Background pipe-command tests"
+run report-status
+
+; Once the first command has finished (^XZ) check its output, then
+; start one that keeps running.
+;
+store-procedure finished-checks
+  select-buffer ".ue_bgcommand"
+  beginning-of-file
+  set %curtest "First line of output"
+  set %got $line
+  set %expect "one"
+  run check-value
+  next-line
+  set %curtest "Second line of output"
+  set %got $line
+  set %expect "two"
+  run check-value
+  end-of-file
+  set %curtest "Lines of output"
+  set %got $curline
+  set %expect 3
+  run check-value
+  set %curtest "Exit status"
+  set %got $rval
+  set %expect 0
+  run check-value
+  select-buffer test-reports
+  pipe-command-background "echo started; exec sleep 60"
+!endm
+buffer-to-key finished-checks ^XZ
+
+; With the second one still running (^XY) kill it.
+;
+store-procedure kill-checks
+  select-buffer ".ue_bgcommand"
+  beginning-of-file
+  set %curtest "Output before kill"
+  set %got $line
+  set %expect "started"
+  run check-value
+  !force kill-pipe-command
+  set %curtest "kill-pipe-command"
+  set %got $force_status
+  set %expect PASSED
+  run check-value
+  set %curtest "Killed by SIGTERM"
+  set %got $rval
+  set %expect 15
+  run check-value
+  !force kill-pipe-command
+  set %curtest "kill-pipe-command with nothing running"
+  set %got $force_status
+  set %expect FAILED
+  run check-value
+  run final-score
+!endm
+buffer-to-key kill-checks ^XY
+
+pipe-command-background "echo one; echo two"
+
+; -+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-
+; Show the final score
+;
+store-procedure final-score
+  select-buffer test-reports
+  newline
+  insert-string &cat &cat "END: ok: " %ok &cat " fail: " %fail
+  newline
+  insert-string &cat %test_name " ended"
+EOD
+
+# If running them all, leave - but first write out the buffer if there
+# were any failures.
+#
+if [ "$1" = FULL-RUN ]; then
+    cat >>uetest.rc <<'EOD'
+  !if &not &equ %fail 0
+    set $cfname &cat "FAIL-" %test_name
+    save-file
+  !else
+    unmark-buffer
+  !endif
+  exit-emacs
+!endm
+EOD
+# Just write out the report if being run singly.
+else
+    cat >>uetest.rc <<'EOD'
+  set $cfname pipe-command-background-report.tfile
+  save-file
+  exit-emacs
+!endm
+EOD
+fi
+
+# Do it...set the default uemacs if caller hasn't set one.
+# ^XY leaves uemacs, but ^X^C is there in case a failure stopped that.
+#
+[ -z "$UE2RUN" ] && UE2RUN="./uemacs -d etc"
+(
+    sleep 2
+    printf '\030z'
+    sleep 2
+    printf '\030y\030\003y'
+) | $UE2RUN -x ./uetest.rc
+
+if [ "$1" = FULL-RUN ]; then
+    if [ -f FAIL-$TNAME ]; then
+        echo "$TNAME FAILed"
+    else
+        echo "$TNAME passed"
+    fi
+else
+    cat pipe-command-background-report.tfile
+    rm -f pipe-command-background-report.tfile
+fi
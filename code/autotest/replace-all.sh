@@ -0,0 +1,221 @@
+#!/bin/sh
+#
+
+TNAME=`basename $0 .sh`
+export TNAME
+
+rm -f FAIL-$TNAME
+
+# Test replace-string, which replaces the matches within each line
+# together, for where it leaves the text, dot, marks and pins.
+
+# -+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-
+# Write out the test input file
+#
+cat >replace-all.tfile <<'EOD'
+foo one foo two foo
+no match here
+foofoo end
+ab cd ab
+k1=v1 k2=v2 k3=v3
+EOD
+
+# -+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-
+# Write out the uemacs start-up file, that will run the tests
+#
+cat >uetest.rc <<'EOD'
+; Some uemacs code to run tests on replace-string
+; Put test results into a specific buffer (test-reports)...
+; ...and switch to that buffer at the end.
+
+execute-file autotest/report-status.rc
+
+set %test_name &env TNAME
+
+select-buffer test-reports
+insert-string &cat %test_name " started"
+newline
+set %fail 0
+set %ok 0
+
+execute-file autotest/check-value.rc
+
+; Check the line and column of dot
+;
+store-procedure check-dot
+  set %got &cat &cat $curline ":" $curcol
+  run check-value
+!endm
+
+; -+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-
+; START running the code!
+;
+set %test-report "START: replace-string tests"
+run report-status
+
+find-file replace-all.tfile
+add-mode Exact
+
+; A mark inside the first match, a pin at the start of the second and
+; the other window's dot at the end of the first.
+1 goto-line
+1 forward-character
+set-mark
+7 forward-character
+drop-pin
+split-current-window
+beginning-of-file
+3 forward-character
+next-window
+beginning-of-file
+replace-string "foo" "XY"
+
+set %curtest "Dot at end of last"
+set %expect "3:5"
+run check-dot
+set %curtest "Line 1"
+1 goto-line
+set %got $line
+set %expect "XY one XY two XY"
+run check-value
+set %curtest "Line 3"
+3 goto-line
+set %got $line
+set %expect "XYXY end"
+run check-value
+
+set %curtest "Mark inside match"
+exchange-point-and-mark
+set %expect "1:1"
+run check-dot
+set %curtest "Pin at match start"
+back-to-pin
+set %expect "1:8"
+run check-dot
+set %curtest "Other window dot at match end"
+next-window
+set %expect "1:3"
+run check-dot
+next-window
+
+; Magic replacements with groups and a counter, and one that has a
+; newline, which is done on its own.
+beginning-of-file
+add-mode Magic
+replace-string "(a)(b)" "${2}${1}${@:%d}"
+set %curtest "Groups and counter"
+4 goto-line
+set %got $line
+set %expect "ba1 cd ba2"
+run check-value
+beginning-of-file
+replace-string " (cd) " "~n${1}~n"
+set %curtest "Newline in replacement"
+set %expect "6:1"
+run check-dot
+4 goto-line
+set %got &cat &cat $line "|" &cat &cat $curline ":" $curcol
+set %expect "ba1|4:1"
+run check-value
+
+; Group replacements are batched too, and leave a mark and pin (and
+; dot) where one at a time would have.
+; (One window, so that report-status doesn't bring back another's mark.)
+delete-other-windows
+; (The newline replacement above made this line 7.)
+7 goto-line
+7 forward-character
+set-mark
+7 forward-character
+drop-pin
+beginning-of-line
+replace-string "(k[0-9])=(v[0-9])" "${2}=yek${1}"
+set %curtest "Batched groups"
+set %got &cat &cat $line "|" &cat &cat $curline ":" $curcol
+set %expect "v1=yekk1 v2=yekk2 v3=yekk3|7:27"
+run check-value
+set %curtest "Mark inside a group match"
+exchange-point-and-mark
+set %expect "7:10"
+run check-dot
+set %curtest "Pin inside a group match"
+back-to-pin
+set %expect "7:19"
+run check-dot
+
+; An anchored match, removed, leaves a new match at the line start for
+; the next one to find.
+select-buffer anchored
+add-mode Exact
+add-mode Magic
+insert-string "aaa bbb"
+newline
+insert-string "aab"
+newline
+beginning-of-file
+replace-string "^a" ""
+set %curtest "Anchored with empty replacement"
+beginning-of-file
+set %got $line
+next-line
+set %got &cat &cat %got "|" $line
+set %expect " bbb|b"
+run check-value
+unmark-buffer
+select-buffer replace-all.tfile
+delete-mode Magic
+
+; A count limits the replacements, and the replacement is no longer
+; magic
+beginning-of-file
+2 replace-string "XY" "Z"
+set %curtest "Count"
+1 goto-line
+set %got $line
+set %expect "Z one Z two XY"
+run check-value
+unmark-buffer
+
+; -+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-
+; Show the final score
+;
+select-buffer test-reports
+newline
+insert-string &cat &cat "END: ok: " %ok &cat " fail: " %fail
+newline
+insert-string &cat %test_name " ended"
+EOD
+
+# If running them all, leave - but first write out the buffer if there
+# were any failures.
+#
+if [ "$1" = FULL-RUN ]; then
+    cat >>uetest.rc <<'EOD'
+!if &not &equ %fail 0
+    set $cfname &cat "FAIL-" %test_name
+    save-file
+!else
+    unmark-buffer
+!endif
+exit-emacs
+EOD
+# Just leave display showing if being run singly.
+else
+    cat >>uetest.rc <<'EOD'
+unmark-buffer
+-2 redraw-display
+EOD
+fi
+
+# Do it...set the default uemacs if caller hasn't set one.
+[ -z "$UE2RUN" ] && UE2RUN="./uemacs -d etc"
+$UE2RUN -x ./uetest.rc
+
+if [ "$1" = FULL-RUN ]; then
+    if [ -f FAIL-$TNAME ]; then
+        echo "$TNAME FAILed"
+    else
+        echo "$TNAME passed"
+        rm -f replace-all.tfile
+    fi
+fi
@@ -0,0 +1,161 @@
+#!/bin/sh
+#
+
+TNAME=`basename $0 .sh`
+export TNAME
+
+rm -f FAIL-$TNAME
+
+# Test revert-file, which only re-reads the parts of a file that have
+# changed.
+
+# -+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-
+# The file to revert to
+#
+i=1
+while [ $i -le 2000 ]; do
+    echo "line $i"
+    i=`expr $i + 1`
+done >revert.tfile
+
+# -+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-
+# Write out the uemacs start-up file, that will run the tests
+#
+cat >uetest.rc <<'EOD'
+; Some uemacs code to run tests on reverting a buffer
+; Put test results into a specific buffer (test-reports)...
+; ...and switch to that buffer at the end.
+
+execute-file autotest/report-status.rc
+
+set %test_name &env TNAME
+
+select-buffer test-reports
+insert-string &cat %test_name " started"
+newline
+set %fail 0
+set %ok 0
+
+execute-file autotest/check-value.rc
+
+; Check the line and column of dot, then the line count
+;
+store-procedure check-dot
+  set %got &cat &cat $curline ":" $curcol
+  run check-value
+  set %curtest &cat %curtest " (lines)"
+  set %got $line
+  set %expect %dotline
+  run check-value
+  drop-pin
+  end-of-file
+  set %got $curline
+  set %expect %nlines
+  run check-value
+  switch-with-pin
+!endm
+
+; -+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-
+; START running the code!
+;
+set %test-report "START: revert-file tests"
+run report-status
+
+find-file revert.tfile
+1500 goto-line
+3 forward-character
+
+; Change lines before dot, insert some and delete others
+!force shell-command "sed -i -e '20s/.*/changed 20/' -e '50a\\\nnew a\\\nnew b' -e '100,102d' -e '1800s/$/ more/' revert.tfile"
+revert-file
+set %curtest "Dot kept"
+set %expect "1499:4"
+set %dotline "line 1500"
+set %nlines 2000
+run check-dot
+
+20 goto-line
+set %curtest "Line changed"
+set %got $line
+set %expect "changed 20"
+run check-value
+52 goto-line
+set %curtest "Line inserted"
+set %got $line
+set %expect "new b"
+run check-value
+1799 goto-line
+set %curtest "Line appended to"
+set %got $line
+set %expect "line 1800 more"
+run check-value
+
+; Change the line dot is on
+1499 goto-line
+3 forward-character
+!force shell-command "sed -i -e '1499s/.*/replaced 1500/' revert.tfile"
+revert-file
+set %curtest "Dot on changed line"
+set %expect "1499:1"
+set %dotline "replaced 1500"
+run check-dot
+
+; Empty it, then fill it again
+!force shell-command ": >revert.tfile"
+revert-file
+set %curtest "Emptied"
+set %expect "1:1"
+set %dotline ""
+set %nlines 1
+run check-dot
+!force shell-command "printf 'one\ntwo' >revert.tfile"
+revert-file
+set %curtest "Refilled"
+set %expect "1:1"
+set %dotline "one"
+set %nlines 3
+run check-dot
+
+; -+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-
+; Show the final score
+;
+select-buffer test-reports
+newline
+insert-string &cat &cat "END: ok: " %ok &cat " fail: " %fail
+newline
+insert-string &cat %test_name " ended"
+EOD
+
+# If running them all, leave - but first write out the buffer if there
+# were any failures.
+#
+if [ "$1" = FULL-RUN ]; then
+    cat >>uetest.rc <<'EOD'
+!if &not &equ %fail 0
+    set $cfname &cat "FAIL-" %test_name
+    save-file
+!else
+    unmark-buffer
+!endif
+exit-emacs
+EOD
+# Just leave display showing if being run singly.
+else
+    cat >>uetest.rc <<'EOD'
+unmark-buffer
+-2 redraw-display
+EOD
+fi
+
+# Do it...set the default uemacs if caller hasn't set one.
+[ -z "$UE2RUN" ] && UE2RUN="./uemacs -d etc"
+$UE2RUN -x ./uetest.rc
+
+if [ "$1" = FULL-RUN ]; then
+    if [ -f FAIL-$TNAME ]; then
+        echo "$TNAME FAILed"
+    else
+        echo "$TNAME passed"
+        rm -f revert.tfile
+    fi
+fi
@@ -0,0 +1,171 @@
+#!/bin/sh
+#
+
+TNAME=`basename $0 .sh`
+export TNAME
+
+rm -f FAIL-$TNAME
+
+# Test that the search arenas give the right replacements while
+# needing (almost) no mallocs once they have grown to size.
+
+# -+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-
+# Write out the test input file.
+# Line 3 of each group has an e followed by two combining marks
+# (U+0301 U+0323), which needs an extended grapheme.
+#
+awk 'BEGIN {
+    for (i = 1; i <= 200; i++) {
+        printf "key%d=val%d\n", i, i
+        printf "nothing here\n"
+        printf "cafe\314\201\314\243 au lait\n"
+    }
+}' >search-arena.tfile
+
+# -+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-
+# Write out the uemacs start-up file, that will run the tests
+#
+cat >uetest.rc <<'EOD'
+; Some uemacs code to run tests on the search arenas
+; Put test results into a specific buffer (test-reports)...
+; ...and switch to that buffer at the end.
+
+execute-file autotest/report-status.rc
+
+set %test_name &env TNAME
+
+select-buffer test-reports
+insert-string &cat %test_name " started"
+newline
+set %fail 0
+set %ok 0
+
+execute-file autotest/check-value.rc
+
+; Run replace-string %from %to over the whole buffer.
+; %uses gets the number of arena items used and %mallocs the number of
+; mallocs they needed.
+;
+store-procedure arena-replace
+  select-buffer search-arena.tfile
+  beginning-of-file
+  set .use $srch_arena_use
+  set .mallocs $srch_arena_mallocs
+  replace-string %from %to
+  set %uses &sub $srch_arena_use .use
+  set %mallocs &sub $srch_arena_mallocs .mallocs
+!endm
+
+; -+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-
+; START running the code!
+;
+set %test-report "START: search arena tests"
+run report-status
+
+find-file search-arena.tfile
+add-mode Magic
+add-mode Exact
+
+; Group replacements. Each match puts two group texts in the arena.
+;
+set %curtest "Group replace"
+set %from "key(\d+)=val(\d+)"
+set %to "${2}:${1}"
+run arena-replace
+set %got &gre %uses 399
+set %expect TRUE
+run check-value
+set %got &les %mallocs 3
+run check-value
+beginning-of-file
+set %got $line
+set %expect "1:1"
+run check-value
+198 next-line
+set %got $line
+set %expect "67:67"
+run check-value
+
+; A function replacement, with its pieces in the replacement arena.
+;
+set %curtest "Function replace"
+set %from "(\d+):(\d+)"
+set %to "${&add ${1} ${2}}"
+run arena-replace
+set %got &les %mallocs 3
+set %expect TRUE
+run check-value
+beginning-of-file
+set %got $line
+set %expect "2"
+run check-value
+end-of-file
+3 previous-line
+set %got $line
+set %expect "400"
+run check-value
+
+; A pattern with a grapheme of two combining marks, which the matcher
+; has to build (in the arena) for every grapheme it compares.
+;
+set %curtest "Extended grapheme"
+set %from &cat &cat "caf(" &chr 0x65 &cat &chr 0x301 &cat &chr 0x323 ") au"
+set %to "${1} X"
+run arena-replace
+set %got &gre %uses 399
+set %expect TRUE
+run check-value
+set %got &les %mallocs 3
+run check-value
+beginning-of-file
+2 next-line
+set %got $line
+set %expect &cat &cat &chr 0x65 &cat &chr 0x301 &chr 0x323 " X lait"
+run check-value
+
+select-buffer search-arena.tfile
+unmark-buffer
+
+; -+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-
+; Show the final score
+;
+select-buffer test-reports
+newline
+insert-string &cat &cat "END: ok: " %ok &cat " fail: " %fail
+newline
+insert-string &cat %test_name " ended"
+EOD
+
+# If running them all, leave - but first write out the buffer if there
+# were any failures.
+#
+if [ "$1" = FULL-RUN ]; then
+    cat >>uetest.rc <<'EOD'
+!if &not &equ %fail 0
+    set $cfname &cat "FAIL-" %test_name
+    save-file
+!else
+    unmark-buffer
+!endif
+exit-emacs
+EOD
+# Just leave display showing if being run singly.
+else
+    cat >>uetest.rc <<'EOD'
+unmark-buffer
+-2 redraw-display
+EOD
+fi
+
+# Do it...set the default uemacs if caller hasn't set one.
+[ -z "$UE2RUN" ] && UE2RUN="./uemacs -d etc"
+$UE2RUN -x ./uetest.rc
+
+if [ "$1" = FULL-RUN ]; then
+    if [ -f FAIL-$TNAME ]; then
+        echo "$TNAME FAILed"
+    else
+        echo "$TNAME passed"
+        rm -f search-arena.tfile
+    fi
+fi
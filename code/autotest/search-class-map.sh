@@ -0,0 +1,143 @@
+#!/bin/sh
+#
+
+TNAME=`basename $0 .sh`
+export TNAME
+
+rm -f FAIL-$TNAME
+
+# Test Magic-mode character classes with non-ASCII parts, which are
+# looked up in a map over the whole of Unicode.
+
+# -+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-
+# Write out the test input file.
+# Line 4 starts with an e and a combining acute accent (U+0301).
+#
+printf 'дд4 x\n!!Straße_σ9 .\nΣΟΦΊΑ σοφίας\ne\314\201 ñ\n' >search-class-map.tfile
+
+# -+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-
+# Write out the uemacs start-up file, that will run the tests
+#
+cat >uetest.rc <<'EOD'
+; Some uemacs code to run tests on character classes
+; Put test results into a specific buffer (test-reports)...
+; ...and switch to that buffer at the end.
+
+execute-file autotest/report-status.rc
+
+set %test_name &env TNAME
+
+select-buffer test-reports
+insert-string &cat %test_name " started"
+newline
+set %fail 0
+set %ok 0
+
+; Search forward for %pat and compare where dot ends up, and the match,
+; with %expect and %expmatch
+;
+store-procedure check-search
+  !force search-forward %pat
+  set %got &cat &cat $curline ":" $curcol
+  !if &and &seq %got %expect &seq $match %expmatch
+    set %test-report &cat %curtest &cat " - OK: " %got
+    set %ok &add %ok 1
+  !else
+    set %test-report &cat %curtest &cat " - WRONG, got: " %got
+    set %test-report &cat %test-report &cat " " $match
+    set %test-report &cat %test-report &cat " - expected: " %expect
+    set %test-report &cat %test-report &cat " " %expmatch
+    set %fail &add %fail 1
+  !endif
+  run report-status
+!endm
+
+; -+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-
+; START running the code!
+;
+set %test-report "START: character class map tests"
+run report-status
+
+find-file search-class-map.tfile
+add-mode Magic
+delete-mode Exact
+
+set %curtest "ASCII class, not Cyrillic"
+set %pat "[4]"
+set %expect "1:4"
+set %expmatch "4"
+run check-search
+set %curtest "Word chars"
+set %pat "[\w]+"
+set %expect "1:6"
+set %expmatch "x"
+run check-search
+set %curtest "Word chars again"
+set %expect "2:12"
+set %expmatch "Straße_σ9"
+run check-search
+set %curtest "Kind of final sigma"
+set %pat "[\k{ς}]"
+set %expect "3:2"
+set %expmatch "Σ"
+run check-search
+add-mode Exact
+set %curtest "Exact kind of final sigma"
+set %expect "3:13"
+set %expmatch "ς"
+run check-search
+set %curtest "Range, not with combining"
+set %pat "[é-ñ]"
+set %expect "4:4"
+set %expmatch "ñ"
+run check-search
+beginning-of-line
+set %curtest "Property, with combining"
+set %pat "[\p{Ll}]"
+set %expect "4:2"
+set %expmatch &cat "e" &chr 769
+run check-search
+
+; -+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-
+; Show the final score
+;
+select-buffer test-reports
+newline
+insert-string &cat &cat "END: ok: " %ok &cat " fail: " %fail
+newline
+insert-string &cat %test_name " ended"
+EOD
+
+# If running them all, leave - but first write out the buffer if there
+# were any failures.
+#
+if [ "$1" = FULL-RUN ]; then
+    cat >>uetest.rc <<'EOD'
+!if &not &equ %fail 0
+    set $cfname &cat "FAIL-" %test_name
+    save-file
+!else
+    unmark-buffer
+!endif
+exit-emacs
+EOD
+# Just leave display showing if being run singly.
+else
+    cat >>uetest.rc <<'EOD'
+unmark-buffer
+-2 redraw-display
+EOD
+fi
+
+# Do it...set the default uemacs if caller hasn't set one.
+[ -z "$UE2RUN" ] && UE2RUN="./uemacs -d etc"
+$UE2RUN -x ./uetest.rc
+
+if [ "$1" = FULL-RUN ]; then
+    if [ -f FAIL-$TNAME ]; then
+        echo "$TNAME FAILed"
+    else
+        echo "$TNAME passed"
+        rm -f search-class-map.tfile
+    fi
+fi
@@ -0,0 +1,178 @@
+#!/bin/sh
+#
+
+TNAME=`basename $0 .sh`
+export TNAME
+
+rm -f FAIL-$TNAME
+
+# Test that a start-up snapshot (-q) restores what the start-up file
+# set up, and that it is used instead of the start-up file.
+
+# -+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-
+# Write out a start-up file, and an rc to just leave.
+# Running uemacs with them makes the snapshot.
+#
+cat >snapshot-rc.tfile <<'EOD'
+set %snap-var "from the start-up file"
+set $fillcol 66
+set $highlight_all 1
+bind-to-key next-word ^XFNA
+bind-to-key previous-word ^XFNB
+unbind-key ^XFNB
+store-procedure snap-proc
+  set %snap-ran "yes"
+!endm
+buffer-to-key snap-proc ^XFNC
+eos-chars ".!?;"
+; This buffer is NOT part of the snapshot.
+; So if it exists in the test run, the snapshot wasn't used.
+select-buffer snap-marker
+unmark-buffer
+select-buffer main
+EOD
+
+echo exit-emacs >snapshot-exit.tfile
+rm -f snapshot.tfile
+
+# Do it...set the default uemacs if caller hasn't set one.
+[ -z "$UE2RUN" ] && UE2RUN="./uemacs -d etc"
+$UE2RUN -c ./snapshot-rc.tfile -q snapshot.tfile -x ./snapshot-exit.tfile
+
+# A copy naming a variable a snapshot never saves must fail the check
+# pass, so must not be used at all (the start-up file is run instead).
+# Record whether the marker buffer then exists, for the tests below.
+#
+sed 's/\$highlight_all/$highlight_xyz/' snapshot.tfile >snapshot-bad.tfile
+cat >snapshot-check.tfile <<'EOD'
+set %marker &exb snap-marker
+select-buffer snap-check
+insert-string %marker
+set $cfname snapshot-used.tfile
+save-file
+exit-emacs
+EOD
+rm -f snapshot-used.tfile
+$UE2RUN -c ./snapshot-rc.tfile -q snapshot-bad.tfile -x ./snapshot-check.tfile
+BAD_SNAP_MARKER=`cat snapshot-used.tfile`
+export BAD_SNAP_MARKER
+
+# -+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-
+# Write out the uemacs start-up file, that will run the tests
+#
+cat >uetest.rc <<'EOD'
+; Some uemacs code to run tests on start-up snapshots
+; Put test results into a specific buffer (test-reports)...
+; ...and switch to that buffer at the end.
+
+execute-file autotest/report-status.rc
+
+set %test_name &env TNAME
+
+select-buffer test-reports
+insert-string &cat %test_name " started"
+newline
+set %fail 0
+set %ok 0
+
+execute-file autotest/check-value.rc
+
+; -+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-
+; START running the code!
+;
+set %test-report "START: Start-up snapshot tests"
+run report-status
+
+set %curtest "Snapshot was used"
+set %got &exb snap-marker
+set %expect "FALSE"
+run check-value
+
+set %curtest "Bad snapshot was not used"
+set %got &env BAD_SNAP_MARKER
+set %expect "TRUE"
+run check-value
+
+set %curtest "User variable"
+set %got %snap-var
+set %expect "from the start-up file"
+run check-value
+
+set %curtest "Environment variable"
+set %got $fillcol
+set %expect 66
+run check-value
+
+set %curtest "Search highlight variable"
+set %got $highlight_all
+set %expect TRUE
+run check-value
+
+set %curtest "New key binding"
+set %got &bin "^XFNA"
+set %expect "next-word"
+run check-value
+
+set %curtest "Removed key binding"
+set %got &bin "^XFNB"
+set %expect "ERROR"
+run check-value
+
+set %curtest "Default key binding"
+set %got &bin "^A"
+set %expect "beginning-of-line"
+run check-value
+
+set %curtest "Procedure key binding"
+set %got &bin "^XFNC"
+set %expect "execute-procedure"
+run check-value
+
+set %curtest "Procedure buffer"
+run snap-proc
+set %got %snap-ran
+set %expect "yes"
+run check-value
+
+; -+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-
+; Show the final score
+;
+select-buffer test-reports
+newline
+insert-string &cat &cat "END: ok: " %ok &cat " fail: " %fail
+newline
+insert-string &cat %test_name " ended"
+EOD
+
+# If running them all, leave - but first write out the buffer if there
+# were any failures.
+#
+if [ "$1" = FULL-RUN ]; then
+    cat >>uetest.rc <<'EOD'
+!if &not &equ %fail 0
+    set $cfname &cat "FAIL-" %test_name
+    save-file
+!else
+    unmark-buffer
+!endif
+exit-emacs
+EOD
+# Just leave display showing if being run singly.
+else
+    cat >>uetest.rc <<'EOD'
+unmark-buffer
+-2 redraw-display
+EOD
+fi
+
+# Do it...set the default uemacs if caller hasn't set one.
+[ -z "$UE2RUN" ] && UE2RUN="./uemacs -d etc"
+$UE2RUN -c ./snapshot-rc.tfile -q snapshot.tfile -x ./uetest.rc
+
+if [ "$1" = FULL-RUN ]; then
+    if [ -f FAIL-$TNAME ]; then
+        echo "$TNAME FAILed"
+    else
+        echo "$TNAME passed"
+    fi
+fi
@@ -172,6 +172,7 @@ int forwchar(int f, int n) {
  */
 int gotobob(int f, int n) {
     UNUSED(f); UNUSED(n);
+    if (curbp->b_flag & BFMAPPED) return mapview_goto_line(1);
     curwp->w.dotp = lforw(curbp->b_linep);
     curwp->w.doto = 0;
     curwp->w_flag |= WFHARD;
@@ -184,6 +185,7 @@ int gotobob(int f, int n) {
  */
 int gotoeob(int f, int n) {
     UNUSED(f); UNUSED(n);
+    if (curbp->b_flag & BFMAPPED) return mapview_goto_line(0);
     curwp->w.dotp = curbp->b_linep;
     curwp->w.doto = 0;
     curwp->w_flag |= WFHARD;
@@ -199,6 +201,9 @@ int gotoeob(int f, int n) {
 static int move_n_lines(int n) {
     struct line *dlp;
 
+/* A mapped file may need another part of it in the buffer first */
+    if (curbp->b_flag & BFMAPPED) n = mapview_lines(n);
+
 /* If we are on the first(back) or last(forw) line as we start,
  * fail the command.
  */
@@ -269,6 +274,9 @@ int gotoline(int f, int n) {
 /* If a bogus argument was passed, then return False. */
     if (n < 0) return FALSE;
 
+/* A mapped file finds the line in the file */
+    if (curbp->b_flag & BFMAPPED) return mapview_goto_line(n);
+
 /* First, we go to the begin of the buffer. */
     gotobob(0, 0);
     return forwline(0, n - 1);
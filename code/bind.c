@@ -362,18 +362,144 @@ int not_in_mb_error(int f, int n) {
  */
 #include <stddef.h>
 #include "idxsorter.h"
+#include "phash.h"
+#include "phash_tab.h"
 
 static int *key_index = NULL;
 static int key_index_allocated = 0;
+static int key_index_valid = 0;
 static int kt_ents;     /* Actual populated entries */
 
 static int keystr_index_valid = 0;
 
+/* Looking up a key code (getbind()) doesn't use a sorted index.
+ * The default bindings (init_keytab) are in a perfect hash generated
+ * at build time by mkphash (see the Makefile), so for any code we
+ * can tell in one step whether it is a default key, and dflt_slot
+ * then gives where (if anywhere) it currently lives in keytab.
+ * Any other code that gets bound is put into an open-addressing
+ * overlay hash (of keytab indices), which is only created once the
+ * user binds such a key.
+ * So there is no sorting at start-up, nor after each (re)binding.
+ */
+static int dflt_slot[PH_KEY_COUNT];
+static int *ovl_tbl = NULL;     /* keytab index, or OVL_EMPTY/OVL_GONE */
+static unsigned int ovl_size = 0;
+static unsigned int ovl_used = 0;       /* Including OVL_GONE */
+#define OVL_EMPTY -1
+#define OVL_GONE  -2
+#define OVL_INIT  32
+
+/* Which init_keytab entry is this code? -1 if none */
+static int dflt_pos(int c) {
+    unsigned int uc = (unsigned int)c;
+    unsigned int d = ph_key_disp[ph_inthash(uc, 0) & (PH_KEY_NBKT - 1)];
+    int di = ph_key_slot[ph_inthash(uc, d) & (PH_KEY_NSLOT - 1)];
+    if ((di < 0) || (ph_key_code[di] != uc)) return -1;
+    return di;
+}
+
+/* Find the overlay slot that holds c.
+ * If it isn't there return the first free one (if add is set) or -1.
+ */
+static int ovl_find(int c, int add) {
+    if (ovl_size == 0) return -1;
+    unsigned int mask = ovl_size - 1;
+    unsigned int hi = ph_inthash((unsigned int)c, 0) & mask;
+    int free_hi = -1;
+    while (ovl_tbl[hi] != OVL_EMPTY) {
+        if (ovl_tbl[hi] == OVL_GONE) {
+            if (free_hi < 0) free_hi = (int)hi;
+        }
+        else if (keytab[ovl_tbl[hi]].k_code == c) return (int)hi;
+        hi = (hi + 1) & mask;
+    }
+    if (!add) return -1;
+    if (free_hi < 0) {
+        free_hi = (int)hi;
+        ovl_used++;
+    }
+    return free_hi;
+}
+
+/* (Re)Build the overlay from keytab, making sure there is room for at
+ * least one more entry.
+ */
+static void ovl_rebuild(void) {
+    unsigned int needed = 1;
+    for (int ki = 0; ki < kt_ents; ki++)
+        if (dflt_pos(keytab[ki].k_code) < 0) needed++;
+    if (ovl_size == 0) ovl_size = OVL_INIT;
+    while (ovl_size < 2*needed) ovl_size <<= 1;
+    ovl_tbl = Xrealloc(ovl_tbl, ovl_size*sizeof(int));
+    for (unsigned int hi = 0; hi < ovl_size; hi++) ovl_tbl[hi] = OVL_EMPTY;
+    ovl_used = 0;
+    for (int ki = 0; ki < kt_ents; ki++) {
+        if (dflt_pos(keytab[ki].k_code) >= 0) continue;
+        ovl_tbl[ovl_find(keytab[ki].k_code, 1)] = ki;
+    }
+    return;
+}
+
+/* Record that key c is in keytab[ki], or unbound if ki is -1.
+ * If c is being moved the old keytab entry must still hold c when this
+ * is called, so that it can be found.
+ */
+static void map_key(int c, int ki) {
+    int di = dflt_pos(c);
+    if (di >= 0) {
+        dflt_slot[di] = ki;
+        return;
+    }
+    if (ki < 0) {
+        int hi = ovl_find(c, 0);
+        if (hi >= 0) ovl_tbl[hi] = OVL_GONE;
+        return;
+    }
+    if (2*(ovl_used + 1) > ovl_size) ovl_rebuild();
+    ovl_tbl[ovl_find(c, 1)] = ki;
+    return;
+}
+
+/* The keytab index for c, or -1 if it isn't bound */
+static int lookup_key(int c) {
+    int di = dflt_pos(c);
+    if (di >= 0) return dflt_slot[di];
+    int hi = ovl_find(c, 0);
+    return (hi >= 0)? ovl_tbl[hi]: -1;
+}
+
+/* Called by extend_keytab() when it has just copied init_keytab into
+ * the start of keytab.
+ */
+void init_keylookup(void) {
+    kt_ents = PH_KEY_COUNT;
+    for (int di = 0; di < PH_KEY_COUNT; di++) dflt_slot[di] = di;
+    for (unsigned int hi = 0; hi < ovl_size; hi++) ovl_tbl[hi] = OVL_EMPTY;
+    ovl_used = 0;
+    key_index_valid = 0;
+    keystr_index_valid = 0;
+    return;
+}
+
+/* Called when keytab has been replaced wholesale (by a start-up
+ * snapshot) with n_ents entries.
+ */
+void reset_keylookup(int n_ents) {
+    kt_ents = n_ents;
+    for (int di = 0; di < PH_KEY_COUNT; di++) dflt_slot[di] = -1;
+    for (unsigned int hi = 0; hi < ovl_size; hi++) ovl_tbl[hi] = OVL_EMPTY;
+    ovl_used = 0;
+    for (int ki = 0; ki < kt_ents; ki++) map_key(keytab[ki].k_code, ki);
+    key_index_valid = 0;
+    keystr_index_valid = 0;
+    return;
+}
+
 /* Note that we sort the keys as UNSIGNED!
  * This is so that we can step through them in order when dumping them
  * in desbind() and have the SPEC entries at the end.
- * It does also mean that when we do a lookup (in getbind()) we need
- * that to do an unsigned comparison during the binary chop.
+ * This is now only needed for that.
  */
 static void index_bindings(void) {
     if (key_index_allocated < keytab_alloc_ents) {
@@ -385,19 +511,9 @@ static void index_bindings(void) {
     fdef.type = 'U';
     fdef.len = sizeof(int);
 
-/* The allocated keytab contains markers at the end, which we do not
- * want to index...
- * The last one will be a ENDS_KMAP, and we skip over any preceding
- * ENDL_KMAP entries. Also allow for 0-based indexing, so -3.
- */
-
-    int ki = key_index_allocated - 3;
-    while (ki >= 0 && keytab[ki].k_type == ENDL_KMAP) ki--;
-    kt_ents = ki + 1;
     idxsort_fields((unsigned char *)keytab, key_index,
          sizeof(struct key_tab), kt_ents, 1, &fdef);
-    key_index_valid = 1;    /* This index is now usable... */
-    keystr_index_valid = 0; /* ... But the other one isn't */
+    key_index_valid = 1;    /* This index is now usable */
     return;
 }
 
@@ -478,48 +594,14 @@ struct key_tab *getbyfnc(fn_t func) {
  * and returns the key_tab entry address.
  * This now returns the key_tab entry address, and callers have
  * been adjusted to work with this.
- * Note that we sort the keys as UNSIGNED (in index_bindings)
- * so we must do an unsigned comparison during the binary chop.
  *
  * int c;               key to find what is bound to it
  */
 struct key_tab *getbind(int c) {
 
-/* We don't want to re-index for each keybinding change when processing
- * start-up files.
- * So we have a flag for whether the index is up-to-date, and another
- * one as to whether we should update it or just do a linear search.
- */
-    if (!key_index_valid) {
-        if (pause_key_index_update) {
-/* Just do a linear look through the key table. */
-            struct key_tab *ktp;
-            for (ktp = keytab; ktp->k_type != ENDL_KMAP; ++ktp) {
-                if (ktp->k_code == c) return ktp;
-            }
-            return NULL;
-        }
-        index_bindings();
-    }
-/* Look through the key table. We can now binary-chop this...
- * NOTE: that we don't do a binary chop that ensures we find the first
- * entry of any multiple ones, as there can't be such entries!
- */
-    int first = 0;
-    int middle = 0;     /* Keep the gcc analyzer happy */
-    int last = kt_ents - 1;
-
-    while (first <= last) {
-        middle = (first + last)/2;
-        if ((unsigned)keytab[key_index[middle]].k_code < (unsigned)c)
-             first = middle + 1;
-        else if (keytab[key_index[middle]].k_code == c) break;
-        else last = middle - 1;
-    }
-    if (first > last) {
-        return NULL;    /* No such binding */
-    }
-    struct key_tab *res = &keytab[key_index[middle]];
+    int ki = lookup_key(c);
+    if (ki < 0) return NULL;    /* No such binding */
+    struct key_tab *res = &keytab[ki];
     current_command = res->fi->n_name;
     return res;
 }
@@ -578,7 +660,6 @@ int deskey(int f, int n) {
  */
 static int unbindchar(int c) {
     struct key_tab *ktp;    /* pointer into the command table */
-    struct key_tab *sktp;   /* saved pointer into the command table */
 
 /* Search the table to see whether the key exists */
 
@@ -590,21 +671,25 @@ static int unbindchar(int c) {
 /* If this was a procedure mapping, free the buffer reference */
     if (ktp->k_type == PROC_KMAP) Xfree(ktp->hndlr.pbp);
 
-/* save the pointer and scan to the end of the table */
-    sktp = ktp;
-    while (ktp->k_type != ENDL_KMAP) ++ktp;
-    --ktp;                  /* backup to the last legit entry */
-
-/* copy the last entry to the current one */
-    *sktp = *ktp;           /* Copy the whole structure */
+/* Unmap it, then move the last entry into its place */
+    int ki = (int)(ktp - keytab);
+    int last = kt_ents - 1;
+    map_key(c, -1);
+    if (ki != last) {
+        *ktp = keytab[last];    /* Copy the whole structure */
+        map_key(ktp->k_code, ki);
+    }
 
 /* null out the last one */
+    ktp = &keytab[last];
     ktp->k_type = ENDL_KMAP;
     ktp->k_code = 0;
     ktp->hndlr.k_fp = NULL;
     ktp->fi = NULL;
+    kt_ents--;
 
-    key_index_valid = 0;    /* Rebuild index before using it. */
+    key_index_valid = 0;    /* Rebuild indexes before using them. */
+    keystr_index_valid = 0;
 
     return TRUE;
 }
@@ -661,16 +746,7 @@ static int update_keybind(int c, int ntimes, int internal_OK,
         destp = ktp;
     }
     else {  /* ...else add a new one at the end */
-        int ki;
-        if (key_index_valid) {  /* We know the valid entry count */
-            ki = kt_ents - 1;   /* The last used entry */
-        }
-        else {                  /* re-indexing is paused ... */
-/* We have to search - quicker to search backwards from end */
-            ki = keytab_alloc_ents - 2;   /* Skip ENDS_KMAP */
-            while (ki >= 0 && keytab[ki].k_type == ENDL_KMAP) ki--;
-        }
-        ktp = &keytab[ki+1];    /* Step forward to an ENDL_KMAP to use... */
+        ktp = &keytab[kt_ents]; /* The first ENDL_KMAP, to use... */
         destp = ktp;
 
 /* If the list is not exhausted the next one will also be an End-of-List.
@@ -686,6 +762,7 @@ static int update_keybind(int c, int ntimes, int internal_OK,
             destp = keytab + destp_offs;
         }
         destp->k_code = c;          /* set keycode */
+        map_key(c, kt_ents++);
     }
     destp->bk_multiplier = ntimes;
     if (bname) {
@@ -702,7 +779,8 @@ static int update_keybind(int c, int ntimes, int internal_OK,
     mpresf = TRUE;                  /* GGR */
     TTflush();
 
-    key_index_valid = 0;    /* Rebuild index before using it. */
+    key_index_valid = 0;    /* Rebuild indexes before using them. */
+    keystr_index_valid = 0;
     return TRUE;
 }
 
@@ -1085,6 +1163,7 @@ static const char* hdr[] = {
     "Ctlx+Meta+SPEC+Control(int)",
 };
 
+        if (!key_index_valid) index_bindings();
         unsigned int prev_cmask = 0xffffffff;
         for (int i = 0; i < kt_ents; i++) {
             unicode_t key = keytab[key_index[i]].k_code;
@@ -1144,12 +1223,16 @@ exit:
  *
  * char *sfname;        name of startup file (null if default)
  */
+const char *startup_fname(const char *sfname) {
+    if (*sfname != 0) return flook(sfname, TRUE, INTABLE);
+    else              return flook(init_files.startup, TRUE, INTABLE);
+}
+
 int startup(const char *sfname) {
     const char *fname;      /* resulting file name to execute */
 
 /* Look up the startup file */
-    if (*sfname != 0) fname = flook(sfname, TRUE, INTABLE);
-    else              fname = flook(init_files.startup, TRUE, INTABLE);
+    fname = startup_fname(sfname);
 
 /* If it isn't around, don't sweat it */
     if (fname == NULL) return TRUE;
@@ -1211,6 +1294,7 @@ void free_bind(void) {
     }
     Xfree(keytab);
     Xfree(key_index);
+    Xfree(ovl_tbl);
     Xfree(keystr_index);
     Xfree(next_keystr_index);
     if (free_path_reqd) Xfree(pathname[0]);
@@ -21,22 +21,142 @@
 
 /* -+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+- */
 
-int set_buffer_name(const char *bufn) {
+/* Buffer name lookups.
+ * bfind() is called for every file-hook, user-procedure, keyboard macro
+ * and named-buffer operation, so rather than strcmp() our way along the
+ * whole of the bheadp list we keep a hash index of the buffer names.
+ * Each bucket is chained through b_hashp.
+ * The bheadp list itself is still kept in lexical order, as that is the
+ * order listbuffers() and nextbuffer() walk it in.
+ */
+#define BHASH_INIT 64       /* Initial bucket count - must be a power of 2 */
+
+static struct buffer **bhash_tbl = NULL;
+static unsigned int bhash_size = 0;
+static int bhash_count = 0;
+
+/* FNV-1a hash of the name */
+static unsigned int bhash_key(const char *bname) {
+    unsigned int h = 2166136261U;
+    while (*bname) {
+        h ^= ch_as_uc(*bname++);
+        h *= 16777619U;
+    }
+    return h;
+}
 
-/* Provided no buffer other than curbp has this name, set it for curbp.
- * Return whether the name was set.
+/* Put every buffer in the list into a table of the given size.
+ * Used to create the table and to grow it.
  */
-    int status = TRUE;
+static void bhash_rebuild(unsigned int new_size) {
+    Xfree(bhash_tbl);
+    bhash_tbl = Xmalloc(new_size*sizeof(struct buffer *));
+    memset(bhash_tbl, 0, new_size*sizeof(struct buffer *));
+    bhash_size = new_size;
+    bhash_count = 0;
     for (struct buffer *bp = bheadp; bp != NULL; bp = bp->b_bufp) {
-        if (bp != curbp) {
-            if (strcmp(bufn, bp->b_bname) == 0) { /* Names the same? */
-                status = FALSE;
-                break;
-            }
+        unsigned int hi = bhash_key(bp->b_bname) & (bhash_size - 1);
+        bp->b_hashp = bhash_tbl[hi];
+        bhash_tbl[hi] = bp;
+        bhash_count++;
+    }
+    return;
+}
+
+/* Add a buffer (which must already have its name set) to the index.
+ * If the table is now over-full, double it.
+ */
+static void bhash_add(struct buffer *bp) {
+    if (bhash_tbl == NULL) {
+        bhash_rebuild(BHASH_INIT);  /* Will pick up bp if in bheadp list */
+        if (bhash_count) return;
+    }
+    unsigned int hi = bhash_key(bp->b_bname) & (bhash_size - 1);
+    bp->b_hashp = bhash_tbl[hi];
+    bhash_tbl[hi] = bp;
+    if (++bhash_count > (int)bhash_size) bhash_rebuild(2*bhash_size);
+    return;
+}
+
+/* Remove a buffer from the index. Must be called *before* the
+ * buffer name is changed or freed.
+ */
+static void bhash_remove(struct buffer *bp) {
+    if (bhash_tbl == NULL) return;
+    struct buffer **hpp = &bhash_tbl[bhash_key(bp->b_bname) & (bhash_size - 1)];
+    while (*hpp) {
+        if (*hpp == bp) {
+            *hpp = bp->b_hashp;
+            bp->b_hashp = NULL;
+            bhash_count--;
+            break;
         }
+        hpp = &((*hpp)->b_hashp);
     }
-    if (status) update_val(curbp->b_bname, bufn);
-    return status;
+    return;
+}
+
+/* Look up a buffer by name in the index */
+static struct buffer *bhash_find(const char *bname) {
+    if (bhash_tbl == NULL) return NULL;
+    struct buffer *bp = bhash_tbl[bhash_key(bname) & (bhash_size - 1)];
+    for (; bp != NULL; bp = bp->b_hashp)
+        if (strcmp(bname, bp->b_bname) == 0) break;
+    return bp;
+}
+
+/* Link a buffer into its lexical place in the bheadp list. */
+static void blist_insert(struct buffer *bp) {
+    struct buffer *sb;      /* buffer to insert after */
+
+    if (bheadp == NULL || strcmp(bheadp->b_bname, bp->b_bname) > 0) {
+        bp->b_bufp = bheadp;            /* Insert at the beginning */
+        bheadp = bp;
+        return;
+    }
+/* Note that we test the buffer *following* the current sb */
+    for (sb = bheadp; sb->b_bufp != NULL; sb = sb->b_bufp) {
+        if (strcmp(sb->b_bufp->b_bname, bp->b_bname) > 0) break;
+    }
+    bp->b_bufp = sb->b_bufp;            /* ...and insert it */
+    sb->b_bufp = bp;
+    return;
+}
+
+/* Unlink a buffer from the bheadp list. */
+static void blist_remove(struct buffer *bp) {
+    struct buffer *bp1 = NULL;          /* Find the header.     */
+    struct buffer *bp2 = bheadp;
+    while (bp2 != bp) {
+        bp1 = bp2;
+        bp2 = bp2->b_bufp;
+    }
+    bp2 = bp2->b_bufp;                  /* Next one in chain.   */
+    if (bp1 == NULL)                    /* Unlink it.           */
+        bheadp = bp2;
+    else
+        bp1->b_bufp = bp2;
+    return;
+}
+
+/* -+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+- */
+
+int set_buffer_name(const char *bufn) {
+
+/* Provided no buffer other than curbp has this name, set it for curbp.
+ * Return whether the name was set.
+ * The buffer is moved to its new place in the list and the index.
+ */
+    struct buffer *bp = bhash_find(bufn);
+    if (bp != NULL && bp != curbp) return FALSE;    /* Names the same? */
+    if (bp == curbp) return TRUE;                   /* No change */
+
+    bhash_remove(curbp);
+    blist_remove(curbp);
+    update_val(curbp->b_bname, bufn);
+    blist_insert(curbp);
+    bhash_add(curbp);
+    return TRUE;
 }
 
 /* -+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+- */
@@ -57,6 +177,11 @@ int bclear(struct buffer *bp) {
         && (s = mlyesno("Discard changes")) != TRUE)
             return s;
     bp->b_flag &= ~BFCHG;               /* Not changed          */
+    bp->b_edits++;                      /* ...but not the same  */
+    jnl_discard(bp);
+    bgcmd_stop(bp);                     /* Nothing more is to go in */
+    follow_stop(bp);
+    mapview_stop(bp);
 
 /* If we are modfying the buffer that the match-group info points
  * to we have to mark them as invalid.
@@ -119,8 +244,6 @@ static void per_macro_level_remove(struct buffer *btogo) {
 /* kill the buffer pointed to by bp
  */
 int zotbuf(struct buffer *bp) {
-    struct buffer *bp1;
-    struct buffer *bp2;
     int s;
 
     if (bp->b_nwnd != 0) {          /* Error if on screen.  */
@@ -129,18 +252,12 @@ int zotbuf(struct buffer *bp) {
     }
     if ((s = bclear(bp)) != TRUE)   /* Blow text away.      */
         return s;
+    server_buffer_gone(bp);         /* Any client is done with it */
+    bgsave_buffer_gone(bp);
+    mcache_free(bp);
     Xfree(bp->b_linep);             /* Release header line (no l_text here) */
-    bp1 = NULL;                     /* Find the header.     */
-    bp2 = bheadp;
-    while (bp2 != bp) {
-        bp1 = bp2;
-        bp2 = bp2->b_bufp;
-    }
-    bp2 = bp2->b_bufp;              /* Next one in chain.   */
-    if (bp1 == NULL)                /* Unlink it.           */
-        bheadp = bp2;
-    else
-        bp1->b_bufp = bp2;
+    bhash_remove(bp);               /* Remove from the name index */
+    blist_remove(bp);               /* ...and unlink it */
 
 /* Free allocated fields */
     Xfree(bp->b_bname);
@@ -226,12 +343,13 @@ int swbuffer(struct buffer *bp, int macro_OK) {
 /* A template struct buffer for new buffers */
 
 static struct buffer buf_templ = {
-    NULL, NULL, NULL, NULL, NULL, NULL, /* structs... */
+    NULL, NULL, NULL, NULL, NULL, NULL, NULL,   /* structs... */
     NULL, NULL, NULL, NULL,             /* char *s */
     { NULL, NULL, 0, 0, 0 },            /* struct locs */
     { 0, 0, 0, 0, 0, 0 },               /* struct func_opts */
     BTNORM, 0, 0, 0, 0,                 /* ints */
-    TRUE, 0, 0                          /* chars */
+    TRUE, 0, 0, 0,                      /* chars */
+    NULL                                /* match cache */
 };
 
 /* Find a buffer, by name. Return a pointer to the buffer structure
@@ -241,38 +359,22 @@ static struct buffer buf_templ = {
  */
 struct buffer *bfind(const char *bname, int cflag, int bflag) {
     struct buffer *bp;
-    struct buffer *sb;      /* buffer to insert after */
     struct line *lp;
 
-    for (bp = bheadp; bp != NULL; bp = bp->b_bufp) {
-        if (strcmp(bname, bp->b_bname) == 0) {
-            if (bp->b_active != TRUE) { /* buffer not active yet */
+    if ((bp = bhash_find(bname)) != NULL) {
+        if (bp->b_active != TRUE) {     /* buffer not active yet */
 /* silent was set to TRUE around this at one point, but it's been
  * removed as it makes sense to show the file being read in for
  * the first time.
  */
-                make_active(bp);
-            }
-            return bp;
+            make_active(bp);
         }
+        return bp;
     }
     if (cflag != FALSE) {
         bp = (struct buffer *)Xmalloc(sizeof(struct buffer));
         *bp = buf_templ;
 
-/* Find the place in the list to insert this buffer */
-        if (bheadp == NULL) {           /* Insert at the beginning */
-            bp->b_bufp = bheadp;
-            bheadp = bp;
-        } else {                        /* Find lexical place... */
-/* Note that we test the buffer *following* the current sb */
-            for (sb = bheadp; sb->b_bufp != NULL; sb = sb->b_bufp) {
-                if (strcmp(sb->b_bufp->b_bname, bname) > 0) break;
-            }
-            bp->b_bufp = sb->b_bufp;    /* ...and insert it */
-            sb->b_bufp = bp;
-        }
-
 /* Now override the "default" values in the template*/
 
         lp = lalloc();      /* Head record has no text buffer */
@@ -290,6 +392,10 @@ struct buffer *bfind(const char *bname, int cflag, int bflag) {
         update_val(bp->b_bname, bname);
         update_val(bp->b_dfname, "");
         update_val(bp->b_rpname, "");
+
+/* Insert it in its lexical place in the list, and index it */
+        blist_insert(bp);
+        bhash_add(bp);
     }
     return bp;
 }
@@ -425,7 +531,6 @@ ask:
         goto ask;       /* Try again */
     }
 
-    update_val(curbp->b_bname, db_val(bufn));   /* Copy name to structure */
     curwp->w_flag |= WFMODE;                    /* Make mode line replot */
     mlerase();
     status = TRUE;
@@ -797,6 +902,7 @@ void free_buffer(void) {
         }
         Xfree(bp->bv);
         if ((bp->b_type == BTPHON) && bp->ptt_headp) ptt_free(bp);
+        mcache_free(bp);
         Xfree(bp->b_bname);
         Xfree(bp->b_dfname);
         Xfree(bp->b_rpname);
@@ -804,6 +910,7 @@ void free_buffer(void) {
         Xfree(bp);
         db_free(addbuf);
     }
+    Xfree(bhash_tbl);
     return;
 }
 #endif
@@ -6,6 +6,11 @@
  */
 
 #include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
 #include "estruct.h"
 
 #define CRYPT_C
@@ -276,3 +281,193 @@ int set_encryption_key(int f, int n) {
     myencrypt(ukey, *klenp);
     return TRUE;
 }
+
+/* -+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+- */
+/* The stream cipher mode.
+ *
+ * myencrypt() can only work one byte at a time, from the start of the
+ * file, as each byte's key depends on all of the previous ones.
+ * If CRYPT_STREAM is set in $crypt_mode files are instead written with
+ * the ChaCha20 stream cipher (D. J. Bernstein, original 64-bit nonce and
+ * 64-bit block counter variant), XORing the data with a keystream that
+ * depends only on the key, a per-file nonce and the byte offset.
+ * So any part of a file can be en/decrypted on its own, and the
+ * keystream is generated CC_LANES 64-byte blocks at a time, with each
+ * operation being a loop over the lanes, which the compiler can turn
+ * into SIMD instructions.
+ *
+ * Such a file starts with a CC_HDR_LEN byte header of the magic string
+ * cc_magic followed by the 8-byte nonce. It is recognized on reading
+ * whatever the current $crypt_mode, so files written by either method
+ * can be read.
+ *
+ * The key is made from the encryption string in two steps:
+ *  stream_key()    absorbs the string, 32 bytes at a time, into a
+ *                  pre-key. Called by resetkey() in file.c.
+ *  stream_start()  mixes that with the file's nonce over CC_KDF_ROUNDS
+ *                  block calls to give the key for the file.
+ *                  Called via stream_new_header() or stream_check_header()
+ *                  from fileio.c.
+ */
+#define CC_LANES 8              /* Blocks generated per call */
+#define CC_BLOCK 64
+#define CC_KDF_ROUNDS 4096
+
+#define CC_MAGIC_LEN (CC_HDR_LEN - 8)
+static const char cc_magic[CC_MAGIC_LEN] =
+     { '\0', 'u', 'e', 'C', 'C', '2', '0', '\n' };
+
+static uint32_t cc_pre[8];      /* Absorbed encryption string */
+static uint32_t cc_key[8];      /* Key for the current file */
+static uint32_t cc_nonce[2];    /* Nonce for the current file */
+
+static inline uint32_t rotl32(uint32_t v, int n) {
+    return (v << n) | (v >> (32 - n));
+}
+
+static inline uint32_t get_le32(const unsigned char *p) {
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 |
+           (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+#define QR(a, b, c, d)                                              \
+    for (int l = 0; l < CC_LANES; l++) {                            \
+        x[a][l] += x[b][l]; x[d][l] = rotl32(x[d][l] ^ x[a][l], 16);\
+        x[c][l] += x[d][l]; x[b][l] = rotl32(x[b][l] ^ x[c][l], 12);\
+        x[a][l] += x[b][l]; x[d][l] = rotl32(x[d][l] ^ x[a][l], 8); \
+        x[c][l] += x[d][l]; x[b][l] = rotl32(x[b][l] ^ x[c][l], 7); \
+    }
+
+/* Generate the CC_LANES keystream blocks starting at block number ctr.
+ * The state is held transposed (word by lane) so that each step of the
+ * rounds is the same operation across all of the lanes.
+ */
+static void chacha_blocks(const uint32_t key[8], const uint32_t nonce[2],
+     uint64_t ctr, unsigned char *out) {
+    static const uint32_t sigma[4] =
+         { 0x61707865, 0x3320646e, 0x79622d32, 0x6b206574 };
+    uint32_t in[16][CC_LANES], x[16][CC_LANES];
+
+    for (int l = 0; l < CC_LANES; l++) {
+        for (int i = 0; i < 4; i++) in[i][l] = sigma[i];
+        for (int i = 0; i < 8; i++) in[4+i][l] = key[i];
+        uint64_t bn = ctr + (uint64_t)l;
+        in[12][l] = (uint32_t)bn;
+        in[13][l] = (uint32_t)(bn >> 32);
+        in[14][l] = nonce[0];
+        in[15][l] = nonce[1];
+    }
+    memcpy(x, in, sizeof(x));
+    for (int r = 0; r < 10; r++) {
+        QR(0, 4,  8, 12) QR(1, 5,  9, 13) QR(2, 6, 10, 14) QR(3, 7, 11, 15)
+        QR(0, 5, 10, 15) QR(1, 6, 11, 12) QR(2, 7,  8, 13) QR(3, 4,  9, 14)
+    }
+    for (int i = 0; i < 16; i++) {
+        for (int l = 0; l < CC_LANES; l++) {
+            uint32_t v = x[i][l] + in[i][l];
+            unsigned char *op = out + l*CC_BLOCK + 4*i;
+            op[0] = (unsigned char)v;
+            op[1] = (unsigned char)(v >> 8);
+            op[2] = (unsigned char)(v >> 16);
+            op[3] = (unsigned char)(v >> 24);
+        }
+    }
+}
+#undef QR
+
+/* Replace key with the first 32 bytes of the first block of ks */
+static void key_from(uint32_t key[8], const unsigned char *ks) {
+    for (int i = 0; i < 8; i++) key[i] = get_le32(ks + 4*i);
+}
+
+/* Absorb the (unencrypted) encryption string into the pre-key.
+ */
+void stream_key(const char *ukey, int klen) {
+    static const uint32_t kdf_nonce[2] = { 0x6d656575, 0x6b2d7363 };
+    unsigned char ks[CC_LANES*CC_BLOCK];
+
+    memset(cc_pre, 0, sizeof(cc_pre));
+    int i = 0;
+    do {
+        for (int j = 0; j < 32 && i + j < klen; j++)
+            cc_pre[j/4] ^= (uint32_t)ch_as_uc(ukey[i+j]) << (8*(j%4));
+        chacha_blocks(cc_pre, kdf_nonce,
+             (uint64_t)klen << 32 | (uint64_t)i, ks);
+        key_from(cc_pre, ks);
+        i += 32;
+    } while (i < klen);
+    memset(ks, 0, sizeof(ks));
+}
+
+/* Set up the key for a file with the given nonce.
+ */
+static void stream_start(const char *nonce) {
+    unsigned char ks[CC_LANES*CC_BLOCK];
+
+    cc_nonce[0] = get_le32((const unsigned char *)nonce);
+    cc_nonce[1] = get_le32((const unsigned char *)nonce + 4);
+    memcpy(cc_key, cc_pre, sizeof(cc_key));
+    for (uint64_t r = 0; r < CC_KDF_ROUNDS; r++) {
+        chacha_blocks(cc_key, cc_nonce, r, ks);
+        key_from(cc_key, ks);
+    }
+    memset(ks, 0, sizeof(ks));
+}
+
+/* Create the header for a new file, with a new random nonce, and set
+ * up to encrypt the file with it.
+ * The nonce must never be re-used with the same key, so if there is no
+ * /dev/urandom we make one from the time, pid and a counter.
+ */
+void stream_new_header(char *hdr) {
+    static uint32_t count = 0;
+    char *nonce = hdr + CC_MAGIC_LEN;
+
+    memcpy(hdr, cc_magic, CC_MAGIC_LEN);
+    int fd = open("/dev/urandom", O_RDONLY);
+    if ((fd < 0) || (read(fd, nonce, 8) != 8)) {
+        struct timespec ts;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        uint32_t v[2];
+        v[0] = (uint32_t)ts.tv_sec ^ (uint32_t)getpid() << 16 ^ ++count;
+        v[1] = (uint32_t)ts.tv_nsec ^ (uint32_t)(ts.tv_sec >> 32);
+        memcpy(nonce, v, 8);
+    }
+    if (fd >= 0) close(fd);
+    stream_start(nonce);
+}
+
+/* If hdr is a stream cipher header, set up to decrypt the file and
+ * return TRUE.
+ */
+int stream_check_header(const char *hdr) {
+    if (memcmp(hdr, cc_magic, CC_MAGIC_LEN)) return FALSE;
+    stream_start(hdr + CC_MAGIC_LEN);
+    return TRUE;
+}
+
+/* Forget the file key when the file is closed.
+ */
+void stream_end(void) {
+    memset(cc_key, 0, sizeof(cc_key));
+}
+
+/* In place encryption/decryption of len bytes that are at byte offset
+ * off in the encrypted data (i.e. after the header).
+ */
+void stream_crypt(char *bptr, size_t len, uint64_t off) {
+    unsigned char ks[CC_LANES*CC_BLOCK];
+    unsigned char *bp = (unsigned char *)bptr;
+
+    while (len) {
+        size_t skip = (size_t)(off % CC_BLOCK);
+        chacha_blocks(cc_key, cc_nonce, off/CC_BLOCK, ks);
+        size_t n = sizeof(ks) - skip;
+        if (n > len) n = len;
+        for (size_t i = 0; i < n; i++) bp[i] ^= ks[skip+i];
+        bp += n;
+        len -= n;
+        off += n;
+    }
+    memset(ks, 0, sizeof(ks));
+}
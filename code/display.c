@@ -11,6 +11,7 @@
 #include <errno.h>
 #include <stdio.h>
 #include <stdarg.h>
+#include <stdint.h>
 #include <unistd.h>
 
 #define DISPLAY_C
@@ -51,8 +52,17 @@ struct video {
     int v_rbcolor;          /* requested background color   */
 #endif
     struct grapheme v_text[0];  /* Screen data - dynamic    */
+/* ...followed by one attribute byte per cell, see v_attr() */
 };
 
+/* The cell attributes live after the v_text array of each row, so
+ * they are allocated (and copied) along with it.
+ */
+static int vt_ncells = 0;               /* Cells per row allocated */
+#define v_attr(vp) ((unsigned char *)((vp)->v_text + vt_ncells))
+#define VAMATCH 0x01                    /* Cell is in a search match */
+static unsigned char vtattr = 0;        /* Attribute vtputc() sets */
+
 #define VFCHG   0x0001          /* Changed flag                 */
 #define VFEXT   0x0002          /* extended (beyond column 80)  */
 #define VFREV   0x0004          /* reverse video status         */
@@ -245,8 +255,10 @@ void vtinit(void) {
 /* Allocate the data for these 2 arrays in one go and
  * assign the array elements in loops.
  */
-    size_t row_size =
-         sizeof(struct video) + (unsigned)term.t_mcol*sizeof(struct grapheme);
+    size_t attr_size = ((unsigned)term.t_mcol + sizeof(void *) - 1) &
+         ~(sizeof(void *) - 1);
+    size_t row_size = sizeof(struct video) +
+         (unsigned)term.t_mcol*sizeof(struct grapheme) + attr_size;
     new_vdata = Xmalloc(2 * (unsigned)term.t_mrow*row_size);
     void *vdp = new_vdata;
     void *pdp = new_vdata + ((unsigned)term.t_mrow*row_size);
@@ -286,7 +298,9 @@ void vtinit(void) {
     vp->v_bcolor = gbcolor;
     vp->v_rbcolor = gbcolor;
 #endif
+    vt_ncells = term.t_mcol;
     for (i = 0; i < term.t_mcol; i++) vp->v_text[i] = blank_gph;
+    memset(v_attr(vp), 0, (size_t)term.t_mcol);
     for (i = 1; i < term.t_mrow; i++) {
         memcpy(new_vscreen[i], vp, row_size);
     }
@@ -370,6 +384,7 @@ static void vtputc(unicode_t c) {
         if (vtcol == 0) {
             update_grapheme(&(vp->v_text[0]), ' ');
             extend_grapheme(&(vp->v_text[0]), c);
+            v_attr(vp)[0] = vtattr;
             ++vtcol;
         }
         return;     /* Nothing else do do... */
@@ -384,10 +399,12 @@ static void vtputc(unicode_t c) {
             if (vp->v_text[dcol].uc == '$') break;  /* Quick repeat exit */
             if (vp->v_text[dcol].uc != 0) {
                 update_grapheme(&(vp->v_text[dcol]), '$');
+                v_attr(vp)[dcol] = 0;
                 break;
             }
         }
         update_grapheme(&(vp->v_text[term.t_ncol - 1]), '$');
+        v_attr(vp)[term.t_ncol - 1] = 0;
         return;
     }
 
@@ -430,11 +447,13 @@ static void vtputc(unicode_t c) {
     int cw = utf8char_width(c);
     if (vtcol >= 0) {
         update_grapheme(&(vp->v_text[vtcol]), c);
+        v_attr(vp)[vtcol] = vtattr;
 /* This code assumes that a NUL byte will not be displayed */
         int pvcol = vtcol;
         for (int nulpad = cw - 1; nulpad > 0; nulpad--) {
             pvcol++;
             update_grapheme(&(vp->v_text[pvcol]), 0);
+            v_attr(vp)[pvcol] = vtattr;
         }
     }
 /* If vtcol is -ve, but will be +ve after the cw increment we need to space
@@ -443,6 +462,7 @@ static void vtputc(unicode_t c) {
     else {
         for (int pcol = vtcol + cw; pcol > 0; pcol--) {
             update_grapheme(&(vp->v_text[pcol-1]), ' ');
+            v_attr(vp)[pcol-1] = vtattr;
         }
     }
     vtcol += cw;
@@ -456,8 +476,12 @@ static void vtputc(unicode_t c) {
  */
 static void vteeol(void) {
     struct grapheme *vcp = vscreen[vtrow]->v_text;
+    unsigned char *vap = v_attr(vscreen[vtrow]);
     if (vtcol < 0) vtcol = 0;
-    while (vtcol < term.t_ncol) update_grapheme(&(vcp[vtcol++]), ' ');
+    while (vtcol < term.t_ncol) {
+        vap[vtcol] = 0;
+        update_grapheme(&(vcp[vtcol++]), ' ');
+    }
 }
 
 void update(int);           /* Forward declaration */
@@ -497,6 +521,7 @@ static void updgar(void) {
  */
         txt = pscreen[i]->v_text;
         for (j = 0; j < term.t_ncol; ++j) txt[j] = blank_gph;
+        memset(v_attr(pscreen[i]), 0, (size_t)term.t_ncol);
     }
 
     movecursor(0, 0);       /* Erase the screen. */
@@ -587,14 +612,87 @@ static int reframe(struct window *wp) {
     return TRUE;
 }
 
-static void show_line(struct line *lp) {
+/* Highlighting of all matches for the current search pattern
+ * ($highlight_all).
+ * Only the lines being shown are scanned, as they are put onto the
+ * virtual screen, so the cost depends on the screen size, not the buffer
+ * size. The matches found are cached per line (in a small table indexed
+ * by the line pointer) and the entry is rescanned once its buffer has been
+ * edited, or the pattern or search modes have changed.
+ * A freed line's address can be reused, so anything that frees or makes
+ * lines (not just lchange()) must bump b_edits, as follow-file,
+ * revert-file, mapped buffers and command output do.
+ */
+#define HL_SLOTS 512
+struct hl_line {
+    struct line *lp;
+    struct buffer *bp;
+    unsigned int edits;     /* b_edits when scanned */
+    int mode;               /* Search modes when scanned */
+    unsigned int gen;       /* hl_gen when scanned */
+    int nspan;              /* Number of (start, end) pairs in span */
+    int alloc;              /* Allocated ints in span */
+    int *span;
+};
+static struct hl_line hl_tbl[HL_SLOTS];
+static unsigned int hl_gen = 0;
+static int hl_on = FALSE;
+static db_strdef(hl_pat);
+
+/* Check whether the highlighting has been switched, or the pattern
+ * changed, since the last update. If so, the cache is stale and every
+ * window needs to be redrawn in full.
+ * Nothing is highlighted while in the minibuffer.
+ */
+static void hl_check(void) {
+    int on = highlight_all && (db_len(pat) > 0) && !inmb;
+    if ((on == hl_on) && (!on || !db_cmp(hl_pat, db_val(pat)))) return;
+    hl_on = on;
+    db_set(hl_pat, db_val(pat));
+    hl_gen++;
+    for (struct window *wp = wheadp; wp; wp = wp->w_wndp)
+        wp->w_flag |= WFHARD;
+}
+
+/* Get the match spans for line lp in window wp, scanning it only if the
+ * cached entry is not valid.
+ */
+static int *hl_spans(struct window *wp, struct line *lp, int *nspan) {
+    *nspan = 0;
+    if (!hl_on || (lp == wp->w_bufp->b_linep)) return NULL;
+
+    struct buffer *bp = wp->w_bufp;
+    int mode = bp->b_mode & (MDEXACT | MDMAGIC | MDEQUIV);
+    struct hl_line *hp = hl_tbl +
+         ((uintptr_t)lp/sizeof(struct line *))%HL_SLOTS;
+    if ((hp->lp != lp) || (hp->bp != bp) || (hp->edits != bp->b_edits) ||
+        (hp->mode != mode) || (hp->gen != hl_gen)) {
+        int ns = line_matches(wp, lp, &hp->span, &hp->alloc);
+        hp->lp = lp;
+        hp->bp = bp;
+        hp->edits = bp->b_edits;
+        hp->mode = mode;
+        hp->gen = hl_gen;
+        hp->nspan = (ns < 0)? 0: ns;
+    }
+    *nspan = hp->nspan;
+    return hp->span;
+}
+
+static void show_line(struct window *wp, struct line *lp) {
+    int nspan;
+    int *span = hl_spans(wp, lp, &nspan);
+    int si = 0;
     int i = 0, len = lused(lp);
 /* Only runs through loop if there is text, so ltext() is OK. */
     while (i < len) {
         unicode_t c;
+        while ((si < nspan) && (i >= span[2*si + 1])) si++;
+        vtattr = ((si < nspan) && (i >= span[2*si]))? VAMATCH: 0;
         i += utf8_to_unicode(ltext(lp), i, len, &c);
         vtputc(c);
     }
+    vtattr = 0;
 }
 
 /* Map a char string with (possibly) utf8 sequences in it to unicode
@@ -631,7 +729,7 @@ static void updone(struct window *wp) {
     vscreen[sline]->v_flag &= ~VFREQ;
     taboff = wp->w.fcol;
     vtmove(sline, -taboff);
-    show_line(lp);
+    show_line(wp, lp);
 #if COLOR
     vscreen[sline]->v_rfcolor = wp->w_fcolor;
     vscreen[sline]->v_rbcolor = wp->w_bcolor;
@@ -660,7 +758,7 @@ static void updall(struct window *wp) {
         vscreen[sline]->v_flag &= ~VFREQ;
         vtmove(sline, -taboff);
         if (lp != wp->w_bufp->b_linep) {    /* if we are not at the end */
-            show_line(lp);
+            show_line(wp, lp);
             lp = lforw(lp);
         }
 
@@ -691,7 +789,8 @@ static int texttest(int vrow, int prow) {
     struct video *vpv = vscreen[vrow];      /* virtual screen image */
     struct video *vpp = pscreen[prow];      /* physical screen image */
 
-    return same_grapheme_array(vpv->v_text, vpp->v_text, term.t_ncol);
+    return same_grapheme_array(vpv->v_text, vpp->v_text, term.t_ncol) &&
+         !memcmp(v_attr(vpv), v_attr(vpp), (size_t)term.t_ncol);
 }
 
 /* return the index of the first blank of trailing whitespace
@@ -791,6 +890,7 @@ static int scrolls(int inserts) {   /* returns true if it does something */
             vpv = vscreen[to + i];
             memcpy(vpp->v_text, vpv->v_text,
                  sizeof(struct grapheme)*(unsigned)cols);
+            memcpy(v_attr(vpp), v_attr(vpv), (size_t)cols);
             vpp->v_flag = vpv->v_flag;  /* XXX */
             if (vpp->v_flag & VFREV) {
                 vpp->v_flag &= ~VFREV;
@@ -810,6 +910,7 @@ static int scrolls(int inserts) {   /* returns true if it does something */
             txt = pscreen[i]->v_text;
 /* This is a pscreen, no need to worry about freeing any ex field */
             for (j = 0; j < term.t_ncol; ++j) txt[j] = blank_gph;
+            memset(v_attr(pscreen[i]), 0, (size_t)term.t_ncol);
             vscreen[i]->v_flag |= VFCHG;
         }
         return TRUE;
@@ -817,6 +918,29 @@ static int scrolls(int inserts) {   /* returns true if it does something */
     return FALSE;
 }
 
+/* Output the cells from col up to (but not including) end of virtual
+ * line vp1, copying them to physical line vp2.
+ * Any cells that are in a search match are shown in reverse video, as is
+ * everything if rev is set. cell_rev tracks the terminal's current state.
+ */
+static int cell_rev = FALSE;
+static void put_cells(struct video *vp1, struct video *vp2, int col,
+     int end, int rev) {
+    for (; col < end; col++) {
+        int want = rev || (v_attr(vp1)[col] & VAMATCH);
+        if (want != cell_rev) {
+            TTrev(want);
+            cell_rev = want;
+        }
+        TTputgrapheme(&vp1->v_text[col]);
+        clone_grapheme(&vp2->v_text[col], &vp1->v_text[col]);
+        v_attr(vp2)[col] = v_attr(vp1)[col];
+    }
+}
+#define same_cell(vp1, vp2, col) \
+    (same_grapheme(&(vp1)->v_text[col], &(vp2)->v_text[col], 0) && \
+     (v_attr(vp1)[col] == v_attr(vp2)[col]))
+
 /* Update a single line. This does not know how to use insert or delete
  * character sequences; we are using VT52 functionality. Update the physical
  * row and column variables. It does try an exploit erase to end of line.
@@ -829,17 +953,10 @@ static int scrolls(int inserts) {   /* returns true if it does something */
  */
 static void updateline(int row, struct video *vp1, struct video *vp2) {
 
-    struct grapheme *cp1;
-    struct grapheme *cp2;
-    struct grapheme *cp3;
-    struct grapheme *cp4;
-    struct grapheme *cp5;
+    int c1, c3, c5;         /* Column indices */
     int nbflag;             /* non-blanks to the right flag? */
     int req;                /* reverse video request flag */
-
-/* Set up pointers to virtual and physical lines */
-    cp1 = &vp1->v_text[0];
-    cp2 = &vp2->v_text[0];
+    int ncol = term.t_ncol;
 
 #if COLOR
     TTforg(vp1->v_rfcolor);
@@ -862,17 +979,15 @@ static void updateline(int row, struct video *vp1, struct video *vp2) {
         movecursor(row, 0);     /* Go to start of line. */
         if (rev != req)         /* set rev video if needed */
             (*term.t_rev) (req);
+        cell_rev = (rev != req) && req;
 
 /* Scan through the line and dump it to the screen and
  * the virtual screen array
  */
-        cp3 = &vp1->v_text[term.t_ncol];
-        while (cp1 < cp3) {
-            TTputgrapheme(cp1);
-            clone_grapheme(cp2++, cp1++);
-        }
-        if (rev != req)     /* turn rev video off */
+        put_cells(vp1, vp2, 0, ncol, cell_rev);
+        if ((rev != req) || cell_rev)   /* turn rev video off */
             (*term.t_rev) (FALSE);
+        cell_rev = FALSE;
 
 /* Update the needed flags */
         vp1->v_flag &= ~VFCHG;
@@ -887,10 +1002,8 @@ static void updateline(int row, struct video *vp1, struct video *vp2) {
 #endif
 
 /* Advance past any common chars at the left */
-    while (cp1 != &vp1->v_text[term.t_ncol] && same_grapheme(cp1, cp2, 0)) {
-        ++cp1;
-        ++cp2;
-    }
+    c1 = 0;
+    while ((c1 < ncol) && same_cell(vp1, vp2, c1)) c1++;
 
 /* This can still happen, even though we only call this routine on changed
  * lines. A hard update is always done when a line splits, a massive
@@ -899,51 +1012,58 @@ static void updateline(int row, struct video *vp1, struct video *vp2) {
  * be hard operations that do a lot of update, so I don't really care.
  */
 /* If both lines are the same, no update needs to be done */
-    if (cp1 == &vp1->v_text[term.t_ncol]) {
+    if (c1 == ncol) {
         vp1->v_flag &= ~VFCHG;      /* Flag this line is changed */
         return;
     }
 
-/* Find out if there is a match on the right */
+/* Find out if there is a match on the right.
+ * A highlighted blank counts as a non-blank, as erasing would lose it.
+ */
     nbflag = FALSE;
-    cp3 = &vp1->v_text[term.t_ncol];
-    cp4 = &vp2->v_text[term.t_ncol];
-
-    while (same_grapheme(&(cp3[-1]), &(cp4[-1]), 0)) {
-        --cp3;
-        --cp4;
-        if (!is_space(&(cp3[0])))   /* Note if any nonblank */
-            nbflag = TRUE;          /* in right match. */
+    c3 = ncol;
+    while (same_cell(vp1, vp2, c3 - 1)) {
+        --c3;
+        if (!is_space(&vp1->v_text[c3]) || v_attr(vp1)[c3])
+            nbflag = TRUE;          /* Note if any nonblank in right match */
     }
 
-    cp5 = cp3;
+    c5 = c3;
 
 /* Erase to EOL ? */
     if (nbflag == FALSE && eolexist == TRUE && (req != TRUE)) {
-        while (cp5 != cp1 && is_space(&(cp5[-1]))) --cp5;
+        while ((c5 != c1) && is_space(&vp1->v_text[c5 - 1]) &&
+             !v_attr(vp1)[c5 - 1]) --c5;
 
-        if (cp3 - cp5 <= 3)         /* Use only if erase is */
-            cp5 = cp3;              /* fewer characters. */
+        if (c3 - c5 <= 3)           /* Use only if erase is */
+            c5 = c3;                /* fewer characters. */
     }
 
-    movecursor(row, (int)(cp1 - &vp1->v_text[0]));  /* Go to start of line. */
+    movecursor(row, c1);    /* Go to start of change. */
+    int lrev = FALSE;
 #if REVSTA
     TTrev(rev);
+    lrev = rev;
 #endif
+    cell_rev = lrev;
 
-    while (cp1 != cp5) {    /* Ordinary. */
-        TTputgrapheme(cp1);
-        clone_grapheme(cp2++, cp1++);
-    }
+    put_cells(vp1, vp2, c1, c5, lrev);  /* Ordinary. */
 
-    if (cp5 != cp3) {       /* Erase. */
+    if (c5 != c3) {         /* Erase. */
+        if (cell_rev != lrev) TTrev(lrev);
+        cell_rev = lrev;
         TTeeol();
-        while (cp1 != cp3)
-            clone_grapheme(cp2++, cp1++);
+        for (; c5 < c3; c5++) {
+            clone_grapheme(&vp2->v_text[c5], &vp1->v_text[c5]);
+            v_attr(vp2)[c5] = v_attr(vp1)[c5];
+        }
     }
 #if REVSTA
     TTrev(FALSE);
+#else
+    if (cell_rev) TTrev(FALSE);
 #endif
+    cell_rev = FALSE;
     vp1->v_flag &= ~VFCHG;  /* Flag this line as updated */
     return;
 }
@@ -992,7 +1112,7 @@ static void updext(void) {
  * once we reach the left edge.
  */
     vtmove(currow, -taboff);    /* start scanning offscreen */
-    show_line(curwp->w.dotp);   /* Show the line */
+    show_line(curwp, curwp->w.dotp);    /* Show the line */
 
 /* Truncate the virtual line, restore tab offset */
     vteeol();
@@ -1003,8 +1123,10 @@ static void updext(void) {
  */
     int cw = utf8char_width(vscreen[currow]->v_text[0].uc);
     update_grapheme(&(vscreen[currow]->v_text[0]), '$');
+    v_attr(vscreen[currow])[0] = 0;
     for (int pcol = cw - 1; pcol > 0; pcol--) {
         update_grapheme(&(vscreen[currow]->v_text[pcol]), ' ');
+        v_attr(vscreen[currow])[pcol] = 0;
     }
 }
 
@@ -1131,7 +1253,7 @@ static void upddex(void) {
                 if ((wp != curwp) || (lp != wp->w.dotp) || !DO_SCROLL) {
                     taboff = wp->w.fcol;
                     vtmove(i, -taboff);
-                    show_line(lp);
+                    show_line(wp, lp);
                     vteeol();
                     taboff = 0;
 
@@ -1355,6 +1477,16 @@ static void modeline(struct window *wp) {
         firstm = FALSE;
         db_append(glb_db, "Truncated");
     }
+    if ((bp->b_flag & BFFOLLOW) != 0) {
+        if (!firstm) db_append(glb_db, " ");
+        firstm = FALSE;
+        db_append(glb_db, "Follow");
+    }
+    if ((bp->b_flag & BFMAPPED) != 0) {
+        if (!firstm) db_append(glb_db, " ");
+        firstm = FALSE;
+        db_append(glb_db, "Mapped");
+    }
     struct window *mwp;
     if (inmb) mwp = mb_info.main_wp;
     else      mwp = wp;
@@ -1439,6 +1571,13 @@ next_mode:
                 msg = " Top ";
             }
     }
+    if (bp->b_flag & BFMAPPED) {    /* Only a part of the file */
+        int ratio = mapview_percent(wp);
+        if (ratio >= 0) {
+            db_sprintf(glb_db, " %2d%% ", ratio);
+            msg = db_val(glb_db);
+        }
+    }
     if (!msg) {
         struct line *lp;
         int numlines, predlines;
@@ -1526,6 +1665,12 @@ void update(int force) {
 
     if (!vismac && (force == FALSE) && (kbdmode == PLAY)) return;
 
+/* A changed highlight pattern needs all windows redrawn */
+    hl_check();
+
+/* A mapped file may need more of it read in around dot */
+    mapview_slide();
+
 /* GGR Set-up any requested new screen size before working out a screen
  * update, rather than waiting until the end.
  * spawn.c forces a redraw using this on return from a command line, and
@@ -1880,6 +2025,8 @@ void free_display(void) {
 
     db_free(last_bname);
     db_free(last_display);
+    db_free(hl_pat);
+    for (int hi = 0; hi < HL_SLOTS; hi++) Xfree(hl_tbl[hi].span);
     return;
 }
 #endif
@@ -81,6 +81,29 @@ void _dbp_setn(db *ds, const void *mp, int n) {
     return;
 }
 
+/* As _dbp_setn(), but for a db that no-one else can see yet, in a
+ * thread that mustn't exit (as Xrealloc() does) if the memory can't be
+ * had. Returns 0 for that, leaving the db as it was.
+ */
+int _dbp_trysetn(db *ds, const void *mp, int n) {
+    size_t need = (size_t)n;
+    if (ds->type & DB_STR) need++;
+    if (need > ds->alloc) {
+        size_t want = (need + DYN_INCR) & ~(DYN_INCR - 1);
+        if (want > INT_MAX) return 0;
+        char *nbuf = realloc(ds->buf, want);
+        if (!nbuf) return 0;
+        ds->buf = nbuf;
+        ds->alloc = want;
+    }
+    if (n > 0) memcpy(ds->buf, mp, (size_t)n);
+    ds->blen = n;
+    ds->alen = n;
+    ds->asp = ds->buf;
+    if (ds->type & DB_STR) *(ds->buf+ds->blen) = '\0';
+    return 1;
+}
+
 /* String copy-in a NUL-terminated string */
 
 void _dbp_set(db *ds, const char *str) {
@@ -60,6 +60,7 @@ typedef struct {
 
 const char *_dbp_val_nc(db *);
 void _dbp_setn(db *, const void *, int);
+int _dbp_trysetn(db *, const void *, int);
 void _dbp_set(db *, const char *);
 void _dbp_replicatech_at(db *, char, int, int);
 void _dbp_insertn_at(db *, const void *, int, int);
@@ -99,6 +100,8 @@ void _dbp_free(db *);
 #define db_setn(to_ds, from_buf, flen) _dbp_setn(&(to_ds), from_buf, flen)
 #define dbp_setn(to_ds, from_buf, flen) _dbp_setn((to_ds), from_buf, flen)
 
+#define db_trysetn(to_ds, from_buf, flen) _dbp_trysetn(&(to_ds), from_buf, flen)
+
 #define db_set(to_ds, from_str) _dbp_set(&(to_ds), from_str)
 #define dbp_set(to_ds, from_str) _dbp_set((to_ds), from_str)
 
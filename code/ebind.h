@@ -39,8 +39,6 @@ struct key_tab *keytab;
  * an ENDS_KMAP entry as the final element.
  */
 
-int key_index_valid = 0;
-
 struct key_tab_init init_keytab[] = {
     {CONTROL|'A',       gotobol         },
     {CONTROL|'B',       backchar        },
@@ -11,6 +11,8 @@
 #define EDEF_H_
 
 #include <string.h>
+#include <stdint.h>
+#include <sys/types.h>
 #include <utf8proc.h>
 #include <time.h>
 
@@ -125,7 +127,7 @@ enum yank_style { Old, GNU };
 
 extern int evl_size;
 extern int names_size;
-extern int *name_index;
+extern const int *name_index;
 
 extern linked_items *macro_pin_headp;
 
@@ -141,7 +143,6 @@ extern int flickcode;           /* do flicker supression?       */
 extern const char *mode2name[]; /* text names of modes          */
 extern char modecode[];         /* letters to represent modes   */
 extern struct key_tab *keytab;  /* key bind to functions table  */
-extern int key_index_valid;     /* Whether idx index for keytab is valid */
 extern struct name_bind names[];/* name to function table */
 extern int gmode;               /* global editor mode           */
 extern int force_mode_on;       /* modes forced to be on        */
@@ -156,6 +157,7 @@ extern int clexec;              /* command line execution flag  */
 extern int discmd;              /* display command flag         */
 extern int disinp;              /* display input characters     */
 extern int vismac;              /* update display during keyboard macros? */
+extern int highlight_all;       /* show all search matches on screen? */
 extern int filock;              /* Do we want file-locking */
 extern int ttrow;               /* Row location of HW cursor */
 extern int ttcol;               /* Column location of HW cursor */
@@ -178,6 +180,8 @@ extern int *kbdptr;             /* current position in keyboard buf */
 extern int *kbdend;             /* ptr to end of the keyboard */
 extern int kbdmode;             /* current keyboard macro mode  */
 extern int kbdrep;              /* number of repetitions        */
+extern int kbd_compiled_play;   /* replaying a compiled macro   */
+extern int input_idle;          /* waiting for a command's 1st key */
 extern int restflag;            /* restricted use?              */
 extern int lastkey;             /* last keystoke                */
 extern int macbug;              /* macro debugging flag         */
@@ -224,6 +228,7 @@ extern int inreex;              /* Set when re-executing */
 
 extern unicode_t *eos_list;     /* List of end-of-sentence characters */
 extern int inmb;                /* Set when in minibuffer */
+extern int hold_lines;          /* Lines mustn't be remade (isearch) */
 extern int pathexpand;          /* Whether to expand paths */
 extern int silent;              /* Set for "no message line info" */
 extern db_dcl(savnam);          /* Saved buffer name */
@@ -256,7 +261,6 @@ extern mb_info_st mb_info;
 extern not_in_mb_st not_in_mb;
 extern const char *not_interactive_fname;
 
-extern int pause_key_index_update;  /* If set, don't update keytab index */
 
 extern prmpt_buf_st prmpt_buf;
 
@@ -312,6 +316,11 @@ extern struct buffer *execbp;
  */
 extern int srch_can_hunt;
 
+/* Counts of the items handed out by the search arenas, and of the
+ * malloc()s they made to do it.
+ */
+extern int srch_arena_use, srch_arena_mallocs;
+
 /* Counters (current, total) for repeating a user-procedure */
 
 extern int uproc_lpcount, uproc_lptotal, uproc_lpforced;
@@ -362,6 +371,7 @@ extern int gl_enc_len;          /* Global key length */
 #define CRYPT_MOD95     0x1000  /* Use the mod95 code */
 #define CRYPT_ONLYP     0x2000  /* Only work on printing chars */
 #define CRYPT_GLOBAL    0x4000  /* Use a global encryption key */
+#define CRYPT_STREAM    0x8000  /* Write with the stream cipher */
 
 /* Key setup mode */
 #define CRYPT_RAW         1
@@ -370,7 +380,11 @@ extern int gl_enc_len;          /* Global key length */
 
 /* Which bits may be set in crypt_mode */
 
-#define CRYPT_VALID (CRYPT_MOD95|CRYPT_ONLYP|CRYPT_GLOBAL|CRYPT_MODEMASK)
+#define CRYPT_VALID (CRYPT_MOD95|CRYPT_ONLYP|CRYPT_GLOBAL|CRYPT_STREAM|\
+     CRYPT_MODEMASK)
+
+/* Header of a stream cipher file - magic string + nonce */
+#define CC_HDR_LEN       16
 
 #endif  /* GLOBALS_C */
 
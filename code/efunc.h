@@ -48,6 +48,8 @@ extern int help(int, int);
 extern int not_in_mb_error(int, int);
 extern struct key_tab *getbyfnc(fn_t);
 extern struct key_tab *getbind(int);
+extern void init_keylookup(void);
+extern void reset_keylookup(int);
 extern int deskey(int, int);
 extern int buffertokey(int, int);
 extern int switch_internal(int, int);
@@ -55,6 +57,7 @@ extern int bindtokey(int, int);
 extern int unbindkey(int, int);
 extern int desbind(int, int);
 extern int apro(int, int);
+extern const char *startup_fname(const char *);
 extern int startup(const char *);
 extern void set_pathname(const char *);
 extern const char *transbind(const char *);
@@ -88,6 +91,11 @@ extern int setforcemode(int, int);
 #ifndef CRYPT_C
 extern void myencrypt(char *, int);
 extern int set_encryption_key(int, int);
+extern void stream_key(const char *, int);
+extern void stream_new_header(char *);
+extern int stream_check_header(const char *);
+extern void stream_end(void);
+extern void stream_crypt(char *, size_t, uint64_t);
 #endif
 
 /* display.c */
@@ -125,6 +133,8 @@ extern int stol(const char *);
 extern int gettyp(const char *);
 extern void getval(db *, db *);
 extern int setvar(int, int);
+extern int set_var(const char *, db *);
+extern const char *uvar_name(int);
 extern int delvar(int, int);
 #endif
 
@@ -137,6 +147,7 @@ extern int namedcmd(int, int);
 extern int execcmd(int, int);
 extern int storemac(int, int);
 extern void ptt_free(struct buffer *);
+extern int ptt_compile(struct buffer *);
 extern int storeproc(int, int);
 extern int storepttable(int, int);
 extern int set_pttable(int, int);
@@ -201,6 +212,7 @@ extern int cbuf40(int, int);
 extern const char *fixup_fname(const char *);
 extern const char *fixup_full(const char *);
 extern const char *get_uniqpath(const char *);
+extern const char *get_fullpath(const char *);
 extern void udir_init(void);
 extern void set_buffer_filenames(struct buffer *, const char *);
 extern int readin(const char *, int);
@@ -214,6 +226,12 @@ extern int viewfile(int, int);
 extern int writeout(const char *);
 extern int filewrite(int, int);
 extern int filesave(int, int);
+extern void bgsave_reap(void);
+extern void bgsave_finish(const char *);
+extern int bgsave_pending(void);
+extern int bgsave_fd(int);
+extern void bgsave_buffer_gone(struct buffer *);
+extern int bgfilesave(int, int);
 extern int filename(int, int);
 #endif
 
@@ -224,9 +242,24 @@ extern int ffropen(const char *);
 extern int ffwopen(const char *);
 extern int ffputline(const char *, int);
 extern int ffgetline(void);
+struct line_run;
+extern int ffbulk_start(int);
+extern int ffgetrun(struct line_run *);
+extern int ffreadtail(int, off_t *, int, struct line_run *);
 extern int fexist(const char *);
 #endif
 
+/* follow.c */
+#ifndef FOLLOW_C
+extern void follow_check(int);
+extern int following(void);
+extern int follow_fd(void);
+extern int follow_timeout(void);
+extern void follow_stop(struct buffer *);
+extern int follow_file(int, int);
+extern void follow_fork_close(void);
+#endif
+
 /* input.c */
 #ifndef INPUT_C
 extern unicode_t tgetc(void);
@@ -248,11 +281,30 @@ extern int fisearch(int, int);
 extern int risearch(int, int);
 #endif
 
+/* journal.c */
+#ifndef JOURNAL_C
+struct line;
+extern void jnl_insert(int, char, int);
+extern void jnl_newline(int);
+extern void jnl_delete(ue64I_t, int);
+extern void jnl_line(struct line *);
+extern void jnl_line_gone(struct line *);
+extern int jnl_sync(void);
+extern int jnl_covers(struct buffer *);
+extern void jnl_discard(struct buffer *);
+extern void jnl_close_all(void);
+extern void jnl_fork_close(void);
+extern void jnl_discard_all(void);
+extern int jnl_exists(const char *);
+extern int recover_journal(int, int);
+#endif
+
 /* lock.c */
 #ifndef LOCK_C
 extern int lock(const char *);
 extern int lockchk(const char *);
 extern int lockrel(void);
+extern int lockrel_file(const char *);
 #endif
 
 /* main.c */
@@ -281,9 +333,20 @@ extern int quickexit(int, int);
 extern void extend_keytab(int);
 #endif
 
+/* mapview.c */
+#ifndef MAPVIEW_C
+extern int mapview_start(struct buffer *, int);
+extern void mapview_stop(struct buffer *);
+extern void mapview_slide(void);
+extern int mapview_first_line(struct buffer *);
+extern int mapview_goto_line(int);
+extern int mapview_lines(int);
+extern int mapview_percent(struct window *);
+extern int mapview_scan(int (*)(void), int, const char *, struct line **);
+#endif
+
 /* names.c */
 #ifndef NAMES_C
-extern void init_namelookup(void);
 extern struct name_bind *func_info(fn_t);
 extern struct name_bind *name_info(const char *);
 extern int nxti_name_info(int);
@@ -296,7 +359,10 @@ extern const char *undolock(const char *);
 #endif
 
 /* posix.c */
+struct pollfd;
 #ifndef POSIX_C
+extern void idle_watch(int (*)(void), int (*)(struct pollfd *),
+     void (*)(struct pollfd *, int));
 extern void ttopen(void);
 extern void ttclose(void);
 extern int ttputc(int c);
@@ -356,6 +422,11 @@ extern int narrow(int, int);
 extern int widen(int, int);
 #endif
 
+/* revert.c */
+#ifndef REVERT_C
+extern int revert_file(int, int);
+#endif
+
 /* search.c */
 #ifndef SEARCH_C
 extern void init_search_ringbuffers(void);
@@ -369,9 +440,37 @@ extern int forwhunt(int, int);
 extern int forwsearch(int, int);
 extern int backhunt(int, int);
 extern int backsearch(int, int);
+extern void scanmore_push(void);
+extern void scanmore_pop(void);
 extern int scanmore(db *, int, int, int);
 extern int sreplace(int, int);
 extern int qreplace(int, int);
+extern int countmatches(int, int);
+extern int listmatches(int, int);
+extern void mcache_free(struct buffer *);
+extern int grepfiles(int, int);
+extern int gotogrepmatch(int, int);
+extern int line_matches(struct window *, struct line *, int **, int *);
+#endif
+
+/* server.c */
+#ifndef SERVER_C
+extern int server_start(void);
+extern void server_stop(void);
+extern void server_buffer_gone(struct buffer *);
+extern int server_done(int, int);
+extern int server_client(int, char **, int, int);
+extern void server_fork_close(void);
+#endif
+
+/* snapshot.c */
+#ifndef SNAPSHOT_C
+extern void snap_argv0(const char *);
+extern void snap_start(const char *);
+extern void snap_cancel(void);
+extern void snap_note_file(const char *);
+extern int snap_save(const char *);
+extern int snap_load(const char *, const char *);
 #endif
 
 /* spawn.c */
@@ -382,6 +481,12 @@ extern int spawn(int, int);
 extern int execprg(int, int);
 extern int pipecmd(int, int);
 extern int filter_buffer(int, int);
+extern int bgcmd_fd(void);
+extern void bgcmd_input(void);
+extern void bgcmd_stop(struct buffer *);
+extern void bgcmd_fork_close(void);
+extern int pipecmd_background(int, int);
+extern int kill_pipe_command(int, int);
 #endif
 
 /* window.c */
@@ -427,6 +532,8 @@ extern int wordcount(int, int);
 
 extern int wrapword(int, int);
 extern int eos_chars(int, int);
+extern void set_eos_list(const char *, int);
+extern const char *eos_setting(void);
 extern int fillpara(int, int);
 extern int justpara(int, int);
 extern int fillwhole(int, int);
@@ -498,9 +605,11 @@ extern void free_display(void);
 extern void free_eval(void);
 extern void free_exec(void);
 extern void free_file(void);
+extern void free_follow(void);
 extern void free_input(void);
 extern void free_line(void);
 extern void free_lock(void);
+extern void free_mapview(void);
 extern void free_names(void);
 extern void free_search(void);
 extern void free_spawn(void);
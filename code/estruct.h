@@ -74,6 +74,8 @@
 #define GGR_FULLWRAP    0x0004
 /* Allow overlapping matches while searching */
 #define GGR_SRCHOLAP    0x0008
+/* Keep the matches of a pattern for repeated hunts */
+#define GGR_HUNTCACHE   0x0010
 
 /* Internal constants. */
 
@@ -315,9 +317,13 @@ struct func_opts {
     unsigned int no_macbug :1;      /* No macbug display while running */
 };
 
-/* These are allocated in bfind()  and freed in zotbuf() */
+/* These are allocated in bfind()  and freed in zotbuf()
+ * They are also indexed by name in a hash table (in buffer.c), chained
+ * through b_hashp.
+ */
 struct buffer {
     struct buffer *b_bufp;  /* Link to next struct buffer   */
+    struct buffer *b_hashp; /* Next in buffer-name hash chain */
     struct line *b_linep;   /* Link to the header struct line */
     struct line *b_topline; /* Link to narrowed top text    */
     struct line *b_botline; /* Link to narrowed bottom text */
@@ -339,6 +345,8 @@ struct buffer {
     int b_active;           /* window activated flag        */
     int b_nwnd;             /* Count of windows on buffer   */
     int b_flag;             /* Flags                        */
+    unsigned int b_edits;   /* Count of changes made        */
+    struct match_cache *b_mcache;   /* Hunt match cache (search.c) */
 };
 
 #define BTNORM  0               /* A "normal" buffer            */
@@ -350,6 +358,8 @@ struct buffer {
 #define BFCHG   0x02            /* Changed since last write     */
 #define BFTRUNC 0x04            /* buffer was truncated when read */
 #define BFNAROW 0x08            /* buffer has been narrowed - GGR */
+#define BFFOLLOW 0x10           /* buffer is following its file */
+#define BFMAPPED 0x20           /* buffer is a view of a mapped file */
 
 /*      mode flags      */
 
@@ -536,6 +546,7 @@ struct while_block {
 #define RXARG_execprg       0x00000200
 #define RXARG_pipecmd       0x00000400
 #define RXARG_filter_buffer 0x00000800
+#define RXARG_pipecmd_background 0x00001000
 
 #define RX_ON  1
 #define RX_OFF 0
@@ -568,7 +579,8 @@ enum ev_val {
     EVSRCHCANHUNT,  EVULPCOUNT, EVULPTOTAL, EVULPFORCED,
     EVSDOPTS,   EVGGROPTS,      EVSYSTYPE,  EVPROCTYPE,
     EVFORCEMODEON,  EVFORCEMODEOFF,         EVPTTMODE,  EVVISMAC,
-    EVFILOCK,   EVCRYPT,    EVBRKTMS,   EVPPFXMAP,
+    EVFILOCK,   EVCRYPT,    EVBRKTMS,   EVPPFXMAP,  EVHILITEALL,
+    EVSRCHARUSE,    EVSRCHARMALLOC,
 };
 
 struct evlist {
@@ -1194,6 +1194,9 @@ static void gtenv(dbp_dcl(res), const char *vname) {
                             break;
     case EVVISMAC:          setval(ltos(vismac));
     case EVFILOCK:          setval(ltos(filock));
+    case EVHILITEALL:       setval(ltos(highlight_all));
+    case EVSRCHARUSE:       setval(ue_itoa(srch_arena_use));
+    case EVSRCHARMALLOC:    setval(ue_itoa(srch_arena_mallocs));
     case EVCRYPT:           setval(ue_itoa(crypt_mode));
     case EVBRKTMS: {
 /* We deal in ms, so need to convert from the s + ns of timespec */
@@ -1507,6 +1510,8 @@ static int svar(struct variable_description *var, dbp_dcl(val)) {
         case EVSYSTYPE:
         case EVFORCEMODEON:
         case EVFORCEMODEOFF:
+        case EVSRCHARUSE:
+        case EVSRCHARMALLOC:
             status = FALSE;
             break;
 
@@ -1596,6 +1601,7 @@ static int svar(struct variable_description *var, dbp_dcl(val)) {
 /* Just replace the current line's text with this text, and put dot at 0 */
             struct line *tlp = curwp->w.dotp;
             db_set(tlp->l_, value);
+            jnl_line(tlp);
             curwp->w.doto = 0;      /* Has to go somewhere */
             break;
         case EVTAB:
@@ -1704,6 +1710,9 @@ static int svar(struct variable_description *var, dbp_dcl(val)) {
         case EVFILOCK:
             filock = stol(value);
             break;
+        case EVHILITEALL:
+            highlight_all = stol(value);
+            break;
         case EVCRYPT: {
             int new_mode = ue_atoi(value);
             int fail = 0;
@@ -1888,6 +1897,22 @@ exit:
     return status;
 }
 
+/* Set a variable by name, outside of any macro.
+ * Used to restore a start-up snapshot.
+ */
+int set_var(const char *name, db *value) {
+    struct variable_description vd;
+    findvar(name, &vd, TRUE);
+    if (vd.v_type == -1) return FALSE;
+    return svar(&vd, value);
+}
+
+/* The name of the i'th user variable, or NULL once past the last one. */
+const char *uvar_name(int i) {
+    if ((i >= MAXVARS) || (uv[i].name[0] == '\0')) return NULL;
+    return uv[i].name;
+}
+
 /* Delete a user (%xxx) or buffer (.xxx) var.
  * These have the same structure - so we just need to know the pointer
  * of the one to delete. we just need to know how many is in the list sent
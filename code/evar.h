@@ -81,6 +81,9 @@ struct evlist evl[] = {
  { "crypt_mode", EVCRYPT },     /* Crypt mode to use (default NONE) */
  { "brkt_ms", EVBRKTMS },       /* Pause time (ms) for bracket matching */
  { "path_pfx_map", EVPPFXMAP }, /* Prefices to ignore in pathname */
+ { "highlight_all", EVHILITEALL },  /* Show all search matches? */
+ { "srch_arena_use", EVSRCHARUSE },  /* Search arena items (read-only) */
+ { "srch_arena_mallocs", EVSRCHARMALLOC }, /* ...and mallocs (read-only) */
 };
 
 /* The tags for user functions - used in struct evlist */
@@ -509,7 +509,7 @@ static const char* get_display_code(const char *buf) {
 /* GGR
  * Compile the contents of a buffer into a ptt_remap structure
  */
-static int ptt_compile(struct buffer *bp) {
+int ptt_compile(struct buffer *bp) {
     const char *ml_display_code;
 
     db_upstrdef(lbuf);
@@ -1054,7 +1054,6 @@ int dobuf(struct buffer *bp) {
     struct while_block *whtemp;     /* temporary ptr to a struct while_block */
     char *einit = NULL;      /* Initial val of eline - set on first call */
     int return_stat = TRUE;  /* What we expect to do */
-    int orig_pause_key_index_update;    /* State on entry - to be restored */
 
     db_strdef(tkn);         /* buffer to evaluate an expresion in */
     db_strdef(golabel);
@@ -1084,9 +1083,6 @@ int dobuf(struct buffer *bp) {
     bp->b_mode |= MDVIEW;
     bp->b_exec_level++;
 
-    orig_pause_key_index_update = pause_key_index_update;
-    pause_key_index_update = 1;
-
 /* Clear IF level flags/while ptr */
     execlevel = 0;
     whlist = NULL;
@@ -1452,7 +1448,6 @@ nxtscan:                /* On to the next line */
             bp->b.dotp = lp;
             bp->b.doto = 0;
             execlevel = 0;
-            pause_key_index_update = orig_pause_key_index_update;
             Xfree(einit);
             goto single_exit;
         }
@@ -1479,7 +1474,6 @@ failexit2:
 
 failexit:
     freewhile(whlist);      /* Run this here for all exits */
-    pause_key_index_update = orig_pause_key_index_update;
 
 /* If this was (meant to be) a procedure buffer, we must switch that off
  * so that we don't try to run it...
@@ -1790,6 +1784,7 @@ int dofile(const char *fname) {
         return status;
     }
     pathexpand = TRUE;      /* GGR */
+    snap_note_file(fixup_fname(fname));
 
 /* Go execute it! */
     curbp = cb;             /* restore the current buffer */
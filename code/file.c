@@ -16,6 +16,9 @@
 #include <alloca.h>
 #endif
 #include <sys/mman.h>
+#include <sys/wait.h>
+#include <fcntl.h>
+#include <errno.h>
 
 #define FILE_C
 
@@ -43,6 +46,9 @@
  *  This is to ensure that ../file and ~/file are treated the same
  *  as the full path to the file.
  *
+ * get_fullpath:
+ *  get_uniqpath(), never shortened - so as a buffer's b_rpname.
+ *
  * THESE ALL RETURN A POINTER TO AN INTERNAL static char ARRAY.
  * The CALLER must handle appropriately.
  */
@@ -309,6 +315,15 @@ const char *get_uniqpath(const char *fn) {
     return db_val(rp_res);
 }
 
+/* get_fullpath
+ */
+const char *get_fullpath(const char *fn) {
+    force_full = 1;
+    const char *res = get_uniqpath(fn);
+    force_full = 0;
+    return res;
+}
+
 /* It's simpler for us to ensure that we have a trailing / on the udirs */
 
 static char *ensure_trailing_slash(char *inp) {
@@ -425,9 +440,9 @@ static int resetkey(void) { /* Reset the encryption key if needed */
 
     if (klen == 0) {        /* No key set - so get one */
         s = set_encryption_key(FALSE, 0);
-/* if this succeeded, things will be fully set */
-        if (s == TRUE) cryptflag = TRUE;    /* let others know... */
-        return s;
+        if (s != TRUE) return s;
+        klen = (crypt_mode & CRYPT_GLOBAL)? gl_enc_len: curbp->b_keylen;
+        ukey = (crypt_mode & CRYPT_GLOBAL)? gl_enc_key: curbp->b_key;
     }
     cryptflag = TRUE;           /* let others know... */
 
@@ -441,9 +456,12 @@ static int resetkey(void) { /* Reset the encryption key if needed */
  * and that is covered by the ukey/klen fetch above.
  * Since we aren't setting the length here, we don't need the indirection
  * of *klenp used in set_encryption_key() itself.
+ * A newly set key goes through this too, as that is also where the
+ * (unencrypted) key is passed to the stream cipher.
  */
     myencrypt((char *) NULL, 0);
     myencrypt(ukey, klen);
+    stream_key(ukey, klen);     /* The stream cipher wants it raw */
     myencrypt((char *) NULL, 0);
     myencrypt(ukey, klen);
     return TRUE;
@@ -459,6 +477,7 @@ static int resetkey(void) { /* Reset the encryption key if needed */
  *  whether it is a dos_file in dos_file.
  */
 static int nlines, dos_file;
+static int view_mapped = 0;     /* Set by view-file for readin() */
 static int file2buf(struct line *iline, const char *mode, int goto_end,
      int check_dos) {
     int s;
@@ -466,6 +485,29 @@ static int file2buf(struct line *iline, const char *mode, int goto_end,
 
     nlines = 0;
     dos_file = FALSE;
+
+/* A large file is read by the pipelined loader, which hands us runs of
+ * lines (with any CRs already removed) to link in.
+ */
+    if (ffbulk_start(check_dos)) {
+        struct line_run run;
+        while ((s = ffgetrun(&run)) == FIOSUC) {
+            lp0 = iline;
+            lp2 = lp0->l_fp;
+            lp2->l_bp = run.last;
+            lp0->l_fp = run.first;
+            run.first->l_bp = lp0;
+            run.last->l_fp = lp2;
+            iline = run.last;
+            dos_file = run.dos;
+            int was = nlines;
+            nlines += run.nlines;
+            if ((nlines/300 != was/300) && !silent)
+                mlwrite(MLbkt("%s file") " : %d lines", mode, nlines);
+        }
+        goto done;
+    }
+
     while ((s = ffgetline()) == FIOSUC) {
         lp1 = fline;            /* Allocate by ffgetline..*/
         lp0 = iline;            /* line previous to insert */
@@ -492,6 +534,7 @@ static int file2buf(struct line *iline, const char *mode, int goto_end,
         if (!(++nlines % 300) && !silent)   /* GGR */
              mlwrite(MLbkt("%s file") " : %d lines", mode, nlines);
     }
+done:
     if (goto_end) curwp->w.dotp = iline;
     ffclose();              /* Ignore errors. */
     return s;
@@ -587,7 +630,14 @@ int readin(const char *fname, int lockfl) {
 /* NOTE! that all of the above (in particular) filehooks and Esc-Spec-R
  * are run *before* the file is read into the buffer.
  * We use the full name based on what the user gave.
+ * view-file may want a large file mapped instead of read in.
  */
+    if (view_mapped && !cryptflag && mapview_start(bp, view_mapped > 1)) {
+        db_set(readin_mesg, MLbkt("Mapped file - lines are read as viewed"));
+        if (!silent) mlwrite_one(db_val(readin_mesg));
+        s = FIOSUC;
+        goto out;
+    }
     s = ffropen(bp->b_rpname);
     if (s == FIOERR) {          /* Hard open failure. */
         db_set(readin_mesg, MLbkt("Can't open!"));
@@ -616,6 +666,8 @@ int readin(const char *fname, int lockfl) {
         mlwrite_one(db_val(readin_mesg));
         if (s == FIOERR) sleep(1);   /* Let it be seen */
     }
+    if (!silent && jnl_exists(curbp->b_rpname))
+        mlwrite_one(MLbkt("Unsaved changes were journalled - use recover-journal"));
 
 out:
     for (wp = wheadp; wp != NULL; wp = wp->w_wndp) {
@@ -672,6 +724,8 @@ static int ifile(const char *fname) {
     bp = curbp;             /* Cheap.               */
     bp->b_flag |= BFCHG;    /* we have changed      */
     bp->b_flag &= ~BFINVS;  /* and are not temporary */
+    bp->b_edits++;
+    jnl_discard(bp);        /* Can't journal this */
 
 /* If we are modfying the buffer that the match-group info points
  * to we have to mark them as invalid.
@@ -883,7 +937,7 @@ int getfile(const char *fname, int lockfl, int check_dir) {
  *          read the file into that buffer
  * We just use the first we come to....
  */
-    const char *testp = get_uniqpath(lfn);
+    const char *testp = get_fullpath(lfn);
     int found = 0;
     int moved_to = 0;
     for (bp = bheadp; bp != NULL; bp = bp->b_bufp) {
@@ -961,8 +1015,11 @@ exit:
     return s;
 }
 
+/* A file of 64MB or more (or any file, given an argument) is viewed
+ * through mmap() - see mapview.c.
+ */
 int viewfile(int f, int n) {    /* Visit a file in VIEW mode */
-    UNUSED(f); UNUSED(n);
+    UNUSED(n);
     int s;                      /* Status return */
     struct window *wp;          /* Scan for windows that need updating */
 
@@ -972,7 +1029,9 @@ int viewfile(int f, int n) {    /* Visit a file in VIEW mode */
     if ((s = mlreply("View file: ", &fname, CMPLT_FILE)) != TRUE)
         goto exit;
     run_filehooks = 1;          /* Set flag */
+    view_mapped = f? 2: 1;      /* Map a large file (any, with an arg) */
     s = getfile(db_val(fname), FALSE, TRUE);
+    view_mapped = 0;
     if (s) {                    /* If we succeed, put it in view mode */
         curwp->w_bufp->b_mode |= MDVIEW;
 
@@ -988,6 +1047,8 @@ exit:
     return s;
 }
 
+void bgsave_finish(const char *);    /* Forward declaration */
+
 /* This function performs the details of file writing.
  * Uses the file management routines in the "fileio.c" package.
  * The number of lines written is displayed.
@@ -998,9 +1059,14 @@ int writeout(const char *fn) {
     struct line *lp;
     int nline;
 
+    if (curbp->b_flag & BFMAPPED) {     /* It's only a part of the file */
+        mlwrite_one("Can't write out a mapped file view");
+        return FALSE;
+    }
     s = resetkey();
     if (s != TRUE) return s;
 
+    bgsave_finish(fn);          /* Don't write it twice at once */
     if ((s = ffwopen(fn)) != FIOSUC) return FALSE;  /* Open writes message */
 
     mlwrite_one(MLbkt("Writing..."));       /* tell us were writing */
@@ -1015,7 +1081,10 @@ int writeout(const char *fn) {
         lp = lforw(lp);
     }
     if (s == FIOSUC) {                      /* No write error.      */
-        ffputline(MAP_FAILED, 0);           /* Must flush write cache!! */
+/* Must flush write cache!! This can write out a lot of lines. */
+        s = ffputline(MAP_FAILED, 0);
+    }
+    if (s == FIOSUC) {                      /* No flush error.      */
         s = ffclose();
         if (s == FIOSUC) {                  /* No close error.      */
             mlwrite(MLbkt("Wrote %d line%s"), nline, (nline == 1)? "": "s");
@@ -1046,6 +1115,7 @@ int filewrite(int f, int n) {
     if ((s = writeout(db_val(fname))) == TRUE) {
         set_buffer_filenames(curbp, db_val(fname));
         curbp->b_flag &= ~BFCHG;
+        jnl_discard(curbp);
         wp = wheadp;        /* Update mode lines.   */
         while (wp != NULL) {
             if (wp->w_bufp == curbp) wp->w_flag |= WFMODE;
@@ -1095,6 +1165,7 @@ int filesave(int f, int n) {
 
     if ((s = writeout(curbp->b_rpname)) == TRUE) {
         curbp->b_flag &= ~BFCHG;
+        jnl_discard(curbp);
         wp = wheadp;            /* Update mode lines. */
         while (wp != NULL) {
             if (wp->w_bufp == curbp) wp->w_flag |= WFMODE;
@@ -1104,6 +1175,166 @@ int filesave(int f, int n) {
     return s;
 }
 
+/* ======================================================================
+ * Background saving.
+ * The save is done by a forked child, which gets a copy-on-write snapshot
+ * of the buffer from the kernel, so editing can carry on while the file
+ * is written. The parent keeps the read end of a pipe whose write end
+ * only the child has, so that it can poll() for the child finishing (the
+ * pipe reaches EOF when it exits). The child's exit status is the errno
+ * of any failure.
+ * When the save has worked the buffer is marked as unchanged, unless it
+ * has been changed since the snapshot was taken.
+ */
+static struct bg_save {
+    struct buffer *bp;      /* NULL once the buffer has gone */
+    char *fname;
+    unsigned int edits;     /* bp->b_edits at the snapshot */
+    pid_t pid;
+    int fd;
+} *bgsaves = NULL;
+static int nbgsaves = 0;
+
+/* Report on a finished background save, and drop its entry. */
+static void bgsave_done(int si, int wstatus) {
+    struct bg_save *bsp = bgsaves + si;
+    int err = WIFEXITED(wstatus)? WEXITSTATUS(wstatus): 255;
+
+    if (err == 0) {
+        struct buffer *bp = bsp->bp;
+        if (bp && (bp->b_edits == bsp->edits) &&
+             !strcmp(bp->b_rpname, bsp->fname)) {
+            bp->b_flag &= ~BFCHG;
+            for (struct window *wp = wheadp; wp; wp = wp->w_wndp)
+                if (wp->w_bufp == bp) wp->w_flag |= WFMODE;
+        }
+/* Any journal is no longer for the file as it is */
+        if (bp) jnl_discard(bp);
+        mlwrite(MLbkt("Saved %s"), bsp->fname);
+    }
+    else if (err == 255)
+        mlwrite("Background save of %s failed", bsp->fname);
+    else
+        mlwrite("Background save of %s failed: %s", bsp->fname,
+             strerror(err));
+    close(bsp->fd);
+    Xfree(bsp->fname);
+    *bsp = bgsaves[--nbgsaves];
+    return;
+}
+
+/* Deal with any background saves that have finished. */
+void bgsave_reap(void) {
+    for (int si = 0; si < nbgsaves; ) {
+        int wstatus;
+        pid_t pid = waitpid(bgsaves[si].pid, &wstatus, WNOHANG);
+        if (pid == 0) si++;                 /* Still going */
+        else {
+            if (pid < 0) wstatus = 255 << 8;    /* Lost it?! */
+            bgsave_done(si, wstatus);
+        }
+    }
+    return;
+}
+
+/* Wait for any background save of fname (all of them for NULL) to
+ * finish.
+ */
+void bgsave_finish(const char *fname) {
+    for (int si = 0; si < nbgsaves; ) {
+        if (fname && strcmp(bgsaves[si].fname, fname)) {
+            si++;
+            continue;
+        }
+        int wstatus;
+        while ((waitpid(bgsaves[si].pid, &wstatus, 0) < 0) &&
+             (errno == EINTR));
+        bgsave_done(si, wstatus);
+    }
+    return;
+}
+
+/* How many background saves are running, and the fd to poll() for
+ * each of them finishing.
+ */
+int bgsave_pending(void) {
+    return nbgsaves;
+}
+int bgsave_fd(int si) {
+    return bgsaves[si].fd;
+}
+
+/* The buffer has been deleted. Called by zotbuf(). */
+void bgsave_buffer_gone(struct buffer *bp) {
+    for (int si = 0; si < nbgsaves; si++)
+        if (bgsaves[si].bp == bp) bgsaves[si].bp = NULL;
+    return;
+}
+
+/* Start a background save of the current buffer.
+ * Returns FALSE if it could not be started.
+ */
+static int bgsave_start(void) {
+    int pfd[2];
+
+    for (int si = 0; si < nbgsaves; si++)   /* Already on the way... */
+        if (!strcmp(bgsaves[si].fname, curbp->b_rpname)) return TRUE;
+
+    if (pipe(pfd) < 0) return FALSE;
+    TTflush();                  /* So the child has nothing pending */
+    pid_t pid = fork();
+    if (pid < 0) {
+        close(pfd[0]);
+        close(pfd[1]);
+        return FALSE;
+    }
+    if (pid == 0) {             /* The child - just write the file */
+        close(pfd[0]);
+        for (int si = 0; si < nbgsaves; si++) close(bgsaves[si].fd);
+        nbgsaves = 0;
+        server_fork_close();    /* A hung save mustn't hold these open */
+        bgcmd_fork_close();
+        follow_fork_close();
+        jnl_fork_close();
+        int nfd = open("/dev/null", O_WRONLY);  /* Keep off the screen */
+        if (nfd >= 0) dup2(nfd, 1);
+        discmd = FALSE;
+        silent = TRUE;
+        errno = 0;
+        int status = writeout(curbp->b_rpname);
+        int err = errno;
+        if (status == TRUE) _exit(0);
+        _exit(((err > 0) && (err < 255))? err: 255);
+    }
+    close(pfd[1]);
+    fcntl(pfd[0], F_SETFD, FD_CLOEXEC);
+    bgsaves = Xrealloc(bgsaves, (size_t)(nbgsaves+1)*sizeof(struct bg_save));
+    bgsaves[nbgsaves].bp = curbp;
+    bgsaves[nbgsaves].fname = Xstrdup(curbp->b_rpname);
+    bgsaves[nbgsaves].edits = curbp->b_edits;
+    bgsaves[nbgsaves].pid = pid;
+    bgsaves[nbgsaves].fd = pfd[0];
+    nbgsaves++;
+    return TRUE;
+}
+
+/* Save the current buffer, if it has changed, in the background.
+ * Used by auto-save mode.
+ * Anything that needs asking about (a truncated or narrowed buffer)
+ * goes to the normal save-file, as does any failure to start.
+ */
+int bgfilesave(int f, int n) {
+    if (curbp->b_mode & MDVIEW) /* Don't allow this command if  */
+        return rdonly();        /* we are in read only mode     */
+    if (!f && (curbp->b_flag & BFCHG) == 0) /* Return, no changes.  */
+        return TRUE;
+    if ((*(curbp->b_rpname) == 0) ||
+         (curbp->b_flag & (BFTRUNC | BFNAROW)) ||
+         !bgsave_start())
+        return filesave(f, n);
+    return TRUE;
+}
+
 /* The command allows the user to modify the file name associated with
  * the current buffer.
  * It is like the "f" command in UNIX "ed".
@@ -1122,6 +1353,7 @@ int filename(int f, int n) {
     if ((s = mlreply("Name: ", &fname, CMPLT_FILE)) == ABORT)
         goto exit;
     set_buffer_filenames(curbp, (s == FALSE)? "": db_val(fname));
+    jnl_discard(curbp);         /* It was for the old file */
 
     for (struct window *wp = wheadp; wp != NULL; wp = wp->w_wndp) {
         if (wp->w_bufp == curbp) wp->w_flag |= WFMODE;
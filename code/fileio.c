@@ -7,10 +7,14 @@
  */
 
 #include <stdio.h>
+#include <limits.h>
 #include <unistd.h>
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <sys/mman.h>
+#include <sys/uio.h>
+#include <signal.h>
+#include <pthread.h>
 
 #define FILEIO_C
 
@@ -40,18 +44,54 @@ static struct {
 #define FILE_START_LEN 100
 static int file_type;   /* -1 binary, 0 unknown, +1 text */
 
+/* Writing without encryption doesn't need to change any bytes, so rather
+ * than copying each line into the cache we collect pointers to the line
+ * texts (and to a shared newline string between them) and hand batches
+ * of them to writev().
+ * The cache then just holds the first FILE_START_LEN bytes, for
+ * file_is_binary().
+ */
+#ifdef IOV_MAX
+#define NIOV IOV_MAX
+#else
+#define NIOV 1024               /* The usual IOV_MAX */
+#endif
+static struct iovec iov[NIOV];
+static int niov;
+static int niov_max;            /* sysconf()'s limit, capped at NIOV */
+static int use_iov;             /* Writing via iov[] rather than cache */
+
+/* A file in the stream cipher format (see crypt.c) has a header, which
+ * goes out at the start of the write cache (unencrypted) or is checked
+ * for on the first read. stream_off is the offset of the next data to
+ * en/decrypt, after the header.
+ */
+static int use_stream;
+static int cache_hdr;           /* Header bytes at the start of the cache */
+static int first_read;
+static uint64_t stream_off;
+
+static off_t file_size;         /* Of the file open for reading */
+static void bulk_stop(void);
+static int bulk_active;
+
 /* Close the ffp file descriptor. Should look at the status in all systems.
  */
 static int ffp_mode;
 int ffclose(void) {
 
     int error_number = -1;
+    if (bulk_active) bulk_stop();
     if (ffp_mode == O_WRONLY) {
         if (fdatasync(ffp) < 0) error_number = errno;
     }
     if (close(ffp) < 0) {
         if (error_number != -1) error_number = errno;
     }
+    if (use_stream) {
+        stream_end();
+        use_stream = 0;
+    }
     if (error_number != -1) {
         mlwrite("Error closing file: %s", strerror(error_number));
         return FIOERR;
@@ -83,6 +123,7 @@ int ffropen(const char *fn) {
             mlwrite("Not a file: %s", fn);
             status = FIOERR;        /* So we close&exit... */
         }
+        file_size = statbuf.st_size;
     }
     if (status != FIOSUC) {
         ffclose();
@@ -94,6 +135,9 @@ int ffropen(const char *fn) {
 /* Unset these on open */
     cache.rst = cache.len = 0;
     curbp->b_EOLmissing = 0;
+    first_read = 1;
+    use_stream = 0;
+    stream_off = 0;
 
     return FIOSUC;
 }
@@ -117,14 +161,28 @@ int ffwopen(const char *fn) {
 
     cache.rst = cache.len = 0;
     file_type = 0;      /* Unkown... */
+    niov = 0;
+    use_iov = !cryptflag;
+    if (!niov_max) {
+        long lim = sysconf(_SC_IOV_MAX);
+        niov_max = ((lim > 0) && (lim < NIOV))? (int)lim: NIOV;
+    }
+    use_stream = cryptflag && (crypt_mode & CRYPT_STREAM);
+    cache_hdr = 0;
+    stream_off = 0;
+    if (use_stream) {
+        stream_new_header(cache.buf);
+        cache.len = cache_hdr = CC_HDR_LEN;
+    }
 
     return FIOSUC;
 }
 
 /* Write a line to the already opened file. The "buf" points to the buffer,
  * and the "nbuf" is its length, less the free newline. Return the status.
- * Now done using a write-cache, so our caller needs to do a final
- * ffputline() call with a NULL buf arg to flush the last part of the cache.
+ * Now done using a write-cache (or a list of pending writev() entries),
+ * so our caller needs to do a final ffputline() call with a MAP_FAILED
+ * buf arg to flush the last part of it.
  *
  * NOTE!!!
  * We wish to handle files which didn't have a newline at the EOF in a
@@ -206,7 +264,13 @@ static int file_is_binary(void) {
  * truncated. We now loop until everything is written or write() fails.
  */
 static int flush_write_cache(void) {
-    if (cryptflag) myencrypt(cache.buf, cache.len);
+    if (use_stream) {
+        size_t clen = (size_t)(cache.len - cache_hdr);
+        stream_crypt(cache.buf + cache_hdr, clen, stream_off);
+        stream_off += clen;
+        cache_hdr = 0;
+    }
+    else if (cryptflag) myencrypt(cache.buf, cache.len);
     size_t off = 0;
     while (off < (size_t)cache.len) {
         errno = 0;
@@ -226,9 +290,95 @@ static int flush_write_cache(void) {
     return FIOSUC;
 }
 
+/* Routine to flush the pending writev() entries.
+ * As with flush_write_cache(), a short write is continued from wherever
+ * it got to.
+ */
+static int flush_iov(void) {
+    struct iovec *ivp = iov;
+    int left = niov;
+    while (left > 0) {
+        errno = 0;
+        ssize_t written = writev(ffp, ivp, left);
+        if (written < 0) {
+            if (errno == EINTR) continue;       /* Interrupted; retry */
+            mlwrite("Write I/O error: %s", strerror(errno));
+            return FIOERR;
+        }
+        if (written == 0) {                     /* Shouldn't happen */
+            mlwrite_one("Write I/O error: zero-length write");
+            return FIOERR;
+        }
+        size_t done = (size_t)written;
+        while ((left > 0) && (done >= ivp->iov_len)) {
+            done -= ivp->iov_len;
+            ivp++;
+            left--;
+        }
+        if (left > 0) {         /* Part-way through an entry */
+            ivp->iov_base = (char *)ivp->iov_base + done;
+            ivp->iov_len -= done;
+        }
+    }
+    niov = 0;
+    return FIOSUC;
+}
+
+/* Add some bytes to the output.
+ * For writev() the bytes must stay put until they have been flushed,
+ * which is the case for buffer text (nothing changes it while we are
+ * writing it out) and the static newline strings.
+ */
+static int put_bytes(const char *buf, int nbuf) {
+    int status;
+
+    if (nbuf <= 0) return FIOSUC;
+    if (use_iov) {
+        if (cache.len < FILE_START_LEN) {   /* Keep a sample to check */
+            int to_fill = FILE_START_LEN - cache.len;
+            if (to_fill > nbuf) to_fill = nbuf;
+            memcpy(cache.buf+cache.len, buf, (size_t)to_fill);
+            cache.len += to_fill;
+        }
+        iov[niov].iov_base = (void *)buf;
+        iov[niov].iov_len = (size_t)nbuf;
+        if (++niov == niov_max) return flush_iov();
+        return FIOSUC;
+    }
+
+    while(nbuf > 0) {
+        int to_fill;
+        if ((cache.len + nbuf) <= CSIZE) to_fill = nbuf;
+        else to_fill = CSIZE - cache.len;
+        memcpy(cache.buf+cache.len, buf, (size_t)to_fill);
+
+/* Check the first FILE_START_LEN bytes once we have them.
+ * Once the check has run file_type will be set to non-zero.
+ */
+        if (!file_type && (cache.len >= FILE_START_LEN)) {
+            file_type = file_is_binary();
+        }
+
+        nbuf -= to_fill;        /* bytes left */
+        cache.len += to_fill;   /* valid in cache */
+        buf += to_fill;         /* new start of input */
+        if (nbuf > 0) {         /* More to go, so flush cache */
+            status = flush_write_cache();
+            if (status != FIOSUC) return status;
+        }
+    }
+    return FIOSUC;
+}
+
+/* The newline to put between lines. */
+static int put_newline(void) {
+    if ((curbp->b_mode & MDDOSLE) == 0) return put_bytes("\n", 1);
+    else                                return put_bytes("\r\n", 2);
+}
+
 /* The actual callable function.
  * We don't know whether to add the newline at the EOF until we get there
- * and the only time we know that is when we are called with a NULL
+ * and the only time we know that is when we are called with a MAP_FAILED
  * buffer to do the final flush.
  * So what we do is out put a newline *before* the line text we have
  * been sent and use the otherwise unused cache.rst variable to note
@@ -236,7 +386,6 @@ static int flush_write_cache(void) {
  */
 int ffputline(const char *buf, int nbuf) {
 
-    static int doing_newline = 0;
     int status;
 
 /* If we've been called with this specific value for buf (an invalid pointer,
@@ -250,7 +399,7 @@ int ffputline(const char *buf, int nbuf) {
             if (cryptflag) reason = "crypt";
             else {
 /* For a small file we might not have triggered the test in the loop below,
- * so check it now.
+ * so check it now. When writing via writev() this is the only check.
  */
                 if (!file_type) file_type = file_is_binary();
                 if (file_type == -1) reason = "binary";
@@ -266,57 +415,25 @@ int ffputline(const char *buf, int nbuf) {
             sleep(1);   /* "Wrote <n> lines" will overwrite minibuffer */
         }
         else {
-            if (cache.rst != 0 && !doing_newline) {
-                doing_newline = 1;
-                if ((curbp->b_mode & MDDOSLE) == 0)
-                   status = ffputline("\n", 1);
-                else
-                   status = ffputline("\r\n", 2);
-                doing_newline = 0;
+            if (cache.rst != 0) {
+                status = put_newline();
                 if (status != FIOSUC) return status;
             }
         }
+        if (use_iov) return flush_iov();
         return flush_write_cache();
     }
 
 /* If not the first call for an output file add a newline,
- * which we won't have been sent
- * It's convenient to do this via a recursive call, provided we
- * note that we are doing it, so don't continue to do so..
- */
-    if (cache.rst != 0 && !doing_newline) {
-        doing_newline = 1;
-        if ((curbp->b_mode & MDDOSLE) == 0)
-            status = ffputline("\n", 1);
-        else
-            status = ffputline("\r\n", 2);
-        doing_newline = 0;
+ * which we won't have been sent.
+ */
+    if (cache.rst != 0) {
+        status = put_newline();
         if (status != FIOSUC) return status;
     }
     cache.rst = 1;          /* Set the "seen first line" flag */
 
-    while(nbuf > 0) {
-        int to_fill;
-        if ((cache.len + nbuf) <= CSIZE) to_fill = nbuf;
-        else to_fill = CSIZE - cache.len;
-        memcpy(cache.buf+cache.len, buf, (size_t)to_fill);
-
-/* Check the first FILE_START_LEN bytes once we have them.
- * Once the check has run file_type will be set to non-zero.
- */
-        if (!file_type && (cache.len >= FILE_START_LEN)) {
-            file_type = file_is_binary();
-        }
-
-        nbuf -= to_fill;        /* bytes left */
-        cache.len += to_fill;   /* valid in cache */
-        buf += to_fill;         /* new start of input */
-        if (nbuf > 0) {         /* More to go, so flush cache */
-            status = flush_write_cache();
-            if (status != FIOSUC) return status;
-        }
-    }
-    return FIOSUC;
+    return put_bytes(buf, nbuf);
 }
 
 /* Read a line from a file, and store the bytes into a global, Xmalloc()ed
@@ -373,6 +490,18 @@ int ffgetline(void) {
                 return FIOERR;
             }
             cache.rst = 0;
+/* A file in the stream cipher format is recognized by its header,
+ * which we skip.
+ */
+            if (first_read) {
+                first_read = 0;
+                if (cryptflag && (cache.len >= CC_HDR_LEN) &&
+                     stream_check_header(cache.buf)) {
+                    use_stream = 1;
+                    cache.rst = CC_HDR_LEN;
+                    cache.len -= CC_HDR_LEN;
+                }
+            }
 /* If we are at the end...return it.
  * But - if we still have cached data then there was no final
  * newline, but we still have to return that, and warn about the
@@ -393,7 +522,12 @@ int ffgetline(void) {
                 }
                 return lused(fline)? FIOSUC: FIOEOF;
             }
-            if (cryptflag) myencrypt(cache.buf, cache.len);
+            if (use_stream) {
+                stream_crypt(cache.buf + cache.rst, (size_t)cache.len,
+                     stream_off);
+                stream_off += (uint64_t)cache.len;
+            }
+            else if (cryptflag) myencrypt(cache.buf, cache.len);
         }
     }
     int cc = (int)(nlp - (cache.buf+cache.rst));
@@ -404,6 +538,478 @@ int ffgetline(void) {
     return FIOSUC;
 }
 
+/* -+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+- */
+/* The pipelined loader for large files.
+ *
+ * ffgetline() does everything in turn - read(), decrypting, looking for
+ * the newlines and allocating the lines - so on a fast disk reading a
+ * large file is limited by the CPU. For files of at least BULK_MIN bytes
+ * file2buf() uses this instead, which runs those steps on separate
+ * threads as a pipeline over BULK_SLOTS blocks of BULK_BLOCK bytes:
+ *
+ *  bulk_reader()   read()s the blocks, in order.
+ *  bulk_decoder()  decrypts them, in order (as myencrypt() must be),
+ *                  skips any stream cipher header and decides whether
+ *                  this is a DOS file.
+ *  bulk_splitter() (one or more of them) takes any decoded block and
+ *                  makes the complete lines within it into a line run,
+ *                  leaving the part-lines at its start and end.
+ *  ffgetrun()      (in the main thread) joins the part-lines across
+ *                  consecutive blocks and returns the runs, in order,
+ *                  for file2buf() to link in.
+ *
+ * A slot is free for the next block once ffgetrun() has taken its lines.
+ * All state changes are made under one mutex and signalled on one
+ * condition variable - there are only a few per block.
+ */
+#define BULK_MIN        (4 << 20)
+#define BULK_BLOCK      (1 << 20)
+#define BULK_SLOTS      8
+#define BULK_SPLITTERS  4           /* At most */
+
+enum bulk_state { BK_FREE, BK_READ, BK_DECODED, BK_SPLITTING, BK_SPLIT };
+
+struct bulk_slot {
+    enum bulk_state state;
+    int seq;                    /* Block number */
+    char *buf;
+    size_t start, len;          /* The data is buf[start] to buf[len-1] */
+    int has_nl;                 /* Whether there is a newline at all */
+    size_t head;                /* Bytes from start to the first newline */
+    size_t tail;                /* Offset in buf after the last newline */
+    struct line_run run;        /* The complete lines in between */
+    int nomem;                  /* The lines couldn't all be allocated */
+};
+
+static pthread_mutex_t bulk_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t bulk_change = PTHREAD_COND_INITIALIZER;
+static struct {
+    pthread_t reader, decoder, splitter[BULK_SPLITTERS];
+    int nsplit;
+    int stop;                   /* Tell the threads to finish */
+    int decode_seq, split_seq, use_seq;     /* Next block for each */
+    int eof_seq;                /* Number of blocks (-1 until known) */
+    int read_errno;
+    int dos, dos_known, prev_cr;
+    int check_dos;
+    int nomem;                  /* A splitter ran out of memory */
+    struct line *part;          /* Line carried over to the next block */
+    struct bulk_slot slot[BULK_SLOTS];
+} bulk;
+
+#define BULK_LOCK()     pthread_mutex_lock(&bulk_lock)
+#define BULK_UNLOCK()   pthread_mutex_unlock(&bulk_lock)
+#define BULK_WAIT()     pthread_cond_wait(&bulk_change, &bulk_lock)
+#define BULK_SIGNAL()   pthread_cond_broadcast(&bulk_change)
+
+static void *bulk_reader(void *arg) {
+    UNUSED(arg);
+    int seq = 0;
+
+    BULK_LOCK();
+    while (!bulk.stop) {
+        struct bulk_slot *sp = &bulk.slot[seq % BULK_SLOTS];
+        if (sp->state != BK_FREE) {
+            BULK_WAIT();
+            continue;
+        }
+        BULK_UNLOCK();
+        size_t len = 0;
+        int err = 0;
+        while (len < BULK_BLOCK) {
+            ssize_t got = read(ffp, sp->buf + len, BULK_BLOCK - len);
+            if (got < 0) {
+                if (errno == EINTR) continue;
+                err = errno;
+                break;
+            }
+            if (got == 0) break;
+            len += (size_t)got;
+        }
+        BULK_LOCK();
+        if (err || (len == 0)) {
+            bulk.read_errno = err;
+            bulk.eof_seq = seq;
+            BULK_SIGNAL();
+            break;
+        }
+        sp->seq = seq++;
+        sp->start = 0;
+        sp->len = len;
+        sp->state = BK_READ;
+        BULK_SIGNAL();
+    }
+    BULK_UNLOCK();
+    return NULL;
+}
+
+/* Decrypt a block and, until we know, look for the end of the first line
+ * to see whether it has a DOS line-ending.
+ */
+static void decode_block(struct bulk_slot *sp) {
+    if ((sp->seq == 0) && cryptflag && (sp->len >= CC_HDR_LEN) &&
+         stream_check_header(sp->buf)) {
+        use_stream = 1;
+        sp->start = CC_HDR_LEN;
+    }
+    char *data = sp->buf + sp->start;
+    size_t dlen = sp->len - sp->start;
+    if (use_stream) {
+        stream_crypt(data, dlen, stream_off);
+        stream_off += dlen;
+    }
+    else if (cryptflag) myencrypt(data, (int)dlen);
+
+    if (!bulk.dos_known && (dlen > 0)) {
+        char *nlp = memchr(data, '\n', dlen);
+        if (nlp) {
+            bulk.dos = (nlp > data)? (nlp[-1] == '\r'): bulk.prev_cr;
+            bulk.dos_known = 1;
+        }
+        else bulk.prev_cr = (data[dlen-1] == '\r');
+    }
+}
+
+static void *bulk_decoder(void *arg) {
+    UNUSED(arg);
+
+    BULK_LOCK();
+    while (!bulk.stop && (bulk.decode_seq != bulk.eof_seq)) {
+        struct bulk_slot *sp = &bulk.slot[bulk.decode_seq % BULK_SLOTS];
+        if (sp->state != BK_READ) {
+            BULK_WAIT();
+            continue;
+        }
+        BULK_UNLOCK();
+        decode_block(sp);
+        BULK_LOCK();
+        sp->state = BK_DECODED;
+        bulk.decode_seq++;
+        BULK_SIGNAL();
+    }
+    BULK_UNLOCK();
+    return NULL;
+}
+
+static void free_run(struct line *);
+
+/* Make the complete lines in a block into a run.
+ * This is run by the splitter threads, so allocates the lines without
+ * lalloc() and db_setn() (which exit on failure, and that's not for a
+ * worker to do). If it runs out it frees what it has made and sets
+ * sp->nomem, for ffgetrun() to report.
+ */
+static void split_block(struct bulk_slot *sp, int dos) {
+    char *data = sp->buf + sp->start;
+    char *end = sp->buf + sp->len;
+
+    sp->run.first = sp->run.last = NULL;
+    sp->run.nlines = 0;
+    sp->nomem = FALSE;
+    char *nlp = memchr(data, '\n', (size_t)(end - data));
+    sp->has_nl = (nlp != NULL);
+    if (!nlp) return;
+    sp->head = (size_t)(nlp - data);
+
+    char *ls = nlp + 1;
+    while ((nlp = memchr(ls, '\n', (size_t)(end - ls))) != NULL) {
+        int ll = (int)(nlp - ls);
+        if (dos && (ll > 0) && (nlp[-1] == '\r')) ll--;
+        struct line *lp = malloc(sizeof(struct line));
+        if (lp) {
+            lp->l_ = (db)db_buf_initval;
+            if ((ll > 0) && !db_trysetn(ldb(lp), ls, ll)) {
+                free(lp);
+                lp = NULL;
+            }
+        }
+        if (!lp) {
+            if (sp->run.last) sp->run.last->l_fp = NULL;
+            free_run(sp->run.first);
+            sp->run.first = sp->run.last = NULL;
+            sp->run.nlines = 0;
+            sp->nomem = TRUE;
+            return;
+        }
+        if (sp->run.last) sp->run.last->l_fp = lp;
+        else              sp->run.first = lp;
+        lp->l_bp = sp->run.last;
+        sp->run.last = lp;
+        sp->run.nlines++;
+        ls = nlp + 1;
+    }
+    sp->tail = (size_t)(ls - sp->buf);
+}
+
+static void *bulk_splitter(void *arg) {
+    UNUSED(arg);
+
+    BULK_LOCK();
+    while (!bulk.stop && (bulk.split_seq != bulk.eof_seq)) {
+        struct bulk_slot *sp = &bulk.slot[bulk.split_seq % BULK_SLOTS];
+        if (sp->state != BK_DECODED) {
+            BULK_WAIT();
+            continue;
+        }
+        sp->state = BK_SPLITTING;
+        bulk.split_seq++;
+        int dos = bulk.dos;
+        BULK_UNLOCK();
+        split_block(sp, dos);
+        BULK_LOCK();
+        sp->state = BK_SPLIT;
+        BULK_SIGNAL();
+    }
+    BULK_UNLOCK();
+    return NULL;
+}
+
+static void free_run(struct line *lp) {
+    while (lp) {
+        struct line *next = lp->l_fp;
+        db_free(ldb(lp));
+        Xfree(lp);
+        lp = next;
+    }
+}
+
+/* Stop all of the threads and free anything not yet handed out.
+ */
+static void bulk_stop(void) {
+    BULK_LOCK();
+    bulk.stop = 1;
+    BULK_SIGNAL();
+    BULK_UNLOCK();
+    pthread_join(bulk.reader, NULL);
+    pthread_join(bulk.decoder, NULL);
+    for (int ti = 0; ti < bulk.nsplit; ti++)
+        pthread_join(bulk.splitter[ti], NULL);
+
+    for (int si = 0; si < BULK_SLOTS; si++) {
+        struct bulk_slot *sp = &bulk.slot[si];
+        if (sp->state == BK_SPLIT) {
+            if (sp->run.last) sp->run.last->l_fp = NULL;
+            free_run(sp->run.first);
+        }
+        Xfree_setnull(sp->buf);
+    }
+    if (bulk.part) {
+        bulk.part->l_fp = NULL;
+        free_run(bulk.part);
+        bulk.part = NULL;
+    }
+    bulk_active = 0;
+}
+
+/* Start the pipelined loader for the file just opened by ffropen(), if
+ * it is large enough to be worth it.
+ * check_dos says whether to look for DOS line-endings.
+ * Returns FALSE if the caller should use ffgetline().
+ */
+int ffbulk_start(int check_dos) {
+    if (file_size < BULK_MIN) return FALSE;
+
+    long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+    bulk.nsplit = (ncpu > 3)? (int)ncpu - 2: 1;
+    if (bulk.nsplit > BULK_SPLITTERS) bulk.nsplit = BULK_SPLITTERS;
+    bulk.stop = 0;
+    bulk.decode_seq = bulk.split_seq = bulk.use_seq = 0;
+    bulk.eof_seq = -1;
+    bulk.read_errno = 0;
+    bulk.nomem = FALSE;
+    bulk.check_dos = check_dos;
+    bulk.dos = bulk.prev_cr = 0;
+    bulk.dos_known = !check_dos;
+    bulk.part = NULL;
+    for (int si = 0; si < BULK_SLOTS; si++) {
+        bulk.slot[si].state = BK_FREE;
+        bulk.slot[si].buf = Xmalloc(BULK_BLOCK);
+    }
+
+/* The threads must leave all signals to the main thread.
+ * The reader is started last, so that if we fail to start any of them
+ * nothing has been read and the caller can still use ffgetline().
+ */
+    sigset_t all, orig;
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &orig);
+    int started = 0;
+    while (started < bulk.nsplit) {
+        if (pthread_create(&bulk.splitter[started], NULL,
+             bulk_splitter, NULL)) break;
+        started++;
+    }
+    int ok = (started == bulk.nsplit);
+    if (ok) ok = !pthread_create(&bulk.decoder, NULL, bulk_decoder, NULL);
+    if (ok) ok = !pthread_create(&bulk.reader, NULL, bulk_reader, NULL);
+    pthread_sigmask(SIG_SETMASK, &orig, NULL);
+    if (!ok) {
+        BULK_LOCK();
+        bulk.stop = 1;
+        BULK_SIGNAL();
+        BULK_UNLOCK();
+        if (started == bulk.nsplit) pthread_join(bulk.decoder, NULL);
+        for (int ti = 0; ti < started; ti++)
+            pthread_join(bulk.splitter[ti], NULL);
+        for (int si = 0; si < BULK_SLOTS; si++)
+            Xfree_setnull(bulk.slot[si].buf);
+        return FALSE;
+    }
+    bulk_active = 1;
+    return TRUE;
+}
+
+/* Add a block's part-line to the carried-over line.
+ */
+static void add_to_part(const char *text, size_t len) {
+    if (len == 0) return;
+    if (!bulk.part) bulk.part = lalloc();
+    db_appendn(ldb(bulk.part), text, (int)len);
+}
+
+/* Return the run of lines from the next block that has any newline,
+ * with the carried-over line (which that newline ends) at its start.
+ * A block whose lines couldn't be allocated ends the load.
+ */
+static int take_block(struct bulk_slot *sp, struct line_run *rp) {
+    char *data = sp->buf + sp->start;
+    if (sp->nomem) {
+        bulk.nomem = TRUE;
+        return FALSE;
+    }
+    if (!sp->has_nl) {
+        add_to_part(data, sp->len - sp->start);
+        return FALSE;
+    }
+    add_to_part(data, sp->head);
+    struct line *lp = bulk.part? bulk.part: lalloc();
+    bulk.part = NULL;
+    if (bulk.dos && (lused(lp) > 0) && (lgetc(lp, lused(lp)-1) == '\r'))
+        db_truncate(ldb(lp), lused(lp)-1);
+
+    rp->first = lp;
+    rp->last = sp->run.last? sp->run.last: lp;
+    rp->nlines = sp->run.nlines + 1;
+    lp->l_fp = sp->run.first;
+    if (sp->run.first) sp->run.first->l_bp = lp;
+
+    add_to_part(sp->buf + sp->tail, sp->len - sp->tail);
+    return TRUE;
+}
+
+/* The main-thread end of the pipeline - the replacement for ffgetline().
+ * Returns the next run of lines in *rp.
+ * At the end the threads are finished and any final line without a
+ * newline is returned, as for ffgetline().
+ */
+int ffgetrun(struct line_run *rp) {
+    int got = FALSE;
+
+    if (!bulk_active) return FIOEOF;
+    BULK_LOCK();
+    while (!got && !bulk.nomem && (bulk.use_seq != bulk.eof_seq)) {
+        struct bulk_slot *sp = &bulk.slot[bulk.use_seq % BULK_SLOTS];
+        if (sp->state != BK_SPLIT) {
+            BULK_WAIT();
+            continue;
+        }
+        BULK_UNLOCK();
+        got = take_block(sp, rp);
+        BULK_LOCK();
+        sp->state = BK_FREE;
+        bulk.use_seq++;
+        BULK_SIGNAL();
+    }
+    BULK_UNLOCK();
+    if (got) {
+        rp->dos = bulk.dos;
+        return FIOSUC;
+    }
+
+/* At the end. Any part-line had no newline. */
+    struct line *lp = bulk.part;
+    bulk.part = NULL;
+    int read_errno = bulk.read_errno;
+    int nomem = bulk.nomem;
+    bulk_stop();
+    if (read_errno || nomem) {
+        if (nomem) mlwrite_one("Out of memory reading file");
+        else       mlwrite("Read I/O error: %s", strerror(read_errno));
+        if (lp) free_run(lp);
+        return FIOERR;
+    }
+    if (!lp) return FIOEOF;
+    int last = lused(lp) - 1;
+    if (!bulk.dos_known && bulk.check_dos) {
+        bulk.dos = (lgetc(lp, last) == '\r');
+        bulk.dos_known = 1;
+    }
+    if (bulk.dos && (lgetc(lp, last) == '\r')) db_truncate(ldb(lp), last);
+    curbp->b_EOLmissing = 1;
+    mlforce("Newline absent at end of file. Added....");
+    rp->first = rp->last = lp;
+    rp->nlines = 1;
+    rp->dos = bulk.dos;
+    return FIOSUC;
+}
+
+/* Read the complete lines that have been added to the file open on fd
+ * since byte offset *offp (the start of a line), for following a
+ * growing file.
+ * Returns FIOSUC with them in *rp and *offp moved past them, FIOEOF if
+ * there are none (yet) and FIOERR on a read error.
+ * A last line without a newline is left until it has one.
+ * This uses the line splitting of the pipelined loader, and reads at most
+ * one block (unless it needs more to find a newline), so the caller
+ * should loop until FIOEOF.
+ */
+int ffreadtail(int fd, off_t *offp, int dos, struct line_run *rp) {
+    struct bulk_slot sl;
+    size_t size = BULK_BLOCK;
+
+    sl.buf = Xmalloc(size);
+    sl.start = sl.len = 0;
+    while (1) {
+        ssize_t got = pread(fd, sl.buf + sl.len, size - sl.len,
+             *offp + (off_t)sl.len);
+        if (got < 0) {
+            if (errno == EINTR) continue;
+            mlwrite("Read I/O error: %s", strerror(errno));
+            Xfree(sl.buf);
+            return FIOERR;
+        }
+        sl.len += (size_t)got;
+        if ((got == 0) || (sl.len < size) || memchr(sl.buf, '\n', sl.len))
+            break;
+        size *= 2;                  /* A very long line */
+        sl.buf = Xrealloc(sl.buf, size);
+    }
+    split_block(&sl, dos);
+    if (sl.nomem) {
+        mlwrite_one("Out of memory reading file");
+        Xfree(sl.buf);
+        return FIOERR;
+    }
+    if (!sl.has_nl) {
+        Xfree(sl.buf);
+        return FIOEOF;
+    }
+
+    int hl = (int)sl.head;
+    if (dos && (hl > 0) && (sl.buf[hl-1] == '\r')) hl--;
+    struct line *lp = lalloc();
+    if (hl > 0) db_setn(ldb(lp), sl.buf, hl);
+    rp->first = lp;
+    rp->last = sl.run.last? sl.run.last: lp;
+    rp->nlines = sl.run.nlines + 1;
+    rp->dos = dos;
+    lp->l_fp = sl.run.first;
+    if (sl.run.first) sl.run.first->l_bp = lp;
+    *offp += (off_t)sl.tail;
+    Xfree(sl.buf);
+    return FIOSUC;
+}
+
 /* Does file <fn> exist on disk?
  *
  */
@@ -0,0 +1,303 @@
+/*      FOLLOW.C
+ *
+ *      Following a growing file (such as a log) in its buffer.
+ *
+ *      follow-file makes the current buffer follow its file. Lines added
+ *      to the end of the file are read from where the buffer's text ends
+ *      and appended to the buffer, so nothing already there is re-read.
+ *      If the file is truncated, or replaced by a new one (log rotation),
+ *      the buffer is re-read from the start of the (new) file.
+ *      Any window with dot at the end of the buffer stays at the end,
+ *      showing the last lines of the file.
+ *
+ *      The check is made from the idle poll() in idle_wait(), whenever
+ *      inotify (on Linux) reports a change to a file and, to notice a
+ *      replaced file (or where there is no inotify), every FOLLOW_POLL_MS.
+ *
+ *      A followed buffer is put into View mode. Clearing or re-reading
+ *      the buffer stops it following.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#ifdef __linux__
+#include <sys/inotify.h>
+#define USE_INOTIFY 1
+#else
+#define USE_INOTIFY 0
+#endif
+
+#define FOLLOW_C
+
+#include "estruct.h"
+#include "edef.h"
+#include "efunc.h"
+#include "line.h"
+
+#define FOLLOW_POLL_MS 1000
+
+static struct follow {
+    struct buffer *bp;
+    int fd;                 /* The file being followed */
+    int wd;                 /* Its inotify watch (-1 if none) */
+    off_t off;              /* Where the buffer's text ends in it */
+    dev_t dev;              /* To notice it being replaced */
+    ino_t ino;
+} *fols = NULL;
+static int nfols = 0;
+static int ino_fd = -1;     /* The inotify descriptor */
+
+/* Open the buffer's file, and watch it if we can.
+ */
+static int open_file(struct follow *fp) {
+    struct stat st;
+
+    fp->fd = open(fp->bp->b_rpname, O_RDONLY);
+    if (fp->fd < 0) return FALSE;
+    fcntl(fp->fd, F_SETFD, FD_CLOEXEC);
+    if (fstat(fp->fd, &st) < 0) {
+        close(fp->fd);
+        fp->fd = -1;
+        return FALSE;
+    }
+    fp->dev = st.st_dev;
+    fp->ino = st.st_ino;
+    fp->wd = -1;
+#if USE_INOTIFY
+    if (ino_fd < 0) ino_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (ino_fd >= 0) fp->wd = inotify_add_watch(ino_fd, fp->bp->b_rpname,
+         IN_MODIFY | IN_ATTRIB | IN_MOVE_SELF | IN_DELETE_SELF);
+#endif
+    return TRUE;
+}
+
+static void close_file(struct follow *fp) {
+#if USE_INOTIFY
+    if (fp->wd >= 0) inotify_rm_watch(ino_fd, fp->wd);
+#endif
+    fp->wd = -1;
+    if (fp->fd >= 0) close(fp->fd);
+    fp->fd = -1;
+}
+
+/* Append any complete new lines of the file to the buffer.
+ */
+static void append_lines(struct follow *fp) {
+    struct buffer *bp = fp->bp;
+    struct line_run run;
+    int added = 0;
+
+    while (ffreadtail(fp->fd, &fp->off, bp->b_mode & MDDOSLE, &run)
+         == FIOSUC) {
+        struct line *hp = bp->b_linep;
+        struct line *lp = lback(hp);
+        lp->l_fp = run.first;
+        run.first->l_bp = lp;
+        run.last->l_fp = hp;
+        hp->l_bp = run.last;
+        added += run.nlines;
+    }
+    if (!added) return;
+
+    bp->b_edits++;          /* For anything keyed on the text */
+    if (bp == group_match_buffer) group_match_buffer = NULL;
+    for (struct window *wp = wheadp; wp != NULL; wp = wp->w_wndp) {
+        if (wp->w_bufp != bp) continue;
+        if (wp->w_linep == bp->b_linep) wp->w_linep = lforw(bp->b_linep);
+        if (wp->w.dotp == bp->b_linep) {    /* Keep the end in view */
+            wp->w_force = -1;
+            wp->w_flag |= WFFORCE;
+        }
+        wp->w_flag |= WFHARD | WFMODE;
+    }
+}
+
+/* Replace the buffer's text with the file's.
+ */
+static void reread(struct follow *fp, const char *why) {
+    struct buffer *bp = fp->bp;
+    struct line *lp;
+
+    while ((lp = lforw(bp->b_linep)) != bp->b_linep) lfree(lp);
+    bp->b_edits++;
+    if (bp == group_match_buffer) group_match_buffer = NULL;
+    for (struct window *wp = wheadp; wp != NULL; wp = wp->w_wndp) {
+        if (wp->w_bufp == bp) wp->w_flag |= WFHARD | WFMODE;
+    }
+    fp->off = 0;
+    append_lines(fp);
+    mlwrite("%s %s - re-read", bp->b_bname, why);
+}
+
+/* Check one followed file for changes.
+ */
+static void check_file(struct follow *fp) {
+    struct stat st;
+
+/* If the name has gone, it may be in the middle of being replaced.
+ * We'll see the new one next time.
+ */
+    if (stat(fp->bp->b_rpname, &st) < 0) return;
+    if ((st.st_dev != fp->dev) || (st.st_ino != fp->ino)) {
+        close_file(fp);
+        if (!open_file(fp)) return;
+        reread(fp, "replaced");
+    }
+    else if (st.st_size < fp->off) reread(fp, "truncated");
+    else if (st.st_size > fp->off) append_lines(fp);
+}
+
+/* Called from idle_wait() after its poll() returns.
+ * inotified says whether inotify has reported anything, otherwise
+ * the poll() timed out (or was for something else).
+ */
+void follow_check(int inotified) {
+#if USE_INOTIFY
+    if (inotified) {            /* Just clear them - we check all files */
+        char evbuf[4096];
+        while (read(ino_fd, evbuf, sizeof(evbuf)) > 0);
+    }
+#else
+    UNUSED(inotified);
+#endif
+    for (int fi = 0; fi < nfols; fi++) {
+        if (fols[fi].fd < 0) {  /* Lost it - try again */
+            if (!open_file(&fols[fi])) continue;
+            reread(&fols[fi], "replaced");
+        }
+        else check_file(&fols[fi]);
+    }
+}
+
+/* Whether anything is being followed */
+int following(void) {
+    return nfols;
+}
+
+/* The descriptor to poll() for changes (-1 if none) */
+int follow_fd(void) {
+    return nfols? ino_fd: -1;
+}
+
+/* In a forked child, drop the followed files and the inotify descriptor */
+void follow_fork_close(void) {
+    for (int fi = 0; fi < nfols; fi++)
+        if (fols[fi].fd >= 0) close(fols[fi].fd);
+    nfols = 0;
+    if (ino_fd >= 0) close(ino_fd);
+    ino_fd = -1;
+    return;
+}
+
+/* The poll() timeout to use */
+int follow_timeout(void) {
+    return nfols? FOLLOW_POLL_MS: -1;
+}
+
+/* Stop following the buffer's file.
+ */
+void follow_stop(struct buffer *bp) {
+    for (int fi = 0; fi < nfols; fi++) {
+        if (fols[fi].bp != bp) continue;
+        close_file(&fols[fi]);
+        bp->b_flag &= ~BFFOLLOW;
+        fols[fi] = fols[--nfols];
+        for (struct window *wp = wheadp; wp != NULL; wp = wp->w_wndp) {
+            if (wp->w_bufp == bp) wp->w_flag |= WFMODE;
+        }
+        break;
+    }
+    if (nfols == 0 && ino_fd >= 0) {
+        close(ino_fd);
+        ino_fd = -1;
+    }
+}
+
+/* follow-file
+ * Toggle following the current buffer's file.
+ * With an argument, follow if it is > 0, otherwise stop.
+ * Asking to follow a buffer that is already following checks its file
+ * at once.
+ */
+int follow_file(int f, int n) {
+    struct buffer *bp = curbp;
+    int on = f? (n > 0): !(bp->b_flag & BFFOLLOW);
+
+    if (!on) {
+        follow_stop(bp);
+        mlwrite_one(MLbkt("Not following"));
+        return TRUE;
+    }
+    if (bp->b_flag & BFFOLLOW) {
+        for (int fi = 0; fi < nfols; fi++)
+            if (fols[fi].bp == bp) check_file(&fols[fi]);
+        return TRUE;
+    }
+    if (*(bp->b_rpname) == 0) {
+        mlwrite_one("No file to follow");
+        return FALSE;
+    }
+    if (bp->b_mode & MDCRYPT) {
+        mlwrite_one("Can't follow an encrypted file");
+        return FALSE;
+    }
+    if (bp->b_flag & (BFNAROW | BFTRUNC | BFCHG | BFMAPPED)) {
+        mlwrite_one("Buffer is narrowed, truncated, changed or mapped");
+        return FALSE;
+    }
+
+    fols = Xrealloc(fols, (size_t)(nfols+1)*sizeof(struct follow));
+    struct follow *fp = &fols[nfols];
+    fp->bp = bp;
+    if (!open_file(fp)) {
+        mlwrite("Cannot open %s: %s", bp->b_rpname, strerror(errno));
+        return FALSE;
+    }
+    nfols++;
+    bp->b_flag |= BFFOLLOW;
+    bp->b_mode |= MDVIEW;
+
+/* A last line that had no newline may still be being written, so drop
+ * it and read it again when it is complete.
+ * Then the text should end at a newline in the file at the total size
+ * of the lines. If not, the file has changed since it was read.
+ */
+    if (bp->b_EOLmissing) {
+        lfree(lback(bp->b_linep));
+        bp->b_EOLmissing = 0;
+        bp->b_edits++;
+    }
+    int eol = (bp->b_mode & MDDOSLE)? 2: 1;
+    fp->off = 0;
+    for (struct line *lp = lforw(bp->b_linep); lp != bp->b_linep;
+         lp = lforw(lp))
+        fp->off += lused(lp) + eol;
+    char last = '\n';
+    if ((fp->off > 0) && (pread(fp->fd, &last, 1, fp->off - 1) != 1))
+        last = 0;
+    if (last != '\n') reread(fp, "changed");
+    else              append_lines(fp);
+
+    for (struct window *wp = wheadp; wp != NULL; wp = wp->w_wndp) {
+        if (wp->w_bufp == bp) wp->w_flag |= WFMODE;
+    }
+    mlwrite(MLbkt("Following %s"), bp->b_rpname);
+    return TRUE;
+}
+
+#ifdef DO_FREE
+/* Add a call to allow free() of normally-unfreed items here for, e.g,
+ * valgrind usage.
+ */
+void free_follow(void) {
+    for (int fi = 0; fi < nfols; fi++) close_file(&fols[fi]);
+    nfols = 0;
+    if (ino_fd >= 0) close(ino_fd);
+    Xfree_setnull(fols);
+    return;
+}
+#endif
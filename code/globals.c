@@ -28,6 +28,7 @@ int clexec = FALSE;             /* command line execution flag  */
 int discmd = TRUE;              /* display command flag         */
 int disinp = TRUE;              /* display input characters     */
 int vismac = FALSE;             /* update display during keyboard macros? */
+int highlight_all = FALSE;      /* show all search matches on screen? */
 int filock = FALSE;             /* Do we want file-locking */
 int crypt_mode = 0;             /* Crypt mode - default is NONE */
 char gl_enc_key[NKEY];          /* Global encryption key */
@@ -56,6 +57,8 @@ int cryptflag = FALSE;          /* currently encrypting?                */
 int *kbdptr;                    /* current position in keyboard buf */
 int kbdmode = STOP;             /* current keyboard macro mode  */
 int kbdrep = 0;                 /* number of repetitions        */
+int kbd_compiled_play = FALSE;  /* replaying a compiled macro   */
+int input_idle = FALSE;         /* waiting for a command's 1st key */
 int restflag = FALSE;           /* restricted use?              */
 int lastkey = 0;                /* last keystoke                */
 int macbug = 0;                 /* macro debuging flag          */
@@ -117,6 +120,7 @@ int  inreex          = FALSE;
 int  allow_current   = 0;
 unicode_t *eos_list  = NULL;
 int  inmb            = FALSE;
+int  hold_lines      = 0;
 int  pathexpand      = TRUE;
 db_strdef(savnam);
 int do_savnam        = 1;
@@ -155,8 +159,6 @@ mb_info_st mb_info = { NULL, NULL, NULL, 0 };
 not_in_mb_st not_in_mb = { NULL, 0 };
 const char *not_interactive_fname = NULL;
 
-int pause_key_index_update = 0;
-
 /* Contains a db string struct */
 prmpt_buf_st prmpt_buf = { db_buf_initval, 0, db_buf_initval };
 
@@ -191,6 +193,7 @@ struct rx_mask rx_mask[] = {
     { "execute-program",        RXARG_execprg },
     { "pipe-command",           RXARG_pipecmd },
     { "filter-buffer",          RXARG_filter_buffer },
+    { "pipe-command-background", RXARG_pipecmd_background },
     { NULL, 0 },
 };
 /* ...and the current setting */
@@ -214,6 +217,9 @@ struct buffer *execbp = NULL;
 
 int srch_can_hunt = 0;
 
+int srch_arena_use = 0;
+int srch_arena_mallocs = 0;
+
 int uproc_lpcount = 0;
 int uproc_lptotal = 0;
 int uproc_lpforced = 0;
@@ -307,8 +307,8 @@ static void cmplt_buffer(db *name, enum cmplt_type mtype) {
  * We need to send in details of how to find the match-text within
  * the structure.
  */
-static int start_check_at(const char *look4, void *bp, int *ip, int nelem,
-     int esize, int offs) {
+static int start_check_at(const char *look4, void *bp, const int *ip,
+     int nelem, int esize, int offs) {
 
     int low = 0;
     int high = nelem - 1;
@@ -449,6 +449,8 @@ unicode_t tgetc(void) {
     if (kbdmode == PLAY) {
         if (kbdptr < kbdend)    /* If there is some left... */
             return (int) *kbdptr++;
+/* A compiled macro command wanting more than it read when recorded */
+        if (kbd_compiled_play) return abortc;
         if (--kbdrep < 1) {     /* at the end of last repetition? */
             kbdmode = STOP;     /* Leave ctlxe_togo alone */
             if (!vismac) update(FALSE); /* Force update now all is done? */
@@ -486,7 +488,7 @@ unicode_t tgetc(void) {
             if (kbdptr == &kbdm[n_kbdm - 1]) {  /* Don't overrun buffer */
                 n_kbdm += 256;
                 kbdm = Xrealloc(kbdm, (size_t)n_kbdm*sizeof(int));
-                kbdptr = &kbdm[n_kbdm - 1];     /* Might have moved */
+                kbdptr = &kbdm[n_kbdm - 257];   /* Might have moved */
             }
             kbdend = kbdptr;
         }
@@ -33,8 +33,6 @@
 
 /* Incremental search defines.
  */
-#define CMDBUFLEN       256     /* Length of our command buffer */
-
 #define CTLCHAR(x) (x & ~0x60)          /* UP or low case -> control */
 #define IS_ABORT        (CTLCHAR('G'))  /* Abort the isearch */
 #define IS_BACKSP       (CTLCHAR('H'))  /* Delete previous char */
@@ -44,11 +42,19 @@
 #define IS_QUIT         (CTLCHAR('['))  /* Exit the search */
 #define IS_RUBOUT       (0x7F)          /* Delete previous character */
 
-/* A couple more "own" variables for the command string */
-
-static int cmd_buff[CMDBUFLEN]; /* Save the command args here */
-static int cmd_offset;                  /* Current offset into command buff */
-static int cmd_reexecute = -1;          /* > 0 if re-executing command */
+/* Each key that changes the search saves the state from before it, so
+ * that a backspace can put that back without searching again.
+ * The saved line pointers (here and in scanmore_push()) stay valid as
+ * hold_lines stops a mapped buffer's lines being remade meanwhile.
+ */
+struct is_step {
+    struct line *dotp;
+    int doto;
+    int patlen;             /* Bytes of the pattern */
+    int dir;
+    int status;
+    int col;                /* Prompt column */
+};
 
 /* Routine to prompt for I-Search string.
  */
@@ -126,36 +132,12 @@ static int echo_char(int c, int col) {
     return col + cw;                /* return the new column no   */
 }
 
-/* Routine to get the next character from the input stream.  If we're reading
- * from the real terminal, force a screen update before we get the char.
- * Otherwise, we must be re-executing the command string, so just return the
- * next character.
+/* Routine to get the next character from the input stream, forcing a
+ * screen update before we get it.
  */
 static int get_char(void) {
-    int c;                      /* A place to get a character */
-
-/* See if we're re-executing:
- * If so we want to play out all of the characters again, in order,
- * so that we replay the whole thing.
- */
-
-    if (cmd_reexecute >= 0)     /* Is there an offset? */
-        if ((c = cmd_buff[cmd_reexecute++]) != 0)
-            return c;           /* Yes, return any character */
-
-/* We're not re-executing (or aren't any more).  Try for a real char */
-
-    cmd_reexecute = -1;     /* Say we're in real mode again */
     update(FALSE);          /* Pretty up the screen */
-/* If we're getting too big ...  Complain loudly and bitterly */
-    if (cmd_offset >= CMDBUFLEN - 1) {
-        mlwrite_one("? command too long");
-        return metac;       /* And force a quit */
-    }
-    c = tgetc();            /* Get the next literal character */
-    cmd_buff[cmd_offset++] = c; /* Save the char for next time */
-    terminate_str(cmd_buff + cmd_offset);
-    return c;               /* Return the character */
+    return tgetc();         /* Get the next literal character */
 }
 
 /* -+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
@@ -387,24 +369,16 @@ static int isearch(int f, int n) {
     UNUSED(f);
     int status;     /* Search status */
     int col;        /* prompt column */
-    int cpos;       /* character number in search string  */
     int c;          /* current input character */
 
 /* GGR - Allow for a trailing NUL */
     db_strdef(pat_save);    /* Saved copy of the old pattern str  */
-    struct line *curline;   /* Current line on entry              */
-    int curoff;             /* Current offset on entry            */
-    int init_direction;     /* The initial search direction       */
+    struct is_step *step = NULL;    /* The states to go back to */
+    int nstep = 0;
+    int step_alloc = 0;
 
 /* Initialize starting conditions */
 
-    cmd_reexecute = -1;         /* We're not re-executing (yet?)      */
-    cmd_offset = 0;             /* Start at the beginning of the buff */
-    terminate_str(cmd_buff);    /* Init the command buffer            */
-    curline = curwp->w.dotp;    /* Save the current line pointer      */
-    curoff = curwp->w.doto;     /* Save the current offset            */
-    init_direction = n;         /* Save the initial search direction  */
-
     db_set(pat_save, db_val_nc(pat)); /* Save the old pattern string */
     db_set(pat, "");            /* Start with nothing */
 
@@ -412,55 +386,15 @@ static int isearch(int f, int n) {
 
     int using_incremental_debug = incremental_debug_check(0);
 
-/* This is a good place to start a re-execution: */
-
-start_over:
-
 /* Ask the user for the text of a pattern */
     col = promptpattern("ISearch:");    /* Prompt, remember the col */
-
-    cpos = 0;               /* Start afresh               */
     status = TRUE;          /* Assume everything's cool   */
 
-/* Get the first character in the pattern.  If we get an initial
- * Control-S or Control-R, re-use the old search string and find
- * the first occurrence
- */
-    c = get_char();         /* Get the first character    */
-    if ((c == IS_FORWARD) || (c == IS_REVERSE)) {
-/* Reuse old search string?   */
-/* Yup, find the grapheme length and re-echo the string. */
-        cpos = 0;
-        int plen = db_len(pat);
-        int final_char = '!';
-        while (db_charat(pat, cpos) != 0) {
-            unicode_t uc;
-            cpos += utf8_to_unicode(db_val(pat), cpos, plen, &uc);
-            col = echo_char(uc, col);
-            final_char = uc;
-	}
-
-        if (c == IS_REVERSE) {      /* forward search?        */
-            n = -1;                 /* No, search in reverse  */
-            if (curwp->w.dotp == curbp->b_linep ) {
-                back_grapheme(1);   /* Be defensive about EOB */
-            }
-        }
-        else
-            n = 1;                  /* Yes, search forward    */
-                                    /* Do the search */
-        status = scanmore(&pat, n, FALSE, FALSE);
-        if (!status) hilite(final_char, col);
-        c = get_char();             /* Get another character */
-    }
-
-/* Top of the per character loop, although only IS_REVERSE and
- * IS_FORWARD actually do loop.
- */
+/* Top of the per character loop */
 
+    c = get_char();         /* Get the first character    */
     while (1) {         /* ISearch per character loop */
                         /* Check for special characters first: */
-                        /* Most cases here change the search */
         switch (c) {            /* dispatch on the input char */
         case IS_QUIT:           /* Want to quit searching?    */
             status = TRUE;
@@ -470,17 +404,76 @@ start_over:
             status = FALSE;
             goto end_isearch;   /* Quit searching again       */
 
+/* Backspace undoes the last key - a search character or a find command.
+ * Its state is put back as it was, along with the match info, and the
+ * prompt line is cut back to where it was.
+ */
+        case IS_BACKSP:     /* If a backspace:      */
+        case IS_RUBOUT:     /*  or if a Rubout:     */
+            if (nstep == 0) {       /* Anything to delete?  */
+                status = TRUE;      /* No, just exit        */
+                goto end_isearch;
+            }
+            struct is_step *sp = step + --nstep;
+            curwp->w.dotp = sp->dotp;
+            curwp->w.doto = sp->doto;
+            curwp->w_flag |= WFMOVE;
+            db_truncate(pat, sp->patlen);
+            n = sp->dir;
+            status = sp->status;
+            scanmore_pop();
+            col = sp->col;
+            force_movecursor(term.t_mbline, col);
+            TTeeol();
+            TTflush();
+            c = get_char();
+            continue;
+        }
+
+/* Anything else changes the search, so save how it is now */
+        if (nstep >= step_alloc) {
+            step_alloc = step_alloc? 2*step_alloc: 32;
+            step = Xreallocarray(step, step_alloc, sizeof(struct is_step));
+        }
+        step[nstep++] = (struct is_step)
+             { curwp->w.dotp, curwp->w.doto, db_len(pat), n, status, col };
+        scanmore_push();
+
+        switch (c) {
         case IS_REVERSE:    /* If backward search         */
         case IS_FORWARD:    /* If forward search          */
             if (c == IS_REVERSE)    /* If reverse search  */
                 n = -1;             /* Set the reverse direction  */
             else                    /* Otherwise,         */
                 n = 1;              /*  go forward        */
-/* This calls asks for the *next* match, not a continuation of the
+
+/* With no pattern yet, re-use the old search string and find the first
+ * occurrence. Echo it as we go.
+ */
+            if (db_len(pat) == 0) {
+                db_set(pat, db_val(pat_save));
+                int cpos = 0;
+                int plen = db_len(pat);
+                int final_char = '!';
+                while (cpos < plen) {
+                    unicode_t uc;
+                    cpos += utf8_to_unicode(db_val(pat), cpos, plen, &uc);
+                    col = echo_char(uc, col);
+                    final_char = uc;
+                }
+                if ((n < 0) && (curwp->w.dotp == curbp->b_linep))
+                    back_grapheme(1);   /* Be defensive about EOB */
+                status = scanmore(&pat, n, FALSE, FALSE);
+                if (!status) hilite(final_char, col);
+            }
+
+/* Otherwise this asks for the *next* match, not a continuation of the
  * current one.
  */
-            status = scanmore(&pat, n, TRUE, FALSE);    /* Restart */
-            if (!status) hilite('!', col+1);        /* No further match */
+            else {
+                status = scanmore(&pat, n, TRUE, FALSE);    /* Restart */
+                if (!status) hilite('!', col+1);    /* No further match */
+            }
             c = get_char(); /* Get next char */
             continue;       /* Continue the search */
 
@@ -488,27 +481,6 @@ start_over:
             c = get_char(); /* Get the next char - might be a control */
             break;
 
-/* The cmd_buff collects *all* chars, including the IS_FORWARD and
- * IS_REVERSE chars, so it remembers the entire history of how you
- * got to here.
- * Backspace after IS_FORWARD/IS_REVERSE undoes the last find command,
- * but leaves the search string (which is displayed) the same.
- */
-        case IS_BACKSP:     /* If a backspace:      */
-        case IS_RUBOUT:     /*  or if a Rubout:     */
-            if (cmd_offset <= 1) {  /* Anything to delete?  */
-                status = TRUE;      /* No, just exit        */
-                goto end_isearch;
-            }
-            --cmd_offset;           /* Back up over Rubout  */
-            terminate_str(cmd_buff + --cmd_offset); /* Yes, delete last char */
-            curwp->w.dotp = curline;    /* Reset the line pointer */
-            curwp->w.doto = curoff; /*  and the offset       */
-            n = init_direction;     /* Reset search direction */
-            db_set(pat, db_val(pat_save));  /* Restore old search str */
-            cmd_reexecute = 0;      /* Start the whole mess over  */
-            goto start_over;        /* Let it take care of itself */
-
 /* Presumably a quasi-normal character comes here.
  * This can include control-chars not explicitly handled.
  */
@@ -547,6 +519,7 @@ end_isearch:
     (void)scanmore(NULL, 0, 0, 0);  /* Invalidate group matches */
     if (using_incremental_debug) incremental_debug_cleanup();
     db_free(pat_save);
+    Xfree(step);
     return status;
 }
 
@@ -559,6 +532,7 @@ int fisearch(int f, int n) {
 /* Remember the initial . on entry: */
 
     int saved_discmd = discmd;      /* Save this in ase we change it. */
+    hold_lines++;                   /* Keep curline in the buffer */
     curline = curwp->w.dotp;        /* Save the current line pointer */
     curoff = curwp->w.doto;         /* Save the current offset       */
 
@@ -573,6 +547,7 @@ int fisearch(int f, int n) {
         mlwrite_one(MLbkt("search failed"));   /* Say we died */
     } else
         mlerase();      /* If happy, just erase the cmd line  */
+    hold_lines--;
     srch_patlen = db_len(pat);   /* Save default search pattern length */
     discmd = saved_discmd;          /* Back to original... */
     return TRUE;
@@ -0,0 +1,613 @@
+/*      JOURNAL.C
+ *
+ *      An append-only journal of the edits made to a file buffer in
+ *      auto-save (Asave) mode, so that unsaved work can be recovered
+ *      after a crash without the whole file being written out every
+ *      $asave keystrokes.
+ *
+ *      The journal for <dir>/<file> is <dir>/.<file>.uej. It starts with
+ *      the size and mtime of the file at the time of the first unsaved
+ *      change (the base) and then has a record for each primitive edit -
+ *      lnewline(), linsert_byte() and ldelete() - giving the line number
+ *      and offset of dot and the force_newline state. Replaying these on
+ *      the base file gives the same buffer. Changes that are made by
+ *      rewriting a line directly are recorded as the new line text.
+ *      Single bytes typed (or yanked) one after the other are collected
+ *      into one text record, and deletes at (or just before) the same
+ *      place into one delete record, while they are still pending.
+ *
+ *      Records are collected in memory and written out, followed by an
+ *      fdatasync(), whenever auto-save would have saved the file, and on
+ *      a crash. A real save of the file discards the journal.
+ *
+ *      Anything that can't be journalled (a narrowed or encrypted buffer,
+ *      inserting a file...) drops the journal, and auto-save goes back to
+ *      saving the whole file until it is next saved.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#define JOURNAL_C
+
+#include "estruct.h"
+#include "edef.h"
+#include "efunc.h"
+#include "line.h"
+
+#define JNL_MAGIC   "uemacs-journal 1\n"
+#define JNL_MAGLEN  (sizeof(JNL_MAGIC) - 1)
+#define JNL_FLUSH   65536       /* Write pending records beyond this */
+
+/* The record types */
+#define JNL_INSERT  'I'         /* n copies of c (linsert_byte())   */
+#define JNL_NEWLINE 'N'         /* lnewline()                       */
+#define JNL_DELETE  'D'         /* n bytes (ldelete())              */
+#define JNL_LINE    'L'         /* The line's new text              */
+#define JNL_TEXT    'T'         /* n bytes of text (linsert_byte()) */
+
+/* Where the fields are in a record */
+#define JNL_OFFS_AT 10
+#define JNL_NUM_AT  18
+
+static struct jnl {
+    struct buffer *bp;
+    char *jname;
+    int fd;                 /* -1 if not journalling this buffer */
+    db_dcl(pend);           /* Records not yet written */
+    struct line *clp;       /* A line known to be at...     */
+    ue64I_t cline;          /* ...this line number (-1 for b_linep) */
+    int last_op;            /* Last pending record, if it can grow */
+    int last_at;            /* Its place in pend */
+    int last_force;
+    ue64I_t last_line;
+    ue64I_t last_offs;
+    ue64I_t last_num;
+} *jnls = NULL;
+static int njnls = 0;
+
+static int replaying = FALSE;
+
+void jnl_discard(struct buffer *);      /* Forward declaration */
+int jnl_covers(struct buffer *);        /* Forward declaration */
+
+/* The journal name for a file */
+static char *jnl_name(const char *fname) {
+    const char *sp = strrchr(fname, '/');
+    int dlen = sp? (int)(sp - fname) + 1: 0;
+    const char *base = fname + dlen;
+    char *jname = Xmalloc((size_t)dlen + strlen(base) + 6);
+    sprintf(jname, "%.*s.%s.uej", dlen, fname, base);
+    return jname;
+}
+
+static struct jnl *jnl_find(struct buffer *bp) {
+    for (int ji = 0; ji < njnls; ji++)
+        if (jnls[ji].bp == bp) return jnls + ji;
+    return NULL;
+}
+
+static void put_i64(struct jnl *jp, ue64I_t val) {
+    db_appendn(jp->pend, (const char *)&val, sizeof(val));
+}
+
+/* The line number of lp, found by walking out from the cached one.
+ * Edits are usually close together, so this is usually short.
+ * The cache is then set to the line before lp, which none of the
+ * primitives being recorded can remove.
+ */
+static ue64I_t line_number(struct jnl *jp, struct line *lp) {
+    struct line *hp = jp->bp->b_linep;
+    struct line *fp = jp->clp, *rp = jp->clp;
+    ue64I_t fn = jp->cline, rn = jp->cline;
+    ue64I_t lnum = -1;
+
+    if ((fp == lp) && (fp != hp)) lnum = fn;
+    int fwd = TRUE, rev = (rp != hp);
+    while ((lnum < 0) && (fwd || rev)) {
+        if (fwd) {
+            fp = lforw(fp);
+            fn++;
+            if (fp == lp) lnum = fn;
+            else if (fp == hp) fwd = FALSE;
+        }
+        if (rev && (lnum < 0)) {
+            rp = lback(rp);
+            rn--;
+            if (rp == hp) rev = FALSE;
+            else if (rp == lp) lnum = rn;
+        }
+    }
+    if (lnum >= 0) {
+        jp->clp = lback(lp);
+        jp->cline = lnum - 1;
+    }
+    return lnum;
+}
+
+/* The line at a line number, walking out from the cached one.
+ * Returns NULL if there is no such line.
+ */
+static struct line *line_at(struct jnl *jp, ue64I_t lnum) {
+    struct line *hp = jp->bp->b_linep;
+    struct line *lp = jp->clp;
+    ue64I_t ln = jp->cline;
+
+    if (lnum < 0) return NULL;
+    while (ln < lnum) {
+        lp = lforw(lp);
+        ln++;
+        if ((lp == hp) && (ln < lnum)) return NULL;     /* Off the end */
+    }
+    while (ln > lnum) {
+        lp = lback(lp);
+        ln--;
+        if (lp == hp) return NULL;                      /* Off the start */
+    }
+    jp->clp = lback(lp);
+    jp->cline = lnum - 1;
+    return lp;
+}
+
+/* Write out the pending records. Drops the journal on an error. */
+static int jnl_write(struct jnl *jp) {
+    const char *cp = db_val(jp->pend);
+    size_t left = (size_t)db_len(jp->pend);
+    while (left > 0) {
+        ssize_t nw = write(jp->fd, cp, left);
+        if (nw < 0) {
+            if (errno == EINTR) continue;
+            mlwrite("Journal write error (%s) - journal dropped",
+                 strerror(errno));
+            jnl_discard(jp->bp);
+            return FALSE;
+        }
+        cp += nw;
+        left -= (size_t)nw;
+    }
+    db_clear(jp->pend);
+    jp->last_op = 0;
+    return TRUE;
+}
+
+/* Get the journal for an edit to the current buffer, starting one if
+ * the buffer is unchanged (so we know it is the same as the file).
+ * Returns NULL if the edit isn't to be journalled.
+ */
+static struct jnl *jnl_for_edit(void) {
+    struct buffer *bp = curbp;
+
+    if (replaying) return NULL;
+    struct jnl *jp = jnl_find(bp);
+    if (!(bp->b_mode & MDASAVE)) {
+        if (jp) jnl_discard(bp);
+        return NULL;
+    }
+    if ((bp->b_mode & MDCRYPT) || (bp->b_flag & (BFNAROW | BFINVS)) ||
+         (bp->b_type != BTNORM) || (*(bp->b_rpname) == '\0')) {
+        if (jp) jnl_discard(bp);
+        return NULL;
+    }
+    if (jp) return (jp->fd >= 0)? jp: NULL;
+    if (bp->b_flag & BFCHG) return NULL;
+
+/* Start a new journal.
+ * If there is already one (from a crash?) leave it alone, for
+ * recover-journal, and don't journal this buffer.
+ */
+    jnls = Xrealloc(jnls, (size_t)(njnls+1)*sizeof(struct jnl));
+    jp = jnls + njnls++;
+    jp->bp = bp;
+    jp->jname = jnl_name(bp->b_rpname);
+    jp->fd = open(jp->jname, O_WRONLY|O_CREAT|O_EXCL|O_APPEND, 0600);
+    db_bufdef(newpend);
+    jp->pend = newpend;
+    jp->clp = bp->b_linep;
+    jp->cline = -1;
+    jp->last_op = 0;
+    if (jp->fd < 0) return NULL;
+    fcntl(jp->fd, F_SETFD, FD_CLOEXEC);
+
+    struct stat st;
+    db_appendn(jp->pend, JNL_MAGIC, JNL_MAGLEN);
+    if (stat(bp->b_rpname, &st) == 0) {
+        put_i64(jp, (ue64I_t)st.st_size);
+        put_i64(jp, (ue64I_t)st.st_mtime);
+    }
+    else {                              /* A new file */
+        put_i64(jp, -1);
+        put_i64(jp, 0);
+    }
+    return jp;
+}
+
+/* The line number of dot, for a record */
+static ue64I_t dot_line(struct jnl *jp) {
+    ue64I_t lnum = line_number(jp, curwp->w.dotp);
+    if (lnum < 0) jnl_discard(jp->bp);  /* Can't happen... */
+    return lnum;
+}
+
+/* Start a record for an edit at dot, on line lnum.
+ * It is noted as the last one, for the caller to extend if it can.
+ */
+static void jnl_record(struct jnl *jp, int op, int force, ue64I_t lnum) {
+    jp->last_op = op;
+    jp->last_at = db_len(jp->pend);
+    jp->last_force = force;
+    jp->last_line = lnum;
+    jp->last_offs = curwp->w.doto;
+    jp->last_num = 0;
+    db_addch(jp->pend, (char)op);
+    db_addch(jp->pend, (char)force);
+    put_i64(jp, lnum);
+    put_i64(jp, curwp->w.doto);
+    return;
+}
+
+/* Update a field of the last record */
+static void set_last_i64(struct jnl *jp, int field, ue64I_t val) {
+    db_overwriten_at(jp->pend, (const char *)&val, sizeof(val),
+         jp->last_at + field);
+    return;
+}
+
+static void jnl_check_flush(struct jnl *jp) {
+    if (db_len(jp->pend) > JNL_FLUSH) (void)jnl_write(jp);
+    return;
+}
+
+/* The hooks called by the line.c primitives, before they make their
+ * change.
+ */
+void jnl_insert(int n, char c, int force) {
+    struct jnl *jp = jnl_for_edit();
+    if (!jp) return;
+    ue64I_t lnum = dot_line(jp);
+    if (lnum < 0) return;
+
+/* Text going on at the end of the last text record is added to it.
+ * Otherwise a single byte starts a new one, in case more follows.
+ * Newlines move dot to another line, so are never in one.
+ */
+    if ((c != '\n') && (jp->last_op == JNL_TEXT) &&
+         (jp->last_force == force) && (jp->last_line == lnum) &&
+         (jp->last_offs + jp->last_num == curwp->w.doto)) {
+        for (int i = 0; i < n; i++) db_addch(jp->pend, c);
+        jp->last_num += n;
+        set_last_i64(jp, JNL_NUM_AT, jp->last_num);
+    }
+    else if ((c != '\n') && (n == 1)) {
+        jnl_record(jp, JNL_TEXT, force, lnum);
+        jp->last_num = 1;
+        put_i64(jp, 1);
+        db_addch(jp->pend, c);
+    }
+    else {
+        jnl_record(jp, JNL_INSERT, force, lnum);
+        jp->last_op = 0;
+        put_i64(jp, n);
+        db_addch(jp->pend, c);
+    }
+    jnl_check_flush(jp);
+    return;
+}
+void jnl_newline(int force) {
+    struct jnl *jp = jnl_for_edit();
+    if (!jp) return;
+    ue64I_t lnum = dot_line(jp);
+    if (lnum < 0) return;
+    jnl_record(jp, JNL_NEWLINE, force, lnum);
+    jp->last_op = 0;
+    jnl_check_flush(jp);
+    return;
+}
+
+/* A delete at the same place as the last one (delete-next-character
+ * repeated) or just before it (backspacing) is added to that.
+ */
+void jnl_delete(ue64I_t n, int force) {
+    struct jnl *jp = jnl_for_edit();
+    if (!jp) return;
+    ue64I_t lnum = dot_line(jp);
+    if (lnum < 0) return;
+
+    if ((jp->last_op == JNL_DELETE) && (jp->last_force == force) &&
+         (jp->last_line == lnum)) {
+        if (jp->last_offs == curwp->w.doto) {
+            jp->last_num += n;
+            set_last_i64(jp, JNL_NUM_AT, jp->last_num);
+            return;
+        }
+        if (curwp->w.doto + n == jp->last_offs) {
+            jp->last_offs = curwp->w.doto;
+            jp->last_num += n;
+            set_last_i64(jp, JNL_OFFS_AT, jp->last_offs);
+            set_last_i64(jp, JNL_NUM_AT, jp->last_num);
+            return;
+        }
+    }
+    jnl_record(jp, JNL_DELETE, force, lnum);
+    jp->last_num = n;
+    put_i64(jp, n);
+    jnl_check_flush(jp);
+    return;
+}
+
+/* A line of the current buffer has been rewritten in place.
+ * Called *before* lchange(), as the others are.
+ */
+void jnl_line(struct line *lp) {
+    struct jnl *jp = jnl_for_edit();
+    if (!jp) return;
+    ue64I_t lnum = line_number(jp, lp);
+    if (lnum < 0) {
+        jnl_discard(jp->bp);
+        return;
+    }
+    jp->last_op = 0;
+    db_addch(jp->pend, JNL_LINE);
+    db_addch(jp->pend, 0);
+    put_i64(jp, lnum);
+    put_i64(jp, 0);
+    put_i64(jp, lused(lp));
+    db_appendn(jp->pend, ltext(lp), lused(lp));
+    jnl_check_flush(jp);
+    return;
+}
+
+/* A line is being freed. Make sure no cache refers to it. */
+void jnl_line_gone(struct line *lp) {
+    for (int ji = 0; ji < njnls; ji++) {
+        if (jnls[ji].clp == lp) {
+            jnls[ji].clp = jnls[ji].bp->b_linep;
+            jnls[ji].cline = -1;
+        }
+    }
+    return;
+}
+
+/* Write out all of the journals, and get them onto the disk.
+ * Returns TRUE if the current buffer has a journal (so auto-save
+ * needn't do anything else).
+ */
+int jnl_sync(void) {
+    for (int ji = 0; ji < njnls; ) {
+        struct jnl *jp = jnls + ji;
+        if (jp->fd < 0) {
+            ji++;
+            continue;
+        }
+        if (!jnl_write(jp)) continue;   /* It's gone */
+        (void)fdatasync(jp->fd);
+        ji++;
+    }
+    return jnl_covers(curbp);
+}
+
+/* Does this buffer have a working journal? */
+int jnl_covers(struct buffer *bp) {
+    struct jnl *jp = jnl_find(bp);
+    return (jp && (jp->fd >= 0));
+}
+
+/* Drop any journal for this buffer - it has been saved, deleted, or has
+ * had a change that can't be journalled.
+ * Only one that we wrote is removed.
+ */
+void jnl_discard(struct buffer *bp) {
+    struct jnl *jp = jnl_find(bp);
+    if (!jp) return;
+    if (jp->fd >= 0) {
+        close(jp->fd);
+        unlink(jp->jname);
+    }
+    Xfree(jp->jname);
+    db_free(jp->pend);
+    *jp = jnls[--njnls];
+    return;
+}
+
+/* In a forked child just close them - pending records are the
+ * parent's to write, and the files are left alone.
+ */
+void jnl_fork_close(void) {
+    for (int ji = 0; ji < njnls; ji++)
+        if (jnls[ji].fd >= 0) close(jnls[ji].fd);
+    njnls = 0;
+    return;
+}
+
+/* Get all of them onto the disk and stop using them, but leave them
+ * there. For when we are dying, as saving the buffers elsewhere must not
+ * remove them.
+ */
+void jnl_close_all(void) {
+    (void)jnl_sync();
+    for (int ji = 0; ji < njnls; ji++) {
+        if (jnls[ji].fd >= 0) close(jnls[ji].fd);
+        Xfree(jnls[ji].jname);
+        db_free(jnls[ji].pend);
+    }
+    njnls = 0;
+    Xfree_setnull(jnls);
+    return;
+}
+
+/* Drop all of them (leaving without saving). */
+void jnl_discard_all(void) {
+    while (njnls) jnl_discard(jnls[0].bp);
+    Xfree_setnull(jnls);
+    return;
+}
+
+/* Is there a journal for this file? */
+int jnl_exists(const char *fname) {
+    char *jname = jnl_name(fname);
+    int exists = (access(jname, F_OK) == 0);
+    Xfree(jname);
+    return exists;
+}
+
+/* ======================================================================
+ * recover-journal
+ * Replay the journal for the current buffer's file, which must be as
+ * read from the file, to recover the unsaved changes.
+ * The journal then carries on being used for the buffer.
+ */
+static ue64I_t get_i64(const char **cpp) {
+    ue64I_t val;
+    memcpy(&val, *cpp, sizeof(val));
+    *cpp += sizeof(val);
+    return val;
+}
+
+int recover_journal(int f, int n) {
+    UNUSED(f); UNUSED(n);
+    struct buffer *bp = curbp;
+    struct jnl *jp;
+    int status = FALSE;
+
+    if (bp->b_mode & MDVIEW) return rdonly();
+    if (*(bp->b_rpname) == '\0') {
+        mlwrite_one("No file name");
+        return FALSE;
+    }
+    if ((bp->b_flag & (BFCHG | BFNAROW)) || jnl_covers(bp)) {
+        mlwrite_one("The buffer must be as read from the file");
+        return FALSE;
+    }
+
+    char *jname = jnl_name(bp->b_rpname);
+    char *data = NULL;
+    int fd = open(jname, O_RDONLY);
+    struct stat st;
+    if ((fd < 0) || (fstat(fd, &st) != 0)) {
+        mlwrite("No journal for %s", bp->b_rpname);
+        goto exit;
+    }
+    data = Xmalloc((size_t)st.st_size + 1);
+    size_t dlen = 0;
+    while (dlen < (size_t)st.st_size) {
+        ssize_t nr = read(fd, data + dlen, (size_t)st.st_size - dlen);
+        if (nr < 0 && errno == EINTR) continue;
+        if (nr <= 0) break;
+        dlen += (size_t)nr;
+    }
+
+/* Check it is for the file as it is now */
+    const char *cp = data;
+    const char *ep = data + dlen;
+    ue64I_t fsize = -1, fmtime = 0;
+    if (stat(bp->b_rpname, &st) == 0) {
+        fsize = st.st_size;
+        fmtime = st.st_mtime;
+    }
+    if ((dlen < JNL_MAGLEN + 16) || memcmp(cp, JNL_MAGIC, JNL_MAGLEN)) {
+        mlwrite("%s is not a journal", jname);
+        goto exit;
+    }
+    cp += JNL_MAGLEN;
+    ue64I_t jsize = get_i64(&cp);
+    ue64I_t jmtime = get_i64(&cp);
+    if ((jsize != fsize) || (jmtime != fmtime)) {
+        mlwrite("Journal %s is not for the file as it now is", jname);
+        goto exit;
+    }
+
+/* Replay it.
+ * A record that was only partly written (by a crash) is ignored.
+ * It is kept as the buffer's journal from here.
+ */
+    jnl_discard(bp);            /* Any "not journalling" entry */
+    jnls = Xrealloc(jnls, (size_t)(njnls+1)*sizeof(struct jnl));
+    jp = jnls + njnls++;
+    jp->bp = bp;
+    jp->jname = jname;
+    jname = NULL;
+    jp->fd = -1;
+    db_bufdef(newpend);
+    jp->pend = newpend;
+    jp->clp = bp->b_linep;
+    jp->cline = -1;
+    jp->last_op = 0;
+
+    const int hdr_len = 2 + 2*8;
+    int nrec = 0;
+    replaying = TRUE;
+    while (ep - cp >= hdr_len) {
+        const char *rp = cp;
+        int op = *rp++;
+        int force = *rp++;
+        ue64I_t lnum = get_i64(&rp);
+        ue64I_t offs = get_i64(&rp);
+        ue64I_t num = 0;
+        if (op == JNL_INSERT || op == JNL_DELETE || op == JNL_LINE ||
+             op == JNL_TEXT) {
+            if (ep - rp < 8) break;
+            num = get_i64(&rp);
+        }
+        if ((op == JNL_INSERT) && (ep - rp < 1)) break;
+        if ((op == JNL_LINE || op == JNL_TEXT) && (ep - rp < num)) break;
+
+        struct line *lp = line_at(jp, lnum);
+        if (!lp || (offs < 0) || (offs > lused(lp))) {
+            mlwrite("Journal record %d doesn't fit the buffer", nrec + 1);
+            break;
+        }
+        curwp->w.dotp = lp;
+        curwp->w.doto = (int)offs;
+        set_force_newline(force);
+        switch(op) {
+        case JNL_INSERT:
+            linsert_byte((int)num, *rp++);
+            break;
+        case JNL_TEXT:
+            for (ue64I_t i = 0; i < num; i++) linsert_byte(1, *rp++);
+            break;
+        case JNL_NEWLINE:
+            lnewline();
+            break;
+        case JNL_DELETE:
+            ldelete(num, FALSE);
+            break;
+        case JNL_LINE:
+            db_setn(ldb(lp), rp, (int)num);
+            rp += num;
+            lchange(WFHARD);
+            for (struct window *wp = wheadp; wp; wp = wp->w_wndp)
+                if ((wp->w.dotp == lp) && (wp->w.doto > lused(lp)))
+                    wp->w.doto = lused(lp);
+            break;
+        default:
+            mlwrite("Journal record %d is corrupt", nrec + 1);
+            goto done;
+        }
+        cp = rp;
+        nrec++;
+    }
+done:
+    replaying = FALSE;
+    set_force_newline(0);
+
+/* Carry on with it, dropping anything after the last good record. */
+    if ((truncate(jp->jname, (off_t)(cp - data)) == 0) &&
+         ((jp->fd = open(jp->jname, O_WRONLY|O_APPEND)) >= 0))
+        fcntl(jp->fd, F_SETFD, FD_CLOEXEC);
+    else
+        jnl_discard(bp);
+    curwp->w_flag |= WFHARD | WFMODE;
+    mlwrite(MLbkt("Recovered %d change%s"), nrec, (nrec == 1)? "": "s");
+    status = TRUE;
+
+exit:
+    if (fd >= 0) close(fd);
+    Xfree(data);
+    Xfree(jname);
+    return status;
+}
@@ -28,6 +28,12 @@
 #include "utf8.h"
 
 static int force_newline = 0;   /* lnewline may need to be told this */
+static int nested = 0;          /* Primitive called by another one */
+
+/* Set force_newline from outside (replaying a journal) */
+void set_force_newline(int force) {
+    force_newline = force;
+}
 
 /* This routine allocates a block of memory large enough to hold a struct
  * line.
@@ -91,6 +97,7 @@ void lfree(struct line *lp) {
     lp->l_bp->l_fp = lp->l_fp;
     lp->l_fp->l_bp = lp->l_bp;
 
+    jnl_line_gone(lp);
     db_free(lp->l_);
     Xfree(lp);
 }
@@ -109,6 +116,7 @@ void lchange(int flag) {
         flag |= WFMODE;             /* update mode lines.   */
         curbp->b_flag |= BFCHG;
     }
+    curbp->b_edits++;
 /* If we are modfying the buffer that the match-group info points
  * to we have to mark them as invalid.
  */
@@ -134,6 +142,7 @@ int lnewline(void) {
 
     if (curbp->b_mode & MDVIEW)     /* Don't allow this command if  */
          return rdonly();           /* we are in read only mode     */
+    if (!nested) jnl_newline(force_newline);
     lchange(WFHARD | WFINS);
 
 /* We need to make a special case of the last line *if we are at the
@@ -245,11 +254,14 @@ int linsert_byte(int n, char c) {
     if (n <= 0) return (n == 0);    /* So 0 is TRUE, but -ve is FALSE */
     if (curbp->b_mode & MDVIEW)     /* Don't allow this command if */
         return rdonly();            /* we are in read only mode */
+    if (!nested) jnl_insert(n, c, force_newline);
     lchange(WFEDIT);
 
     if (c == '\n') {                /* Newline is a special case */
         int status = TRUE;
+        nested++;
         while (status && n--) lnewline();
+        nested--;
         return status;
     }
 
@@ -263,7 +275,9 @@ int linsert_byte(int n, char c) {
             mlwrite_one("bug: linsert");
             return FALSE;
         }
+        nested++;
         lnewline();
+        nested--;
 /* addline_to_curb will put dot on the dummy end line, effectively
  * adding a newline at the end of it.
  * So we move dot back 1 char, to the end of what we've added....
@@ -567,6 +581,7 @@ int ldelete(ue64I_t n, int kflag) {
 
     if (curbp->b_mode & MDVIEW) /* don't allow this command if  */
         return rdonly();        /* we are in read only mode     */
+    if (!nested) jnl_delete(n, force_newline);
     while (n != 0) {
         dotp = curwp->w.dotp;
         doto = curwp->w.doto;
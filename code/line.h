@@ -24,6 +24,14 @@ struct line {
     db_dcl(l_);             /* Chars in dynamic buffer      */
 };
 
+/* A run of linked lines, as returned by ffgetrun() */
+struct line_run {
+    struct line *first;     /* l_bp of this is not set          */
+    struct line *last;      /* l_fp of this is not set          */
+    int nlines;
+    int dos;                /* It's a DOS file (CRs removed)    */
+};
+
 #define lforw(lp)       ((lp)->l_fp)
 #define lback(lp)       ((lp)->l_bp)
 
@@ -49,6 +57,7 @@ struct line {
 extern struct line *lalloc(void);           /* Allocate a line. */
 extern void lfree(struct line *lp);
 extern void lchange(int flag);
+extern void set_force_newline(int);
 extern int insspace(int f, int n);
 extern int linsert_byte(int, char c);
 extern int lins_dynbuf(db *);
@@ -85,8 +85,9 @@ int lock(const char *fname) {
  *      check a file for locking and add it to the list
  *
  * NOTE!
- *  There is currently no mechanism to remove a file from this list
- *  if a buffer is closed!
+ *  The only way to remove a file from this list when its buffer is
+ *  closed is lockrel_file() (used when a client's buffer is finished
+ *  with or killed).
  *
  * char *fname;                 file to check for a lock
  */
@@ -149,6 +150,27 @@ int lockrel(void) {
     return status;
 }
 
+/* lockrel_file:
+ *      release the lock on one file, if we hold it
+ *
+ * char *fname;         file to release
+ */
+int lockrel_file(const char *fname) {
+    int status = TRUE;
+    char *tmpname = Xstrdup(fixup_fname(fname));
+
+    for (int i = 0; i < numlocks; ++i) {
+        if (strcmp(tmpname, lname[i]) == 0) {
+            status = unlock(lname[i]);
+            Xfree(lname[i]);
+            lname[i] = lname[--numlocks];
+            break;
+        }
+    }
+    Xfree(tmpname);
+    return status;
+}
+
 #ifdef DO_FREE
 /* Add a call to allow free() of normally-unfreed items here for, e.g,
  * valgrind usage.
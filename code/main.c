@@ -100,10 +100,13 @@ printf( \
 "      -m           message for mini-buffer at start-up"  NL \
 "      -n           accept null chars (now always true)"  NL \
 "      -P           close stdout, pretend we are 80x24"   NL \
+"      -q<filepath> quick-start snapshot of rc state"     NL \
 "      -r           restrictive use"                      NL \
 "      -s<str>      initial search string"                NL \
 "      -v           view only (no edit)"                  NL \
+"      -w           pass files to a -z uemacs and wait"   NL \
 "      -x<filepath> an additional rc file"                NL \
+"      -z           be a server for -w invocations"       NL \
 "      -h,--help    display this help and exit"           NL \
 "      --           end of main arg list. -v and -e are"  NL \
 "                   still handled in remaining tokens"    NL \
@@ -813,7 +816,8 @@ static void exit_via_signal(int signr) {
     if (dump_message) printf("-*-*- %s -*-*-\n\n", dump_message);
 #endif
 
-/* Try to save any modified files. */
+/* Get any journals onto the disk, then try to save any modified files. */
+    jnl_close_all();
     if (can_dump_files) dump_modified_buffers();
 
 #if !defined(NUTRACE)
@@ -922,6 +926,7 @@ com_arg *multiplier_check(int c) {
 
 static char *rcfile = NULL;     /* GGR non-default rc file */
 static char *rcextra[10];       /* GGR additional rc files */
+static char *snapfile = NULL;   /* start-up snapshot file */
 
 static int set_rcfile(char *fname) {
     if (rcfile) {
@@ -1231,6 +1236,177 @@ static void edinit(const char *bname) {
     return;
 }
 
+/* ======================================================================
+ * Compiled keyboard macros.
+ * As each command of a keyboard macro is recorded we also note its key,
+ * its f/n args and the range of kbdm[] keystrokes it read while running
+ * (e.g. replies to prompts).
+ * The key is looked up again (through the perfect hash) when it is
+ * replayed, so, as for the keystroke replay, a key rebound since the
+ * recording runs its new command.
+ * Runs of self-inserted characters are collapsed into one literal text
+ * entry.
+ * execute-macro replays this directly, with redisplay suppressed,
+ * rather than pushing every keystroke back through the command loop.
+ * The keystrokes are kept, as the fallback if the macro was not ended
+ * normally or if $vismac is set, and the text form is still written to
+ * the keyboard macro buffer.
+ */
+struct kbd_op {
+    int c;
+    int f;
+    int n;
+    int k_from;         /* kbdm[] keystrokes read by the command */
+    int k_to;
+    db text;            /* Self-inserted text, for literal entries */
+};
+static struct kbd_op *kbd_ops = NULL;
+static int kbd_nops = 0;
+static int kbd_ops_alloc = 0;
+static int kbd_ops_valid = FALSE;   /* Set when recording ends normally */
+
+#define KBD_LITERAL_MODES \
+    (MDVIEW | MDOVER | MDWRAP | MDCMOD | MDPHON | MDASAVE)
+
+static void kbd_ops_reset(void) {
+    for (int i = 0; i < kbd_nops; i++) db_free(kbd_ops[i].text);
+    kbd_nops = 0;
+    kbd_ops_valid = FALSE;
+    return;
+}
+
+static struct kbd_op *kbd_op_new(void) {
+    if (kbd_nops == kbd_ops_alloc) {
+        kbd_ops_alloc += 64;
+        kbd_ops = Xrealloc(kbd_ops,
+             (size_t)kbd_ops_alloc*sizeof(struct kbd_op));
+    }
+    struct kbd_op *op = &kbd_ops[kbd_nops++];
+    db_strdef(empty_text);
+    op->text = empty_text;
+    return op;
+}
+
+int execute(int, int, int);     /* Forward declaration */
+
+/* Run one recorded command, while recording.
+ * Whether it is self-inserted text has to be noted before running it,
+ * as it may change the binding itself.
+ */
+static void record_kbd_op(int c, int f, int n) {
+    int literal = !getbind(c) && !f && !(curbp->b_mode & MDVIEW) &&
+          ((c >= 0x20 && c <= 0x7E) || (c >= 0xA0 && c <= MAX_UNICODE_CHAR));
+    int k_from = (int)(kbdptr - kbdm);
+
+    execute(c, f, n);
+    if (kbdmode != RECORD) return;  /* Ended (or aborted) here */
+
+    int k_to = (int)(kbdptr - kbdm);
+    if (literal && (k_from == k_to)) {
+        char utf8[6];
+        int nbytes = unicode_to_utf8((unicode_t)c, utf8);
+        struct kbd_op *op;
+        if ((kbd_nops > 0) && (db_len(kbd_ops[kbd_nops-1].text) > 0))
+            op = &kbd_ops[kbd_nops-1];  /* Add to the current text */
+        else
+            op = kbd_op_new();
+        op->c = c;              /* Last char, for f_arg */
+        op->f = FALSE;
+        op->n = 1;
+        op->k_from = op->k_to = k_to;
+        db_appendn(op->text, utf8, nbytes);
+        return;
+    }
+    struct kbd_op *op = kbd_op_new();
+    op->c = c;
+    op->f = f;
+    op->n = n;
+    op->k_from = k_from;
+    op->k_to = k_to;
+    return;
+}
+
+/* Whether any character of a literal entry has been bound since it
+ * was recorded.
+ */
+static int kbd_text_bound(struct kbd_op *op) {
+    const char *tp = db_val(op->text);
+    int len = db_len(op->text);
+    for (int i = 0; i < len; ) {
+        unicode_t uc;
+        i += utf8_to_unicode(tp, i, len, &uc);
+        if (getbind((int)uc)) return TRUE;
+    }
+    return FALSE;
+}
+
+/* Replay one compiled entry.
+ * The keystrokes that it read when recorded are made available to it,
+ * and tgetc() will give it abortc if it tries to read more.
+ */
+static int run_kbd_op(struct kbd_op *op) {
+    if (!meta_spec_active.C) {      /* As for the command loop */
+        meta_spec_active.C = 1;
+        execute(META|SPEC|'C', FALSE, 1);
+        meta_spec_active.C = 0;
+    }
+    kbdptr = kbdm + op->k_from;
+    kbdend = kbdm + op->k_to;
+
+    if (db_len(op->text) == 0) return execute(op->c, op->f, op->n);
+
+/* Literal text. If any mode would do something special for a typed
+ * character, or one of them is now bound, we have to let execute() do
+ * it, one at a time.
+ */
+    if ((curbp->b_mode & KBD_LITERAL_MODES) || kbd_text_bound(op)) {
+        const char *tp = db_val(op->text);
+        int len = db_len(op->text);
+        int status = TRUE;
+        for (int i = 0; i < len; ) {
+            unicode_t uc;
+            i += utf8_to_unicode(tp, i, len, &uc);
+            status = execute((int)uc, FALSE, 1);
+        }
+        return status;
+    }
+    com_flag = 0;
+    f_arg.func = NULL;
+    f_arg.ca.c = op->c;
+    f_arg.ca.f = FALSE;
+    f_arg.ca.n = 1;
+    return lins_dynbuf(&op->text);
+}
+
+/* Replay the compiled macro reps times.
+ * Stops if a command ends the macro (as execute() does on failure).
+ */
+static int run_kbd_ops(int reps) {
+    int *save_end = kbdend;
+
+    kbdmode = PLAY;
+    kbd_compiled_play = TRUE;
+    while ((reps-- > 0) && (kbdmode == PLAY)) {
+        f_arg = p_arg;
+        for (int i = 0; (i < kbd_nops) && (kbdmode == PLAY); i++)
+            (void)run_kbd_op(&kbd_ops[i]);
+    }
+    kbd_compiled_play = FALSE;
+    kbdptr = kbdm;
+    kbdend = save_end;
+
+/* This is what ctlxrp() would do at the end of the last pass */
+    int status = (kbdmode == PLAY);
+    if (status) {
+        kbdmode = STOP;
+        f_arg = p_arg;
+    }
+    inreex = FALSE;
+    mline_persist = FALSE;
+    update(FALSE);      /* All done, so show it */
+    return status;
+}
+
 /* ======================================================================
  * Begin a keyboard macro.
  * Error if not at the top level in keyboard processing. Set up variables and
@@ -1254,6 +1430,7 @@ int ctlxlp(int f, int n) {
     kbdptr = kbdm;
     kbdend = kbdptr;
     kbdmode = RECORD;
+    kbd_ops_reset();
     start_kbdmacro();
     return TRUE;
 }
@@ -1274,6 +1451,8 @@ int ctlxe(int f, int n) {
 /* Have to save current c/f/n-last */
     p_arg = f_arg;          /* Restored on ctlxrp in execute() */
 
+    if (kbd_ops_valid && !vismac) return run_kbd_ops(n);
+
     kbdrep = n;             /* remember how many times to execute */
     kbdmode = PLAY;         /* start us in play mode */
     kbdptr = kbdm;          /*    at the beginning */
@@ -1313,7 +1492,10 @@ int ctlxrp(int f, int n) {
         mlwrite_one("Macro not active");
         return FALSE;
     }
-    if (kbdmode == RECORD) end_kbdmacro();
+    if (kbdmode == RECORD) {
+        kbd_ops_valid = TRUE;
+        end_kbdmacro();
+    }
 
 /* Collecting a keyboard macro puts a ctlxrp at the end of the buffer.
  * this is somewhat fortunate, as it allows us to detect the end of a
@@ -1714,6 +1896,13 @@ int reexecute(int f, int n) {
  * we're setting up the macro to replay, which is not the same thing...
  */
     if (f_arg.func == ctlxe) {
+/* A compiled macro is replayed within ctlxe(), so we can just loop */
+        if (kbd_ops_valid && !vismac) {
+            int status = TRUE;
+            for (reloop = 1; (reloop <= n) && status; ++reloop)
+                status = ctlxe(f_arg.ca.f, f_arg.ca.n);
+            return status;
+        }
         if (ctlxe_togo == 0) {  /* First call */
             if (n > 1)  ctlxe_togo = n;
             else        ctlxe_togo = 1;
@@ -1794,12 +1983,16 @@ int unarg(int f, int n) {
 int quit(int f, int n) {
     int s;
 
+    bgsave_finish(NULL);    /* Let these finish (and mark the buffers) */
     if (f != FALSE          /* Argument forces it.  */
         || anycb() == FALSE /* All buffers clean.   */
         || (s =             /* User says it's OK.   */
             mlyesno("Modified buffers exist. Leave anyway")) == TRUE) {
 
+        jnl_discard_all();  /* Unsaved changes are being abandoned */
+        bgcmd_stop(NULL);
         vttidy();
+        server_stop();
 
         if (filock) {
             if (lockrel() != TRUE) {
@@ -1816,13 +2009,17 @@ int quit(int f, int n) {
         free_eval();
         free_exec();
         free_file();
+        free_follow();
         free_input();
         free_line();
+        free_mapview();
         free_names();
         free_search();
         free_spawn();
         free_utf8();
         free_word();
+        kbd_ops_reset();
+        Xfree(kbd_ops);
 
         if (filock) free_lock();
 
@@ -1892,6 +2089,7 @@ int quickexit(int f, int n) {
  * functions in this file.
  */
 #include "ebind.h"
+#include "phash_tab.h"
 
 /* ======================================================================
  * GGR - Extend the size of the key_table list.
@@ -1920,7 +2118,7 @@ void extend_keytab(int n_ents) {
             ktp->k_type = FUNC_KMAP;    /* All init ones are this */
             ktp->k_code = init_keytab[n].k_code;
             ktp->hndlr.k_fp = init_keytab[n].k_fp;
-            ktp->fi = func_info(ktp->hndlr.k_fp);
+            ktp->fi = &names[ph_key_name[n]];   /* Known at build time */
             ktp->bk_multiplier = 1;
         }
         init_from = n_init_keys;    /* Only need to add tags from here */
@@ -1930,7 +2128,7 @@ void extend_keytab(int n_ents) {
         keytab[i] = endl_keytab;
     keytab[keytab_alloc_ents - 1] = ends_keytab;
 
-    key_index_valid = 0;    /* Rebuild index before using it. */
+    if (n_ents) init_keylookup();   /* Lookups now match init_keytab */
 
     return;
 }
@@ -1972,6 +2170,7 @@ int main(int argc, char **argv) {
     for (unsigned int si = 0; si < ARRAY_SIZE(siglist); si++)
         sigaction(siglist[si], &sigact, NULL);
     called_as = argv[0];
+    snap_argv0(argv[0]);
 /* The old one to get you out... */
     sigact.sa_handler = emergencyexit;
     sigaction(SIGHUP, &sigact, NULL);
@@ -1988,16 +2187,15 @@ int main(int argc, char **argv) {
     int errflag = FALSE;    /* not doing C error parsing */
     int cryptflag = FALSE;  /* no encryption by default */
     int verflag = 0;        /* GGR Flags -v/-V presence on command line */
+    int clientflag = FALSE; /* -w - pass files to a server */
+    int serverflag = FALSE; /* -z - be a server */
 
 /* Set up the initial keybindings.  Must be done early, before any
  * command line processing.
- * NOTE that we must initialize the namelookup indexing first, i.e. before
- * calling extend_keytab().
  * We need to allow for the additional ENDL_KMAP and ENDS_KMAP entries,
  * which mark the End-of-List and End-of-Structure, and round up to the
  * next KEYTAB_INCR boundary.
  */
-    init_namelookup();
     int n_init_keys = ARRAY_SIZE(init_keytab);
     int init_ents = n_init_keys + 2 + KEYTAB_INCR;
     init_ents /= KEYTAB_INCR;
@@ -2076,7 +2274,7 @@ do {
                  verflag = istrlen(arg);
             key1 = *arg;
 /* Allow options to be given as separate tokens */
-            if (strchr("CDFGKMSX", key1 & (char)~0x20)) {
+            if (strchr("CDFGKMQSX", key1 & (char)~0x20)) {
                 opt = *argv + 2;
                 if (*opt == '\0' && argc > 0 && !strchr("-@", *(*argv + 1))) {
                     if (--argc <= 0) {
@@ -2139,6 +2337,10 @@ do {
                 (void)dup2(nu, 1);
                 close(nu);
                 break;
+            case 'Q':       /* -q start-up snapshot file */
+                Xfree(snapfile);
+                snapfile = Xstrdup(fixup_fname(opt));
+                break;
             case 'R':       /* -r restrictive use */
                 restflag = TRUE;
                 break;
@@ -2153,6 +2355,9 @@ do {
                 if (!verflag) verflag = 1;  /* could be version or */
                 viewflag = TRUE;    /* view request */
                 break;
+            case 'W':       /* -w hand the files to a server */
+                clientflag = TRUE;
+                break;
             case 'X':       /* GGR: -x for eXtra rc file */
                 if (rcnum < ARRAY_SIZE(rcextra)) {
 /* ffropen() will expand any relative/~ pathname *IN PLACE* so
@@ -2162,6 +2367,9 @@ do {
                     rcnum++;
                 }
                 break;
+            case 'Z':       /* -z be a server for -w */
+                serverflag = TRUE;
+                break;
             default:        /* unknown switch - ignore this for now */
                 break;
             }
@@ -2177,6 +2385,13 @@ do {
         exit(EXIT_SUCCESS);
     }
 
+/* A client just hands its files to a server, if there is one */
+    if (clientflag) {
+        int status = server_client(argc, argv,
+             gotoflag? gline: -1, viewflag);
+        if (status >= 0) exit(status);
+    }
+
 /* Initialize the editor.
  * newscreensize() will call vtinit()
  */
@@ -2197,8 +2412,16 @@ do {
 
 /* GGR - Now process initialisation files before processing rest of comline */
     silent = TRUE;
-    if (!rcfile || !startup(rcfile)) startup("");
+    if (!snapfile || !snap_load(snapfile, rcfile)) {
+        if (snapfile) snap_start(rcfile);
+        if (!rcfile || !startup(rcfile)) {
+            if (rcfile) snap_cancel();  /* Not what snap_load() checks */
+            startup("");
+        }
+        if (snapfile) snap_save(snapfile);
+    }
     Xfree_setnull(rcfile);
+    Xfree_setnull(snapfile);
     if (rcnum) {
         for (unsigned int n = 0; n < rcnum; n++) {
             startup(rcextra[n]);
@@ -2308,6 +2531,8 @@ do {
         if (forwhunt(FALSE, 0) == FALSE) update(FALSE);
     }
 
+    if (serverflag) server_start();
+
 /* Setup to process commands. */
 
 loop:
@@ -2332,7 +2557,9 @@ loop:
         movecursor(srow, scol); /* Send the cursor back to where it was */
         TTflush();
     }
+    input_idle = TRUE;      /* Client requests etc. may be handled now */
     c = getcmd();
+    input_idle = FALSE;
 
 /* If there is something on the command line, clear it */
 
@@ -2347,7 +2574,8 @@ loop:
 
 /* And execute the command */
     if (carg->f) mlerase();     /* Remove any numeric arg */
-    execute(carg->c, carg->f, carg->n);
+    if (kbdmode == RECORD) record_kbd_op(carg->c, carg->f, carg->n);
+    else                   execute(carg->c, carg->f, carg->n);
     goto loop;
 }
 
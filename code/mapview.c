@@ -0,0 +1,690 @@
+/*      MAPVIEW.C
+ *
+ *      Viewing a huge file through mmap().
+ *
+ *      The file is mapped read-only and only a part of it (around
+ *      REGION_BYTES) is made into lines in the buffer at any time.
+ *      As dot nears either end of that part it is moved along the file,
+ *      freeing lines at one end and making them at the other, so any
+ *      lines still in view stay where they are.
+ *
+ *      A background thread builds a sparse index of the file's lines
+ *      (the offset of every IDX_STEP-th one), which is used to find a
+ *      line by number, and to number the lines in the buffer.
+ *
+ *      Searches that fail in the buffer move it along the file and try
+ *      again. A literal pattern is looked for in the mapped bytes first,
+ *      so only the part of the file holding it need be made into lines.
+ *
+ *      The buffer is always in View mode and can't be written out.
+ *      Clearing or re-reading it removes the mapping.
+ *
+ *      If the file is cut short while it is mapped (as logrotate's
+ *      copytruncate does) reading the mapping past its new end raises
+ *      SIGBUS. So everything here that reads it does so with a handler
+ *      set to get it out, and the view is then stopped, leaving what is
+ *      in the buffer (marked as Truncated).
+ */
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <setjmp.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define MAPVIEW_C
+
+#include "estruct.h"
+#include "edef.h"
+#include "efunc.h"
+#include "line.h"
+
+#define MAPVIEW_MIN     (64*1024*1024)  /* view-file maps files this big */
+#define REGION_BYTES    (1024*1024)
+#define SLIDE_MARGIN    (REGION_BYTES/4)
+#define SCAN_OVERLAP    4096    /* Kept when a search moves along */
+#define IDX_STEP        65536
+#define IDX_BLOCK       (4*1024*1024)
+
+static struct mapview {
+    struct buffer *bp;
+    const char *base;           /* The mapped file */
+    size_t size;
+    int fd;                     /* Kept open to notice it shrinking */
+    size_t start;               /* The part of it in the buffer */
+    size_t end;
+    int first_line;             /* Line number of the first line there */
+
+    pthread_t indexer;
+    pthread_mutex_t lock;       /* For all below here */
+    size_t *idx;                /* idx[k] is where line k*IDX_STEP+1 is */
+    int nidx;
+    size_t ix_off;              /* Indexed up to here... */
+    int ix_lines;               /* ...which has this many lines before it */
+    int stop;
+} **mvs = NULL;
+static int nmvs = 0;
+
+static struct mapview *find_mv(struct buffer *bp) {
+    for (int mi = 0; mi < nmvs; mi++)
+        if (mvs[mi]->bp == bp) return mvs[mi];
+    return NULL;
+}
+
+/* How much of the mapping can still be read.
+ * If the file has been cut short since it was mapped, touching the
+ * mapping past its new end would raise SIGBUS.
+ */
+static size_t readable(struct mapview *mv) {
+    struct stat st;
+    if (fstat(mv->fd, &st) < 0) return 0;
+    return ((size_t)st.st_size < mv->size)? (size_t)st.st_size: mv->size;
+}
+
+/* Where the SIGBUS handler is to jump back to in this thread, while it
+ * is reading a mapping. Any other SIGBUS is left to the handler that
+ * was there before (which exits).
+ * The mapview pointers in the functions that set it are volatile, as
+ * they are used after a siglongjmp() back.
+ */
+static __thread sigjmp_buf *bus_jmp = NULL;
+static struct sigaction old_bus;
+static int bus_set = 0;
+
+static void bus_caught(int signr) {
+    if (bus_jmp) siglongjmp(*bus_jmp, 1);
+    sigaction(signr, &old_bus, NULL);   /* Happens again on return */
+    return;
+}
+
+static void map_lost(struct mapview *);     /* Forward declaration */
+
+static void bus_catch(void) {
+    if (bus_set) return;
+    struct sigaction sigact;
+    memset(&sigact, 0, sizeof(sigact));
+    sigact.sa_handler = bus_caught;
+    sigemptyset(&sigact.sa_mask);
+    sigaction(SIGBUS, &sigact, &old_bus);
+    bus_set = 1;
+    return;
+}
+
+/* Where the line holding off starts, and where the next one does */
+static size_t line_start(struct mapview *mv, size_t off) {
+    if (off == 0) return 0;
+    const char *nl = memrchr(mv->base, '\n', off);
+    return nl? (size_t)(nl - mv->base) + 1: 0;
+}
+static size_t line_end(struct mapview *mv, size_t off) {
+    if (off >= mv->size) return mv->size;
+    const char *nl = memchr(mv->base + off, '\n', mv->size - off);
+    return nl? (size_t)(nl - mv->base) + 1: mv->size;
+}
+
+/* Count the lines starting in [from, to) */
+static int count_lines(struct mapview *mv, size_t from, size_t to) {
+    int nl = 0;
+    const char *p = mv->base + from;
+    const char *end = mv->base + to;
+    while ((p < end) && (p = memchr(p, '\n', (size_t)(end - p)))) {
+        nl++;
+        p++;
+    }
+    return nl;
+}
+
+/* The background indexer.
+ * If the file is cut short it just stops, and the index stays as far
+ * as it got (the main thread finds out for itself).
+ */
+static void index_file(struct mapview *mv) {
+    size_t off = 0;
+    int lines = 0;
+    while (off < mv->size) {
+        size_t to = off + IDX_BLOCK;
+        if (to > mv->size) to = mv->size;
+        const char *p = mv->base + off;
+        const char *end = mv->base + to;
+        pthread_mutex_lock(&mv->lock);
+        if (mv->stop) {
+            pthread_mutex_unlock(&mv->lock);
+            break;
+        }
+        pthread_mutex_unlock(&mv->lock);
+        if (readable(mv) < to) break;
+        while ((p < end) && (p = memchr(p, '\n', (size_t)(end - p)))) {
+            p++;
+            if ((++lines % IDX_STEP) == 0) {
+                pthread_mutex_lock(&mv->lock);
+                mv->idx = Xrealloc(mv->idx,
+                     (size_t)(mv->nidx+1)*sizeof(size_t));
+                mv->idx[mv->nidx++] = (size_t)(p - mv->base);
+                pthread_mutex_unlock(&mv->lock);
+            }
+        }
+        off = to;
+        pthread_mutex_lock(&mv->lock);
+        mv->ix_off = off;
+        mv->ix_lines = lines;
+        pthread_mutex_unlock(&mv->lock);
+    }
+    return;
+}
+
+/* The indexer thread.
+ * It blocks all signals bar SIGBUS, leaving them to the main thread.
+ * The file can still be cut short between its check and its reading a
+ * block, so it catches that too.
+ */
+static void *indexer(void *arg) {
+    sigset_t all;
+    sigfillset(&all);
+    sigdelset(&all, SIGBUS);
+    pthread_sigmask(SIG_BLOCK, &all, NULL);
+
+    sigjmp_buf env;
+    if (sigsetjmp(env, 1) == 0) {
+        bus_jmp = &env;
+        index_file(arg);
+    }
+    bus_jmp = NULL;
+    return NULL;
+}
+
+/* Where line n (from 1) starts, or the file size if there are fewer.
+ * Starts counting from the nearest point the indexer has reached.
+ */
+static size_t line_offset(struct mapview *mv, int n) {
+    size_t off = 0;
+    int line = 1;
+    pthread_mutex_lock(&mv->lock);
+    int k = (n - 1)/IDX_STEP;
+    if (k > mv->nidx) k = mv->nidx;
+    if (k > 0) {
+        off = mv->idx[k-1];
+        line = k*IDX_STEP + 1;
+    }
+    size_t ix_off = 0;
+    int from_ix = (mv->ix_lines < n) && (mv->ix_lines + 1 > line);
+    if (from_ix) {
+        ix_off = mv->ix_off;
+        line = mv->ix_lines + 1;
+    }
+    pthread_mutex_unlock(&mv->lock);
+    if (from_ix) off = line_start(mv, ix_off);  /* Not with the lock held */
+    while ((line < n) && (off < mv->size)) {
+        off = line_end(mv, off);
+        line++;
+    }
+    return off;
+}
+
+/* The number of the line starting at off */
+static int line_number(struct mapview *mv, size_t off) {
+    size_t from = 0;
+    int line = 1;
+    pthread_mutex_lock(&mv->lock);
+    int lo = 0, hi = mv->nidx;     /* Last index entry <= off */
+    while (lo < hi) {
+        int mid = (lo + hi)/2;
+        if (mv->idx[mid] <= off) lo = mid + 1;
+        else                     hi = mid;
+    }
+    if (lo > 0) {
+        from = mv->idx[lo-1];
+        line = lo*IDX_STEP + 1;
+    }
+    pthread_mutex_unlock(&mv->lock);
+    return line + count_lines(mv, from, off);
+}
+
+/* Make lines of [from, to) and put them in before lp.
+ * Returns how many there were.
+ */
+static int make_lines(struct mapview *mv, size_t from, size_t to,
+     struct line *lp) {
+    int dos = (mv->bp->b_mode & MDDOSLE) != 0;
+    int nl = 0;
+    while (from < to) {
+        size_t next = line_end(mv, from);
+        size_t len = next - from;
+        if ((len > 0) && (mv->base[next-1] == '\n')) {
+            len--;
+            if (dos && (len > 0) && (mv->base[from+len-1] == '\r')) len--;
+        }
+        struct line *nlp = lalloc();
+        nlp->l_bp = lp->l_bp;   /* In before the copy, which might fail */
+        nlp->l_fp = lp;
+        lp->l_bp->l_fp = nlp;
+        lp->l_bp = nlp;
+        if (len > 0) db_setn(ldb(nlp), mv->base + from, (int)len);
+        nl++;
+        from = next;
+    }
+    return nl;
+}
+
+/* Put [ns, ne) of the file into the buffer.
+ * Where this overlaps what is there the lines are kept, otherwise
+ * they are all replaced.
+ */
+static void set_region(struct mapview *mv, size_t ns, size_t ne) {
+    struct buffer *bp = mv->bp;
+    struct line *lp;
+
+    if ((ns >= mv->end) || (ne <= mv->start) || (mv->start == mv->end)) {
+        while ((lp = lforw(bp->b_linep)) != bp->b_linep) lfree(lp);
+        make_lines(mv, ns, ne, bp->b_linep);
+        mv->first_line = line_number(mv, ns);
+    }
+    else {
+        while (mv->start < ns) {
+            mv->start = line_end(mv, mv->start);
+            lfree(lforw(bp->b_linep));
+            mv->first_line++;
+        }
+        if (ns < mv->start)
+            mv->first_line -= make_lines(mv, ns, mv->start,
+                 lforw(bp->b_linep));
+        while (mv->end > ne) {
+            mv->end = line_start(mv, mv->end - 1);
+            lfree(lback(bp->b_linep));
+        }
+        if (mv->end < ne) make_lines(mv, mv->end, ne, bp->b_linep);
+    }
+    mv->start = ns;
+    mv->end = ne;
+    bp->b_edits++;          /* The lines have changed */
+
+    for (struct window *wp = wheadp; wp != NULL; wp = wp->w_wndp) {
+        if (wp->w_bufp != bp) continue;
+        if (wp->w_linep == bp->b_linep) wp->w_linep = lforw(bp->b_linep);
+        wp->w_flag |= WFHARD | WFMODE;
+    }
+    if (bp == group_match_buffer) group_match_buffer = NULL;
+}
+
+/* Put the REGION_BYTES or so around off into the buffer */
+static void region_around(struct mapview *mv, size_t off) {
+    size_t ns = (off > REGION_BYTES/2)? off - REGION_BYTES/2: 0;
+    size_t ne = off + REGION_BYTES/2;
+    set_region(mv, line_start(mv, ns), line_end(mv, ne));
+}
+
+/* Where in the file a line of the buffer starts */
+static size_t line_pos(struct mapview *mv, struct line *tlp) {
+    size_t off = mv->start;
+    for (struct line *lp = lforw(mv->bp->b_linep); lp != tlp;
+         lp = lforw(lp)) {
+        if (lp == mv->bp->b_linep) return mv->end;
+        off = line_end(mv, off);
+    }
+    return off;
+}
+
+/* The line of the buffer starting at off (which must be in it) */
+static struct line *pos_line(struct mapview *mv, size_t pos) {
+    struct line *lp = lforw(mv->bp->b_linep);
+    for (size_t off = mv->start; off < pos; off = line_end(mv, off))
+        lp = lforw(lp);
+    return lp;
+}
+
+/* Map the buffer's file, if it is big enough or always is set.
+ * Called by readin() in place of reading the file.
+ * Returns FALSE if it didn't, and the file should be read as usual.
+ */
+int mapview_start(struct buffer *bp, int always) {
+    struct stat st;
+
+    int fd = open(bp->b_rpname, O_RDONLY);
+    if (fd < 0) return FALSE;
+    if ((fstat(fd, &st) < 0) || !S_ISREG(st.st_mode) ||
+         (!always && (st.st_size < MAPVIEW_MIN)) || (st.st_size == 0)) {
+        close(fd);
+        return FALSE;
+    }
+    void *base = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE,
+         fd, 0);
+    if (base == MAP_FAILED) {
+        close(fd);
+        return FALSE;
+    }
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+    bus_catch();
+
+    struct mapview *volatile mv = Xmalloc(sizeof(struct mapview));
+    memset(mv, 0, sizeof(struct mapview));
+    mv->bp = bp;
+    mv->base = base;
+    mv->size = (size_t)st.st_size;
+    mv->fd = fd;
+    mv->first_line = 1;
+    pthread_mutex_init(&mv->lock, NULL);
+    madvise(base, mv->size, MADV_SEQUENTIAL);
+    if (pthread_create(&mv->indexer, NULL, indexer, mv) != 0) {
+        pthread_mutex_destroy(&mv->lock);
+        munmap(base, mv->size);
+        close(fd);
+        Xfree(mv);
+        return FALSE;
+    }
+    mvs = Xrealloc(mvs, (size_t)(nmvs+1)*sizeof(struct mapview *));
+    mvs[nmvs++] = mv;
+    bp->b_flag |= BFMAPPED;
+    bp->b_mode |= MDVIEW;
+    bp->b_EOLmissing = 0;
+
+    sigjmp_buf env;
+    if (sigsetjmp(env, 1)) {
+        map_lost(mv);
+        return TRUE;
+    }
+    bus_jmp = &env;
+
+/* The DOS check is the same as readin()'s - on the first line */
+    size_t fe = line_end(mv, 0);
+    if (autodos && (fe > 1) && (mv->base[fe-1] == '\n') &&
+         (mv->base[fe-2] == '\r'))
+        bp->b_mode |= MDDOSLE;
+    else
+        bp->b_mode &= ~MDDOSLE;
+    set_region(mv, 0, line_end(mv, REGION_BYTES));
+    bus_jmp = NULL;
+    return TRUE;
+}
+
+static void unmap(struct mapview *mv) {
+    pthread_mutex_lock(&mv->lock);
+    mv->stop = 1;
+    pthread_mutex_unlock(&mv->lock);
+    pthread_join(mv->indexer, NULL);
+    pthread_mutex_destroy(&mv->lock);
+    munmap((void *)mv->base, mv->size);
+    close(mv->fd);
+    Xfree(mv->idx);
+    Xfree(mv);
+}
+
+/* Remove any mapping of the buffer's file */
+void mapview_stop(struct buffer *bp) {
+    for (int mi = 0; mi < nmvs; mi++) {
+        if (mvs[mi]->bp != bp) continue;
+        unmap(mvs[mi]);
+        mvs[mi] = mvs[--nmvs];
+        bp->b_flag &= ~BFMAPPED;
+        break;
+    }
+}
+
+/* Reading the mapping has raised SIGBUS, as the file has been cut short
+ * since it was mapped.
+ * Stop the view, leaving whatever lines are in the buffer (lfree() will
+ * have moved anything pointing at any it had freed), marked as being
+ * only a part of the file.
+ */
+static void map_lost(struct mapview *mv) {
+    struct buffer *bp = mv->bp;
+
+    bus_jmp = NULL;
+    mapview_stop(bp);
+    bp->b_flag |= BFTRUNC;
+    bp->b_edits++;
+    for (struct window *wp = wheadp; wp != NULL; wp = wp->w_wndp) {
+        if (wp->w_bufp != bp) continue;
+        if (wp->w_linep == bp->b_linep) wp->w_linep = lforw(bp->b_linep);
+        wp->w_flag |= WFHARD | WFMODE;
+    }
+    if (bp == group_match_buffer) group_match_buffer = NULL;
+    mlwrite_one("File has been cut short - mapped view stopped");
+}
+
+/* Called at the start of update().
+ * If dot in the current window is near either end of what is in the
+ * buffer, move that along the file to be around it.
+ * Not while a command that keeps line pointers across its redisplays
+ * (isearch, query-replace) is running, as that would free them.
+ */
+void mapview_slide(void) {
+    struct mapview *volatile mv;
+    if (hold_lines) return;
+    if (!(curbp->b_flag & BFMAPPED) || !(mv = find_mv(curbp))) return;
+
+    curbp->b_mode |= MDVIEW;    /* Whatever anyone tried */
+    sigjmp_buf env;
+    if (sigsetjmp(env, 1)) {
+        map_lost(mv);
+        return;
+    }
+    bus_jmp = &env;
+    size_t pos = line_pos(mv, curwp->w.dotp);
+    if (((mv->start > 0) && (pos - mv->start < SLIDE_MARGIN)) ||
+         ((mv->end < mv->size) && (mv->end - pos < SLIDE_MARGIN))) {
+        region_around(mv, pos);
+    }
+    bus_jmp = NULL;
+}
+
+/* Called by next-line and previous-line before moving dot n lines.
+ * Moves what is in the buffer so that the move stays within it.
+ * A move too far for that puts dot just short of where it is going,
+ * and returns the one line still to move.
+ */
+static int move_lines(struct mapview *mv, int n) {
+    size_t dpos = line_pos(mv, curwp->w.dotp);
+    size_t tpos = dpos;
+    int togo = n;
+    while ((togo > 0) && (tpos < mv->size)) {
+        if (tpos - dpos > REGION_BYTES/2) break;
+        tpos = line_end(mv, tpos);
+        togo--;
+    }
+    while ((togo < 0) && (tpos > 0)) {
+        if (dpos - tpos > REGION_BYTES/2) break;
+        tpos = line_start(mv, tpos - 1);
+        togo++;
+    }
+    if ((togo > 0) && (tpos < mv->size)) {
+        int target = line_number(mv, dpos) + n;
+        tpos = line_start(mv, line_offset(mv, target) - 1);
+        n = 1;
+    }
+    else if ((togo < 0) && (tpos > 0)) {
+        int target = line_number(mv, dpos) + n;
+        tpos = line_end(mv, line_offset(mv, (target > 1)? target: 1));
+        n = -1;
+    }
+    else {      /* Dot stays in the buffer, with where it's going */
+        size_t lo = (n > 0)? dpos: tpos;
+        size_t hi = (n > 0)? tpos: dpos;
+        if (((lo >= mv->start + SLIDE_MARGIN) || (mv->start == 0)) &&
+            ((hi + SLIDE_MARGIN <= mv->end) || (mv->end == mv->size)))
+            return n;
+        region_around(mv, lo + (hi - lo)/2);
+        return n;
+    }
+    int doto = curwp->w.doto;   /* For the goal column */
+    region_around(mv, tpos);
+    curwp->w.dotp = pos_line(mv, tpos);
+    curwp->w.doto = (doto < lused(curwp->w.dotp))?
+         doto: lused(curwp->w.dotp);
+    return n;
+}
+
+/* move_lines(), stopping the view if the file has been cut short */
+int mapview_lines(int n) {
+    struct mapview *volatile mv = find_mv(curbp);
+    volatile int vn = n;
+    if (!mv || (n == 0)) return n;
+
+    sigjmp_buf env;
+    if (sigsetjmp(env, 1)) {    /* Dot stays where it is */
+        map_lost(mv);
+        return 0;
+    }
+    bus_jmp = &env;
+    int togo = move_lines(mv, vn);
+    bus_jmp = NULL;
+    return togo;
+}
+
+/* For the mode line of a window onto a mapped buffer.
+ * How far through the file its top line is, as a percentage, or -1
+ * if it is showing the start or end of the file.
+ */
+int mapview_percent(struct window *wp) {
+    struct mapview *volatile mv = find_mv(wp->w_bufp);
+    if (!mv) return -1;
+
+    struct line *blp = wp->w_bufp->b_linep;
+    if ((mv->start == 0) && (lback(wp->w_linep) == blp)) return -1;
+    if (mv->end == mv->size) {
+        struct line *lp = wp->w_linep;
+        for (int rows = wp->w_ntrows; rows--; lp = lforw(lp))
+            if (lp == blp) return -1;
+    }
+    sigjmp_buf env;
+    if (sigsetjmp(env, 1)) {
+        map_lost(mv);
+        return -1;
+    }
+    bus_jmp = &env;
+    size_t pc = 100*line_pos(mv, wp->w_linep)/mv->size;
+    bus_jmp = NULL;
+    return (pc > 99)? 99: (int)pc;
+}
+
+/* The file line number of the first line in the buffer */
+int mapview_first_line(struct buffer *bp) {
+    struct mapview *mv = find_mv(bp);
+    return mv? mv->first_line: 1;
+}
+
+/* goto-line, beginning-of-file and end-of-file for a mapped buffer.
+ * Line 0 is the end.
+ */
+int mapview_goto_line(int n) {
+    struct mapview *volatile mv = find_mv(curbp);
+    if (!mv) return FALSE;
+
+    sigjmp_buf env;
+    if (sigsetjmp(env, 1)) {
+        map_lost(mv);
+        return FALSE;
+    }
+    bus_jmp = &env;
+    size_t pos = (n > 0)? line_offset(mv, n): mv->size;
+    region_around(mv, pos);
+    curwp->w.dotp = pos_line(mv, pos);
+    curwp->w.doto = 0;
+    curwp->w_flag |= WFHARD;
+    bus_jmp = NULL;
+    return TRUE;
+}
+
+/* Run a search scan in a mapped buffer, moving what is in the buffer
+ * along the file (in direction dir) each time it fails, until it
+ * succeeds or the file runs out.
+ * If lit is set it is a literal pattern, so the next place to try can
+ * be found in the mapped bytes (unless it has a newline and the file has
+ * CRLF ones, so the bytes won't match).
+ * If it fails, the buffer is put back as it was and *olpp (a line the
+ * caller wants to return to) is set to the line it now is.
+ * If the file is truncated under us it fails there, putting the buffer
+ * back only if that part of the file is still there. Otherwise *olpp is
+ * left on the line it was trying from.
+ */
+static int scan_map(struct mapview *mv, int (*scan)(void), int dir,
+     const char *lit, struct line **olpp) {
+    size_t ostart = mv->start;
+    size_t oend = mv->end;
+    size_t opos = line_pos(mv, *olpp);
+    if (lit && (curbp->b_mode & MDDOSLE) && strchr(lit, '\n')) lit = NULL;
+    size_t litlen = lit? strlen(lit): 0;
+
+    while (1) {
+        struct line *slp = curwp->w.dotp;
+        int soff = curwp->w.doto;
+        if (scan()) return TRUE;
+        curwp->w.dotp = slp;
+        curwp->w.doto = soff;
+        size_t rsize = readable(mv);
+        if (rsize < mv->size) {
+            if (oend <= rsize) break;
+            *olpp = slp;
+            return FALSE;
+        }
+        size_t dpos = line_pos(mv, slp);
+
+        size_t ns, ne;
+        if (dir == FORWARD) {
+            if (mv->end >= mv->size) break;
+            ns = line_start(mv, mv->end - SCAN_OVERLAP);
+            if (ns <= mv->start) ns = mv->end;
+            if (lit) {
+                const char *hit = memmem(mv->base + ns, mv->size - ns,
+                     lit, litlen);
+                if (!hit) break;
+                size_t hs = line_start(mv, (size_t)(hit - mv->base));
+                if (hs > ns) ns = hs;
+            }
+            ne = line_end(mv, ns + REGION_BYTES);
+            set_region(mv, ns, ne);
+            if (dpos < ns) {    /* Start at the top of the new part */
+                curwp->w.dotp = lforw(curbp->b_linep);
+                curwp->w.doto = 0;
+            }
+        }
+        else {
+            if (mv->start == 0) break;
+            ne = line_end(mv, mv->start + SCAN_OVERLAP);
+            if (ne >= mv->end) ne = mv->start;
+            ns = (ne > REGION_BYTES)? line_start(mv, ne - REGION_BYTES): 0;
+            set_region(mv, ns, ne);
+            if (dpos >= ne) {   /* Start at the end of the new part */
+                curwp->w.dotp = curbp->b_linep;
+                curwp->w.doto = 0;
+            }
+        }
+    }
+
+/* Not found - put it all back */
+    set_region(mv, ostart, oend);
+    *olpp = pos_line(mv, opos);
+    return FALSE;
+}
+
+/* scan_map(), stopping the view if the file has been cut short */
+int mapview_scan(int (*scan)(void), int dir, const char *lit,
+     struct line **olpp) {
+    struct mapview *volatile mv = find_mv(curbp);
+    if (!mv) return scan();
+
+    sigjmp_buf env;
+    if (sigsetjmp(env, 1)) {    /* *olpp may have been freed */
+        map_lost(mv);
+        *olpp = curwp->w.dotp;
+        return FALSE;
+    }
+    bus_jmp = &env;
+    int status = scan_map(mv, scan, dir, lit, olpp);
+    bus_jmp = NULL;
+    return status;
+}
+
+#ifdef DO_FREE
+/* Add a call to allow free() of normally-unfreed items here for, e.g,
+ * valgrind usage.
+ */
+void free_mapview(void) {
+    for (int mi = 0; mi < nmvs; mi++) unmap(mvs[mi]);
+    nmvs = 0;
+    Xfree_setnull(mvs);
+    return;
+}
+#endif
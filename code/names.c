@@ -37,6 +37,7 @@ struct name_bind names[] = {
     {"clear-and-redraw", redraw, {0, 0, 0, 1, 0, 0}, CFALL},
     {"clear-message-line", clrmes, {0, 0, 0, 1, 0, 0}, CFNONE},
     {"copy-region", copyregion, {0, 0, 0, 1, 0, 0}, CFCPCN|CFKILL},
+    {"count-matches", countmatches, {0, 1, 0, 0, 0, 0}, CFNONE},
     {"count-words", wordcount, {0, 1, 0, 1, 0, 0}, CFNONE},
     {"ctlx-prefix", cex, {0, 0, 0, 0, 0, 0}, CFNONE},
     {"delete-blank-lines", deblank, {0, 0, 0, 0, 0, 0}, CFNONE},
@@ -117,10 +118,13 @@ struct name_bind names[] = {
     {"fill-all-paragraphs", fillwhole, {0, 0, 0, 0, 0, 0}, CFNONE},
     {"filter-buffer", filter_buffer, {0, 0, 0, 0, 0, 0}, CFNONE},
     {"find-file", filefind, {0, 0, 0, 0, 0, 0}, CFNONE},
+    {"follow-file", follow_file, {0, 0, 0, 0, 0, 0}, CFNONE},
     {"forward-character", forwchar, {0, 0, 0, 0, 0, 0}, CFNONE},
     {"ggr-style", ggr_style, {0, 0, 0, 1, 0, 0}, CFNONE},
+    {"goto-grep-match", gotogrepmatch, {0, 0, 0, 0, 0, 0}, CFNONE},
     {"goto-line", gotoline, {0, 0, 0, 0, 0, 0}, CFNONE},
     {"goto-matching-fence", getfence, {0, 0, 0, 0, 0, 0}, CFNONE},
+    {"grep-files", grepfiles, {0, 1, 0, 0, 0, 0}, CFNONE},
     {"grow-window", enlargewind, {0, 1, 0, 1, 0, 0}, CFNONE},
     {"handle-tab", insert_tab, {0, 0, 0, 0, 0, 0}, CFNONE},
     {"help", help, {0, 1, 0, 1, 0, 0}, CFNONE},
@@ -135,10 +139,12 @@ struct name_bind names[] = {
     {"insert-string", istring, {0, 0, 0, 0, 0, 0}, CFNONE},
     {"justify-paragraph", justpara, {0, 0, 0, 0, 0, 0}, CFNONE},
     {"kill-paragraph", killpara, {0, 0, 0, 0, 0, 0}, CFKILL},
+    {"kill-pipe-command", kill_pipe_command, {0, 0, 0, 0, 0, 0}, CFNONE},
     {"kill-region", killregion, {0, 0, 0, 0, 0, 0}, CFKILL},
     {"kill-to-end-of-line", killtext, {0, 0, 0, 0, 0, 0}, CFKILL},
     {"leave-one-white", leaveone, {0, 0, 0, 0, 0, 0}, CFNONE},
     {"list-buffers", listbuffers, {0, 1, 0, 1, 0, 0}, CFALL},
+    {"list-matches", listmatches, {0, 1, 0, 0, 0, 0}, CFNONE},
     {"macro-helper", macro_helper, {0, 1, 1, 0, 0, 0}, CFNONE},
     {"makelist-region", makelist_region, {0, 0, 0, 0, 0, 0}, CFNONE},
     {"numberlist-region", numberlist_region, {0, 0, 0, 0, 0, 0}, CFNONE},
@@ -161,6 +167,7 @@ struct name_bind names[] = {
     {"open-line", openline, {0, 0, 0, 0, 0, 0}, CFNONE},
     {"overwrite-string", ovstring, {0, 0, 0, 0, 0, 0}, CFNONE},
     {"pipe-command", pipecmd, {0, 1, 0, 0, 0, 0}, CFNONE},
+    {"pipe-command-background", pipecmd_background, {0, 1, 0, 0, 0, 0}, CFNONE},
     {"previous-line", backline, {0, 0, 0, 0, 0, 0}, CFCPCN},
     {"previous-page", backpage, {0, 0, 0, 0, 0, 0}, CFNONE},
     {"previous-paragraph", gotobop, {0, 0, 0, 0, 0, 0}, CFNONE},
@@ -171,6 +178,7 @@ struct name_bind names[] = {
     {"quote-character", quote, {1, 0, 0, 0, 0, 0}, CFNONE},
     {"quoted-count", quotedcount, {0, 0, 0, 0, 0, 0}, CFNONE},
     {"read-file", fileread, {0, 0, 0, 0, 0, 0}, CFNONE},
+    {"recover-journal", recover_journal, {0, 0, 0, 0, 0, 0}, CFNONE},
     {"redraw-display", reposition, {0, 0, 0, 1, 0, 0}, CFALL},
 /* Marked as non_moving for convenience. Original command will be correct */
     {"reexecute", reexecute, {0, 0, 0, 1, 0, 0}, CFALL},
@@ -178,8 +186,10 @@ struct name_bind names[] = {
     {"restore-window", restwnd, {0, 1, 0, 0, 0, 0}, CFNONE},
     {"replace-string", sreplace, {0, 0, 0, 0, 0, 0}, CFNONE},
     {"reverse-incremental-search", risearch, {0, 1, 0, 0, 0, 0}, CFNONE},
+    {"revert-file", revert_file, {0, 0, 0, 0, 0, 0}, CFNONE},
     {"run", execproc, {0, 0, 0, 0, 0, 0}, CFNONE},
     {"save-file", filesave, {0, 0, 0, 1, 0, 0}, CFALL},
+    {"save-file-background", bgfilesave, {0, 0, 0, 1, 0, 0}, CFALL},
     {"save-window", savewnd, {0, 1, 0, 1, 0, 0}, CFALL},
     {"scroll-next-up", scrnextup, {0, 1, 0, 1, 0, 0}, CFNONE},
     {"scroll-next-down", scrnextdw, {0, 1, 0, 1, 0, 0}, CFNONE},
@@ -187,6 +197,7 @@ struct name_bind names[] = {
     {"search-forward", forwsearch, {0, 0, 0, 1, 0, 0}, CFNONE},
     {"search-reverse", backsearch, {0, 0, 0, 1, 0, 0}, CFNONE},
     {"select-buffer", usebuffer, {0, 1, 0, 0, 0, 0}, CFNONE},
+    {"server-done", server_done, {0, 1, 0, 0, 0, 0}, CFNONE},
     {"set", setvar, {0, 0, 0, 1, 0, 0}, CFALL},
     {"set-encryption-key", set_encryption_key, {0, 1, 0, 0, 0, 0}, CFALL},
     {"set-fill-column", setfillcol, {0, 1, 0, 1, 0, 0}, CFALL},
@@ -225,82 +236,74 @@ struct name_bind names[] = {
     {"yank-replace", yank_replace, {0, 0, 0, 0, 0, 0}, CFYANK},
 };
 
-/* Routine to produce an array index for names sorted by:
- *      a) function call (addr)
- *      b) function name
- * To be called from main() at start-up time.
+/* Lookups on names[].
+ * The name lookup, and the ordered stepping through names, use the
+ * perfect hash tables and sorted order generated at build time by
+ * mkphash (see the Makefile), so there is no sorting at start-up.
+ * The function address lookup can't be done at build time (the
+ * addresses aren't known until link time), so that uses an
+ * open-addressing hash on the address, built on first use.
  */
 
-#include <stddef.h>
-#include "idxsorter.h"
+#ifndef PHASH_GEN       /* Not set when mkphash is preprocessing us */
 
-int names_size = ARRAY_SIZE(names);
-static int *func_index = NULL;
-int *name_index = NULL;
-static int *next_name_index = NULL;
+#include <stdint.h>
+
+#include "phash.h"
+#include "phash_tab.h"
 
-void init_namelookup(void) {
-    struct fields fdef;
+int names_size = ARRAY_SIZE(names);
+const int *name_index = ph_name_order;
 
-    fdef.offset = offsetof(struct name_bind, n_func);
-    fdef.type = 'P';
-    fdef.len = sizeof(fn_t);
-    func_index = Xmalloc((size_t)(names_size+1)*sizeof(int));
-    idxsort_fields((unsigned char *)names, func_index,
-          sizeof(struct name_bind), names_size, 1, &fdef);
+static short *func_hash = NULL;
+static unsigned int func_hash_size;
 
-    fdef.offset = offsetof(struct name_bind, n_name);
-    fdef.type = 'S';
-    fdef.len = 0;
-    name_index = Xmalloc((size_t)(names_size+1)*sizeof(int));
-    idxsort_fields((unsigned char *)names, name_index,
-          sizeof(struct name_bind), names_size, 1, &fdef);
+static unsigned int func_key(fn_t func) {
+    return ph_inthash((unsigned int)(uintptr_t)func, 0) &
+          (func_hash_size - 1);
+}
 
-/* We want to step through this one, so need a next index too */
-    next_name_index = Xmalloc((size_t)(names_size+1)*sizeof(int));
-    make_next_idx(name_index, next_name_index, names_size);
+/* Insert in names[] order, skipping any function already there.
+ * So for any function with multiple names we keep the first.
+ */
+static void init_func_hash(void) {
+    func_hash_size = 2;
+    while (func_hash_size < 2*(unsigned int)names_size) func_hash_size <<= 1;
+    func_hash = Xmalloc(func_hash_size*sizeof(short));
+    for (unsigned int hi = 0; hi < func_hash_size; hi++) func_hash[hi] = -1;
+    for (int ni = 0; ni < names_size; ni++) {
+        unsigned int hi = func_key(names[ni].n_func);
+        while (func_hash[hi] >= 0) {
+            if (names[func_hash[hi]].n_func == names[ni].n_func) break;
+            hi = (hi + 1) & (func_hash_size - 1);
+        }
+        if (func_hash[hi] < 0) func_hash[hi] = (short)ni;
+    }
     return;
 }
 
 /* Lookup by function call address.
- * NOTE: that we use a binary chop that ensures we find the first
- * entry of any multiple ones.
+ * NOTE: that this returns the first entry in names[] of any multiple
+ * ones.
  */
 struct name_bind *func_info(fn_t func) {
-    int first = 0;
-    int last = names_size - 1;
-    int middle;
-
-    while (first != last) {
-        middle = (first + last)/2;
-/* middle is too low, so try from middle + 1 */
-        if ((void*)names[func_index[middle]].n_func < (void*)func)
-             first = middle + 1;
-/* middle is at or beyond start, so set last here */
-        else last = middle;
+    if (!func_hash) init_func_hash();
+    unsigned int hi = func_key(func);
+    while (func_hash[hi] >= 0) {
+        if (names[func_hash[hi]].n_func == func) return &names[func_hash[hi]];
+        hi = (hi + 1) & (func_hash_size - 1);
     }
-    if (names[func_index[first]].n_func != func) return NULL;
-    return &names[func_index[first]];
+    return NULL;
 }
 
 /* Lookup by function name.
- * NOTE: that we don't need a binary chop that ensures we find the first
- * entry of any multiple ones, as there can't be such entries!
+ * There is only one slot the name can be in, so it's just one check.
  */
 struct name_bind *name_info(const char *name) {
-    int first = 0;
-    int last = names_size - 1;
-
-    int middle;
-    while (first <= last) {
-        middle = (first + last)/2;
-        int res = strcmp(names[name_index[middle]].n_name, name);
-        if (res < 0) first = middle + 1;
-        else if (res == 0) break;
-        else last = middle - 1;
-    }
-    if (first > last) return NULL;
-    return &names[name_index[middle]];
+    unsigned int d = ph_name_disp[ph_strhash(name, 0) & (PH_NAME_NBKT - 1)];
+    int ni = ph_name_slot[ph_strhash(name, d) & (PH_NAME_NSLOT - 1)];
+    if ((ni < 0) || strcmp(names[ni].n_name, name)) return NULL;
+    return &names[ni];
 }
 
 /* A function to allow you to step through the index in order.
@@ -310,12 +313,8 @@ struct name_bind *name_info(const char *name) {
  * If the index is out of range it will return -2.
  */
 int nxti_name_info(int ci) {
-    if (ci == -1) return name_index[0];
-    if ((ci >= 0) && (ci < names_size)) {
-        int ni = next_name_index[ci];
-        if (ni >= 0) return ni;
-        return -1;
-    }
+    if (ci == -1) return ph_name_order[0];
+    if ((ci >= 0) && (ci < names_size)) return ph_name_next[ci];
     return -2;
 }
 
@@ -324,9 +323,9 @@ int nxti_name_info(int ci) {
  * valgrind usage.
  */
 void free_names(void) {
-    Xfree(func_index);
-    Xfree(name_index);
-    Xfree(next_name_index);
+    Xfree(func_hash);
     return;
 }
 #endif
+
+#endif  /* PHASH_GEN */
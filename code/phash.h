@@ -0,0 +1,43 @@
+/*      phash.h
+ *
+ *      Hash functions for the perfect hash tables of the built-in
+ *      command names and default key bindings.
+ *
+ *      The tables themselves (phash_tab.h) are generated at build time
+ *      by mkphash (../tools/mkphash.c), which also includes this file,
+ *      so the generator and the lookup code always agree on the hashing.
+ *
+ *      A lookup is:
+ *          d = disp[hash(key, 0) & (buckets-1)];
+ *          slot = hash(key, d) & (slots-1);
+ *      and the entry in that slot then only needs checking against the
+ *      key to know whether the key is in the table at all.
+ */
+#ifndef PHASH_H_
+#define PHASH_H_
+
+/* FNV-1a over a NUL-terminated string, with a seed folded in. */
+static inline unsigned int ph_strhash(const char *str, unsigned int seed) {
+    unsigned int h = 2166136261U ^ (seed * 0x9E3779B9U);
+    while (*str) {
+        h ^= (unsigned char)*str++;
+        h *= 16777619U;
+    }
+    return h ^ (h >> 15);
+}
+
+/* An integer mixer (the murmur3 finalizer) with a seed folded in.
+ * Key codes differ mostly in their low bits and top 4 (prefix) bits, so
+ * they need a proper mix before masking.
+ */
+static inline unsigned int ph_inthash(unsigned int key, unsigned int seed) {
+    unsigned int h = key ^ (seed * 0x9E3779B9U);
+    h ^= h >> 16;
+    h *= 0x85EBCA6BU;
+    h ^= h >> 13;
+    h *= 0xC2B2AE35U;
+    h ^= h >> 16;
+    return h;
+}
+
+#endif  /* PHASH_H_ */
@@ -150,6 +150,76 @@ void ttflush(void) {
 #include <poll.h>
 static struct pollfd ue_wait = { 0, POLLIN, 0 };
 
+/* Anything else the idle wait is to watch (the server).
+ * nfds() is the most fds it might want, fill() sets them in the poll()
+ * array (returning how many it set) and ready() is given them back once
+ * poll() returns.
+ */
+static int (*watch_nfds)(void) = NULL;
+static int (*watch_fill)(struct pollfd *) = NULL;
+static void (*watch_ready)(struct pollfd *, int) = NULL;
+
+void idle_watch(int (*nfds)(void), int (*fill)(struct pollfd *),
+     void (*ready)(struct pollfd *, int)) {
+    watch_nfds = nfds;
+    watch_fill = fill;
+    watch_ready = ready;
+    return;
+}
+
+int typahead(void);         /* Forward declaration */
+
+/* Is there anything for the idle wait to do? */
+static int idle_work(void) {
+    return (watch_nfds && watch_nfds()) || bgsave_pending() ||
+         (bgcmd_fd() >= 0) || following();
+}
+
+/* Called by ttgetc() when it is about to wait for the first key of a
+ * command. Deals with any background saves finishing, any background
+ * pipe-command output, any followed files growing and whatever has
+ * been registered by idle_watch() (client requests), until there is
+ * some keyboard input to read.
+ * Returns -1 if interrupted by a signal (as the read would have been).
+ */
+static int idle_wait(void) {
+    bgsave_reap();
+    if (!idle_work()) return 0;
+
+    struct pollfd *pfds = NULL;
+    int status = 0;
+    while (1) {
+        if (typahead()) break;
+        int nbg = bgsave_pending();
+        int nw = watch_nfds? watch_nfds(): 0;
+        pfds = Xrealloc(pfds, (size_t)(nbg+nw+3)*sizeof(struct pollfd));
+        pfds[0].fd = 0;
+        pfds[1].fd = bgcmd_fd();        /* A background pipe-command */
+        pfds[2].fd = follow_fd();       /* inotify, for followed files */
+        for (int bi = 0; bi < nbg; bi++) pfds[3+bi].fd = bgsave_fd(bi);
+        int w_pfd = 3 + nbg;
+        int npfd = w_pfd;
+        if (nw) npfd += watch_fill(pfds + w_pfd);
+        for (int pi = 0; pi < npfd; pi++) pfds[pi].events = POLLIN;
+
+        int nready = poll(pfds, (nfds_t)npfd, follow_timeout());
+        if (nready < 0) {
+            if (errno == EINTR) status = -1;
+            break;
+        }
+        if (pfds[0].revents) break;     /* The keyboard wins */
+
+        if (npfd > w_pfd) watch_ready(pfds + w_pfd, npfd - w_pfd);
+        if (pfds[1].revents) bgcmd_input();
+        if ((nready == 0) || pfds[2].revents) follow_check(pfds[2].revents);
+        bgsave_reap();
+        update(FALSE);
+        if (!idle_work()) break;
+    }
+    Xfree(pfds);
+    return status;
+}
+
 int ttgetc(void) {
     static char buffer[32];
     static int pending = 0;
@@ -159,6 +229,10 @@ int ttgetc(void) {
 
     count = pending;    /* So we don't update pending on error */
     if (!count) {
+        if (input_idle) {       /* Deal with client requests etc. first */
+            input_idle = FALSE;
+            if (idle_wait() < 0) return 0;
+        }
         count = (int)read(0, buffer, sizeof(buffer));
         if (count <= 0) return 0;
         pending = count;
@@ -157,7 +157,9 @@ int getcline(void) {
         lp = lforw(lp);
     }
 
-/* And return the resulting count */
+/* And return the resulting count (in the file, for a mapped view) */
+    if (curbp->b_flag & BFMAPPED)
+        numlines += mapview_first_line(curbp) - 1;
     return numlines + 1;
 }
 
@@ -271,6 +273,7 @@ int twiddle(int f, int n) {
         db_setn(glb_db, l_buf+rch_st, rch_nb);
         db_appendn(glb_db, l_buf+lch_st, lch_nb);
         db_overwriten_at(ldb(dotp), db_val(glb_db), db_len(glb_db), lch_st);
+        jnl_line(dotp);
 
         if (reset_col) curwp->w.doto = lch_st + lch_nb + rch_nb;
     }
@@ -499,6 +502,7 @@ int trim(int f, int n) {
             break;
         }
         db_truncate(ldb(lp), length);
+        jnl_line(lp);
 
 /* Advance/or back to the next line */
         forwline(TRUE, inc);
@@ -891,6 +895,12 @@ static int adjustmode(int kind, int global) {
                 else        curbp->b_mode |= (1 << i);
             }
             else {
+                if (!global && ((1 << i) == MDVIEW) &&
+                     (curbp->b_flag & BFMAPPED)) {
+                    mlwrite_one("A mapped file view stays in View mode");
+                    status = FALSE;
+                    goto exit;
+                }
                 if (global) gmode &= ~(1 << i);
                 else        curbp->b_mode &= ~(1 << i);
             }
@@ -249,6 +249,10 @@ int narrow(int f, int n) {
         mlwrite_one("This buffer is already narrowed");
         return(FALSE);
     }
+    if (bp->b_flag&BFMAPPED) {
+        mlwrite_one("A mapped file view can't be narrowed");
+        return(FALSE);
+    }
 
 /* Avoid complications later by checking for an buffer empty now. */
     if (bp->b_linep->l_fp == bp->b_linep) {
@@ -0,0 +1,369 @@
+/*      REVERT.C
+ *
+ *      Reverting a buffer to its file, re-reading only what has changed.
+ *
+ *      The buffer's lines and the file's are each cut into chunks, ending
+ *      after a line whose sum has its low CUT_BITS bits clear (or at
+ *      CHUNK_MAX lines). Since the cuts depend only on the text, an
+ *      insertion or deletion only upsets the chunks around it.
+ *      Each chunk has a checksum, and chunks of the file that match
+ *      (in order) a chunk of the buffer are left alone. Only the
+ *      unmatched parts of the file are made into lines, replacing the
+ *      unmatched parts of the buffer.
+ *
+ *      So dot, marks and macro pins on unchanged lines stay where they
+ *      are, and those on replaced lines move to the start of the
+ *      replacement (as lfree() does).
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define REVERT_C
+
+#include "estruct.h"
+#include "edef.h"
+#include "efunc.h"
+#include "line.h"
+
+#define CUT_BITS    5           /* Chunks average 32 lines */
+#define CHUNK_MAX   256
+#define NOEOL_SUM   0x9e3779b97f4a7c15ULL
+
+struct chunk {
+    uint64_t sum;
+    int nlines;
+    int noeol;                  /* Ends with a line with no newline */
+    union {
+        struct line *lp;        /* Buffer: its first line */
+        const char *text;       /* File: where it starts */
+    } at;
+};
+
+struct chunk_list {
+    struct chunk *c;
+    int *order;                 /* Indices sorted by sum, then index */
+    int n;
+    int alloc;
+};
+
+/* FNV-1a */
+static uint64_t line_sum(const char *text, size_t len) {
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < len; i++) {
+        h ^= (unsigned char)text[i];
+        h *= 0x100000001b3ULL;
+    }
+    return h;
+}
+
+/* Add a line's sum to the list's last chunk, starting a new one if the
+ * last one has been cut. Sets cut if the chunk is to end after it.
+ */
+static void add_line(struct chunk_list *cl, int *cut, uint64_t lsum) {
+    struct chunk *cp;
+
+    if (*cut || cl->n == 0) {
+        if (cl->n == cl->alloc) {
+            cl->alloc = cl->alloc? 2*cl->alloc: 1024;
+            cl->c = Xrealloc(cl->c, (size_t)cl->alloc*sizeof(struct chunk));
+        }
+        cp = &cl->c[cl->n++];
+        cp->sum = 0;
+        cp->nlines = 0;
+        cp->noeol = 0;
+        *cut = 0;
+    }
+    else
+        cp = &cl->c[cl->n-1];
+    cp->sum = (cp->sum ^ lsum) * 0x100000001b3ULL;
+    cp->nlines++;
+    *cut = (((lsum >> 40) & ((1 << CUT_BITS) - 1)) == 0) ||
+         (cp->nlines == CHUNK_MAX);
+}
+
+/* Find the end of the file line at p, returning where the next one
+ * starts and setting the length of its text.
+ * A DOS file's lines lose their trailing CR, as when read.
+ */
+static const char *next_line(const char *p, const char *end, int dos,
+     size_t *lenp) {
+    const char *nl = memchr(p, '\n', (size_t)(end - p));
+    size_t len = (size_t)((nl? nl: end) - p);
+    if (dos && nl && (len > 0) && (p[len-1] == '\r')) len--;
+    *lenp = len;
+    return nl? nl + 1: end;
+}
+
+static void chunk_buffer(struct chunk_list *cl, struct buffer *bp) {
+    int cut = 0;
+    for (struct line *lp = lforw(bp->b_linep); lp != bp->b_linep;
+         lp = lforw(lp)) {
+        int was = cl->n;
+        add_line(cl, &cut, line_sum(ltext(lp), (size_t)lused(lp)));
+        if (cl->n != was) cl->c[cl->n-1].at.lp = lp;
+    }
+    if (cl->n && bp->b_EOLmissing) {
+        cl->c[cl->n-1].sum ^= NOEOL_SUM;
+        cl->c[cl->n-1].noeol = 1;
+    }
+}
+
+static void chunk_file(struct chunk_list *cl, const char *p,
+     const char *end, int dos) {
+    int cut = 0;
+    while (p < end) {
+        size_t len;
+        const char *next = next_line(p, end, dos, &len);
+        int was = cl->n;
+        add_line(cl, &cut, line_sum(p, len));
+        if (cl->n != was) cl->c[cl->n-1].at.text = p;
+        p = next;
+    }
+    if (cl->n && (end[-1] != '\n')) {
+        cl->c[cl->n-1].sum ^= NOEOL_SUM;
+        cl->c[cl->n-1].noeol = 1;
+    }
+}
+
+/* Check that a buffer chunk really is the same as a file one */
+static int same(struct chunk *bc, struct chunk *fc, const char *end,
+     int dos) {
+    if ((bc->sum != fc->sum) || (bc->nlines != fc->nlines) ||
+         (bc->noeol != fc->noeol)) return FALSE;
+    struct line *lp = bc->at.lp;
+    const char *p = fc->at.text;
+    for (int li = 0; li < bc->nlines; li++) {
+        size_t len;
+        const char *next = next_line(p, end, dos, &len);
+        if ((len != (size_t)lused(lp)) || memcmp(p, ltext(lp), len))
+            return FALSE;
+        p = next;
+        lp = lforw(lp);
+    }
+    return TRUE;
+}
+
+/* For sorting a list's order[] */
+static struct chunk *sort_chunks;
+static int by_sum(const void *a, const void *b) {
+    int ia = *(const int *)a;
+    int ib = *(const int *)b;
+    uint64_t sa = sort_chunks[ia].sum;
+    uint64_t sb = sort_chunks[ib].sum;
+    if (sa != sb) return (sa < sb)? -1: 1;
+    return ia - ib;
+}
+
+static void sort_list(struct chunk_list *cl) {
+    cl->order = Xmalloc((size_t)(cl->n + 1)*sizeof(int));
+    for (int ci = 0; ci < cl->n; ci++) cl->order[ci] = ci;
+    sort_chunks = cl->c;
+    qsort(cl->order, (size_t)cl->n, sizeof(int), by_sum);
+}
+
+/* Find the first chunk in cl at or after index from with the same
+ * sum as wanted, for which the check says it really is the same.
+ * Returns its index, or -1.
+ */
+static int find_from(struct chunk_list *cl, int from, struct chunk *want,
+     int want_is_file, const char *end, int dos) {
+    int lo = 0, hi = cl->n;
+    while (lo < hi) {           /* First of (sum, index) >= (want, from) */
+        int mid = (lo + hi)/2;
+        struct chunk *mc = &cl->c[cl->order[mid]];
+        if ((mc->sum < want->sum) ||
+             ((mc->sum == want->sum) && (cl->order[mid] < from)))
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    for (; lo < cl->n; lo++) {
+        struct chunk *mc = &cl->c[cl->order[lo]];
+        if (mc->sum != want->sum) break;
+        if (want_is_file? same(mc, want, end, dos): same(want, mc, end, dos))
+            return cl->order[lo];
+    }
+    return -1;
+}
+
+/* Whether a buffer line has the text of the file line at p */
+static int same_line(struct line *lp, const char *p, const char *end,
+     int dos) {
+    size_t len;
+    next_line(p, end, dos, &len);
+    return (len == (size_t)lused(lp)) && !memcmp(p, ltext(lp), len);
+}
+
+/* Replace the lines of buffer chunks [bfrom, bto) with those of file
+ * chunks [ffrom, fto).
+ * Any lines the same at the start and end are left alone, and the new
+ * lines go in after the old ones, so anything on an old line moves to
+ * the first new one as the old ones are freed.
+ */
+static int nnew;
+static void replace(struct buffer *bp, struct chunk_list *bcl, int bfrom,
+     int bto, struct chunk_list *fcl, int ffrom, int fto, const char *end,
+     int dos) {
+    if ((bfrom == bto) && (ffrom == fto)) return;
+
+    struct line *before = (bto < bcl->n)? bcl->c[bto].at.lp: bp->b_linep;
+    struct line *lp = (bfrom < bto)? bcl->c[bfrom].at.lp: before;
+    int nold = 0;
+    for (int ci = bfrom; ci < bto; ci++) nold += bcl->c[ci].nlines;
+    const char *p = (ffrom < fto)? fcl->c[ffrom].at.text: NULL;
+    const char *pend = (fto < fcl->n)? fcl->c[fto].at.text: end;
+
+    if (p) {
+        while ((nold > 0) && (p < pend) && same_line(lp, p, end, dos)) {
+            size_t len;
+            p = next_line(p, end, dos, &len);
+            lp = lforw(lp);
+            nold--;
+        }
+        while ((nold > 0) && (p < pend)) {
+            const char *ls = pend - 1;  /* Find the start of the last */
+            while ((ls > p) && (ls[-1] != '\n')) ls--;
+            if (!same_line(lback(before), ls, end, dos)) break;
+            before = lback(before);
+            pend = ls;
+            nold--;
+        }
+        while (p < pend) {
+            size_t len;
+            const char *next = next_line(p, end, dos, &len);
+            struct line *nlp = lalloc();
+            if (len > 0) db_setn(ldb(nlp), p, (int)len);
+            nlp->l_bp = before->l_bp;
+            nlp->l_fp = before;
+            before->l_bp->l_fp = nlp;
+            before->l_bp = nlp;
+            nnew++;
+            p = next;
+        }
+    }
+    while (nold--) {
+        struct line *next = lforw(lp);
+        lfree(lp);
+        lp = next;
+    }
+}
+
+/* revert-file
+ * Make the current buffer the same as its file again, only re-reading
+ * the parts that differ.
+ */
+int revert_file(int f, int n) {
+    UNUSED(f); UNUSED(n);
+    struct buffer *bp = curbp;
+    struct stat st;
+    int s;
+
+    if (*(bp->b_rpname) == 0) {
+        mlwrite_one("No file to revert to");
+        return FALSE;
+    }
+    if (bp->b_mode & MDCRYPT) {
+        mlwrite_one("Can't revert an encrypted file - use read-file");
+        return FALSE;
+    }
+    if (bp->b_flag & (BFNAROW | BFMAPPED)) {
+        mlwrite_one("Buffer is narrowed or a mapped view");
+        return FALSE;
+    }
+    if ((bp->b_flag & BFCHG) && ((s = mlyesno("Discard changes")) != TRUE))
+        return s;
+
+    int fd = open(bp->b_rpname, O_RDONLY);
+    if ((fd < 0) || (fstat(fd, &st) < 0)) {
+        mlwrite("Cannot open %s: %s", bp->b_rpname, strerror(errno));
+        if (fd >= 0) close(fd);
+        return FALSE;
+    }
+    size_t fsize = (size_t)st.st_size;
+    const char *text = "";
+    if (fsize > 0) {
+        text = mmap(NULL, fsize, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (text == MAP_FAILED) {
+            mlwrite("Cannot map %s: %s", bp->b_rpname, strerror(errno));
+            close(fd);
+            return FALSE;
+        }
+    }
+    close(fd);
+    const char *end = text + fsize;
+    int dos = (bp->b_mode & MDDOSLE) != 0;
+
+    int was_following = bp->b_flag & BFFOLLOW;
+    if (was_following) follow_stop(bp);
+
+    struct chunk_list bcl = { NULL, NULL, 0, 0 };
+    struct chunk_list fcl = { NULL, NULL, 0, 0 };
+    chunk_buffer(&bcl, bp);
+    int was_empty = (bcl.n == 0);
+    chunk_file(&fcl, text, end, dos);
+    sort_list(&bcl);
+    sort_list(&fcl);
+
+/* Walk along both, matching chunks where we can.
+ * Where the next two don't match, a buffer chunk that isn't in the rest
+ * of the file has gone, and a file chunk that isn't in the rest of the
+ * buffer is new. If both are there later, skip the shorter gap.
+ */
+    int bi = 0, fi = 0, hb = 0, hf = 0;
+    nnew = 0;
+    while ((bi < bcl.n) && (fi < fcl.n)) {
+        if (same(&bcl.c[bi], &fcl.c[fi], end, dos)) {
+            replace(bp, &bcl, hb, bi, &fcl, hf, fi, end, dos);
+            hb = ++bi;
+            hf = ++fi;
+            continue;
+        }
+        int kf = find_from(&fcl, fi, &bcl.c[bi], FALSE, end, dos);
+        if (kf < 0) {
+            bi++;
+            continue;
+        }
+        int jb = find_from(&bcl, bi, &fcl.c[fi], TRUE, end, dos);
+        if (jb < 0) {
+            fi++;
+            continue;
+        }
+        if ((jb - bi) <= (kf - fi)) bi = jb;
+        else                        fi = kf;
+    }
+    replace(bp, &bcl, hb, bcl.n, &fcl, hf, fcl.n, end, dos);
+
+    Xfree(bcl.c);
+    Xfree(bcl.order);
+    Xfree(fcl.c);
+    Xfree(fcl.order);
+    bp->b_EOLmissing = (fsize > 0) && (end[-1] != '\n');
+    if (fsize > 0) munmap((void *)text, fsize);
+
+    bp->b_flag &= ~(BFCHG | BFTRUNC);
+    bp->b_edits++;
+    jnl_discard(bp);
+    if (bp == group_match_buffer) group_match_buffer = NULL;
+    if ((bp->b_type == BTPHON) && bp->ptt_headp) ptt_free(bp);
+    for (struct window *wp = wheadp; wp != NULL; wp = wp->w_wndp) {
+        if (wp->w_bufp != bp) continue;
+        if (wp->w_linep == bp->b_linep) wp->w_linep = lforw(bp->b_linep);
+        if (was_empty) {            /* Start at the top, as when read */
+            wp->w.dotp = lforw(bp->b_linep);
+            wp->w.doto = 0;
+        }
+        wp->w_flag |= WFHARD | WFMODE;
+    }
+
+    if (was_following) follow_file(TRUE, 1);
+    mlwrite(MLbkt("Reverted - %d line%s re-read"), nnew,
+         (nnew == 1)? "": "s");
+    return TRUE;
+}
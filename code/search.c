@@ -117,7 +117,16 @@
 #include <ctype.h>
 #include <unistd.h>
 #include <limits.h>
+#include <stdint.h>
 #include <string.h>
+#include <signal.h>
+#include <pthread.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <glob.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #define SEARCH_C
 
@@ -231,6 +240,7 @@ struct magic {
         struct xccl *xt_cclmap; /* Pointer */
         int next_or_idx;        /* next alternative check */
     } x;
+    struct ccl_trie *uc_trie;   /* Whole-Unicode CCL map (if xt_cclmap) */
 };
 
 struct magic_counter {
@@ -335,6 +345,115 @@ char current_base[16] = "";
 enum call_type {Search, Replace};  /* So we know the current call type */
 static enum call_type this_rt;
 
+/* Arenas for the transient matcher state.
+ * Items are handed out from the top chunk and are never freed singly.
+ * Instead the whole arena is reset at a known point, which leaves one
+ * chunk large enough for everything that was needed since the last reset,
+ * so the next round needs no malloc()s at all.
+ * match_arena holds what is only valid for the current search (group
+ * texts, extended grapheme parts) and is reset by init_dyn_group_status().
+ * rmc_arena holds the pieces of the replacement pattern and is reset by
+ * rmcclear().
+ * srch_arena_use and srch_arena_mallocs count the items handed out and
+ * the malloc()s made to provide them.
+ */
+struct arena_chunk {
+    struct arena_chunk *prev;
+    size_t size;
+    size_t used;
+    char data[0];
+};
+struct arena {
+    struct arena_chunk *top;
+    size_t in_use;              /* Total handed out since the last reset */
+};
+static struct arena match_arena = { NULL, 0 };
+static struct arena rmc_arena = { NULL, 0 };
+
+#define ARENA_MIN 4096
+#define ARENA_ALIGN sizeof(void *)
+
+static void *arena_alloc(struct arena *ap, size_t need) {
+    need = (need + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+    struct arena_chunk *cp = ap->top;
+    if (!cp || (cp->size - cp->used < need)) {
+        size_t size = ARENA_MIN;
+        while (size < need) size *= 2;
+        cp = Xmalloc(sizeof(struct arena_chunk) + size);
+        cp->prev = ap->top;
+        cp->size = size;
+        cp->used = 0;
+        ap->top = cp;
+        srch_arena_mallocs++;
+    }
+    void *retval = cp->data + cp->used;
+    cp->used += need;
+    ap->in_use += need;
+    srch_arena_use++;
+    return retval;
+}
+
+static char *arena_strndup(struct arena *ap, const char *str, size_t len) {
+    char *retval = arena_alloc(ap, len + 1);
+    memcpy(retval, str, len);
+    retval[len] = '\0';
+    return retval;
+}
+
+/* Short-lived items can be given back by returning to a mark, provided
+ * nothing has needed a new chunk since.
+ */
+struct arena_mark {
+    struct arena_chunk *top;
+    size_t used;
+};
+static inline struct arena_mark arena_getmark(struct arena *ap) {
+    struct arena_mark mk = { ap->top, ap->top? ap->top->used: 0 };
+    return mk;
+}
+static inline void arena_release(struct arena *ap, struct arena_mark mk) {
+    if (ap->top && (ap->top == mk.top)) {
+        ap->in_use -= ap->top->used - mk.used;
+        ap->top->used = mk.used;
+    }
+}
+
+/* Forget everything, keeping (or making) one chunk that would have held
+ * all of it.
+ */
+static void arena_reset(struct arena *ap) {
+    struct arena_chunk *cp = ap->top;
+    if (cp && cp->prev) {
+        size_t size = cp->size;
+        while (size < ap->in_use) size *= 2;
+        while (cp) {
+            struct arena_chunk *prev = cp->prev;
+            Xfree(cp);
+            cp = prev;
+        }
+        cp = Xmalloc(sizeof(struct arena_chunk) + size);
+        cp->prev = NULL;
+        cp->size = size;
+        ap->top = cp;
+        srch_arena_mallocs++;
+    }
+    if (cp) cp->used = 0;
+    ap->in_use = 0;
+}
+
+#ifdef DO_FREE
+static void arena_free(struct arena *ap) {
+    struct arena_chunk *cp = ap->top;
+    while (cp) {
+        struct arena_chunk *prev = cp->prev;
+        Xfree(cp);
+        cp = prev;
+    }
+    ap->top = NULL;
+    ap->in_use = 0;
+}
+#endif
+
 /* Function to increase allocated sizes for group control info */
 #define NGRP_INCR 10
 static void increase_group_info(void) {
@@ -633,6 +752,13 @@ static void setbit(int bc, char *cclmap) {
     *(cclmap + (bc >> 3)) |= (char)BIT(bc & 7);
 }
 
+/* biteq -- is the character in the bitmap?
+ */
+static int biteq(int bc, char *cclmap) {
+    bc = bc & 0xFF;     /* So range is now 0 -> 255 */
+    return (*(cclmap + (bc >> 3)) & BIT(bc & 7)) ? TRUE : FALSE;
+}
+
 /* parse_error
  * Helper routine
  * A simple routine to display where errors occur in patterns
@@ -660,10 +786,161 @@ static struct xccl *add2_xt_cclmap(struct magic *mp, int type) {
     xp += uni_ccl_cnt - 1;  /* Point to the last one */
     xp->xc = null_mg;       /* (re)Mark end of list */
     xp--;                   /* Where we want to add the new one */
+    xp->xc = null_mg;       /* Clear flags (the first is new space) */
     xp->xc.type = (unsigned char)type;  /* An 8-bit assignment */
     return xp;
 }
 
+/* xccl_test -- does one xt_cclmap entry match a base character (which
+ *      may, or may not, have combining parts)?
+ * An Equiv-mode UCLITL test is left to the caller, as it compares whole
+ * graphemes.
+ */
+static int xccl_test(struct xccl *xp, unicode_t uc, int cdm, int exact) {
+    int res;
+    switch(xp->xc.type) {
+/* This is for a range above MAXASCII.
+ * NOTE that there is no case handling here. Non-ASCII case-mapping
+ * doesn't fit well with ranges.
+ */
+    case CCL:           /* Cannot have any combining bit */
+        res = !cdm && (xp->xval.cl_lim.low <= uc) &&
+                      (xp->xval.cl_lim.high >= uc);
+        break;
+    case UCLITL:        /* No combining bit (without Equiv) */
+        if (cdm) {
+            res = FALSE;
+            break;
+        }               /* Fall through */
+    case UCKIND:        /* May have any combining bit */
+        if (exact) res = (xp->xval.uchar == uc);
+        else            /* Upper so Greek sigmas work (2l->1U) */
+            res = (utf8proc_toupper(xp->xval.uchar) == utf8proc_toupper(uc));
+        break;
+/* May have any combining bit, but only the base character is tested */
+    case UCPROP: {
+        const char *uccat = utf8proc_category_string(uc);
+        int testlen = istrlen(xp->xval.prop);   /* 1 or 2 */
+        res = !strncmp(uccat, xp->xval.prop, (size_t)testlen);
+        break;
+    }
+    default:            /* Nothing else can match */
+        res = FALSE;
+        break;
+    }
+    if (xp->xc.negate_test) res = !res;
+    return res;
+}
+
+/* A class with non-ASCII parts (an xt_cclmap list) is also given a
+ * two-level map over the whole of Unicode, so testing a character is two
+ * lookups however many ranges, properties and literals the class has,
+ * rather than a walk along the list with a utf8proc call per entry.
+ * The top level has an entry per 256-character block, which indexes a
+ * 256-bit leaf. There are two top levels, as ranges and literals don't
+ * match a character with combining parts, but properties and "kind of"
+ * tests do.
+ * A block's leaves are filled in from the list the first time a character
+ * in it is tested. Expanding all 4352 blocks up front takes ~20ms, and the
+ * pattern is remade for each search command. Leaves that are the same as
+ * the previous one, or all-clear or all-set, are shared.
+ * What matches depends on Exact mode, so the map notes which it was made
+ * for and is emptied if a search runs where that differs. Equiv mode
+ * compares literals as whole graphemes, so a class with any of those
+ * goes back to the list walk then.
+ */
+#define CT_MAXUC    0x110000
+#define CT_BLOCKS   (CT_MAXUC >> 8)
+#define CT_LWORDS   (256 / 32)
+#define CT_UNSET    0xFFFF
+
+struct ccl_trie {
+    int exact;                  /* MDEXACT setting it was made for */
+    int has_uclitl;             /* Has UCLITL tests */
+    int nleaves;
+    unsigned int (*leaf)[CT_LWORDS];
+    unsigned short blk[2][CT_BLOCKS];   /* [with cdm][uc >> 8] -> leaf */
+};
+
+/* ccl_trie_reset -- set up an empty map for a class.
+ */
+static void ccl_trie_reset(struct magic *mt, int exact) {
+    struct ccl_trie *ct = mt->uc_trie;
+    if (!ct) ct = mt->uc_trie = Xmalloc(sizeof(struct ccl_trie));
+    else     Xfree(ct->leaf);
+
+    ct->exact = exact;
+    ct->has_uclitl = FALSE;
+    for (struct xccl *xp = mt->x.xt_cclmap; xp->xc.type != EGRP; xp++)
+        if (xp->xc.type == UCLITL) ct->has_uclitl = TRUE;
+
+/* Leaves 0 and 1 are the all-clear and all-set ones */
+    ct->leaf = Xmalloc(2 * sizeof(ct->leaf[0]));
+    memset(ct->leaf[0], 0, sizeof(ct->leaf[0]));
+    memset(ct->leaf[1], 0xff, sizeof(ct->leaf[0]));
+    ct->nleaves = 2;
+    memset(ct->blk, 0xff, sizeof(ct->blk));     /* All CT_UNSET */
+}
+
+/* ccl_trie_leaf -- return the index of a leaf with the given bits,
+ *      adding it if it isn't the last one, or all-clear or all-set.
+ */
+static unsigned short ccl_trie_leaf(struct ccl_trie *ct, unsigned int *bits) {
+    size_t lsize = sizeof(ct->leaf[0]);
+    if (!memcmp(bits, ct->leaf[0], lsize)) return 0;
+    if (!memcmp(bits, ct->leaf[1], lsize)) return 1;
+    if (!memcmp(bits, ct->leaf[ct->nleaves - 1], lsize))
+        return (unsigned short)(ct->nleaves - 1);
+    ct->leaf = Xreallocarray(ct->leaf, (size_t)ct->nleaves + 1, lsize);
+    memcpy(ct->leaf[ct->nleaves], bits, lsize);
+    return (unsigned short)ct->nleaves++;
+}
+
+/* ccl_trie_fill -- fill in the leaves for one block of a class's map.
+ */
+static void ccl_trie_fill(struct magic *mt, int blk) {
+    struct ccl_trie *ct = mt->uc_trie;
+    unsigned int bits[2][CT_LWORDS];
+
+    memset(bits, 0, sizeof(bits));
+    for (int bi = 0; bi < 256; bi++) {
+        unicode_t uc = (unicode_t)((blk << 8) | bi);
+        int asc = FALSE;
+        if (uc <= MAXASCII) {
+            asc = biteq((int)uc, mt->val.cclmap);
+            if (!asc && !ct->exact && isASCletter(uc))
+                asc = biteq(CHCASE((int)uc), mt->val.cclmap);
+        }
+        for (int cdm = 0; cdm < 2; cdm++) {
+            int res = asc;
+            for (struct xccl *xp = mt->x.xt_cclmap;
+                 !res && xp->xc.type != EGRP; xp++)
+                res = xccl_test(xp, uc, cdm, ct->exact);
+            if (res) bits[cdm][bi >> 5] |= 1U << (bi & 31);
+        }
+    }
+    ct->blk[0][blk] = ccl_trie_leaf(ct, bits[0]);
+    ct->blk[1][blk] = ccl_trie_leaf(ct, bits[1]);
+}
+
+/* ccl_trie_free -- free the whole-Unicode map for a class.
+ */
+static void ccl_trie_free(struct magic *mt) {
+    if (!mt->uc_trie) return;
+    Xfree(mt->uc_trie->leaf);
+    Xfree_setnull(mt->uc_trie);
+}
+
+/* ccl_trie_test -- look up a grapheme's base character in a class's map.
+ */
+static int ccl_trie_test(struct magic *mt, struct grapheme *gc) {
+    struct ccl_trie *ct = mt->uc_trie;
+    int blk = gc->uc >> 8;
+    if (ct->blk[0][blk] == CT_UNSET) ccl_trie_fill(mt, blk);
+    unsigned int *lp = ct->leaf[ct->blk[gc->cdm != 0][blk]];
+    return (int)(lp[(gc->uc >> 5) & 7] >> (gc->uc & 31)) & 1;
+}
+
 /* cclmake -- create the bitmap for the character class.
  *      On success ppatptr is left pointing to the end-of-character-class
  *      character, so that a loop may automatically increment with safety.
@@ -694,6 +971,7 @@ static int cclmake(char **ppatptr, struct magic *mcptr) {
     else
         mcptr->mc.negate_test = 0;
     mcptr->x.xt_cclmap = NULL;      /* So we can Xrealloc on it */
+    mcptr->uc_trie = NULL;
     uni_ccl_cnt = 1;                /* Space for EGRP(0) at end if used */
 
 /* We can't handle things as we reach them, as we might have a range defined
@@ -987,7 +1265,11 @@ loop_transition:
  */
     *ppatptr = --patptr;
 
-    if (ccl_ended) return TRUE;     /* All looks OK */
+    if (ccl_ended) {                /* All looks OK */
+        if (mcptr->x.xt_cclmap)
+            ccl_trie_reset(mcptr, curwp->w_bufp->b_mode & MDEXACT);
+        return TRUE;
+    }
 
     parse_error(patptr, "Character class not ended");
 
@@ -1002,13 +1284,6 @@ error_exit:
     return FALSE;
 }
 
-/* biteq -- is the character in the bitmap?
- */
-static int biteq(int bc, char *cclmap) {
-    bc = bc & 0xFF;     /* So range is now 0 -> 255 */
-    return (*(cclmap + (bc >> 3)) & BIT(bc & 7)) ? TRUE : FALSE;
-}
-
 /* set_lims - get the low/high values for a repeating range.
  * Recurses (once at most).
  */
@@ -1056,6 +1331,7 @@ static void mcclear(void) {
                 }
                 Xfree(mcptr->x.xt_cclmap);
             }
+            ccl_trie_free(mcptr);
 	}
         if ((mcptr->mc.type) == UCGRAPH) Xfree(mcptr->val.gc.ex);
         mcptr++;
@@ -1072,41 +1348,14 @@ static void rmcclear(void) {
 
     rmcptr = rmcpat;
 
+/* Varnames, counter formats and function call pieces are all in
+ * rmc_arena.
+ */
     while (rmcptr->mc.type != EGRP) {
-        switch(rmcptr->mc.type) {
-        case UCGRAPH:
-            Xfree (rmcptr->val.gc.ex);
-            break;
-        case REPL_VAR:
-            Xfree(rmcptr->val.varname);
-            break;
-        case REPL_CNT:
-            Xfree(rmcptr->val.x.fmt);
-            break;
-        case REPL_FNC: {
-            struct func_call *fcp = rmcptr->val.fc;
-            while (fcp) {
-                switch(fcp->type) {
-                case LITCHAR:
-                    Xfree(fcp->val.ltext);
-                    break;
-                case REPL_CNT:
-                    Xfree(fcp->val.x.fmt);
-                    break;
-                default:
-                    ;
-                }
-                struct func_call *next_fcp = fcp->next;
-                Xfree(fcp);
-                fcp = next_fcp;
-            }
-            break;
-        }
-        default:
-            ;
-        }
+        if (rmcptr->mc.type == UCGRAPH) Xfree (rmcptr->val.gc.ex);
         rmcptr++;
     }
+    arena_reset(&rmc_arena);
     rmcpat[0].mc = null_mg;
 }
 
@@ -1132,6 +1381,86 @@ static void rmcclear(void) {
  *      times to allow this!!
  */
 static int group_cntr;  /* Number of possible groups in search pattern */
+
+/* The case-folded literal scanner.
+ * A non-Magic search that is not in Exact mode for a pattern with
+ * non-ASCII characters (but no combining ones) would otherwise need
+ * the step_scanner(), running utf8proc_toupper() on each grapheme it
+ * compares. Instead the pattern is folded (to upper case) once, each
+ * line is split into folded graphemes as it is reached, and a
+ * Boyer-Moore-Horspool search is run over those.
+ * The matching is as mgpheq() does it - a grapheme with combining marks
+ * matches nothing, and an ASCII character in the pattern only matches
+ * an ASCII one.
+ */
+#define FOLD_NONASC  0x40000000     /* Non-ASCII char folded to ASCII */
+#define FOLD_NOMATCH -1             /* Grapheme with combining marks */
+
+static int fold_scan = FALSE;       /* Set by mcstr() if usable */
+static unicode_t *fold_bmp = NULL;  /* utf8proc_toupper() of the BMP */
+static struct {
+    unicode_t *uc;                  /* The folded pattern */
+    char *ascii;                    /* Whether each was ASCII */
+    int len;
+    int alloc;
+    int fskip[256];                 /* Skips, by low byte of the fold */
+    int bskip[256];
+} fpat = { NULL, NULL, 0, 0, { 0 }, { 0 } };
+
+static unicode_t fold_uc(unicode_t uc) {
+    return ((uc >= 0) && (uc < 0x10000))? fold_bmp[uc]:
+         utf8proc_toupper(uc);
+}
+
+/* Set up the folded pattern from mcpat, if it is all literal.
+ * Returns FALSE if it can't be used.
+ */
+static int set_fold_pattern(void) {
+    if ((curwp->w_bufp->b_mode & (MDMAGIC | MDEXACT | MDEQUIV)) ||
+         (group_cntr != 0))
+        return FALSE;
+
+    int np = 0;
+    for (struct magic *mp = mcpat + 1; mp->mc.type != EGRP; mp++) {
+        if (mp->mc.negate_test) return FALSE;
+        if (mp->mc.type == LITCHAR) {
+            if (mp->val.lchar == '\n') return FALSE;
+        }
+        else if (mp->mc.type != UCLITL) return FALSE;
+        np++;
+    }
+    if (np == 0) return FALSE;
+
+    if (!fold_bmp) {
+        fold_bmp = Xmalloc(0x10000*sizeof(unicode_t));
+        for (unicode_t uc = 0; uc < 0x10000; uc++)
+            fold_bmp[uc] = utf8proc_toupper(uc);
+    }
+    if (np > fpat.alloc) {
+        fpat.alloc = np;
+        fpat.uc = Xrealloc(fpat.uc, (size_t)np*sizeof(unicode_t));
+        fpat.ascii = Xrealloc(fpat.ascii, (size_t)np);
+    }
+    fpat.len = np;
+    for (int pi = 0; pi < np; pi++) {
+        struct magic *mp = mcpat + 1 + pi;
+        if (mp->mc.type == LITCHAR) {
+            fpat.uc[pi] = fold_uc(ch_as_uc(mp->val.lchar));
+            fpat.ascii[pi] = 1;
+        }
+        else {
+            fpat.uc[pi] = fold_uc(mp->val.uchar);
+            fpat.ascii[pi] = 0;
+        }
+    }
+    for (int ki = 0; ki < 256; ki++) fpat.fskip[ki] = fpat.bskip[ki] = np;
+    for (int pi = 0; pi < np - 1; pi++)
+        fpat.fskip[fpat.uc[pi] & 0xff] = np - 1 - pi;
+    for (int pi = np - 1; pi > 0; pi--)
+        fpat.bskip[fpat.uc[pi] & 0xff] = pi;
+    return TRUE;
+}
+
 static int mcstr(void) {
     struct magic *mcptr = mcpat;
     char *patptr = strdupa(db_val(pat));
@@ -1145,6 +1474,7 @@ static int mcstr(void) {
  */
     if (mc_alloc) mcclear();
     mc_alloc = FALSE;
+    fold_scan = FALSE;
     group_cntr = 0;
 
     cntl_grp_info[0].state = GPOPEN;    /* But group 0 is always OPEN */
@@ -1553,6 +1883,11 @@ pchr_done_noincr:
         cntl_grp_info[gi].state = GPIDLE;
     }
 
+/* A literal pattern that only needs the step_scanner() for its case
+ * folding can use the folded scanner.
+ */
+    if (status && slow_scan) fold_scan = set_fold_pattern();
+
 /* The only way the status would be bad is from the cclmake() routine,
  * and the bitmap for that member is guaranteed to be freed.
  */
@@ -1561,7 +1896,8 @@ pchr_done_noincr:
 
 /* An internal function to create a new ("NULL") func_call item */
 static struct func_call *new_fc(void) {
-    struct func_call *retval = Xmalloc(sizeof(struct func_call));
+    struct func_call *retval =
+         arena_alloc(&rmc_arena, sizeof(struct func_call));
     retval->type = EOL;
     retval->next = NULL;
     return retval;
@@ -1652,6 +1988,7 @@ static int rmcstr(void) {
  * So we have to call here from valgrind's DO_FREE section at the end.
  */
     if (rmagical) rmcclear();
+    else arena_reset(&rmc_arena);   /* In case a parse failed */
     rmagical = FALSE;
 
     while (*patptr) {
@@ -1704,15 +2041,15 @@ static int rmcstr(void) {
             case '.':
                 rmcptr->mc.type = REPL_VAR;
 /* Adding 1 for NUL */
-                rmcptr->val.varname = Xmalloc((size_t)dbp_len(btext)+1);
-                strcpy(rmcptr->val.varname, dbp_val(btext));
+                rmcptr->val.varname = arena_strndup(&rmc_arena,
+                     dbp_val(btext), (size_t)dbp_len(btext));
                 break;
             case '@':   /* Replace with a counter - optional formatting */
                 rmcptr->mc.type = REPL_CNT;
 /* Defaults... */
                 rmcptr->val.x.curval = 1;
                 rmcptr->val.x.incr = 1;
-                rmcptr->val.x.fmt = Xstrdup("%d");
+                rmcptr->val.x.fmt = arena_strndup(&rmc_arena, "%d", 2);
 /* ...but can expand on this using @:start=n,incr=m,fmt=%aad.
  * NOTE that the format spec MUST be for a d (or u) item!!!
  * We've already got the length of btext for advancing, so the fact that
@@ -1734,8 +2071,8 @@ static int rmcstr(void) {
                                 parse_error(patptr, "Invalid ${@..} counter");
                                 return FALSE;
                             }
-                            Xfree(rmcptr->val.x.fmt);
-                            rmcptr->val.x.fmt = Xstrdup(ntp+4);
+                            rmcptr->val.x.fmt = arena_strndup(&rmc_arena,
+                                 ntp+4, strlen(ntp+4));
                         }
                     }
                 }
@@ -1759,7 +2096,8 @@ static int rmcstr(void) {
                     if (!nxt) break;
                     if (nxt - bp) { /* Save previous text, if any */
                         wkfcp->type = LITCHAR;      /* Change type */
-                        wkfcp->val.ltext = strndup(bp, (size_t)(nxt - bp));
+                        wkfcp->val.ltext = arena_strndup(&rmc_arena,
+                             bp, (size_t)(nxt - bp));
                         wkfcp->next = new_fc();
                         wkfcp = wkfcp->next;
                     }
@@ -1770,7 +2108,7 @@ static int rmcstr(void) {
                         wkfcp->type = REPL_CNT;
                         wkfcp->val.x.curval = 1;
                         wkfcp->val.x.incr = 1;
-                        wkfcp->val.x.fmt = Xstrdup("%d");
+                        wkfcp->val.x.fmt = arena_strndup(&rmc_arena, "%d", 2);
 /* ...but can expand on this using @:start=n,incr=m,fmt=%aad.
  * NOTE that the format spec MUST be for a d (or u) item!!!
  * We've already got the length of btext for advancing, so the fact that
@@ -1788,7 +2126,8 @@ static int rmcstr(void) {
                                     wkfcp->val.x.incr = atoi(ntp+5);
                                 }
                                 else if (0 == strncmp("fmt=", ntp, 4)) {
-                                    wkfcp->val.x.fmt = Xstrdup(ntp+4);
+                                    wkfcp->val.x.fmt = arena_strndup(
+                                         &rmc_arena, ntp+4, strlen(ntp+4));
                                 }
                             }
                         }
@@ -1805,7 +2144,8 @@ static int rmcstr(void) {
 /* Copy any trailing text */
                 if (ep - tr_start) {        /* Save trailing text, if any */
                     wkfcp->type = LITCHAR;  /* Change type */
-                    wkfcp->val.ltext = strndup(tr_start, (size_t)(ep-tr_start));
+                    wkfcp->val.ltext = arena_strndup(&rmc_arena, tr_start,
+                         (size_t)(ep-tr_start));
                     wkfcp->next = new_fc();
                     wkfcp = wkfcp->next;
                  }
@@ -1892,9 +2232,6 @@ static int asc_eq(char bc, char pc) {
 
 /* mgpheq -- meta-character equality with a grapheme.
  *  Used by step_scanner.
- * NOTE that this free()s any ex part of the incoming gc!
- * (because all callers are done with it after this call, so it
- * puts the free() in one location).
  */
 static int mgpheq(struct grapheme *gc, struct magic *mt) {
     int res;
@@ -1928,35 +2265,25 @@ static int mgpheq(struct grapheme *gc, struct magic *mt) {
  *
  * So for any test we can stop as soon as one part is TRUE.
  */
-    case CCL:                   /* Now have to allow for extended CCL too */
-        if (gc->uc & 0x80) {
+    case CCL: {                 /* Now have to allow for extended CCL too */
+        int mode = curwp->w_bufp->b_mode;
+        struct ccl_trie *ct = mt->uc_trie;
+        if (ct && (unsigned int)gc->uc < CT_MAXUC &&
+             !((mode & MDEQUIV) && ct->has_uclitl)) {
+            if (ct->exact != (mode & MDEXACT))
+                ccl_trie_reset(mt, mode & MDEXACT);
+            res = ccl_trie_test(mt, gc);
+            break;
+        }
+        if (gc->uc > MAXASCII) {
             res = FALSE;        /* So that we drop into xt_cclmap tests */
         }
         else if (!(res = biteq(gc->uc, mt->val.cclmap))) {
 /* Must be ASCII to ever get here...perhaps it's just a case difference? */
-            if ((curwp->w_bufp->b_mode & MDEXACT) == 0 &&
-                 (isASCletter(gc->uc))) {
+            if ((mode & MDEXACT) == 0 && (isASCletter(gc->uc))) {
                 res = biteq(CHCASE(gc->uc), mt->val.cclmap);
             }
         }
-        if (!res && mt->x.xt_cclmap) {
-            int done = 0;
-            for (struct xccl *xp = mt->x.xt_cclmap; !done && !res; xp++) {
-                switch(xp->xc.type) {
-                case EGRP:
-                    done = 1;
-                    break;
-/* This is for a range above MAXASCII.
- * NOTE that there is no case handling here. Non-ASCII case-mapping
- * doesn't fit well with ranges.
- */
-                case CCL:    /* Cannot have any combining bit */
-                    if (gc->cdm)
-                        res = FALSE;
-                    else
-                        res = ((xp->xval.cl_lim.low <= gc->uc) &&
-                               (xp->xval.cl_lim.high >= gc->uc));
-                    break;
 /* Whether UCLITL can contain any combining bit depends on whether
  * EQUIV mode is on. If it is then it is possible for a literal
  * unicode char to match a base char + combining char.
@@ -1965,44 +2292,26 @@ static int mgpheq(struct grapheme *gc, struct magic *mt) {
  *    ñ can be U+006E+U+0303 or U+00F1
  * So, if EQUIV mode is on (Magic must be on for us to be here)
  * we run same_grapheme() on the pair to match, otherwise
- * we run through a simpler test.
+ * xccl_test() runs through a simpler test.
  */
-                case UCLITL:    /* Can it have any combining bit? */
-                    if (curwp->w_bufp->b_mode & MDEQUIV) {
-                        struct grapheme testgc;
-                        testgc.uc = xp->xval.uchar;
-                        testgc.cdm = 0;
-                        testgc.ex = NULL;
-                        res = same_grapheme(gc, &testgc, USE_WPBMODE);
-                        break;
-                    }
-                    if (gc->cdm) {
-                        res = FALSE;
-                        break;
-                    }           /* Fall through */
-                case UCKIND:    /* May have any combining bit */
-                    if (curwp->w_bufp->b_mode & MDEXACT) {
-                        res = (xp->xval.uchar == gc->uc);
-                    }
-                    else {      /* Upper so Greek sigmas work (2l->1U) */
-                        res = (utf8proc_toupper(xp->xval.uchar) ==
-                               utf8proc_toupper(gc->uc));
-                    }
-                    break;
-/* May have any combining bit, but only the base character is tested */
-                case UCPROP: {
-                    const char *uccat = utf8proc_category_string(gc->uc);
-                    int testlen = istrlen(xp->xval.prop);   /* 1 or 2 */
-                    res = !strncmp(uccat, xp->xval.prop, (size_t)testlen);
-                    break;
-                }
-                default:        /* Nothing else can match */
-                    break;
+        if (!res && mt->x.xt_cclmap) {
+            for (struct xccl *xp = mt->x.xt_cclmap;
+                 !res && xp->xc.type != EGRP; xp++) {
+                if ((xp->xc.type == UCLITL) && (mode & MDEQUIV)) {
+                    struct grapheme testgc;
+                    testgc.uc = xp->xval.uchar;
+                    testgc.cdm = 0;
+                    testgc.ex = NULL;
+                    res = same_grapheme(gc, &testgc, USE_WPBMODE);
+                    if (xp->xc.negate_test) res = !res;
                 }
-                if (xp->xc.negate_test) res = !res;
+                else
+                    res = xccl_test(xp, gc->uc, gc->cdm != 0,
+                         mode & MDEXACT);
             }
         }
         break;
+    }
 /* Whether UCLITL can contain any combining bit depends on whether
  * EQUIV mode is on. If it is then it is possible for a literal
  * unicode char to match a base char + combining char.
@@ -2052,12 +2361,6 @@ static int mgpheq(struct grapheme *gc, struct magic *mt) {
         res = FALSE;
     }
 
-/* May seem unusual to free it here, but once we've tested it we've
- * done with it.
- */
-    if (gc->ex) {           /* Our responsibility! */
-        Xfree_setnull(gc->ex);
-    }
     if (mt->mc.negate_test) res = !res;
     return res;
 }
@@ -2220,8 +2523,11 @@ static int readpattern(const char *prompt, db *apat, int srch) {
             (!(curwp->w_bufp->b_mode & MDEXACT) && srch)) {
             status = srch ? mcstr() : rmcstr();
         }
-        else
-            if (srch) slow_scan = 0;
+        else if (srch) slow_scan = 0;
+        else {                  /* Don't use an old replacement magic */
+            if (rmagical) rmcclear();
+            rmagical = FALSE;
+        }
 
 /* If we are doing the search string remember the length for substitution
  * purposes and reverse string copy. For fast scans, set jump tables.
@@ -2246,10 +2552,30 @@ static int readpattern(const char *prompt, db *apat, int srch) {
  *  grapheme from the current point and move beyond it, while
  *  reverse searches get the previous grapheme and move to its start.
  * NOTE!!! that we return a pointer to a static, internal struct grapheme.
- * It is the CALLERs responsibility to deal with any alloc's on gc.ex!!
+ * Any gc.ex part is in match_arena, so the caller can give it back with
+ * arena_release() once done with it.
  *  Used by step_scanner.
  */
 
+/* Put the combining marks after the first one of the grapheme gc, which
+ * is at buf[from] up to buf[to], into an ex part in match_arena.
+ */
+static void arena_gph_ex(struct grapheme *gc, const char *buf, int from,
+     int to) {
+    if (!gc->cdm) return;
+    unicode_t c;
+    int offs = from + utf8_to_unicode(buf, from, to, &c);   /* Base */
+    offs += utf8_to_unicode(buf, offs, to, &c);             /* cdm */
+    if (offs >= to) return;
+
+    int nex = 0;
+    for (int xo = offs; xo < to; nex++) xo += utf8_to_unicode(buf, xo, to, &c);
+    gc->ex = arena_alloc(&match_arena, (size_t)(nex + 1)*sizeof(unicode_t));
+    for (int xi = 0; xi < nex; xi++)
+        offs += utf8_to_unicode(buf, offs, to, &gc->ex[xi]);
+    gc->ex[nex] = UEM_NOCHAR;
+}
+
 /* For non-overlapping, reverse slow searches we need to set-up an
  * artifical barrier beyond which we don't retrieve characters.
  */
@@ -2330,7 +2656,11 @@ static struct grapheme *nextgph(struct line **pcurline, int *pcuroff,
             if (dir == FORWARD) get_graph = build_next_grapheme;
             else                get_graph = build_prev_grapheme;
             nextoff =
-                 get_graph(ltext(curline), curoff, lused(curline), &gc, 0);
+                 get_graph(ltext(curline), curoff, lused(curline), &gc, 1);
+            if (dir == FORWARD)
+                arena_gph_ex(&gc, ltext(curline), curoff, nextoff);
+            else
+                arena_gph_ex(&gc, ltext(curline), nextoff, curoff);
         }
         nextline = curline;
         if (bytes_used) *bytes_used = abs(nextoff - curoff);
@@ -2353,6 +2683,7 @@ static int check_next(struct line **cline, int *coff, struct magic *mcptr) {
  *   https://stackoverflow.com/questions/5080848/disable-gcc-may-be-used-uninitialized-on-a-particular-variable
  */
     int used = used;
+    struct arena_mark mk = arena_getmark(&match_arena);
     struct grapheme *gc = nextgph(cline, coff, &used, FORWARD);
 /* Check that there *is* a next character! */
     if (gc->uc == UEM_NOCHAR) {
@@ -2361,10 +2692,8 @@ static int check_next(struct line **cline, int *coff, struct magic *mcptr) {
     else if (!mgpheq(gc, mcptr)) {
         used = -1;      /* Failed (to match the next character) */
     }
-/* mgpheq() will have freed any malloc()ed gc->ex parts.
- * And if we didn't get round to calling mgpheq(), then there won;t be
- * any gc->ex parts to free.
- */
+/* Give back any gc->ex part */
+    arena_release(&match_arena, mk);
     return used;
 }
 
@@ -2670,12 +2999,9 @@ failed:
  */
 static void init_dyn_group_status(void) {
 
-/* If we allocated any result strings, free them now... */
-    for (int gi = 0; gi < max_grp; gi++) {
-        if (grp_text[gi]) {
-            Xfree_setnull(grp_text[gi]);
-        }
-    }
+/* Forget any result strings (they are in match_arena)... */
+    for (int gi = 0; gi < max_grp; gi++) grp_text[gi] = NULL;
+    arena_reset(&match_arena);
 /* ...and also initialize dynamic group matching info */
     for (int gi = 0; gi <= group_cntr; gi++) {
         match_grp_info[gi] = null_match_grp_info;
@@ -2684,6 +3010,111 @@ static void init_dyn_group_status(void) {
     return;
 }
 
+/* The folded graphemes of (part of) a line, and where each starts */
+static struct {
+    unicode_t *key;
+    int *off;
+    int alloc;
+} fgph = { NULL, NULL, 0 };
+
+/* Split text[from, len) into folded graphemes, as build_next_grapheme()
+ * would. Returns how many there are, with fgph.off[] set for each and
+ * one more for the end.
+ */
+static int fold_line(const char *text, int from, int len) {
+    int ng = 0;
+    int off = from;
+    while (off < len) {
+        if (ng + 1 >= fgph.alloc) {
+            fgph.alloc = fgph.alloc? 2*fgph.alloc: 256;
+            fgph.key = Xrealloc(fgph.key,
+                 (size_t)fgph.alloc*sizeof(unicode_t));
+            fgph.off = Xrealloc(fgph.off, (size_t)fgph.alloc*sizeof(int));
+        }
+        fgph.off[ng] = off;
+        unicode_t uc = ch_as_uc(text[off]);
+        if (uc < 0x80) off++;
+        else           off += utf8_to_unicode(text, off, len, &uc);
+        unicode_t key = fold_uc(uc);
+        if ((uc > 0x7f) && (key <= 0x7f)) key |= FOLD_NONASC;
+        while ((off < len) && (text[off] & 0x80)) {
+            unicode_t c;
+            int nb = utf8_to_unicode(text, off, len, &c);
+            if (!combining_type(c)) break;
+            off += nb;
+            key = FOLD_NOMATCH;
+        }
+        fgph.key[ng++] = key;
+    }
+    fgph.off[ng] = off;
+    return ng;
+}
+
+/* Does the pattern match the graphemes from gi? */
+static int fold_match(int gi) {
+    for (int pi = 0; pi < fpat.len; pi++) {
+        unicode_t key = fgph.key[gi + pi];
+        if ((key & ~FOLD_NONASC) != fpat.uc[pi]) return FALSE;
+        if ((key & FOLD_NONASC) && fpat.ascii[pi]) return FALSE;
+    }
+    return TRUE;
+}
+
+/* fold_scanner -- step_scanner() for a fold_scan pattern.
+ * Matches are always within a line. As for step_scanner(), a reverse
+ * search finds the nearest match starting before dot (or at it, for
+ * REVERSE_NOSKIP), which need not end before it unless the barrier is
+ * active.
+ */
+static int fold_scanner(int direct, int beg_or_end) {
+    struct line *lp = curwp->w.dotp;
+    int plen = fpat.len;
+    int gi = -1;
+    int ng;
+
+    if (direct == FORWARD) {
+        int from = curwp->w.doto;
+        for (; lp != curbp->b_linep; lp = lforw(lp), from = 0) {
+            ng = fold_line(ltext(lp), from, lused(lp));
+            for (gi = 0; gi + plen <= ng;
+                 gi += fpat.fskip[fgph.key[gi + plen - 1] & 0xff]) {
+                if (fold_match(gi)) goto found;
+            }
+        }
+        return FALSE;
+    }
+
+    int limit = curwp->w.doto + (direct == REVERSE_NOSKIP);
+    if (lp == curbp->b_linep) {
+        lp = lback(lp);
+        limit = INT_MAX;
+    }
+    for (; lp != curbp->b_linep; lp = lback(lp), limit = INT_MAX) {
+        ng = fold_line(ltext(lp), 0, lused(lp));
+        int maxlast = (barrier_active && (lp == barrier_endline))?
+             barrier_offset: INT_MAX;
+        gi = ng - plen;
+        while ((gi >= 0) && ((fgph.off[gi] >= limit) ||
+             (fgph.off[gi + plen - 1] >= maxlast)))
+            gi--;
+        for (; gi >= 0; gi -= fpat.bskip[fgph.key[gi] & 0xff]) {
+            if (fold_match(gi)) goto found;
+        }
+    }
+    return FALSE;
+
+found:
+    match_grp_info[0].mline = lp;
+    match_grp_info[0].start = fgph.off[gi];
+    match_grp_info[0].len = fgph.off[gi + plen] - fgph.off[gi];
+    curwp->w.dotp = lp;
+    curwp->w.doto = (beg_or_end == PTEND)? fgph.off[gi + plen]:
+         fgph.off[gi];
+    curwp->w_flag |= WFMOVE;
+    group_match_buffer = curwp->w_bufp;
+    return TRUE;
+}
+
 /* step_scanner -- Search for a meta-pattern in either direction.
  *  If found, reset the "." to be at the start or just after the match
  *  string, and (perhaps) repaint the display.
@@ -2702,6 +3133,13 @@ static int step_scanner(struct magic *mcpatrn, int direct, int beg_or_end) {
 
     init_dyn_group_status();    /* Forget the past */
 
+/* A literal pattern can use the folded scanner, if the modes that
+ * mgpheq() would look at still allow it.
+ */
+    if (fold_scan && (mcpatrn == mcpat) &&
+         !(curwp->w_bufp->b_mode & (MDEXACT | MDEQUIV)))
+        return fold_scanner(direct, beg_or_end);
+
 /* We never actually test in reverse for step_scanner(), so there is no
  * need to toggle beg_or_end here.
  */
@@ -3040,7 +3478,8 @@ const char *group_match(int grp) {
  */
     if (!grp_text[grp]) {
 
-        grp_text[grp] = Xmalloc((size_t)(match_grp_info[grp].len + 1));
+        grp_text[grp] = arena_alloc(&match_arena,
+             (size_t)(match_grp_info[grp].len + 1));
 
 /* Create the match text for this group... */
 
@@ -3093,6 +3532,48 @@ static void report_match(void) {
     return;
 }
 
+/* The scans made by forwhunt() and backhunt(), as functions that
+ * mapview_scan() can call again as it moves a mapped file along.
+ */
+static int mc_hunt(int);    /* Forward declaration */
+static int scan_forw(void) {
+    if (slow_scan) return step_scanner(mcpat, FORWARD, PTEND);
+    int status = mc_hunt(FORWARD);
+    return (status >= 0)? status: fast_scanner(db_val(pat), FORWARD, PTEND);
+}
+static int scan_back(void) {
+    if (!slow_scan) {
+        int status = mc_hunt(REVERSE);
+        if (status >= 0) return status;
+        return fast_scanner(db_val(tap), REVERSE, PTBEG);
+    }
+
+/* For the slow scan in reverse mode we might need to set an artificial
+ * barrier to prevent overlapping matches.
+ */
+    if (!(ggr_opts&GGR_SRCHOLAP)) {
+        barrier_endline = curwp->w.dotp;
+        barrier_offset = curwp->w.doto;
+        barrier_active = 1;
+    }
+    int status = step_scanner(mcpat, REVERSE, PTBEG);
+    barrier_active = 0;
+    return status;
+}
+
+/* The pattern, if it can be found as it is in a mapped file's bytes.
+ * So not magic or equivalence mode, and not case-folded unless it has
+ * no letters.
+ */
+static const char *literal_pat(void) {
+    if (slow_scan || (curbp->b_mode & (MDMAGIC | MDEQUIV))) return NULL;
+    if (!(curbp->b_mode & MDEXACT)) {
+        for (const char *cp = db_val(pat); *cp; cp++)
+            if ((*cp & 0x80) || isalpha((unsigned char)*cp)) return NULL;
+    }
+    return db_val(pat);
+}
+
 /* forwhunt -- Search forward for a previously acquired search string.
  *      If found, reset the "." to be just after the match string,
  *      and (perhaps) repaint the display.
@@ -3145,8 +3626,10 @@ int forwhunt(int f, int n) {
             status = FALSE;
             break;
         }
-        status = (slow_scan)? step_scanner(mcpat, FORWARD, PTEND)
-                            : fast_scanner(db_val(pat), FORWARD, PTEND);
+        if (curbp->b_flag & BFMAPPED)
+            status = mapview_scan(scan_forw, FORWARD, literal_pat(), &olp);
+        else
+            status = scan_forw();
 /* We now have a valid group_match, or have failed */
         if (ggr_opts&GGR_SRCHOLAP) do_preskip = 1;
     } while ((--n > 0) && status);
@@ -3160,6 +3643,8 @@ int forwhunt(int f, int n) {
         mlwrite_one("Not found");
         curwp->w.dotp = olp;
         curwp->w.doto = obyte_offset;
+        if (curwp->w.doto > lused(olp))     /* A truncated mapview */
+            curwp->w.doto = lused(olp);
     }
     return status;
 }
@@ -3249,21 +3734,11 @@ int backhunt(int f, int n) {
 
 /* Search for the pattern for as long as n is positive (n == 0 will go
  * through once, which is just fine).
- * For the slow scan in reverse mode we might need to set an artificial
- * barrier to prevent overlapping matches.
  */
-        if (slow_scan) {
-            if (!(ggr_opts&GGR_SRCHOLAP)) {
-                barrier_endline = curwp->w.dotp;
-                barrier_offset = curwp->w.doto;
-                barrier_active = 1;
-            }
-            status = step_scanner(mcpat, REVERSE, PTBEG);
-            barrier_active = 0;
-        }
-        else {
-            status = fast_scanner(db_val(tap), REVERSE, PTBEG);
-        }
+        if (curbp->b_flag & BFMAPPED)
+            status = mapview_scan(scan_back, REVERSE, NULL, &olp);
+        else
+            status = scan_back();
 /* We now have a valid group_match, or have failed */
         if (ggr_opts&GGR_SRCHOLAP) do_preskip = 1;
     } while ((--n > 0) && status);
@@ -3277,6 +3752,8 @@ int backhunt(int f, int n) {
         mlwrite_one("Not found");
         curwp->w.dotp = olp;
         curwp->w.doto = obyte_offset;
+        if (curwp->w.doto > lused(olp))     /* A truncated mapview */
+            curwp->w.doto = lused(olp);
     }
     return status;
 }
@@ -3321,6 +3798,132 @@ int backsearch(int f, int n) {
     return backhunt(f, n);
 }
 
+/* line_matches -- find the matches for the current search pattern that
+ *      start on line lp of the buffer in window wp, for highlighting.
+ * Sets *spans to an array of (start, end) byte offset pairs, the end
+ * stopping at the end of the line, and returns how many there are, or
+ * -1 if there is no pattern.
+ * It runs the scanner the hunts would use only along the line, with wp
+ * made current, and leaves the last search's match as it was.
+ */
+static struct match_group_info *lm_match = NULL;
+static struct control_group_info *lm_cntl = NULL;
+static int lm_ngrp = 0;
+static void lm_add(int **spans, int *alloc, int ns, int start, int end) {
+    if (2*ns + 2 > *alloc) {
+        *alloc = *alloc? 2**alloc: 16;
+        *spans = Xrealloc(*spans, (size_t)*alloc*sizeof(int));
+    }
+    (*spans)[2*ns] = start;
+    (*spans)[2*ns + 1] = end;
+}
+int line_matches(struct window *wp, struct line *lp, int **spans,
+     int *alloc) {
+    if (db_len(pat) == 0) return -1;
+    if (slow_scan && (mcpat[0].mc.type == EGRP)) return -1;
+
+    struct window *owp = curwp;
+    struct buffer *obp = curbp;
+    curwp = wp;
+    curbp = wp->w_bufp;
+    int ns = 0;
+    int len = lused(lp);
+
+    if (!slow_scan) {           /* As fast_scanner() would find them */
+        const char *pp = db_val(pat);
+        for (int off = 0; off < len; ) {
+            struct line *tlp = lp;
+            int toff = off;
+            const char *cp = pp;
+            while (*cp && (tlp != curbp->b_linep) &&
+                   asc_eq(nextbyte(&tlp, &toff, FORWARD), *cp)) cp++;
+            struct grapheme gct;
+            if (!*cp) (void)build_next_grapheme(ltext(tlp), toff, lused(tlp),
+                 &gct, 1);
+            if (*cp || combining_type(gct.uc)) {
+                off++;
+                continue;
+            }
+            int end = (tlp == lp)? toff: len;
+            lm_add(spans, alloc, ns++, off, end);
+            if (tlp != lp) break;
+            off = end;
+        }
+        curwp = owp;
+        curbp = obp;
+        return ns;
+    }
+
+/* The Magic scanner needs its group state kept for the last search */
+    int ngrp = group_cntr + 1;
+    if (ngrp > lm_ngrp) {
+        lm_ngrp = ngrp;
+        lm_match = Xreallocarray(lm_match, lm_ngrp,
+             sizeof(struct match_group_info));
+        lm_cntl = Xreallocarray(lm_cntl, lm_ngrp,
+             sizeof(struct control_group_info));
+    }
+    memcpy(lm_match, match_grp_info, (size_t)ngrp*sizeof(*lm_match));
+    memcpy(lm_cntl, cntl_grp_info, (size_t)ngrp*sizeof(*lm_cntl));
+    struct buffer *ogmb = group_match_buffer;
+    for (int gi = 0; gi < ngrp; gi++) {
+        match_grp_info[gi] = null_match_grp_info;
+        cntl_grp_info[gi].state = GPIDLE;
+        cntl_grp_info[gi].next_choice_idx = 0;
+    }
+
+    for (int off = 0; off <= len; ) {
+        struct line *tlp = lp;
+        int toff = off;
+        int end = off;
+        if (amatch(mcpat, &tlp, &toff, 0) >= 0) {
+            end = (tlp == lp)? toff: len;
+            if (end > off) lm_add(spans, alloc, ns++, off, end);
+            if (tlp != lp) break;
+        }
+        if (end > off) off = end;
+        else if (off < len) off = next_utf8_offset(ltext(lp), off, len, TRUE);
+        else break;
+    }
+
+    memcpy(match_grp_info, lm_match, (size_t)ngrp*sizeof(*lm_match));
+    memcpy(cntl_grp_info, lm_cntl, (size_t)ngrp*sizeof(*lm_cntl));
+    group_match_buffer = ogmb;
+    curwp = owp;
+    curbp = obp;
+    return ns;
+}
+
+/* isearch saves the match found so far before each key, and puts it back
+ * on a backspace, as the match info is what scanmore() works from.
+ */
+struct sm_state {
+    struct match_group_info match;
+    struct buffer *bp;          /* The group_match_buffer */
+};
+static struct sm_state *sm_saved = NULL;
+static int sm_nsaved = 0;
+static int sm_alloc = 0;
+
+void scanmore_push(void) {
+    if (sm_nsaved >= sm_alloc) {
+        sm_alloc = sm_alloc? 2*sm_alloc: 32;
+        sm_saved = Xreallocarray(sm_saved, sm_alloc, sizeof(struct sm_state));
+    }
+    struct sm_state *sp = sm_saved + sm_nsaved++;
+    sp->match = match_grp_info? match_grp_info[0]: null_match_grp_info;
+    sp->bp = group_match_buffer;
+}
+
+void scanmore_pop(void) {
+    if (sm_nsaved == 0) return;
+    struct sm_state *sp = sm_saved + --sm_nsaved;
+    if (!match_grp_info) return;
+    init_dyn_group_status();
+    match_grp_info[0] = sp->match;
+    group_match_buffer = sp->bp;
+}
+
 /* Entry point for isearch.
  * This needs to set-up the patterns for the search to work.
  */
@@ -3329,9 +3932,12 @@ static int sm_off = 0;
 int scanmore(db *patrn, int dir, int next_match, int extend_match) {
     int sts;                /* search status */
 
-/* If called with a NULL pattern, just remove group info. */
+/* If called with a NULL pattern, just remove group info (and anything
+ * saved by isearch).
+ */
     if (!patrn) {
         init_dyn_group_status();
+        sm_nsaved = 0;
         return TRUE;
     }
 
@@ -3412,9 +4018,11 @@ int scanmore(db *patrn, int dir, int next_match, int extend_match) {
 }
 
 /* Work out the replacement text for the current match.
- * The working buffer is never freed - only grows as needed.
+ * The working buffers are never freed - only grow as needed.
  */
 static db_strdef(repl);
+static db_strdef(fnc_buf);
+static db_strdef(fnc_result);
 
 static const char *getrepl(void) {
 
@@ -3466,8 +4074,7 @@ static const char *getrepl(void) {
             break;
         }
         case REPL_FNC: {
-            db_strdef(fnc_buf);
-            db_set(fnc_buf, "");   /* Start with nothing */
+            db_clear(fnc_buf);      /* Start with nothing */
             for (struct func_call *fcp = rmcptr->val.fc; fcp->type != EOL;
                     fcp = fcp->next) {
                 switch (fcp->type) {
@@ -3493,11 +4100,8 @@ static const char *getrepl(void) {
  * command-line text and return the resulting string
  * We have a function to do that...
  */
-            db_strdef(result);
-            evaluate_cmdb(db_val(fnc_buf), &result);
-            db_free(fnc_buf);
-            db_append(repl, db_val(result));
-            db_free(result);
+            evaluate_cmdb(db_val(fnc_buf), &fnc_result);
+            db_append(repl, db_val(fnc_result));
             break;
         }
         default:;
@@ -3583,6 +4187,1275 @@ static int delins(const char *repstr) {
     return status;
 }
 
+/* Finding all of the matches from a point to the end of the buffer,
+ * for match counts, list-matches and replace-string.
+ *
+ * For a literal pattern (one that fast_scanner() would use) this is done
+ * in parallel. One pass along the line list cuts it into chunks of about
+ * PS_CHUNK bytes, which worker threads take in turn, each finding the
+ * matches that start in a chunk as if a scan had started at its
+ * beginning. They only read the line text, which nothing changes while
+ * they run.
+ * The chunks' results are then merged in order. Where a match runs on
+ * into the next chunk that one is rescanned from the match's end until
+ * it finds a match that its worker also found, as from there the rest of
+ * the worker's results must be the same.
+ * When only counting, a worker keeps just the first PS_KEEP matches in
+ * a chunk, and a rescan that gets past those carries on to the chunk's
+ * end.
+ * Other patterns are scanned for from the start with the usual scanner.
+ */
+#define PS_CHUNK    (1 << 20)
+#define PS_THREADS  8
+#define PS_KEEP     64
+
+struct ps_pos {
+    struct line *lp;
+    long lno;               /* Line number (from 0 for the start line) */
+    int off;
+};
+struct ps_match {
+    struct ps_pos start;
+    struct ps_pos end;
+};
+struct ps_chunk {
+    struct ps_pos first;    /* Where the chunk starts */
+    long nlines;
+    long count;             /* Number of matches found */
+    struct ps_pos last_end; /* Where to go on from the last one */
+    struct ps_match *match; /* The matches (the first PS_KEEP, if counting) */
+    int nmatch;
+    int alloc;
+    int nomem;              /* The matches couldn't all be kept */
+};
+static struct {
+    const char *pat;
+    int nseg;               /* Pattern segments (split at newlines) */
+    int *seg_off, *seg_len;
+    unsigned char fold[256];
+    int skip[256];
+    struct line *endp;      /* The buffer's header line */
+    int keep_all;
+    int overlap;            /* Find overlapping matches too */
+    struct ps_chunk *chunk;
+    int nchunk;
+    int next_chunk;         /* The next one for a worker to take */
+    pthread_mutex_t lock;
+} ps = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+static int ps_cmp(struct ps_pos *a, struct ps_pos *b) {
+    if (a->lno != b->lno) return (a->lno < b->lno)? -1: 1;
+    return a->off - b->off;
+}
+
+/* Where to look for the match after this one */
+static struct ps_pos ps_resume(struct ps_match *mp) {
+    if (!ps.overlap) return mp->end;
+    struct ps_pos next = mp->start;
+    next.off++;
+    return next;
+}
+
+/* Compare text with the pattern, as asc_eq() does */
+static int ps_eq(const char *tp, const char *pp, int len) {
+    while (len-- > 0)
+        if (ps.fold[(unsigned char)*tp++] != ps.fold[(unsigned char)*pp++])
+            return FALSE;
+    return TRUE;
+}
+
+/* As fast_scanner(), a match can't end before a combining character */
+static int ps_combi(struct line *lp, int off) {
+    if ((lp == ps.endp) || (off >= lused(lp))) return FALSE;
+    unicode_t uc;
+    (void)utf8_to_unicode(ltext(lp), off, lused(lp), &uc);
+    return combining_type(uc);
+}
+
+/* ps_find -- find the first match that starts on a line at or after off.
+ */
+static int ps_find(struct line *lp, long lno, int off, struct ps_match *mp) {
+    const char *text = ltext(lp);
+    int len = lused(lp);
+
+    if (ps.nseg == 1) {         /* Within the line, so Horspool along it */
+        int plen = ps.seg_len[0];
+        unsigned char last = ps.fold[(unsigned char)ps.pat[plen - 1]];
+        for (int ti = off; ti + plen <= len; ) {
+            unsigned char c = ps.fold[(unsigned char)text[ti + plen - 1]];
+            if ((c == last) && ps_eq(text + ti, ps.pat, plen - 1) &&
+                 !ps_combi(lp, ti + plen)) {
+                mp->start = (struct ps_pos){ lp, lno, ti };
+                mp->end = (struct ps_pos){ lp, lno, ti + plen };
+                return TRUE;
+            }
+            ti += ps.skip[c];
+        }
+        return FALSE;
+    }
+
+/* With newlines the first segment must end this line, any middle ones
+ * be the whole of the next lines, and the last start the one after.
+ * Nothing can match beyond the newline of the buffer's last line.
+ */
+    int start = len - ps.seg_len[0];
+    if ((start < off) || !ps_eq(text + start, ps.pat, ps.seg_len[0]))
+        return FALSE;
+    struct line *elp = lp;
+    int si;
+    for (si = 1; si < ps.nseg; si++) {
+        elp = lforw(elp);
+        if (elp == ps.endp) break;
+        int slen = ps.seg_len[si];
+        if ((si < ps.nseg - 1)? (lused(elp) != slen): (lused(elp) < slen))
+            return FALSE;
+        if (!ps_eq(ltext(elp), ps.pat + ps.seg_off[si], slen)) return FALSE;
+    }
+    if (si < ps.nseg) {         /* Ran into the header line */
+        if ((si < ps.nseg - 1) || ps.seg_len[si]) return FALSE;
+    }
+    int eoff = ps.seg_len[ps.nseg - 1];
+    if (ps_combi(elp, eoff)) return FALSE;
+    mp->start = (struct ps_pos){ lp, lno, start };
+    mp->end = (struct ps_pos){ elp, lno + ps.nseg - 1, eoff };
+    return TRUE;
+}
+
+/* ps_next -- find the next match from *pos that starts on or before line
+ *      last_lno, moving *pos over the lines without one.
+ */
+static int ps_next(struct ps_pos *pos, long last_lno, struct ps_match *mp) {
+    while (pos->lno <= last_lno) {
+        if (ps_find(pos->lp, pos->lno, pos->off, mp)) return TRUE;
+        pos->lp = lforw(pos->lp);
+        pos->lno++;
+        pos->off = 0;
+    }
+    return FALSE;
+}
+
+/* ps_add -- add a match to a chunk's results.
+ * Run by the workers, so the list is grown without Xreallocarray() (which
+ * exits on failure, and that's not for a worker to do). Returns FALSE if
+ * it can't be, having set cp->nomem for par_scan() to report.
+ */
+static int ps_add(struct ps_chunk *cp, struct ps_match *mp) {
+    cp->count++;
+    cp->last_end = ps_resume(mp);
+    if (!ps.keep_all && (cp->nmatch >= PS_KEEP)) return TRUE;
+    if (cp->nmatch >= cp->alloc) {
+        int alloc = cp->alloc? 2*cp->alloc: 32;
+        struct ps_match *match = reallocarray(cp->match, (size_t)alloc,
+             sizeof(struct ps_match));
+        if (!match) {
+            cp->nomem = TRUE;
+            return FALSE;
+        }
+        cp->match = match;
+        cp->alloc = alloc;
+    }
+    cp->match[cp->nmatch++] = *mp;
+    return TRUE;
+}
+
+static void *ps_worker(void *arg) {
+    UNUSED(arg);
+    while (1) {
+        pthread_mutex_lock(&ps.lock);
+        int ci = ps.next_chunk++;
+        pthread_mutex_unlock(&ps.lock);
+        if (ci >= ps.nchunk) break;
+
+        struct ps_chunk *cp = ps.chunk + ci;
+        struct ps_pos pos = cp->first;
+        struct ps_match m;
+        while (ps_next(&pos, cp->first.lno + cp->nlines - 1, &m)) {
+            if (!ps_add(cp, &m)) break;
+            pos = ps_resume(&m);
+        }
+    }
+    return NULL;
+}
+
+/* ps_setup -- split the pattern at its newlines, and make the case-folding
+ *      and skip tables.
+ */
+static void ps_setup(void) {
+    ps.pat = db_val(pat);
+    ps.nseg = 1;
+    for (const char *cp = ps.pat; *cp; cp++) if (*cp == '\n') ps.nseg++;
+    ps.seg_off = Xmalloc(2 * (size_t)ps.nseg * sizeof(int));
+    ps.seg_len = ps.seg_off + ps.nseg;
+    int si = 0;
+    ps.seg_off[0] = 0;
+    for (int pi = 0; pi < srch_patlen; pi++) {
+        if (ps.pat[pi] != '\n') continue;
+        ps.seg_len[si] = pi - ps.seg_off[si];
+        ps.seg_off[++si] = pi + 1;
+    }
+    ps.seg_len[si] = srch_patlen - ps.seg_off[si];
+
+    int exact = curwp->w_bufp->b_mode & MDEXACT;
+    for (int c = 0; c < 256; c++)
+        ps.fold[c] = (!exact && isASClower(c))? (unsigned char)(c ^ DIFCASE):
+                                                (unsigned char)c;
+    int plen = ps.seg_len[0];
+    for (int c = 0; c < 256; c++) ps.skip[c] = plen;
+    for (int pi = 0; pi < plen - 1; pi++)
+        ps.skip[ps.fold[(unsigned char)ps.pat[pi]]] = plen - 1 - pi;
+}
+
+/* par_scan -- find the matches for a literal pattern from (lp, off) to
+ *      the end of buffer bp, including those overlapping others if
+ *      overlap is set.
+ * Returns the number of matches and, if mlist is given, sets it to an
+ * Xmalloc()ed list of them all, in order.
+ * If a worker ran out of memory that is reported, and it returns -1
+ * (with *mlist NULL).
+ */
+static long par_scan(struct buffer *bp, struct line *lp, int off,
+     int overlap, struct ps_match **mlist) {
+    ps_setup();
+    ps.endp = bp->b_linep;
+    ps.keep_all = (mlist != NULL);
+    ps.overlap = overlap;
+
+/* Cut the lines into chunks */
+    ps.chunk = NULL;
+    ps.nchunk = 0;
+    int alloc = 0;
+    size_t bytes = PS_CHUNK;
+    for (long lno = 0; lp != ps.endp; lp = lforw(lp), lno++) {
+        if (bytes >= PS_CHUNK) {
+            if (ps.nchunk >= alloc) {
+                alloc = alloc? 2*alloc: 16;
+                ps.chunk = Xreallocarray(ps.chunk, (size_t)alloc,
+                     sizeof(struct ps_chunk));
+            }
+            ps.chunk[ps.nchunk++] = (struct ps_chunk)
+                 { { lp, lno, (lno == 0)? off: 0 }, 0, 0,
+                   { NULL, 0, 0 }, NULL, 0, 0, 0 };
+            bytes = 0;
+        }
+        ps.chunk[ps.nchunk - 1].nlines++;
+        bytes += (size_t)lused(lp) + 1;
+    }
+
+/* Scan them, with threads if there is more than one.
+ * The threads must leave all signals to the main thread, which also
+ * takes chunks while it waits for them.
+ */
+    ps.next_chunk = 0;
+    pthread_t worker[PS_THREADS];
+    int started = 0;
+    if (ps.nchunk > 1) {
+        long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+        int want = (ncpu > 1)? (int)ncpu - 1: 0;
+        if (want > PS_THREADS) want = PS_THREADS;
+        if (want > ps.nchunk - 1) want = ps.nchunk - 1;
+        sigset_t all, orig;
+        sigfillset(&all);
+        pthread_sigmask(SIG_SETMASK, &all, &orig);
+        while (started < want) {
+            if (pthread_create(&worker[started], NULL, ps_worker, NULL))
+                break;
+            started++;
+        }
+        pthread_sigmask(SIG_SETMASK, &orig, NULL);
+    }
+    (void)ps_worker(NULL);
+    for (int ti = 0; ti < started; ti++) pthread_join(worker[ti], NULL);
+
+    int nomem = 0;
+    for (int ci = 0; ci < ps.nchunk; ci++) if (ps.chunk[ci].nomem) nomem++;
+    if (nomem) {
+        for (int ci = 0; ci < ps.nchunk; ci++) Xfree(ps.chunk[ci].match);
+        Xfree_setnull(ps.chunk);
+        Xfree_setnull(ps.seg_off);
+        if (mlist) *mlist = NULL;
+        mlwrite_one("Out of memory finding the matches");
+        return -1;
+    }
+
+/* Merge the results */
+    long total = 0;
+    struct ps_match *list = NULL;
+    size_t nlist = 0, list_alloc = 0;
+    struct ps_pos pos = ps.nchunk? ps.chunk[0].first: (struct ps_pos){0};
+    for (int ci = 0; ci < ps.nchunk; ci++) {
+        struct ps_chunk *cp = ps.chunk + ci;
+        int from = 0;           /* The worker's results to take */
+        long extra = 0;         /* Matches found by a rescan */
+        if (ps_cmp(&pos, &cp->first) > 0) {
+            struct ps_match m;
+            from = cp->nmatch;  /* Unless we get back in step */
+            while (ps_next(&pos, cp->first.lno + cp->nlines - 1, &m)) {
+                int mi = 0;
+                while ((mi < cp->nmatch) &&
+                       (ps_cmp(&cp->match[mi].start, &m.start) < 0)) mi++;
+                if ((mi < cp->nmatch) &&
+                     !ps_cmp(&cp->match[mi].start, &m.start)) {
+                    from = mi;
+                    break;
+                }
+                extra++;
+                if (mlist) {
+                    if (nlist >= list_alloc) {
+                        list_alloc = list_alloc? 2*list_alloc: 64;
+                        list = Xrealloc(list,
+                             list_alloc*sizeof(struct ps_match));
+                    }
+                    list[nlist++] = m;
+                }
+                pos = ps_resume(&m);
+            }
+            total += extra;
+            if (from == cp->nmatch) {
+                Xfree(cp->match);
+                continue;
+            }
+        }
+        total += cp->count - from;
+        if (cp->count) pos = cp->last_end;
+        if (mlist && (cp->nmatch > from)) {
+            size_t add = (size_t)(cp->nmatch - from);
+            if (nlist + add > list_alloc) {
+                list_alloc = nlist + add + list_alloc;
+                list = Xrealloc(list,
+                     list_alloc*sizeof(struct ps_match));
+            }
+            memcpy(list + nlist, cp->match + from,
+                 add*sizeof(struct ps_match));
+            nlist += add;
+        }
+        Xfree(cp->match);
+    }
+    Xfree_setnull(ps.chunk);
+    Xfree_setnull(ps.seg_off);
+    if (mlist) *mlist = list;
+    return total;
+}
+
+/* seq_scan -- as par_scan(), for a pattern that needs the step_scanner()
+ *      (or its folding version).
+ * A zero-length match is counted, then the scan moves on a character.
+ * The scanners work in curbp, so bp is made that while it runs.
+ */
+static long seq_scan(struct buffer *bp, struct line *lp, int off,
+     struct ps_match **mlist) {
+    struct buffer *obp = curbp;
+    struct line *odotp = curwp->w.dotp;
+    int odoto = curwp->w.doto;
+    long total = 0;
+    struct ps_match *list = NULL;
+    size_t list_alloc = 0;
+    struct line *nlp = lp;      /* For keeping track of line numbers */
+    long nlno = 0;
+
+    curbp = bp;
+    curwp->w.dotp = lp;
+    curwp->w.doto = off;
+    while ((curwp->w.dotp != curbp->b_linep) &&
+            step_scanner(mcpat, FORWARD, PTEND)) {
+        if (mlist) {
+            if ((size_t)total >= list_alloc) {
+                list_alloc = list_alloc? 2*list_alloc: 64;
+                list = Xrealloc(list,
+                     list_alloc*sizeof(struct ps_match));
+            }
+            struct ps_match *mp = list + total;
+            while (nlp != match_grp_info[0].mline) {
+                nlp = lforw(nlp);
+                nlno++;
+            }
+            mp->start = (struct ps_pos){ nlp, nlno, match_grp_info[0].start };
+            mp->end = mp->start;
+            while (mp->end.lp != curwp->w.dotp) {
+                mp->end.lp = lforw(mp->end.lp);
+                mp->end.lno++;
+            }
+            mp->end.off = curwp->w.doto;
+        }
+        total++;
+        if (match_grp_info[0].len == 0) {
+            if (curwp->w.dotp == curbp->b_linep) break;
+            (void)forw_grapheme(1);
+        }
+    }
+    init_dyn_group_status();
+    curbp = obp;
+    curwp->w.dotp = odotp;
+    curwp->w.doto = odoto;
+    if (mlist) *mlist = list;
+    return total;
+}
+
+/* The hunt match cache.
+ * A macro that runs forw/backhunt in a loop would otherwise rescan from
+ * dot every time. So for a literal pattern without a newline, the second
+ * hunt with it (and the same Exact mode) in a buffer that hasn't changed
+ * since the first one finds all of its matches there, overlapping ones
+ * too, with par_scan(). That hunt, and those after it, then look up the
+ * match they want in the list. count-matches and list-matches make it at
+ * once, as they scan the whole buffer anyway.
+ * The list is in order, and the first match on each line with any is
+ * found from a hash of line pointers, so a hunt only steps over the lines
+ * between dot and the match.
+ * Any change to the buffer drops the list. lchange() doesn't say which
+ * line is about to change (and that line may be replaced or split), so
+ * there is no finer way. The buffer's edit count is checked (follow-file
+ * and revert-file bump it too when they replace lines), and also its
+ * first and last lines, to notice narrowing.
+ * The cache is only used while bit 0x10 of $ggr_opts is set.
+ */
+struct match_cache {
+    char *pat;              /* What the list is for... */
+    int exact;
+    unsigned int edits;     /* ...and the state of the buffer */
+    struct line *first;
+    struct line *last;
+    int built;              /* Whether the list has been made */
+    struct ps_match *match; /* All of the matches, in order */
+    long nmatch;
+    long *line_first;       /* Hash of lines to their first match */
+    size_t hmask;
+};
+
+static size_t mc_hash(struct line *lp) {
+    return (size_t)(((uintptr_t)lp >> 4) * 2654435761u);
+}
+
+/* The index of the first match on lp, or -1 */
+static long mc_line_first(struct match_cache *mc, struct line *lp) {
+    for (size_t hi = mc_hash(lp) & mc->hmask; ; hi = (hi + 1) & mc->hmask) {
+        long mi = mc->line_first[hi];
+        if ((mi < 0) || (mc->match[mi].start.lp == lp)) return mi;
+    }
+}
+
+static void mc_drop(struct match_cache *mc) {
+    Xfree_setnull(mc->match);
+    Xfree_setnull(mc->line_first);
+    mc->nmatch = 0;
+    mc->built = FALSE;
+}
+
+static int mc_build(struct buffer *bp, struct match_cache *mc) {
+    mc->nmatch = par_scan(bp, lforw(bp->b_linep), 0, TRUE, &mc->match);
+    if (mc->nmatch < 0) {
+        mc->nmatch = 0;
+        return FALSE;
+    }
+    size_t hsize = 16;
+    while (hsize < 2*(size_t)mc->nmatch) hsize <<= 1;
+    mc->line_first = Xmalloc(hsize*sizeof(long));
+    for (size_t hi = 0; hi < hsize; hi++) mc->line_first[hi] = -1;
+    mc->hmask = hsize - 1;
+    for (long mi = 0; mi < mc->nmatch; mi++) {
+        struct line *lp = mc->match[mi].start.lp;
+        if (mi && (mc->match[mi-1].start.lp == lp)) continue;
+        size_t hi = mc_hash(lp) & mc->hmask;
+        while (mc->line_first[hi] >= 0) hi = (hi + 1) & mc->hmask;
+        mc->line_first[hi] = mi;
+    }
+    mc->built = TRUE;
+    return TRUE;
+}
+
+/* mc_get -- get the cache for the current pattern in bp, if it can have
+ *      one.
+ * Unless build is set, the list is only made if the previous call was
+ * for the same pattern and state of the buffer, so a loop that edits the
+ * buffer between its hunts doesn't make one each time.
+ */
+static struct match_cache *mc_get(struct buffer *bp, int build) {
+    if (!(ggr_opts&GGR_HUNTCACHE) || slow_scan || (srch_patlen == 0) ||
+         (bp->b_flag & BFMAPPED) || strchr(db_val(pat), '\n'))
+        return NULL;
+
+    int exact = curwp->w_bufp->b_mode & MDEXACT;
+    struct match_cache *mc = bp->b_mcache;
+    if (!mc) {
+        mc = bp->b_mcache = Xmalloc(sizeof(struct match_cache));
+        *mc = (struct match_cache){ 0 };
+    }
+    if (mc->pat && !strcmp(mc->pat, db_val(pat)) && (mc->exact == exact) &&
+         (mc->edits == bp->b_edits) &&
+         (mc->first == lforw(bp->b_linep)) &&
+         (mc->last == lback(bp->b_linep))) {
+        if (mc->built) return mc;
+        build = TRUE;
+    }
+    else {
+        mc_drop(mc);
+        update_val(mc->pat, db_val(pat));
+        mc->exact = exact;
+        mc->edits = bp->b_edits;
+        mc->first = lforw(bp->b_linep);
+        mc->last = lback(bp->b_linep);
+    }
+    if (!build || !mc_build(bp, mc)) return NULL;
+    return mc;
+}
+
+/* mcache_free -- free any match cache for a buffer that is going.
+ */
+void mcache_free(struct buffer *bp) {
+    struct match_cache *mc = bp->b_mcache;
+    if (!mc) return;
+    mc_drop(mc);
+    Xfree(mc->pat);
+    Xfree_setnull(bp->b_mcache);
+}
+
+/* mc_hunt -- do what fast_scanner() does for scan_forw() and scan_back(),
+ *      from the cache.
+ * Forwards that is to find the first match starting at or after dot, and
+ * in reverse the last one ending at or before it.
+ * Returns -1 if there is no cache to use.
+ */
+static int mc_hunt(int direct) {
+    struct match_cache *mc = mc_get(curbp, FALSE);
+    if (!mc) return -1;
+
+    struct line *lp = curwp->w.dotp;
+    int off = curwp->w.doto;
+    long mi = (lp == curbp->b_linep)? -1: mc_line_first(mc, lp);
+    if (direct == FORWARD) {
+        if (lp == curbp->b_linep) return FALSE;
+        if (mi >= 0) {
+            while ((mi < mc->nmatch) && (mc->match[mi].start.lp == lp) &&
+                   (mc->match[mi].start.off < off)) mi++;
+        }
+        else {
+            do lp = lforw(lp);
+            while ((lp != curbp->b_linep) &&
+                   ((mi = mc_line_first(mc, lp)) < 0));
+            if (lp == curbp->b_linep) mi = mc->nmatch;
+        }
+        if (mi >= mc->nmatch) return FALSE;
+    }
+    else {
+        if (mi >= 0) {
+            while ((mi < mc->nmatch) && (mc->match[mi].start.lp == lp) &&
+                   (mc->match[mi].end.off <= off)) mi++;
+        }
+        else {
+            do lp = lback(lp);
+            while ((lp != curbp->b_linep) &&
+                   ((mi = mc_line_first(mc, lp)) < 0));
+            if (lp == curbp->b_linep) return FALSE;
+            while ((mi < mc->nmatch) && (mc->match[mi].start.lp == lp)) mi++;
+        }
+        if (--mi < 0) return FALSE;
+    }
+
+/* Leave things as fast_scanner() would */
+    struct ps_match *mp = mc->match + mi;
+    init_dyn_group_status();
+    if (direct == FORWARD) {
+        curwp->w.dotp = mp->end.lp;
+        curwp->w.doto = mp->end.off;
+    }
+    else {
+        curwp->w.dotp = mp->start.lp;
+        curwp->w.doto = mp->start.off;
+    }
+    curwp->w_flag |= WFMOVE;
+    match_grp_info[0].mline = mp->start.lp;
+    match_grp_info[0].start = mp->start.off;
+    match_grp_info[0].len = srch_patlen;
+    group_match_buffer = curwp->w_bufp;
+    return TRUE;
+}
+
+/* all_matches -- find the matches for the current pattern from
+ *      (lp, off) to the end of buffer bp, whichever scan it needs.
+ * A whole buffer search with a literal pattern takes the ones that don't
+ * overlap from the match cache.
+ */
+static long all_matches(struct buffer *bp, struct line *lp, int off,
+     struct ps_match **mlist) {
+    if (mlist) *mlist = NULL;
+    if (srch_patlen == 0) return 0;
+    if (slow_scan) return seq_scan(bp, lp, off, mlist);
+    struct match_cache *mc = NULL;
+    if ((lp == lforw(bp->b_linep)) && (off == 0)) mc = mc_get(bp, TRUE);
+    if (!mc) return par_scan(bp, lp, off, FALSE, mlist);
+
+    long total = 0;
+    struct ps_match *list = NULL;
+    if (mlist && mc->nmatch)
+        list = Xmalloc((size_t)mc->nmatch*sizeof(struct ps_match));
+    struct ps_pos after = { lp, 0, 0 };
+    for (long mi = 0; mi < mc->nmatch; mi++) {
+        struct ps_match *mp = mc->match + mi;
+        if (ps_cmp(&mp->start, &after) < 0) continue;
+        if (list) list[total] = *mp;
+        total++;
+        after = mp->end;
+    }
+    if (mlist) *mlist = list;
+    return total;
+}
+
+/* Get the pattern for count-matches and list-matches.
+ */
+static int whole_buffer_pattern(const char *prompt) {
+    if (curbp->b_flag & BFMAPPED) {
+        mlwrite_one("Not in a mapped file view");
+        return FALSE;
+    }
+    return readpattern(prompt, &pat, TRUE);
+}
+
+/* countmatches -- count the matches for a pattern in the buffer.
+ */
+int countmatches(int f, int n) {
+    UNUSED(f); UNUSED(n);
+    int status = whole_buffer_pattern("Count");
+    if (status != TRUE) return status;
+    long count = all_matches(curbp, lforw(curbp->b_linep), 0, NULL);
+    if (count < 0) return FALSE;
+    mlwrite("%D matches", (ue64I_t)count);
+    return TRUE;
+}
+
+/* show_list -- show a list buffer in a popup window (if it isn't already
+ *      on screen), from its start.
+ */
+static int show_list(struct buffer *bp) {
+    struct window *wp;
+    if (bp->b_nwnd == 0) {          /* Not on screen yet */
+        if ((wp = wpopup()) == NULL) return FALSE;
+        struct buffer *obp = wp->w_bufp;
+        if (--obp->b_nwnd == 0) obp->b = wp->w;
+        wp->w_bufp = bp;
+        ++bp->b_nwnd;
+    }
+    for (wp = wheadp; wp != NULL; wp = wp->w_wndp) {
+        if (wp->w_bufp == bp) {
+            wp->w_linep = lforw(bp->b_linep);
+            wp->w.dotp = lforw(bp->b_linep);
+            wp->w.doto = 0;
+            wp->w.markp = NULL;
+            wp->w.marko = 0;
+            wp->w_flag |= WFMODE | WFHARD;
+        }
+    }
+    return TRUE;
+}
+
+/* listmatches -- list the lines of the buffer with matches for a pattern
+ *      in //Matches, each with its line number.
+ */
+int listmatches(int f, int n) {
+    UNUSED(f); UNUSED(n);
+    int status = whole_buffer_pattern("List");
+    if (status != TRUE) return status;
+
+    struct buffer *bp = bfind("//Matches", TRUE, BFINVS);
+    if (bp == NULL) return FALSE;
+    bp->b_flag &= ~BFCHG;           /* Don't complain! */
+    if ((status = bclear(bp)) != TRUE) return status;
+
+    struct ps_match *list;
+    long count = all_matches(curbp, lforw(curbp->b_linep), 0, &list);
+    if (count < 0) return FALSE;
+    db_strdef(mline);
+    db_sprintf(mline, "%ld matches for \"%s\" in %s", count,
+         dbp_val(expandp(&pat)), curbp->b_bname);
+    addline_to_anyb(&mline, bp);
+    long prev_lno = -1;
+    for (long mi = 0; mi < count; mi++) {
+        struct ps_match *mp = list + mi;
+        if (mp->start.lno == prev_lno) continue;
+        prev_lno = mp->start.lno;
+        db_sprintf(mline, "%6ld: ", mp->start.lno + 1);
+        db_appendn(mline, ltext(mp->start.lp), lused(mp->start.lp));
+        addline_to_anyb(&mline, bp);
+    }
+    db_free(mline);
+    Xfree(list);
+    return show_list(bp);
+}
+
+/* grep-files searches files for a pattern, putting each line with a match
+ * into //Grep as file:line:text. goto-grep-match visits the one on the
+ * current line.
+ * The files are those named plus everything below any directory named
+ * (skipping hidden ones), in the order given, with each directory's
+ * entries sorted.
+ * A file already in a buffer is searched there, as it may have been
+ * changed. For a literal pattern the others are mapped and searched by
+ * a pool of threads, while the main one adds their results in order,
+ * redisplaying //Grep as it fills. A Magic (or folded non-ASCII)
+ * pattern needs the usual scanners, which only run in the main thread,
+ * so each file is made into lines in a scratch buffer and scanned there.
+ */
+#define GF_BINCHECK     4096    /* A NUL in this much means a binary file */
+#define GF_REDISPLAY    200     /* ms between redisplays as //Grep fills */
+
+enum gf_state { GF_PENDING, GF_RUNNING, GF_DONE };
+struct gf_hit {
+    long lno;               /* Line number (from 1) */
+    size_t off;             /* Where the line starts */
+    size_t len;
+};
+struct gf_job {
+    char *fname;
+    struct buffer *bp;      /* A buffer already holding the file */
+    enum gf_state state;
+    const char *map;        /* The file, mapped until its hits are added */
+    size_t size;
+    struct gf_hit *hit;
+    int nhit;
+    int alloc;
+    int nomem;              /* The hits couldn't all be kept */
+};
+static struct {
+    const char *pat;
+    size_t plen;
+    unsigned char fold[256];
+    size_t skip[256];
+    struct gf_job *job;
+    int njob;
+    int alloc;
+    int next_job;           /* The next one for a worker to look at */
+    pthread_mutex_t lock;
+    pthread_cond_t done;
+} gf = { .lock = PTHREAD_MUTEX_INITIALIZER,
+         .done = PTHREAD_COND_INITIALIZER };
+
+static void gf_addjob(const char *fname) {
+    if (gf.njob >= gf.alloc) {
+        gf.alloc = gf.alloc? 2*gf.alloc: 64;
+        gf.job = Xreallocarray(gf.job, gf.alloc, sizeof(struct gf_job));
+    }
+    gf.job[gf.njob++] = (struct gf_job)
+         { Xstrdup(fname), NULL, GF_PENDING, NULL, 0, NULL, 0, 0, 0 };
+}
+
+static int gf_namecmp(const void *a, const void *b) {
+    return strcmp(*(char * const *)a, *(char * const *)b);
+}
+
+/* gf_walk -- add a file, or the files below a directory, to the jobs.
+ * Symbolic links to directories are only followed if named.
+ */
+static void gf_walk(const char *path, int named) {
+    struct stat st;
+    if (!named && (lstat(path, &st) == 0) && S_ISLNK(st.st_mode) &&
+         (stat(path, &st) == 0) && S_ISDIR(st.st_mode)) return;
+    if (stat(path, &st) != 0) return;
+    if (S_ISREG(st.st_mode)) {
+        gf_addjob(path);
+        return;
+    }
+    if (!S_ISDIR(st.st_mode)) return;
+
+    DIR *dirp = opendir(path);
+    if (!dirp) return;
+    char **name = NULL;
+    int nname = 0, alloc = 0;
+    struct dirent *dp;
+    while ((dp = readdir(dirp)) != NULL) {
+        if (dp->d_name[0] == '.') continue;
+        if (nname >= alloc) {
+            alloc = alloc? 2*alloc: 32;
+            name = Xreallocarray(name, alloc, sizeof(char *));
+        }
+        name[nname++] = Xstrdup(dp->d_name);
+    }
+    closedir(dirp);
+    qsort(name, (size_t)nname, sizeof(char *), gf_namecmp);
+
+    db_strdef(child);
+    for (int ni = 0; ni < nname; ni++) {
+        if (strcmp(path, ".")) {
+            db_set(child, path);
+            if (path[strlen(path) - 1] != '/') db_append(child, "/");
+            db_append(child, name[ni]);
+        }
+        else db_set(child, name[ni]);
+        gf_walk(db_val(child), FALSE);
+        Xfree(name[ni]);
+    }
+    db_free(child);
+    Xfree(name);
+}
+
+/* gf_map -- map a job's file. Fails for an empty or binary file.
+ */
+static int gf_map(struct gf_job *jp) {
+    int fd = open(jp->fname, O_RDONLY);
+    if (fd < 0) return FALSE;
+    struct stat st;
+    void *map = MAP_FAILED;
+    if ((fstat(fd, &st) == 0) && S_ISREG(st.st_mode) && (st.st_size > 0))
+        map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) return FALSE;
+    jp->map = map;
+    jp->size = (size_t)st.st_size;
+    return !memchr(jp->map, 0, (jp->size < GF_BINCHECK)? jp->size:
+                                                         GF_BINCHECK);
+}
+
+static void gf_unmap(struct gf_job *jp) {
+    if (jp->map) munmap((void *)jp->map, jp->size);
+    jp->map = NULL;
+}
+
+/* Compare text with the pattern, and check that a match doesn't end
+ * before a combining character, as ps_eq() and ps_combi() do.
+ */
+static int gf_eq(const char *tp, size_t len) {
+    for (size_t pi = 0; pi < len; pi++)
+        if (gf.fold[(unsigned char)tp[pi]] !=
+            gf.fold[(unsigned char)gf.pat[pi]]) return FALSE;
+    return TRUE;
+}
+static int gf_combi(const char *text, size_t size, size_t off) {
+    if ((off >= size) || (text[off] == '\n')) return FALSE;
+    unicode_t uc;
+    size_t len = size - off;
+    (void)utf8_to_unicode(text + off, 0, (len > 8)? 8: (int)len, &uc);
+    return combining_type(uc);
+}
+
+/* gf_scan -- find the lines with a match for a literal pattern in a
+ *      mapped file. Newlines in the pattern are just bytes to match.
+ * Run by the workers, so it must only use the job and gf's tables.
+ * The hits are grown without Xreallocarray() (which exits on failure,
+ * and that's not for a worker to do), so running out just ends the scan,
+ * for the main thread to report.
+ */
+static void gf_scan(struct gf_job *jp) {
+    if (!gf_map(jp)) return;
+    const char *text = jp->map;
+    size_t size = jp->size;
+    size_t plen = gf.plen;
+    unsigned char last = gf.fold[(unsigned char)gf.pat[plen - 1]];
+    long lno = 1;
+    size_t lstart = 0;          /* Start of line lno */
+    size_t counted = 0;         /* Lines counted up to here */
+
+    for (size_t ti = 0; ti + plen <= size; ) {
+        unsigned char c = gf.fold[(unsigned char)text[ti + plen - 1]];
+        if ((c != last) || !gf_eq(text + ti, plen - 1) ||
+             gf_combi(text, size, ti + plen)) {
+            ti += gf.skip[c];
+            continue;
+        }
+        const char *nl;
+        while ((nl = memchr(text + counted, '\n', ti - counted)) != NULL) {
+            lno++;
+            counted = lstart = (size_t)(nl - text) + 1;
+        }
+        counted = ti;
+        nl = memchr(text + ti, '\n', size - ti);
+        size_t lend = nl? (size_t)(nl - text): size;
+        if (jp->nhit >= jp->alloc) {
+            int alloc = jp->alloc? 2*jp->alloc: 16;
+            struct gf_hit *hit = reallocarray(jp->hit, (size_t)alloc,
+                 sizeof(struct gf_hit));
+            if (!hit) {
+                jp->nomem = TRUE;
+                return;
+            }
+            jp->hit = hit;
+            jp->alloc = alloc;
+        }
+        jp->hit[jp->nhit++] = (struct gf_hit){ lno, lstart, lend - lstart };
+
+/* Carry on from the end of the match or, if that is on this line, from
+ * the next one, as this one is already listed.
+ */
+        ti = (ti + plen > lend)? ti + plen: lend + 1;
+    }
+}
+
+static void *gf_worker(void *arg) {
+    UNUSED(arg);
+    while (1) {
+        pthread_mutex_lock(&gf.lock);
+        while ((gf.next_job < gf.njob) &&
+               (gf.job[gf.next_job].state != GF_PENDING)) gf.next_job++;
+        if (gf.next_job >= gf.njob) {
+            pthread_mutex_unlock(&gf.lock);
+            break;
+        }
+        struct gf_job *jp = gf.job + gf.next_job++;
+        jp->state = GF_RUNNING;
+        pthread_mutex_unlock(&gf.lock);
+
+        gf_scan(jp);
+
+        pthread_mutex_lock(&gf.lock);
+        jp->state = GF_DONE;
+        pthread_cond_broadcast(&gf.done);
+        pthread_mutex_unlock(&gf.lock);
+    }
+    return NULL;
+}
+
+/* gf_setup -- the case-folding and skip tables for the whole pattern.
+ */
+static void gf_setup(void) {
+    gf.pat = db_val(pat);
+    gf.plen = (size_t)srch_patlen;
+    int exact = curwp->w_bufp->b_mode & MDEXACT;
+    for (int c = 0; c < 256; c++)
+        gf.fold[c] = (!exact && isASClower(c))? (unsigned char)(c ^ DIFCASE):
+                                                (unsigned char)c;
+    for (int c = 0; c < 256; c++) gf.skip[c] = gf.plen;
+    for (size_t pi = 0; pi < gf.plen - 1; pi++)
+        gf.skip[gf.fold[(unsigned char)gf.pat[pi]]] = gf.plen - 1 - pi;
+}
+
+/* Add one result line to //Grep. Any CR of a DOS line ending is dropped.
+ */
+static void gf_addline(struct buffer *gbp, db *lbuf, const char *fname,
+     long lno, const char *text, size_t len) {
+    if (len && (text[len - 1] == '\r')) len--;
+    db_sprintf(*lbuf, "%s:%ld:", fname, lno);
+    db_appendn(*lbuf, text, (int)len);
+    addline_to_anyb(lbuf, gbp);
+}
+
+/* gf_lines -- search a buffer's lines (the file's own, or those made
+ *      in scratch from the mapped file) and add each one with a match.
+ * Returns -1 if the matches couldn't be found for lack of memory.
+ */
+static long gf_lines(struct buffer *bp, struct buffer *gbp, db *lbuf,
+     const char *fname) {
+    struct ps_match *list;
+    long count = all_matches(bp, lforw(bp->b_linep), 0, &list);
+    if (count < 0) return -1;
+    long nlines = 0, prev_lno = -1;
+    for (long mi = 0; mi < count; mi++) {
+        struct ps_match *mp = list + mi;
+        if (mp->start.lno == prev_lno) continue;
+        prev_lno = mp->start.lno;
+        gf_addline(gbp, lbuf, fname, mp->start.lno + 1,
+             ltext_chk(mp->start.lp), (size_t)lused(mp->start.lp));
+        nlines++;
+    }
+    Xfree(list);
+    return nlines;
+}
+
+/* gf_scratch -- make the lines of a mapped file in the scratch buffer.
+ */
+static void gf_scratch(struct gf_job *jp, struct buffer *sbp) {
+    bclear(sbp);
+    for (size_t from = 0; from < jp->size; ) {
+        const char *nl = memchr(jp->map + from, '\n', jp->size - from);
+        size_t to = nl? (size_t)(nl - jp->map): jp->size;
+        size_t len = to - from;
+        if (len && (jp->map[to - 1] == '\r')) len--;
+        struct line *lp = lalloc();
+        db_setn(ldb(lp), jp->map + from, (int)len);
+        lp->l_bp = lback(sbp->b_linep);
+        lp->l_fp = sbp->b_linep;
+        lback(sbp->b_linep)->l_fp = lp;
+        sbp->b_linep->l_bp = lp;
+        from = to + 1;
+    }
+}
+
+static long gf_msecs(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long)ts.tv_sec*1000 + ts.tv_nsec/1000000;
+}
+
+/* grepfiles -- search files and directories for a pattern.
+ */
+int grepfiles(int f, int n) {
+    UNUSED(f); UNUSED(n);
+    if (restflag) return resterr();
+    int status = readpattern("Grep", &pat, TRUE);
+    if (status != TRUE) return status;
+    if (srch_patlen == 0) return FALSE;
+
+    db_strdef(where);
+    status = mlreply("Grep in: ", &where, CMPLT_FILE);
+    if (status == ABORT) {
+        db_free(where);
+        return status;
+    }
+    if (status == FALSE) db_set(where, ".");
+
+/* Gather the files, noting any already in a (fully read-in) buffer */
+    gf.njob = 0;
+    char *wlist = strdupa(db_val(where));
+    db_free(where);
+    char *sp;
+    for (char *word = strtok_r(wlist, " \t", &sp); word;
+          word = strtok_r(NULL, " \t", &sp)) {
+        glob_t gl;
+        if (*word == '~') word = strdupa(fixup_fname(word));
+        if (glob(word, GLOB_NOCHECK, NULL, &gl) != 0) continue;
+        for (size_t gi = 0; gi < gl.gl_pathc; gi++)
+            gf_walk(gl.gl_pathv[gi], TRUE);
+        globfree(&gl);
+    }
+    for (int ji = 0; ji < gf.njob; ji++) {
+        struct gf_job *jp = gf.job + ji;
+        const char *rpname = get_fullpath(fixup_fname(jp->fname));
+        for (struct buffer *bp = bheadp; bp != NULL; bp = bp->b_bufp) {
+            if ((bp->b_flag & (BFINVS | BFMAPPED)) || !bp->b_active)
+                continue;
+            if (strcmp(bp->b_rpname, rpname) == 0) {
+                jp->bp = bp;
+                jp->state = GF_RUNNING;     /* Not for the workers */
+                break;
+            }
+        }
+    }
+
+    struct buffer *gbp = bfind("//Grep", TRUE, BFINVS);
+    if (gbp == NULL) return FALSE;
+    gbp->b_flag &= ~BFCHG;          /* Don't complain! */
+    if ((status = bclear(gbp)) != TRUE) return status;
+    struct buffer *sbp = NULL;
+    if (slow_scan && ((sbp = bfind("//grep-file", TRUE, BFINVS)) == NULL))
+        return FALSE;
+    if ((status = show_list(gbp)) != TRUE) return status;
+
+/* Start the workers for a literal pattern. They leave all signals to
+ * the main thread.
+ */
+    pthread_t worker[PS_THREADS];
+    int started = 0;
+    gf.next_job = 0;
+    if (!slow_scan) {
+        gf_setup();
+        long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+        int want = (ncpu > 1)? (int)ncpu - 1: 0;
+        if (want > PS_THREADS) want = PS_THREADS;
+        if (want > gf.njob - 1) want = gf.njob - 1;
+        sigset_t all, orig;
+        sigfillset(&all);
+        pthread_sigmask(SIG_SETMASK, &all, &orig);
+        while (started < want) {
+            if (pthread_create(&worker[started], NULL, gf_worker, NULL))
+                break;
+            started++;
+        }
+        pthread_sigmask(SIG_SETMASK, &orig, NULL);
+    }
+
+/* Add the results in order, doing any job no worker has taken yet */
+    db_strdef(lbuf);
+    long nlines = 0;
+    int nfiles = 0;
+    int nomem = 0;
+    long shown = gf_msecs();
+    for (int ji = 0; ji < gf.njob; ji++) {
+        struct gf_job *jp = gf.job + ji;
+        long added = 0;
+        if (jp->bp) added = gf_lines(jp->bp, gbp, &lbuf, jp->fname);
+        else if (slow_scan) {
+            if (gf_map(jp)) {
+                gf_scratch(jp, sbp);
+                added = gf_lines(sbp, gbp, &lbuf, jp->fname);
+            }
+        }
+        else {
+            pthread_mutex_lock(&gf.lock);
+            int mine = (jp->state == GF_PENDING);
+            if (mine) jp->state = GF_RUNNING;
+            else while (jp->state != GF_DONE)
+                pthread_cond_wait(&gf.done, &gf.lock);
+            pthread_mutex_unlock(&gf.lock);
+            if (mine) gf_scan(jp);
+            for (int hi = 0; hi < jp->nhit; hi++) {
+                struct gf_hit *hp = jp->hit + hi;
+                gf_addline(gbp, &lbuf, jp->fname, hp->lno,
+                     jp->map + hp->off, hp->len);
+            }
+            added = jp->nhit;
+            if (jp->nomem) nomem++;
+            Xfree(jp->hit);
+        }
+        if (added < 0) {
+            nomem++;
+            added = 0;
+        }
+        gf_unmap(jp);
+        Xfree(jp->fname);
+        if (added) {
+            nlines += added;
+            nfiles++;
+            if (gf_msecs() - shown >= GF_REDISPLAY) {
+                show_list(gbp);
+                if (!typahead()) update(FALSE);
+                shown = gf_msecs();
+            }
+        }
+    }
+    for (int ti = 0; ti < started; ti++) pthread_join(worker[ti], NULL);
+    db_free(lbuf);
+    Xfree_setnull(gf.job);
+    gf.alloc = 0;
+    if (sbp) {
+        bclear(sbp);
+        zotbuf(sbp);
+    }
+
+    show_list(gbp);
+    if (nomem) {
+        mlwrite("Out of memory: matches missing from %d file%s", nomem,
+             (nomem == 1)? "": "s");
+        return FALSE;
+    }
+    mlwrite("%D matching line%s in %d file%s", (ue64I_t)nlines,
+         (nlines == 1)? "": "s", nfiles, (nfiles == 1)? "": "s");
+    return TRUE;
+}
+
+/* gotogrepmatch -- visit the file and line of the //Grep entry on the
+ *      current line. The file name ends at the first :<digits>:.
+ * If there is another window it is used, leaving //Grep in view.
+ */
+int gotogrepmatch(int f, int n) {
+    UNUSED(f); UNUSED(n);
+    const char *text = ltext_chk(curwp->w.dotp);
+    int len = lused(curwp->w.dotp);
+    int ci, ni = 0;
+    for (ci = 0; ci < len; ci++) {
+        if (text[ci] != ':') continue;
+        for (ni = ci + 1; (ni < len) && isdigit((unsigned char)text[ni]);
+             ni++);
+        if ((ni > ci + 1) && (ni < len) && (text[ni] == ':')) break;
+    }
+    if (ci == 0 || ci >= len) {
+        mlwrite_one("Not a grep match line");
+        return FALSE;
+    }
+    char *fname = strndupa(text, (size_t)ci);
+    int lno = atoi(text + ci + 1);
+
+    if ((curbp->b_flag & BFINVS) && (wheadp->w_wndp != NULL))
+        nextwind(FALSE, 1);
+    int status = getfile(fname, TRUE, FALSE);
+    if (status != TRUE) return status;
+    return gotoline(TRUE, lno);
+}
+
+/* Replacing without a query is done a line at a time.
+ * The matches within a line are collected, building its new text as
+ * they are found, and the line is only changed (once) when the search
+ * moves on from it. Dot, marks and pins on it end up where doing each
+ * replacement in turn with delins() would have left them.
+ * Group, counter and function replacements are made by getrepl() as
+ * each match is found, so are batched too. Only patterns with a ^ or $
+ * anchor can't be: the search carries on in the old text, where the
+ * line's start and end aren't where the replacements will put them.
+ */
+struct batch_match {
+    int off;                /* Start of match in the old text */
+    int mlen;               /* Length of the match */
+    int rlen;               /* Length of its replacement */
+};
+static struct {
+    struct line *lp;        /* Line with pending replacements, or NULL */
+    int done;               /* Its old text is in text up to here */
+    db_dcl(text);           /* Its new text */
+    struct batch_match *match;
+    int nmatch;
+    int alloc;
+} batch = { NULL, 0, db_str_initval, NULL, 0, 0 };
+
+/* Whether the compiled Magic pattern has a ^ or $ in it (anywhere, as
+ * there may be one in each alternative of a group).
+ */
+static int pat_anchored(void) {
+    if (!slow_scan) return FALSE;
+    for (struct magic *mcptr = mcpat; ; mcptr++) {
+        switch(mcptr->mc.type) {
+        case BOL:
+        case EOL:
+            return TRUE;
+        case EGRP:
+            if (mcptr->mc.group_num == 0) return FALSE;
+        }
+    }
+}
+
+/* Where an offset on the line goes to.
+ * Each replacement is an ldelete() then an insert at the match start,
+ * which leaves a dot there after the insert, but a mark or pin before.
+ */
+static int batch_newoff(int off, int is_dot) {
+    int shift = 0;
+    for (int mi = 0; mi < batch.nmatch; mi++) {
+        struct batch_match *bm = batch.match + mi;
+        int mo = bm->off + shift;
+        if (off > mo) {
+            off -= bm->mlen;
+            if (off < mo) off = mo;
+        }
+        if ((off > mo) || (is_dot && (off == mo))) off += bm->rlen;
+        shift += bm->rlen - bm->mlen;
+    }
+    return off;
+}
+
+/* Put the new text into the pending line */
+static void batch_flush(void) {
+    struct line *lp = batch.lp;
+    if (!lp) return;
+
+    db_appendn(batch.text, ltext(lp) + batch.done, lused(lp) - batch.done);
+    for (struct window *wp = wheadp; wp != NULL; wp = wp->w_wndp) {
+        if (wp->w.dotp == lp) wp->w.doto = batch_newoff(wp->w.doto, TRUE);
+        if (wp->w.markp == lp)
+            wp->w.marko = batch_newoff(wp->w.marko, FALSE);
+    }
+    if (sysmark.p == lp) sysmark.o = batch_newoff(sysmark.o, FALSE);
+    for (linked_items *mp = macro_pin_headp; mp; mp = mp->next) {
+        if (mmi(mp, lp) == lp)
+            mmi(mp, offset) = batch_newoff(mmi(mp, offset), FALSE);
+    }
+    db_setn(ldb(lp), db_val(batch.text), db_len(batch.text));
+    jnl_line(lp);
+    lchange(WFHARD);
+
+    batch.lp = NULL;
+    batch.nmatch = 0;
+    db_clear(batch.text);
+}
+
+/* Add the match at dot to the batch, and move dot to its end.
+ * The match must be within the line, and repstr must have no newline.
+ */
+static void batch_add(const char *repstr) {
+    struct line *lp = curwp->w.dotp;
+    int off = curwp->w.doto;
+    int mlen = match_grp_info[0].len;
+    int rlen = istrlen(repstr);
+
+    if (lp != batch.lp) {
+        batch_flush();
+        batch.lp = lp;
+        batch.done = 0;
+    }
+    db_appendn(batch.text, ltext(lp) + batch.done, off - batch.done);
+    db_appendn(batch.text, repstr, rlen);
+    batch.done = off + mlen;
+    if (batch.nmatch >= batch.alloc) {
+        batch.alloc = batch.alloc? 2*batch.alloc: 32;
+        batch.match = Xrealloc(batch.match,
+             (size_t)batch.alloc*sizeof(struct batch_match));
+    }
+    batch.match[batch.nmatch++] = (struct batch_match){ off, mlen, rlen };
+    curwp->w.doto = off + mlen;
+}
+
 /* replaces -- Search for a string and replace it with another
  *      string.  Query might be enabled (according to query).
  *
@@ -3605,6 +5478,8 @@ static int replaces(int query, int f, int n) {
     struct line *origline;  /* original "." position */
     int origoff;            /* and offset (for . query option) */
     int undone = 0;         /* Set if we undo a replace */
+    struct ps_match *mlist = NULL;  /* All the matches to replace... */
+    long mcount = 0, mnext = 0;     /* ...once no longer querying */
 
     int status = TRUE;      /* Default assumption */
 
@@ -3658,10 +5533,39 @@ static int replaces(int query, int f, int n) {
 
         const char *match_p, *repl_p;
 
+/* Once not querying, a literal pattern's matches (within lines, with
+ * a fixed replacement) can all be found at once. Lines only change when
+ * the replacements in one are all known, so they stay as they were found.
+ */
+        if (!query && !mlist && !slow_scan && !rmagical &&
+             !strchr(db_val(pat), '\n') && !strchr(db_val(rpat), '\n') &&
+             (curwp->w.dotp != curbp->b_linep)) {
+            mcount = par_scan(curbp, curwp->w.dotp, curwp->w.doto, FALSE,
+                 &mlist);
+            mnext = 0;
+            if (mcount < 0) {   /* Out of memory - reported */
+                status = FALSE;
+                goto end_replaces;
+            }
+            if (!mlist) break;  /* No matches */
+        }
+
 /* Search for the pattern. The true length of the matched string ends up
  * in match_grp_info[0].len
  */
-        if (slow_scan) {    /* All done? */
+        if (mlist) {
+            if (mnext >= mcount) break;
+            struct ps_match *mp = mlist + mnext++;
+            init_dyn_group_status();
+            curwp->w.dotp = mp->start.lp;
+            curwp->w.doto = mp->start.off;
+            curwp->w_flag |= WFMOVE;
+            match_grp_info[0].mline = mp->start.lp;
+            match_grp_info[0].start = mp->start.off;
+            match_grp_info[0].len = srch_patlen;
+            group_match_buffer = curwp->w_bufp;
+        }
+        else if (slow_scan) {   /* All done? */
             if (!step_scanner(mcpat, FORWARD, PTBEG)) break;
         }
         else {              /* All done? */
@@ -3673,15 +5577,15 @@ static int replaces(int query, int f, int n) {
 
         nlrepl = (lforw(curwp->w.dotp) == curwp->w_bufp->b_linep);
 
-/* Set match_p and repl_p */
+/* Set repl_p (and match_p, if it will be shown) */
 
-        match_p = group_match(0);
         if (rmagical) repl_p = getrepl();
         else          repl_p = db_val(rpat);
 
 /* Check for query mode. */
 
         if (query) {     /* Get the query. */
+            match_p = group_match(0);
 pprompt:
 
 /* Build query replace question string dynamically.
@@ -3806,10 +5710,20 @@ qprompt:
             goto end_replaces;
         }
 
-/* Delete the sucker, and insert its replacement. */
-
-        status = delins(repl_p);
-        if (status != TRUE) goto end_replaces;
+/* Delete the sucker, and insert its replacement.
+ * Without a query, one within a line is added to the batch for it,
+ * unless the pattern is anchored (see struct batch_match).
+ */
+        if (!query && !pat_anchored() && (curwp->w.dotp != curbp->b_linep) &&
+             (curwp->w.doto + match_grp_info[0].len <=
+              lused(curwp->w.dotp)) && !strchr(repl_p, '\n')) {
+            batch_add(repl_p);
+        }
+        else {
+            batch_flush();
+            status = delins(repl_p);
+            if (status != TRUE) goto end_replaces;
+        }
 
         numsub++;       /* increment # of substitutions */
     }
@@ -3820,6 +5734,8 @@ qprompt:
 /* Invalidate the group matches when we leave */
 
 end_replaces:
+    batch_flush();
+    Xfree(mlist);
     init_dyn_group_status();
     if (using_incremental_debug) incremental_debug_cleanup();
     return TRUE;
@@ -3841,7 +5757,9 @@ int sreplace(int f, int n) {
  */
 int qreplace(int f, int n) {
     int saved_discmd = discmd;      /* Save this in case we change it. */
+    hold_lines++;                   /* It keeps origline etc. */
     int retval = replaces(TRUE, f, n);
+    hold_lines--;
     discmd = saved_discmd;          /* Restore original... */
     return retval;
 }
@@ -3853,20 +5771,32 @@ int qreplace(int f, int n) {
 void free_search(void) {
     Xfree(last_match.match);
     Xfree(last_match.replace);
-    for (int gi = 0; gi < max_grp; gi++) Xfree(grp_text[gi]);
     Xfree(cntl_grp_info);
     Xfree(match_grp_info);
     Xfree(grp_text);
+    Xfree(lm_match);
+    Xfree(lm_cntl);
     for (int ix = 0; ix < RING_SIZE; ix++) {
         db_free(srch_txt[ix]);
         db_free(repl_txt[ix]);
     }
     if (mc_alloc) mcclear();
     rmcclear();
+    arena_free(&match_arena);
+    arena_free(&rmc_arena);
     Xfree(mcpat);
     Xfree(rmcpat);
+    Xfree(fold_bmp);
+    Xfree(fpat.uc);
+    Xfree(fpat.ascii);
+    Xfree(fgph.key);
+    Xfree(fgph.off);
 
     db_free(repl);
+    db_free(fnc_buf);
+    db_free(fnc_result);
+    db_free(batch.text);
+    Xfree(batch.match);
     db_free(pat);
     db_free(tap);
     db_free(rpat);
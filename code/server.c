@@ -0,0 +1,471 @@
+/*      SERVER.C
+ *
+ *      Client/server editing.
+ *
+ *      "uemacs -z" runs as a normal editor which also listens on a
+ *      per-user Unix domain socket.
+ *      "uemacs -w [+n] [-v] files..." then, rather than starting another
+ *      editor, hands the files over to that one, which opens each of them
+ *      in a buffer (as find-file would, so with the usual file locking).
+ *      The client waits until all of its files have been finished with,
+ *      either by running server-done in the buffer or by deleting it.
+ *      If there is no server to talk to, "uemacs -w" just carries on as
+ *      a normal editor.
+ *
+ *      Requests are only looked at while the editor is waiting for the
+ *      first key of a command (in idle_wait(), which the server adds its
+ *      socket and clients to), so they never arrive in the middle of one.
+ *      As that wait is also waiting for the keyboard, a new connection
+ *      is non-blocking, and what it sends is collected over as many
+ *      waits as it takes, so a slow client never holds up the editor.
+ *
+ *      The protocol is lines of text. The client sends:
+ *          line <n>        line to go to in the first file (optional)
+ *          view <0|1>      View mode for the following files (optional)
+ *          file <path>     for each file (an absolute pathname)
+ *          end
+ *      and the server replies "done" once it has finished with all of
+ *      the files, then closes the connection.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#define SERVER_C
+
+#include "estruct.h"
+#include "edef.h"
+#include "efunc.h"
+
+static int listen_fd = -1;
+static char *sock_name = NULL;
+
+/* Connections whose request hasn't all arrived yet */
+#define MAX_REQUEST 65536       /* Anything longer isn't a real client */
+static struct srv_conn {
+    int fd;
+    db req;
+} *conns = NULL;
+static int nconns = 0;
+
+/* The buffers being edited for clients, and the connection to report
+ * back on for each. A client is finished with once it has none left.
+ */
+static struct srv_buf {
+    struct buffer *bp;
+    char *fname;            /* As given - for lock release */
+    int fd;
+} *sbufs = NULL;
+static int nsbufs = 0;
+
+/* Where the socket lives.
+ * In $XDG_RUNTIME_DIR if that is set, otherwise in a private directory
+ * in /tmp, which must be ours and not accessible by anyone else.
+ */
+static const char *sock_path(void) {
+    static char path[sizeof(((struct sockaddr_un *)0)->sun_path)];
+    const char *rtd = getenv("XDG_RUNTIME_DIR");
+    int plen;
+
+    if (rtd && *rtd) {
+        plen = snprintf(path, sizeof(path), "%s/uemacs-server", rtd);
+    }
+    else {
+        char dir[64];
+        struct stat st;
+        snprintf(dir, sizeof(dir), "/tmp/uemacs-%d", (int)getuid());
+        (void)mkdir(dir, 0700);
+        if ((lstat(dir, &st) != 0) || !S_ISDIR(st.st_mode) ||
+             (st.st_uid != getuid()) || (st.st_mode & 077))
+            return NULL;
+        plen = snprintf(path, sizeof(path), "%s/server", dir);
+    }
+    if ((plen < 0) || (plen >= (int)sizeof(path))) return NULL;
+    return path;
+}
+
+/* Connect to the server socket. Returns the fd, or -1 */
+static int sock_connect(const char *path) {
+    struct sockaddr_un sa;
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    memset(&sa, 0, sizeof(sa));
+    sa.sun_family = AF_UNIX;
+    strcpy(sa.sun_path, path);
+    if (connect(fd, (struct sockaddr *)&sa, sizeof(sa)) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/* Write all of a string to fd. */
+static int write_all(int fd, const char *str, size_t len) {
+    while (len > 0) {
+        ssize_t nw = write(fd, str, len);
+        if (nw < 0) {
+            if (errno == EINTR) continue;
+            return FALSE;
+        }
+        str += nw;
+        len -= (size_t)nw;
+    }
+    return TRUE;
+}
+
+/* ======================================================================
+ * The server side.
+ */
+
+static int srv_nfds(void);                      /* Forward declarations */
+static int srv_fill(struct pollfd *);
+static void srv_ready(struct pollfd *, int);
+
+/* Start listening.
+ * Fails if there is already a server answering on the socket. One that
+ * isn't answering is assumed to be left over from a crash.
+ */
+int server_start(void) {
+    if (listen_fd >= 0) return TRUE;
+
+    const char *path = sock_path();
+    if (!path) {
+        mlwrite_one("Cannot set up server socket directory");
+        return FALSE;
+    }
+    int fd = sock_connect(path);
+    if (fd >= 0) {
+        close(fd);
+        mlwrite_one("A uemacs server is already running");
+        return FALSE;
+    }
+    unlink(path);
+
+    struct sockaddr_un sa;
+    if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0) goto fail;
+    memset(&sa, 0, sizeof(sa));
+    sa.sun_family = AF_UNIX;
+    strcpy(sa.sun_path, path);
+    mode_t omask = umask(077);
+    int status = bind(fd, (struct sockaddr *)&sa, sizeof(sa));
+    umask(omask);
+    if ((status != 0) || (listen(fd, 8) != 0)) {
+        close(fd);
+        goto fail;
+    }
+    fcntl(fd, F_SETFD, FD_CLOEXEC);     /* Not for shell commands */
+    listen_fd = fd;
+    sock_name = Xstrdup(path);
+    idle_watch(srv_nfds, srv_fill, srv_ready);
+    return TRUE;
+
+fail:
+    mlwrite("Cannot start server: %s", strerror(errno));
+    return FALSE;
+}
+
+/* Is any other buffer being edited for this client? */
+static int client_has_bufs(int fd) {
+    for (int si = 0; si < nsbufs; si++)
+        if (sbufs[si].fd == fd) return TRUE;
+    return FALSE;
+}
+
+/* Drop an entry, replying to its client if that was its last one.
+ * A -ve fd is a client that has gone away.
+ * If the buffer is going too (unlock is set) so is the file's lock, as
+ * nothing else would release it until we exit.
+ */
+static void release_sbuf(int si, int unlock) {
+    int fd = sbufs[si].fd;
+    if (unlock && filock) lockrel_file(sbufs[si].fname);
+    Xfree(sbufs[si].fname);
+    sbufs[si] = sbufs[--nsbufs];
+    if ((fd >= 0) && !client_has_bufs(fd)) {
+        (void)write_all(fd, "done\n", 5);
+        close(fd);
+    }
+    return;
+}
+
+/* The buffer has been deleted (or finished with).
+ * Called by zotbuf().
+ */
+void server_buffer_gone(struct buffer *bp) {
+    for (int si = 0; si < nsbufs; ) {
+        if (sbufs[si].bp == bp) release_sbuf(si, TRUE);
+        else                    si++;
+    }
+    return;
+}
+
+/* The client has gone away (e.g. been interrupted).
+ * Its buffers are left as they are (so are still locked).
+ */
+static void drop_client(int fd) {
+    for (int si = 0; si < nsbufs; si++)
+        if (sbufs[si].fd == fd) sbufs[si].fd = -1;
+    for (int si = 0; si < nsbufs; ) {
+        if (sbufs[si].fd == -1) release_sbuf(si, FALSE);
+        else                    si++;
+    }
+    close(fd);
+    return;
+}
+
+/* Forget a connection that hasn't sent a whole request */
+static void drop_conn(int ci) {
+    close(conns[ci].fd);
+    db_free(conns[ci].req);
+    conns[ci] = conns[--nconns];
+    return;
+}
+
+/* Stop listening, and let any waiting clients go. */
+void server_stop(void) {
+    if (listen_fd < 0) return;
+    close(listen_fd);
+    listen_fd = -1;
+    while (nconns) drop_conn(0);
+    Xfree_setnull(conns);
+    unlink(sock_name);
+    Xfree_setnull(sock_name);
+    while (nsbufs) server_buffer_gone(sbufs[0].bp);
+    Xfree_setnull(sbufs);
+    return;
+}
+
+/* In a forked child (which doesn't exec, so FD_CLOEXEC is no help):
+ * let go of the socket and the clients, but leave the parent to tidy up.
+ */
+void server_fork_close(void) {
+    if (listen_fd >= 0) close(listen_fd);
+    listen_fd = -1;
+    for (int ci = 0; ci < nconns; ci++) close(conns[ci].fd);
+    nconns = 0;
+    for (int si = 0; si < nsbufs; si++)
+        if (sbufs[si].fd >= 0) close(sbufs[si].fd);
+    nsbufs = 0;
+    return;
+}
+
+/* Open the files for a client's request (which is freed). */
+static void handle_request(int fd, char *text) {
+    int gline = -1;
+    int view = FALSE;
+    int nfiles = 0;
+    struct buffer *firstbp = NULL;
+    char *lp = text;
+    char *nlp;
+    for (; (nlp = strchr(lp, '\n')); lp = nlp + 1) {
+        *nlp = '\0';
+        if (!strncmp(lp, "line ", 5)) gline = atoi(lp + 5);
+        else if (!strncmp(lp, "view ", 5)) view = atoi(lp + 5);
+        else if (!strncmp(lp, "file ", 5)) {
+            if (getfile(lp + 5, TRUE, FALSE) != TRUE) continue;
+            if (view) {
+                curbp->b_mode |= MDVIEW;
+                curwp->w_flag |= WFMODE;
+            }
+            if (!firstbp) firstbp = curbp;
+            sbufs = Xrealloc(sbufs, (size_t)(nsbufs+1)*sizeof(struct srv_buf));
+            sbufs[nsbufs].bp = curbp;
+            sbufs[nsbufs].fname = Xstrdup(lp + 5);
+            sbufs[nsbufs].fd = fd;
+            nsbufs++;
+            nfiles++;
+        }
+    }
+    Xfree(text);
+
+    if (nfiles == 0) {          /* Nothing to wait for */
+        (void)write_all(fd, "done\n", 5);
+        close(fd);
+        return;
+    }
+    if (firstbp != curbp) swbuffer(firstbp, 0);
+    if (gline >= 0) gotoline(TRUE, gline);
+    mlwrite("[Editing %d file%s for a client - server-done when finished]",
+         nfiles, (nfiles == 1)? "": "s");
+    return;
+}
+
+/* Take a new connection, to collect its request as it arrives.
+ * It's close-on-exec, so that shell commands (and background saves)
+ * don't hold it open.
+ */
+static void new_conn(void) {
+    int fd = accept(listen_fd, NULL, NULL);
+    if (fd < 0) return;
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    conns = Xrealloc(conns, (size_t)(nconns+1)*sizeof(struct srv_conn));
+    conns[nconns].fd = fd;
+    conns[nconns].req = (db)db_str_initval;
+    nconns++;
+    return;
+}
+
+/* Read whatever has arrived on a connection. Once it has sent the whole
+ * request, up to the "end" line, that is handled.
+ */
+static void conn_input(int ci) {
+    char buf[1024];
+    struct srv_conn *cp = conns + ci;
+    while (1) {
+        ssize_t nr = read(cp->fd, buf, sizeof(buf));
+        if (nr < 0) {
+            if (errno == EINTR) continue;
+            if ((errno == EAGAIN) || (errno == EWOULDBLOCK)) return;
+        }
+        if (nr <= 0) break;             /* Gone away (or an error) */
+        db_appendn(cp->req, buf, (int)nr);
+        int len = db_len(cp->req);
+        if (len > MAX_REQUEST) break;
+        if ((len >= 4) && !strcmp(db_val(cp->req) + len - 4, "end\n")) {
+            int fd = cp->fd;
+            char *text = Xstrdup(db_val(cp->req));
+            db_free(cp->req);
+            conns[ci] = conns[--nconns];
+            handle_request(fd, text);
+            return;
+        }
+    }
+    drop_conn(ci);
+    return;
+}
+
+/* The server's part of the idle wait (idle_wait(), in posix.c), which
+ * is registered when it starts.
+ * It watches the socket, each client still waiting (just once each, to
+ * see if they go away) and each connection still sending its request.
+ */
+static int srv_cn_pfd;          /* Where the connections start */
+
+static int srv_nfds(void) {
+    return (listen_fd < 0)? 0: 1 + nsbufs + nconns;
+}
+
+static int srv_fill(struct pollfd *pfds) {
+    int npfd = 0;
+    pfds[npfd++].fd = listen_fd;
+    for (int si = 0; si < nsbufs; si++) {
+        int pi;
+        if (sbufs[si].fd < 0) continue;
+        for (pi = 1; pi < npfd; pi++)
+            if (pfds[pi].fd == sbufs[si].fd) break;
+        if (pi == npfd) pfds[npfd++].fd = sbufs[si].fd;
+    }
+    srv_cn_pfd = npfd;
+    for (int ci = 0; ci < nconns; ci++) pfds[npfd++].fd = conns[ci].fd;
+    return npfd;
+}
+
+static void srv_ready(struct pollfd *pfds, int npfd) {
+    for (int pi = 1; pi < srv_cn_pfd; pi++)
+        if (pfds[pi].revents) drop_client(pfds[pi].fd);
+    for (int pi = srv_cn_pfd; pi < npfd; pi++) {
+        if (!pfds[pi].revents) continue;
+        for (int ci = 0; ci < nconns; ci++) {
+            if (conns[ci].fd != pfds[pi].fd) continue;
+            conn_input(ci);
+            break;
+        }
+    }
+    if (pfds[0].revents & POLLIN) new_conn();
+    return;
+}
+
+/* server-done
+ * Finish with the current buffer, which a client is waiting for.
+ * It is saved if it has been changed, the client is told, and then it
+ * is replaced by the next buffer being edited for a client (if any) and
+ * deleted.
+ */
+int server_done(int f, int n) {
+    UNUSED(f); UNUSED(n);
+    struct buffer *bp = curbp;
+    int si;
+
+    for (si = 0; si < nsbufs; si++)
+        if (sbufs[si].bp == bp) break;
+    if (si == nsbufs) {
+        mlwrite_one("This buffer is not being edited for a client");
+        return FALSE;
+    }
+    if ((bp->b_flag & BFCHG) && (filesave(FALSE, 1) != TRUE)) return FALSE;
+    server_buffer_gone(bp);
+
+    if (nsbufs) swbuffer(sbufs[0].bp, 0);
+    else        nextbuffer(FALSE, 1);
+    if (bp->b_nwnd == 0) zotbuf(bp);
+    return TRUE;
+}
+
+/* ======================================================================
+ * The client side.
+ * Returns -1 if there is no server (so the caller carries on as an
+ * editor itself), otherwise the exit status.
+ */
+int server_client(int argc, char **argv, int gline, int view) {
+    const char *path = sock_path();
+    if (!path) return -1;
+    int fd = sock_connect(path);
+    if (fd < 0) return -1;
+
+    db_strdef(req);
+    db_strdef(cwd);
+    if (gline >= 0) db_sprintf(req, "line %d\n", gline);
+    if (view) db_append(req, "view 1\n");
+
+    char *cwdp = getcwd(NULL, 0);
+    db_set(cwd, cwdp? cwdp: "");
+    free(cwdp);
+
+    while (argc-- > 0) {
+        const char *arg = *argv++;
+        if (!strcmp(arg, "-e") || !strcmp(arg, "-v")) {
+            db_append(req, (arg[1] == 'v')? "view 1\n": "view 0\n");
+            continue;
+        }
+        const char *fname = fixup_fname(arg);
+        db_append(req, "file ");
+        if (*fname != '/') {
+            db_append(req, db_val(cwd));
+            db_append(req, "/");
+        }
+        db_append(req, fname);
+        db_append(req, "\n");
+    }
+    db_append(req, "end\n");
+
+    int status = 1;
+    if (write_all(fd, db_val(req), (size_t)db_len(req))) {
+        char reply[16];
+        ssize_t nr;
+        int got = 0;
+        while ((got < (int)sizeof(reply) - 1) &&
+             ((nr = read(fd, reply + got, sizeof(reply) - 1 - (size_t)got))
+                 != 0)) {
+            if (nr < 0) {
+                if (errno == EINTR) continue;
+                break;
+            }
+            got += (int)nr;
+        }
+        reply[got] = '\0';
+        if (!strcmp(reply, "done\n")) status = 0;
+    }
+    close(fd);
+    db_free(req);
+    db_free(cwd);
+    return status;
+}
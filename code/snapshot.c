@@ -0,0 +1,626 @@
+/*      SNAPSHOT.C
+ *
+ *      Start-up snapshots.
+ *
+ *      Running the start-up file (and anything it executes) is most of
+ *      the cost of starting the editor. With -q<file> the state that
+ *      running it leaves behind is written to <file>, and on later
+ *      starts that state is read back from there instead of running
+ *      the start-up file again.
+ *
+ *      What is saved is:
+ *          the key bindings (and the meta/ctlx/repeat/abort prefixes)
+ *          procedure buffers and phonetic translation tables
+ *          user (%) variables and the persistent $ variables
+ *          the global modes and those of the initial buffer
+ *          the eos-chars, char-replace and rxargs settings
+ *
+ *      The snapshot also records every file that was executed while it
+ *      was being made, with its size, modification time and a hash of
+ *      its contents. If any of these has changed, or the uemacs binary
+ *      has, the snapshot is ignored, the start-up file is run as usual
+ *      and the snapshot is re-made.
+ *      So a start-up file whose results depend on anything other than
+ *      its own contents (the terminal type, the environment, ...) should
+ *      not be used with -q.
+ *
+ *      The format is private to the binary that wrote it (native byte
+ *      order and int sizes), which is why the binary is checked too.
+ */
+
+#include "estruct.h"
+
+#define SNAPSHOT_C
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "edef.h"
+#include "efunc.h"
+#include "line.h"
+#include "util.h"
+#include "version.h"
+
+#define SNAP_MAGIC "uemacs start-up snapshot 2\n"
+
+/* The $ variables that are carried across.
+ * These are the settable ones that a start-up file might sensibly set
+ * and which persist after it has finished. Those for the position in
+ * the current buffer/window and the screen size are not, and the
+ * (read-only) forced modes are carried across with the odds and ends.
+ */
+static const char *snap_evars[] = {
+    "$fillcol", "$asave", "$acount", "$tab", "$overlap", "$jump",
+    "$scroll", "$hjump", "$hscroll", "$yankmode", "$autoclean",
+    "$regionlist_text", "$regionlist_number", "$autodos",
+    "$showdir_tokskip", "$uproc_opts", "$equiv_type", "$srch_can_hunt",
+    "$showdir_opts", "$ggr_opts", "$vismac", "$filock", "$crypt_mode",
+    "$brkt_ms", "$path_pfx_map", "$replace", "$gmode", "$discmd",
+    "$disinp", "$debug", "$seed", "$highlight_all",
+};
+
+/* State while a snapshot is being made */
+
+static int recording = FALSE;
+static char *rec_rcarg = NULL;      /* -c/@ file given, or "" */
+static char *rec_rcname = NULL;     /* What startup() looked up, or "" */
+static struct rec_file {
+    char *name;
+    int64_t size;
+    int64_t mtime;
+    uint64_t hash;
+} *rec_files = NULL;
+static int rec_nfiles = 0;
+
+/* Hash (FNV-1a, 64-bit) of a file's contents. Returns FALSE if it
+ * can't be read.
+ */
+static int file_hash(const char *fname, uint64_t *hashp) {
+    FILE *fp = fopen(fname, "r");
+    if (!fp) return FALSE;
+    uint64_t h = 14695981039346656037ULL;
+    char buf[8192];
+    size_t nr;
+    while ((nr = fread(buf, 1, sizeof(buf), fp)) > 0) {
+        for (size_t i = 0; i < nr; i++) {
+            h ^= (unsigned char)buf[i];
+            h *= 1099511628211ULL;
+        }
+    }
+    int status = !ferror(fp);
+    fclose(fp);
+    *hashp = h;
+    return status;
+}
+
+/* How we were run (argv[0]), for finding the binary */
+static const char *exe_argv0 = NULL;
+void snap_argv0(const char *argv0) {
+    exe_argv0 = argv0;
+    return;
+}
+
+/* The modification time of the running binary, or 0 if unknown.
+ * Without /proc/self/exe it's found as the shell would have: argv[0]
+ * if that has a /, otherwise the first executable one along PATH.
+ * An unknown time means no snapshot is made or used, as we couldn't
+ * tell whether the binary has changed.
+ */
+static int64_t exe_mtime(void) {
+    struct stat st;
+    if (stat("/proc/self/exe", &st) == 0) return (int64_t)st.st_mtime;
+    if (!exe_argv0 || !*exe_argv0) return 0;
+    if (strchr(exe_argv0, '/'))
+        return (stat(exe_argv0, &st) == 0)? (int64_t)st.st_mtime: 0;
+
+    const char *path = getenv("PATH");
+    if (!path) return 0;
+    int64_t mtime = 0;
+    db_strdef(fspec);
+    while (1) {
+        const char *sep = strchr(path, PATHCHR);
+        int dlen = sep? (int)(sep - path): istrlen(path);
+        if (dlen) db_setn(fspec, path, dlen);
+        else      db_set(fspec, ".");       /* Empty means here */
+        db_addch(fspec, '/');
+        db_append(fspec, exe_argv0);
+        if ((stat(db_val(fspec), &st) == 0) && S_ISREG(st.st_mode) &&
+             (access(db_val(fspec), X_OK) == 0)) {
+            mtime = (int64_t)st.st_mtime;
+            break;
+        }
+        if (!sep) break;
+        path = sep + 1;
+    }
+    db_free(fspec);
+    return mtime;
+}
+
+/* What startup() would execute for this argument, or "" */
+static const char *rc_lookup(const char *rcarg) {
+    const char *fname = startup_fname(rcarg);
+    return fname? fname: "";
+}
+
+/* Start recording the files run by the start-up file. */
+void snap_start(const char *rcarg) {
+    if (!rcarg) rcarg = "";
+    rec_rcarg = Xstrdup(rcarg);
+    rec_rcname = Xstrdup(rc_lookup(rcarg));
+    recording = TRUE;
+    return;
+}
+
+/* Stop recording, without saving anything. */
+void snap_cancel(void) {
+    for (int fi = 0; fi < rec_nfiles; fi++) Xfree(rec_files[fi].name);
+    Xfree_setnull(rec_files);
+    rec_nfiles = 0;
+    Xfree_setnull(rec_rcarg);
+    Xfree_setnull(rec_rcname);
+    recording = FALSE;
+    return;
+}
+
+/* Called by dofile() for each file it has read in to execute. */
+void snap_note_file(const char *fname) {
+    if (!recording) return;
+    struct stat st;
+    uint64_t hash;
+    if ((stat(fname, &st) != 0) || !file_hash(fname, &hash)) {
+        snap_cancel();  /* Couldn't check it later, so no snapshot */
+        return;
+    }
+    rec_files = Xrealloc(rec_files, (size_t)(rec_nfiles+1)*sizeof(struct rec_file));
+    struct rec_file *rfp = rec_files + rec_nfiles++;
+    rfp->name = Xstrdup(fname);
+    rfp->size = (int64_t)st.st_size;
+    rfp->mtime = (int64_t)st.st_mtime;
+    rfp->hash = hash;
+    return;
+}
+
+/* ======================================================================
+ * Writing.
+ * Everything is written as a 64-bit int or as a length-prefixed string
+ * (which is also written with a trailing NUL, so that it can be used in
+ * place when read back).
+ */
+static void put_int(FILE *fp, int64_t val) {
+    fwrite(&val, sizeof(val), 1, fp);
+    return;
+}
+static void put_strn(FILE *fp, const char *str, int len) {
+    put_int(fp, len);
+    fwrite(str, 1, (size_t)len, fp);
+    fputc('\0', fp);
+    return;
+}
+#define put_str(fp, str) put_strn(fp, str, istrlen(str))
+
+static void put_opts(FILE *fp, struct func_opts *op) {
+    put_int(fp, op->skip_in_macro);
+    put_int(fp, op->not_mb);
+    put_int(fp, op->not_interactive);
+    put_int(fp, op->search_ok);
+    put_int(fp, op->one_pass);
+    put_int(fp, op->no_macbug);
+    return;
+}
+
+/* Write out the current state, if we have been recording since the
+ * start-up file was started. Recording stops either way.
+ */
+int snap_save(const char *sfile) {
+    if (!recording) return FALSE;
+
+    int status = FALSE;
+    db_strdef(tmpname);
+    int64_t mtime = exe_mtime();
+    if (!mtime) goto exit;
+    db_sprintf(tmpname, "%s.%d", sfile, (int)getpid());
+    FILE *fp = fopen(db_val(tmpname), "w");
+    if (!fp) goto exit;
+
+    fputs(SNAP_MAGIC, fp);
+    put_str(fp, VERSION);
+    put_int(fp, mtime);
+    put_str(fp, rec_rcarg);
+    put_str(fp, rec_rcname);
+
+    put_int(fp, rec_nfiles);
+    for (int fi = 0; fi < rec_nfiles; fi++) {
+        put_str(fp, rec_files[fi].name);
+        put_int(fp, rec_files[fi].size);
+        put_int(fp, rec_files[fi].mtime);
+        put_int(fp, (int64_t)rec_files[fi].hash);
+    }
+
+/* Procedure buffers and translation tables.
+ * The keyboard macro buffer exists before the start-up file runs, so
+ * it isn't one of its results.
+ */
+    int nbuf = 0;
+    struct buffer *bp;
+    for (bp = bheadp; bp; bp = bp->b_bufp)
+        if ((bp->b_type == BTPROC || bp->b_type == BTPHON) &&
+             bp != kbdmac_bp) nbuf++;
+    put_int(fp, nbuf);
+    for (bp = bheadp; bp; bp = bp->b_bufp) {
+        if (!(bp->b_type == BTPROC || bp->b_type == BTPHON) ||
+             bp == kbdmac_bp) continue;
+        put_str(fp, bp->b_bname);
+        put_int(fp, bp->b_type);
+        put_int(fp, bp->b_mode);
+        put_opts(fp, &bp->btp_opt);
+        int nlines = 0;
+        struct line *lp;
+        for (lp = lforw(bp->b_linep); lp != bp->b_linep; lp = lforw(lp))
+            nlines++;
+        put_int(fp, nlines);
+        for (lp = lforw(bp->b_linep); lp != bp->b_linep; lp = lforw(lp))
+            put_strn(fp, ltext_chk(lp), lused(lp));
+    }
+    put_str(fp, ptt? ptt->b_bname: "");
+
+/* Key bindings */
+    int nkeys = 0;
+    struct key_tab *ktp;
+    for (ktp = keytab; ktp->k_type != ENDL_KMAP; ktp++) nkeys++;
+    put_int(fp, nkeys);
+    for (ktp = keytab; ktp->k_type != ENDL_KMAP; ktp++) {
+        put_int(fp, ktp->k_type);
+        put_int(fp, ktp->k_code);
+        put_int(fp, ktp->bk_multiplier);
+        if (ktp->k_type == PROC_KMAP) put_str(fp, ktp->hndlr.pbp);
+        else                          put_str(fp, ktp->fi->n_name);
+    }
+    put_int(fp, metac);
+    put_int(fp, ctlxc);
+    put_int(fp, reptc);
+    put_int(fp, abortc);
+
+/* Variables */
+    db_strdef(vname);
+    db_strdef(vval);
+    const char *uvn;
+    int nvar = 0;
+    while (uvar_name(nvar)) nvar++;
+    put_int(fp, nvar);
+    for (int vi = 0; (uvn = uvar_name(vi)); vi++) {
+        db_sprintf(vname, "%%%s", uvn);
+        getval(&vname, &vval);
+        put_str(fp, db_val(vname));
+        put_strn(fp, db_val(vval), db_len(vval));
+    }
+    put_int(fp, ARRAY_SIZE(snap_evars));
+    for (size_t vi = 0; vi < ARRAY_SIZE(snap_evars); vi++) {
+        db_set(vname, snap_evars[vi]);
+        getval(&vname, &vval);
+        put_str(fp, snap_evars[vi]);
+        put_strn(fp, db_val(vval), db_len(vval));
+    }
+    db_free(vname);
+    db_free(vval);
+
+/* Odds and ends */
+    put_int(fp, curbp->b_mode);
+    const char *eos = eos_setting();
+    put_str(fp, eos? eos: "");
+    const unicode_t *remap;
+    put_int(fp, char_remap_get(&remap));
+    int npairs = 0;
+    if (remap) while (remap[2*npairs] != UEM_NOCHAR) npairs++;
+    put_int(fp, npairs);
+    for (int pi = 0; pi < 2*npairs; pi++) put_int(fp, remap[pi]);
+    put_int(fp, rxargs);
+    put_int(fp, force_mode_on);
+    put_int(fp, force_mode_off);
+
+    status = !ferror(fp);
+    if (fclose(fp) != 0) status = FALSE;
+    if (status) status = (rename(db_val(tmpname), sfile) == 0);
+    if (!status) unlink(db_val(tmpname));
+
+exit:
+    db_free(tmpname);
+    snap_cancel();
+    return status;
+}
+
+/* ======================================================================
+ * Reading.
+ * The whole file is read into memory and then gone through twice.
+ * The first pass only checks that it is complete, still valid and that
+ * everything it refers to exists, so that nothing is changed unless the
+ * whole snapshot can be used. The second pass applies it, and has
+ * nothing left that can fail, so never stops with only part of it used.
+ */
+struct snap_in {
+    const char *p;
+    const char *end;
+    int ok;
+};
+
+static int64_t get_i64(struct snap_in *in) {
+    int64_t val = 0;
+    if (in->end - in->p < (ptrdiff_t)sizeof(val)) {
+        in->ok = FALSE;
+        return 0;
+    }
+    memcpy(&val, in->p, sizeof(val));
+    in->p += sizeof(val);
+    return val;
+}
+#define get_int(in) ((int)get_i64(in))
+
+/* Returns a pointer to the (NUL-terminated) string in the data itself,
+ * or "" if the data is bad (when in->ok is cleared).
+ */
+static const char *get_strn(struct snap_in *in, int *lenp) {
+    int64_t len = get_i64(in);
+    if (!in->ok || (len < 0) || (in->end - in->p <= len) || in->p[len]) {
+        in->ok = FALSE;
+        if (lenp) *lenp = 0;
+        return "";
+    }
+    const char *str = in->p;
+    in->p += len + 1;
+    if (lenp) *lenp = (int)len;
+    return str;
+}
+#define get_str(in) get_strn(in, NULL)
+
+static void get_opts(struct snap_in *in, struct func_opts *op) {
+    memset(op, 0, sizeof(*op));
+    if (get_int(in)) op->skip_in_macro = 1;
+    if (get_int(in)) op->not_mb = 1;
+    if (get_int(in)) op->not_interactive = 1;
+    if (get_int(in)) op->search_ok = 1;
+    if (get_int(in)) op->one_pass = 1;
+    if (get_int(in)) op->no_macbug = 1;
+    return;
+}
+
+/* Is a recorded file still as it was? */
+static int file_unchanged(const char *fname, int64_t size, int64_t mtime,
+     uint64_t hash) {
+    struct stat st;
+    if (stat(fname, &st) != 0) return FALSE;
+    if ((int64_t)st.st_size != size) return FALSE;
+    if ((int64_t)st.st_mtime == mtime) return TRUE;
+    uint64_t now_hash;      /* Touched - but was it changed? */
+    return file_hash(fname, &now_hash) && (now_hash == hash);
+}
+
+/* Is this one of the $ variables a snapshot saves? */
+static int evar_saved(const char *vname) {
+    for (size_t vi = 0; vi < ARRAY_SIZE(snap_evars); vi++)
+        if (!strcmp(vname, snap_evars[vi])) return TRUE;
+    return FALSE;
+}
+
+/* Go through the snapshot, checking it or (if apply is set) using it.
+ * Every test that can fail is made only when checking, and returns
+ * FALSE. When applying, it has already passed them all.
+ */
+static int snap_pass(struct snap_in *in, const char *rcarg, int apply) {
+    int count;
+
+    const char *version = get_str(in);
+    int64_t snap_mtime = get_i64(in);
+    const char *snap_rcarg = get_str(in);
+    const char *snap_rcname = get_str(in);
+    if (!apply) {
+        if (strcmp(version, VERSION)) return FALSE;
+        int64_t mtime = exe_mtime();
+        if (!mtime || (snap_mtime != mtime)) return FALSE;
+        if (strcmp(snap_rcarg, rcarg)) return FALSE;
+        if (strcmp(snap_rcname, rc_lookup(rcarg))) return FALSE;
+    }
+
+    count = get_int(in);
+    for (int fi = 0; in->ok && fi < count; fi++) {
+        const char *fname = get_str(in);
+        int64_t size = get_i64(in);
+        int64_t mtime = get_i64(in);
+        uint64_t hash = (uint64_t)get_i64(in);
+        if (in->ok && !apply && !file_unchanged(fname, size, mtime, hash))
+            return FALSE;
+    }
+
+/* Procedure buffers and translation tables */
+    count = get_int(in);
+    for (int bi = 0; in->ok && bi < count; bi++) {
+        const char *bname = get_str(in);
+        int b_type = get_int(in);
+        int b_mode = get_int(in);
+        struct func_opts opts;
+        get_opts(in, &opts);
+        struct buffer *bp = bfind(bname, FALSE, 0);
+        if (!apply) {       /* The lines would be added to any text */
+            if (bp && (lforw(bp->b_linep) != bp->b_linep)) return FALSE;
+        }
+        else {
+            bp = bfind(bname, TRUE, BFINVS);
+            bp->b_type = b_type;
+            bp->b_mode = b_mode;
+            bp->btp_opt = opts;
+        }
+        int nlines = get_int(in);
+        db_strdef(lbuf);
+        for (int li = 0; in->ok && li < nlines; li++) {
+            int len;
+            const char *ltext = get_strn(in, &len);
+            if (!apply) continue;
+            db_setn(lbuf, ltext, len);
+            addline_to_anyb(&lbuf, bp);
+        }
+        db_free(lbuf);
+        if (apply) {
+            bp->b_flag &= ~BFCHG;
+            if (b_type == BTPHON) ptt_compile(bp);
+        }
+    }
+    const char *ptt_name = get_str(in);
+    if (apply) {
+        ptt = NULL;
+        if (*ptt_name) ptt = bfind(ptt_name, FALSE, 0);
+    }
+
+/* Key bindings.
+ * Only check that all the functions exist on the first pass.
+ */
+    count = get_int(in);
+    if (apply) {
+        struct key_tab *ktp;
+        for (ktp = keytab; ktp->k_type != ENDL_KMAP; ktp++)
+            if (ktp->k_type == PROC_KMAP) Xfree_setnull(ktp->hndlr.pbp);
+        while (keytab_alloc_ents < count + 2) extend_keytab(0);
+    }
+    for (int ki = 0; in->ok && ki < count; ki++) {
+        int k_type = get_int(in);
+        int k_code = get_int(in);
+        int mult = get_int(in);
+        const char *name = get_str(in);
+        struct name_bind *nbp = NULL;
+        if (k_type == FUNC_KMAP) nbp = name_info(name);
+        if (!apply) {
+            if ((k_type == FUNC_KMAP)? !nbp: (k_type != PROC_KMAP))
+                return FALSE;
+            continue;
+        }
+        struct key_tab *ktp = keytab + ki;
+        ktp->k_type = k_type;
+        ktp->k_code = k_code;
+        ktp->bk_multiplier = mult;
+        if (k_type == FUNC_KMAP) {
+            ktp->hndlr.k_fp = nbp->n_func;
+            ktp->fi = nbp;
+        }
+        else {
+            ktp->hndlr.pbp = Xstrdup(name);
+            ktp->fi = func_info(execproc);
+        }
+    }
+    if (apply) {
+        for (int ki = count; ki < keytab_alloc_ents - 1; ki++) {
+            keytab[ki].k_type = ENDL_KMAP;
+            keytab[ki].hndlr.pbp = NULL;
+        }
+        keytab[keytab_alloc_ents - 1].k_type = ENDS_KMAP;
+        reset_keylookup(count);
+    }
+    unicode_t prefix[4];
+    for (int pi = 0; pi < 4; pi++) prefix[pi] = get_int(in);
+    if (apply) {
+        metac = prefix[0];
+        ctlxc = prefix[1];
+        reptc = prefix[2];
+        abortc = prefix[3];
+    }
+
+/* Variables - user ones then $ ones */
+    db_strdef(vval);
+    db_strdef(vcur);
+    db_strdef(vtok);
+    for (int pass = 0; pass < 2; pass++) {
+        count = get_int(in);
+        for (int vi = 0; in->ok && vi < count; vi++) {
+            const char *vname = get_str(in);
+            int len;
+            const char *val = get_strn(in, &len);
+            if (!apply) {
+                if (in->ok && !((pass == 0)? (vname[0] == '%'):
+                     evar_saved(vname))) return FALSE;
+                continue;
+            }
+/* Only set $ variables that have changed, as setting some of them
+ * has side-effects.
+ */
+            if (pass == 1) {
+                db_set(vtok, vname);
+                getval(&vtok, &vcur);
+                if ((db_len(vcur) == len) &&
+                     !memcmp(db_val(vcur), val, (size_t)len))
+                    continue;
+            }
+            db_setn(vval, val, len);
+            set_var(vname, &vval);
+        }
+    }
+    db_free(vval);
+    db_free(vcur);
+    db_free(vtok);
+
+/* Odds and ends */
+    int b_mode = get_int(in);
+    int eos_len;
+    const char *eos = get_strn(in, &eos_len);
+    unicode_t repchar = get_int(in);
+    int npairs = get_int(in);
+    if (!in->ok || npairs < 0 || npairs > (in->end - in->p)) {
+        if (!apply) return FALSE;
+        npairs = 0;         /* Not reached - the check pass failed */
+    }
+    unicode_t *pairs = Xmalloc((size_t)(2*npairs + 1)*sizeof(unicode_t));
+    for (int pi = 0; pi < 2*npairs; pi++) pairs[pi] = get_int(in);
+    int rxa = get_int(in);
+    int fm_on = get_int(in);
+    int fm_off = get_int(in);
+    if (apply) {
+        curbp->b_mode = b_mode;
+        set_eos_list(eos, eos_len);
+        char_remap_set(repchar, pairs, npairs);
+        rxargs = rxa;
+        force_mode_on = fm_on;
+        force_mode_off = fm_off;
+    }
+    Xfree(pairs);
+
+    return apply || (in->ok && (in->p == in->end));
+}
+
+/* Load the snapshot, if it exists and is still valid for the given
+ * start-up file argument (NULL for the default).
+ * Returns TRUE if it was used.
+ */
+int snap_load(const char *sfile, const char *rcarg) {
+    if (!rcarg) rcarg = "";
+
+    FILE *fp = fopen(sfile, "r");
+    if (!fp) return FALSE;
+    struct stat st;
+    if (fstat(fileno(fp), &st) != 0 || st.st_size <= 0) {
+        fclose(fp);
+        return FALSE;
+    }
+    size_t dlen = (size_t)st.st_size;
+    char *data = Xmalloc(dlen);
+    int status = (fread(data, 1, dlen, fp) == dlen);
+    fclose(fp);
+
+    size_t mlen = strlen(SNAP_MAGIC);
+    if (status && (dlen < mlen ||
+         memcmp(data, SNAP_MAGIC, mlen))) status = FALSE;
+
+    struct snap_in in;
+    if (status) {
+        in.p = data + mlen;
+        in.end = data + dlen;
+        in.ok = TRUE;
+        status = snap_pass(&in, rcarg, FALSE);
+    }
+    if (status) {
+        in.p = data + mlen;
+        in.ok = TRUE;
+        status = snap_pass(&in, rcarg, TRUE);
+    }
+    Xfree(data);
+    return status;
+}
@@ -12,12 +12,16 @@
 #include <string.h>
 #include <errno.h>
 #include <limits.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/wait.h>
 
 #define SPAWN_C
 
 #include "estruct.h"
 #include "edef.h"
 #include "efunc.h"
+#include "line.h"
 
 /* If the screen size has changed whilst we were away on the command line
  * force a redraw to the new size.
@@ -183,6 +187,277 @@ int execprg(int f, int n) {
     return run_one_liner(RXARG(execprg), TRUE, "$");
 }
 
+/* ======================================================================
+ * Running a command through pipes.
+ * The command's output is read into a new list of lines, and (for a
+ * filter) the lines of a buffer are written to its input at the same
+ * time, from one poll() loop, so that neither side can block the other
+ * however much there is. Nothing goes via temporary files.
+ */
+#define PIPE_CHUNK 65536
+
+/* Append a line of text to the end of a line list */
+static void add_to_list(struct line *hp, const char *text, int len) {
+    struct line *lp = lalloc();
+    if (len > 0) db_setn(ldb(lp), text, len);
+    lp->l_fp = hp;
+    lp->l_bp = hp->l_bp;
+    hp->l_bp->l_fp = lp;
+    hp->l_bp = lp;
+    return;
+}
+
+/* Free a line list, including its header line */
+static void free_list(struct line *hp) {
+    while (lforw(hp) != hp) lfree(lforw(hp));
+    db_free(ldb(hp));
+    Xfree(hp);
+    return;
+}
+
+/* The state of the read side - the list being built and any partial
+ * line left at the end of the last read.
+ */
+struct pipe_in {
+    struct line *hp;
+    db_dcl(part);
+    int check_dos;
+    int dos;
+    int nlines;
+};
+
+/* Add a line read from the command, handling DOS line endings as
+ * file2buf() does for a file.
+ */
+static void pipe_line(struct pipe_in *pi, const char *text, int len) {
+    if ((pi->nlines == 0) && pi->check_dos && (len > 0) &&
+         (text[len-1] == '\r')) pi->dos = TRUE;
+    if (pi->dos && (len > 0) && (text[len-1] == '\r')) len--;
+    add_to_list(pi->hp, text, len);
+    pi->nlines++;
+    return;
+}
+
+/* Split what has been read into lines. */
+static void pipe_data(struct pipe_in *pi, const char *cp, size_t len) {
+    const char *ep = cp + len;
+    while (cp < ep) {
+        const char *nlp = memchr(cp, '\n', (size_t)(ep - cp));
+        if (!nlp) {
+            db_appendn(pi->part, cp, (int)(ep - cp));
+            break;
+        }
+        if (db_len(pi->part)) {
+            db_appendn(pi->part, cp, (int)(nlp - cp));
+            pipe_line(pi, db_val(pi->part), db_len(pi->part));
+            db_clear(pi->part);
+        }
+        else
+            pipe_line(pi, cp, (int)(nlp - cp));
+        cp = nlp + 1;
+    }
+    return;
+}
+
+/* Fill the output buffer from the lines of the buffer being filtered.
+ * Returns the number of bytes put in it (0 at the end of the buffer).
+ * *lpp and *offp say how far we have got.
+ */
+static size_t fill_from_buffer(struct buffer *bp, struct line **lpp,
+     int *offp, char *obuf) {
+    size_t olen = 0;
+    const char *eol = (bp->b_mode & MDDOSLE)? "\r\n": "\n";
+    int eol_len = (bp->b_mode & MDDOSLE)? 2: 1;
+
+    while ((*lpp != bp->b_linep) && (olen < PIPE_CHUNK - 2)) {
+        struct line *lp = *lpp;
+        int left = lused(lp) - *offp;
+        if (left > 0) {
+            size_t room = PIPE_CHUNK - 2 - olen;
+            size_t nb = ((size_t)left < room)? (size_t)left: room;
+            memcpy(obuf + olen, ltext(lp) + *offp, nb);
+            olen += nb;
+            *offp += (int)nb;
+            if (*offp < lused(lp)) break;   /* Full */
+        }
+        memcpy(obuf + olen, eol, (size_t)eol_len);
+        olen += (size_t)eol_len;
+        *lpp = lforw(lp);
+        *offp = 0;
+    }
+    return olen;
+}
+
+/* Run cmd via the shell, reading its stdout into the (empty) line
+ * list at hp. If bp is not NULL its lines are written to its stdin,
+ * otherwise it keeps ours.
+ * Returns TRUE if it all worked and the command exited with status 0.
+ * Sets rval to the wait status, as system() would have.
+ */
+static int pipe_through(const char *cmd, struct buffer *bp,
+     struct line *hp, int *dosp) {
+    int to_cmd[2] = { -1, -1 };
+    int from_cmd[2] = { -1, -1 };
+    int ok = FALSE;
+
+    if ((pipe(from_cmd) < 0) || (bp && (pipe(to_cmd) < 0))) {
+        mlwrite("Cannot create pipe: %s", strerror(errno));
+        goto close_pipes;
+    }
+    pid_t pid = fork();
+    if (pid < 0) {
+        mlwrite("Cannot fork: %s", strerror(errno));
+        goto close_pipes;
+    }
+    if (pid == 0) {             /* Child */
+        dup2(from_cmd[1], 1);
+        if (bp) dup2(to_cmd[0], 0);
+        for (int i = 0; i < 2; i++) {
+            close(from_cmd[i]);
+            if (to_cmd[i] >= 0) close(to_cmd[i]);
+        }
+        signal(SIGPIPE, SIG_DFL);
+        execl("/bin/sh", "sh", "-c", cmd, (char *)NULL);
+        _exit(127);
+    }
+    close(from_cmd[1]);
+    from_cmd[1] = -1;
+    if (bp) {
+        close(to_cmd[0]);
+        to_cmd[0] = -1;
+        fcntl(to_cmd[1], F_SETFL, fcntl(to_cmd[1], F_GETFL) | O_NONBLOCK);
+    }
+
+/* A command that stops reading its input early isn't an error, so we
+ * want EPIPE rather than being killed.
+ */
+    struct sigaction ign, old_pipe;
+    memset(&ign, 0, sizeof(ign));
+    ign.sa_handler = SIG_IGN;
+    sigaction(SIGPIPE, &ign, &old_pipe);
+
+    struct pipe_in pi = { hp, db_buf_initval, (dosp != NULL), FALSE, 0 };
+    char *buf = Xmalloc(PIPE_CHUNK);
+    char *obuf = bp? Xmalloc(PIPE_CHUNK): NULL;
+    size_t ostart = 0, oend = 0;
+    struct line *wlp = bp? lforw(bp->b_linep): NULL;
+    int woff = 0;
+    int io_err = 0;
+    int in_fd = from_cmd[0];
+    int out_fd = to_cmd[1];
+
+    while (in_fd >= 0) {
+        struct pollfd pfd[2];
+        int npfd = 1;
+        pfd[0].fd = in_fd;
+        pfd[0].events = POLLIN;
+        if (out_fd >= 0) {
+            if (ostart == oend) {
+                ostart = 0;
+                oend = fill_from_buffer(bp, &wlp, &woff, obuf);
+            }
+            if (ostart == oend) {       /* All sent */
+                close(out_fd);
+                out_fd = -1;
+            }
+            else {
+                pfd[1].fd = out_fd;
+                pfd[1].events = POLLOUT;
+                npfd = 2;
+            }
+        }
+        if (poll(pfd, (nfds_t)npfd, -1) < 0) {
+            if (errno == EINTR) continue;
+            io_err = errno;
+            break;
+        }
+        if ((npfd == 2) && pfd[1].revents) {
+            ssize_t nw = write(out_fd, obuf + ostart, oend - ostart);
+            if (nw > 0) ostart += (size_t)nw;
+            else if ((nw < 0) && (errno == EPIPE)) {
+                close(out_fd);  /* It has stopped reading */
+                out_fd = -1;
+            }
+            else if ((nw < 0) && (errno != EAGAIN) && (errno != EINTR)) {
+                io_err = errno;
+                break;
+            }
+        }
+        if (pfd[0].revents) {
+            ssize_t nr = read(in_fd, buf, PIPE_CHUNK);
+            if (nr > 0) pipe_data(&pi, buf, (size_t)nr);
+            else if (nr == 0) {
+                close(in_fd);
+                in_fd = -1;
+            }
+            else if ((errno != EAGAIN) && (errno != EINTR)) {
+                io_err = errno;
+                break;
+            }
+        }
+    }
+    if (db_len(pi.part)) pipe_line(&pi, db_val(pi.part), db_len(pi.part));
+    if (in_fd >= 0) close(in_fd);
+    if (out_fd >= 0) close(out_fd);
+    from_cmd[0] = to_cmd[1] = -1;   /* Closed now */
+    db_free(pi.part);
+    Xfree(buf);
+    Xfree(obuf);
+
+    while ((waitpid(pid, &rval, 0) < 0) && (errno == EINTR));
+    sigaction(SIGPIPE, &old_pipe, NULL);
+
+    if (io_err)
+        mlwrite("Pipe I/O error: %s", strerror(io_err));
+    else
+        ok = WIFEXITED(rval) && (WEXITSTATUS(rval) == 0);
+    if (dosp) *dosp = pi.dos;
+
+close_pipes:
+    for (int i = 0; i < 2; i++) {
+        if (from_cmd[i] >= 0) close(from_cmd[i]);
+        if (to_cmd[i] >= 0) close(to_cmd[i]);
+    }
+    return ok;
+}
+
+/* Replace the text of the current buffer (or its narrowed part) with
+ * the line list at hp, which is then freed. Dot goes to the top.
+ */
+static void replace_text(struct buffer *bp, struct line *hp) {
+    struct line *lp;
+
+    while ((lp = lforw(bp->b_linep)) != bp->b_linep) lfree(lp);
+    bp->b_edits++;          /* For anything keyed on the text */
+    if (lforw(hp) != hp) {
+        bp->b_linep->l_fp = lforw(hp);
+        lforw(hp)->l_bp = bp->b_linep;
+        bp->b_linep->l_bp = lback(hp);
+        lback(hp)->l_fp = bp->b_linep;
+        hp->l_fp = hp->l_bp = hp;
+    }
+    free_list(hp);
+
+    for (struct window *wp = wheadp; wp != NULL; wp = wp->w_wndp) {
+        if (wp->w_bufp == bp) {
+            wp->w_linep = lforw(bp->b_linep);
+            wp->w.dotp = lforw(bp->b_linep);
+            wp->w.doto = 0;
+            wp->w.markp = NULL;
+            wp->w.marko = 0;
+            wp->w_flag |= WFMODE | WFHARD;
+        }
+    }
+    return;
+}
+
+/* An empty line list */
+static struct line *new_list(void) {
+    struct line *hp = lalloc();
+    hp->l_fp = hp->l_bp = hp;
+    return hp;
+}
+
 /* Pipe a one line command into a window
  * Bound to ^X @
  *
@@ -203,7 +478,6 @@ int pipecmd(int f, int n) {
     get_orig_size();
 
     db_strdef(line);        /* command line sent to shell */
-    db_strdef(comfile);
 
 /* Get the command to pipe in */
     if ((s = next_spawn_cmd(RXARG(pipecmd), "@", &line)) != TRUE) goto exit;
@@ -216,33 +490,14 @@ int pipecmd(int f, int n) {
         goto exit;
     }
 
-/* Create the tempfile via mkstemp() so the name is unpredictable.
- * The old "$HOME/.ue_<pid>" pattern let a co-located attacker pre-create
- * a symlink at that path; the shell's `>` redirection would then follow
- * it and truncate an arbitrary file the user could write.
- * mkstemp() creates the file owned-by-us with mode 0600 and a name an
- * attacker can't predict; the subsequent shell `>` re-opens it, which is
- * fine because the file already exists.
+/* Run it, collecting its output. Whatever it produced is shown, even
+ * if it failed.
  */
-    {
-        const char *hp = udir.home? udir.home: ".";
-        char tmpl[PATH_MAX];
-        snprintf(tmpl, sizeof(tmpl), "%s/.ue_XXXXXX", hp);
-        int fd = mkstemp(tmpl);
-        if (fd < 0) {
-            mlwrite("Cannot create tempfile: %s", strerror(errno));
-            s = FALSE;
-            goto exit;
-        }
-        close(fd);
-        db_set(comfile, tmpl);
-    }
+    struct line *hp = new_list();
     TTflush();
     TTclose();              /* stty to old modes    */
     TTkclose();
-    db_append(line, ">");
-    db_append(line, db_val(comfile));
-    rval = system(db_val(line));
+    (void)pipe_through(db_val(line), NULL, hp, NULL);
     TTopen();
     TTkopen();
     TTflush();
@@ -251,12 +506,14 @@ int pipecmd(int f, int n) {
     check_for_resize();
 
 /* Split the current window to make room for the command output */
-    if (splitwind(FALSE, 1) == FALSE) { s = FALSE; goto exit; }
+    if (splitwind(FALSE, 1) == FALSE) {
+        free_list(hp);
+        s = FALSE;
+        goto exit;
+    }
 
-/* And read the stuff in */
-    if (readin(db_val(comfile), FALSE) != TRUE) { s = FALSE; goto exit; }
-    terminate_str(bp->b_dfname);    /* Zap temporary filename */
-    terminate_str(bp->b_rpname);    /* Zap temporary filename */
+/* And put the stuff in */
+    replace_text(bp, hp);
 
 /* Put this window into VIEW mode.*/
     curwp->w_bufp->b_mode |= MDVIEW;
@@ -269,18 +526,14 @@ int pipecmd(int f, int n) {
     s = TRUE;
 
 exit:
-/* Always remove the tempfile on the way out, even on failure paths
- * (mkstemp creates it before we know if system() succeeds, and the old
- * "return FALSE" mid-function used to leak both the file and the dbs).
- */
-    if (db_len(comfile) > 0) unlink(db_val(comfile));
-    db_free(comfile);
     db_free(line);
     return s;
 }
 
 /* Filter a buffer through an external DOS program
  * Bound to ^X #
+ * The buffer (or its narrowed part) is streamed through the command and
+ * only replaced by the result if the command succeeds.
  */
 int filter_buffer(int f, int n) {
     UNUSED(f); UNUSED(n);
@@ -296,71 +549,19 @@ int filter_buffer(int f, int n) {
     get_orig_size();
 
     db_strdef(line);         /* command line send to shell */
-    db_strdef(tmpnam);       /* place to store real file name */
-    db_strdef(fltin);
-    db_strdef(fltout);
 
 /* Get the filter name and its args */
     if ((s = next_spawn_cmd(RXARG(filter_buffer), "#", &line)) != TRUE)
          goto exit;
 
-/* Setup the proper file names */
     bp = curbp;
-    db_set(tmpnam, bp->b_rpname);   /* Save the (full) original name */
-    const char *hp = udir.home;
-    if (!hp) hp = ".";              /* Default if absent */
-
-/* Create the in/out tempfiles via mkstemp() so the names are
- * unpredictable. The old "$HOME/.ue_f{in,out}_<pid>" pattern was a
- * symlink hazard: an attacker could pre-create either path as a
- * symlink, then have the shell's `<`/`>` redirection follow it.
- * NOTE: the previous code baked the `<`/`>` redirection characters into
- * fltin/fltout themselves and then passed db_val(fltin) to writeout(),
- * which tried to open a file literally named "<HOME/...". That was
- * broken — fltin/fltout now hold the path only; the redirection chars
- * are added when building the shell command (below).
- */
-    {
-        char tmpl[PATH_MAX];
-        int fd;
-
-        snprintf(tmpl, sizeof(tmpl), "%s/.ue_fin_XXXXXX", hp);
-        if ((fd = mkstemp(tmpl)) < 0) {
-            mlwrite("Cannot create filter input file: %s", strerror(errno));
-            s = FALSE;
-            goto exit;
-        }
-        close(fd);
-        db_set(fltin, tmpl);
-
-        snprintf(tmpl, sizeof(tmpl), "%s/.ue_fout_XXXXXX", hp);
-        if ((fd = mkstemp(tmpl)) < 0) {
-            mlwrite("Cannot create filter output file: %s", strerror(errno));
-            s = FALSE;
-            goto exit;
-        }
-        close(fd);
-        db_set(fltout, tmpl);
-    }
-
-/* Set this to our new one for */
-    set_buffer_filenames(bp, db_val(fltin));
-
-/* Write it out, checking for errors */
-    if (writeout(db_val(fltin)) != TRUE) {
-        mlwrite_one(MLbkt("Cannot write filter file"));
-        s = FALSE;
-        goto reset_bufname_exit;
-    }
+    struct line *hp = new_list();
+    int dos;
     ttput1c('\n');          /* Already have '\r'    */
     TTflush();
     TTclose();              /* stty to old modes    */
     TTkclose();
-    db_addch(line, '<');
-    db_append(line, db_val(fltin));
-    db_addch(line, '>');
-    db_append(line, db_val(fltout));
-    rval = system(db_val(line));
+    s = pipe_through(db_val(line), bp, hp, autodos? &dos: NULL);
     TTopen();
     TTkopen();
     TTflush();
@@ -368,40 +569,250 @@ int filter_buffer(int f, int n) {
 
     check_for_resize();
 
-/* Unset this flag, otherwise readin() prompts for "Discard changes" if
- * the original buffer (which we've just written out...to edit) was marked
- * as modified.
+    if (s != TRUE) {
+        free_list(hp);
+        if (WIFEXITED(rval))
+            mlwrite("Filter failed (exit status %d) - buffer unchanged",
+                 WEXITSTATUS(rval));
+        else
+            mlwrite_one(MLbkt("Execution failed"));
+        goto exit;
+    }
+
+/* Swap in the result. It can't be journalled.
+ * lchange() marks the buffer as changed, invalidates any match-group
+ * info pointing to it and removes any compiled translation table data.
  */
-    bp->b_flag &= ~BFCHG;
+    jnl_discard(bp);
+    replace_text(bp, hp);
+    if (autodos) {
+        if (dos) bp->b_mode |= MDDOSLE;
+        else     bp->b_mode &= ~MDDOSLE;
+    }
+    lchange(WFHARD | WFMODE);
+
+exit:
+    db_free(line);
+    return s;
+}
 
-/* If we are modfying the buffer that the match-group info points
- * to we want to mark them as invalid - readin() will do that.
- * Report any failure, then continue to tidy up... */
-    if ((s = readin(db_val(fltout), FALSE)) == FALSE) {
-        mlwrite_one(MLbkt("Execution failed"));
+/* ======================================================================
+ * Background pipe-commands.
+ * pipe-command-background runs a command with its output (stdout and
+ * stderr) going to a pipe, and returns at once. What it writes is added
+ * to the BGPIPEBUF buffer while we are waiting for the first key of a
+ * command (by idle_wait()), so it fills as you carry on editing.
+ * Only the windows showing that buffer are redrawn for it.
+ * kill-pipe-command stops it.
+ * There is only one at a time - starting another stops any running one.
+ */
+#define BGPIPEBUF ".ue_bgcommand"
+static struct bg_cmd {
+    struct buffer *bp;
+    pid_t pid;
+    int fd;                 /* -1 if none running */
+    db_dcl(part);           /* Partial last line */
+} bgcmd = { NULL, 0, -1, db_buf_initval };
+
+/* Add a line to the end of the buffer, fixing up its windows */
+static void bgcmd_line(const char *text, int len) {
+    struct buffer *bp = bgcmd.bp;
+
+    add_to_list(bp->b_linep, text, len);
+    bp->b_edits++;          /* For anything keyed on the text */
+    if (bp == group_match_buffer) group_match_buffer = NULL;
+    for (struct window *wp = wheadp; wp != NULL; wp = wp->w_wndp) {
+        if (wp->w_bufp != bp) continue;
+        if (wp->w_linep == bp->b_linep) wp->w_linep = lforw(bp->b_linep);
+        wp->w_flag |= WFHARD;
     }
-    bp->b_flag |= BFCHG;            /* Flag it as changed */
+    return;
+}
 
-/* If this is a translation table, remove any compiled data */
+/* It has finished (or is to be stopped) - tidy up and report */
+static void bgcmd_end(int stop) {
+    int wstatus = 0;
+    pid_t wpid;
+
+    if (db_len(bgcmd.part))
+        bgcmd_line(db_val(bgcmd.part), db_len(bgcmd.part));
+    db_free(bgcmd.part);
+    close(bgcmd.fd);
+    bgcmd.fd = -1;
+/* Stopping it - ask nicely (its whole process group), and insist if
+ * that hasn't worked after a second.
+ */
+    if (stop) {
+        kill(-bgcmd.pid, SIGTERM);
+        for (int tries = 0; tries < 20; tries++) {
+            if ((wpid = waitpid(bgcmd.pid, &wstatus, WNOHANG)) == bgcmd.pid)
+                goto reaped;
+            usleep(50000);
+        }
+        kill(-bgcmd.pid, SIGKILL);
+    }
+    while (((wpid = waitpid(bgcmd.pid, &wstatus, 0)) < 0) && (errno == EINTR));
+reaped:
+    if (wpid < 0) {         /* e.g. ECHILD - we have no status */
+        rval = -1;
+        mlwrite("Cannot get command status: %s", strerror(errno));
+        return;
+    }
+    rval = wstatus;
+    if (stop)
+        mlwrite_one(MLbkt("Command killed"));
+    else if (WIFEXITED(wstatus) && (WEXITSTATUS(wstatus) == 0))
+        mlwrite_one(MLbkt("Command finished"));
+    else if (WIFEXITED(wstatus))
+        mlwrite(MLbkt("Command exited with status %d"),
+             WEXITSTATUS(wstatus));
+    else
+        mlwrite_one(MLbkt("Command failed"));
+    return;
+}
 
-    if ((bp->b_type == BTPHON) && bp->ptt_headp) ptt_free(bp);
+/* The descriptor to poll() for output (-1 if none) */
+int bgcmd_fd(void) {
+    return bgcmd.fd;
+}
 
-reset_bufname_exit:
-    set_buffer_filenames(bp, db_val(tmpnam));
-exit:
-/* Always remove the tempfiles on the way out — including on any of the
- * early-error paths above that goto exit. mkstemp() may have created
- * one or both; len==0 means we never got that far.
+/* In a forked child, drop our end of the command's pipe */
+void bgcmd_fork_close(void) {
+    if (bgcmd.fd >= 0) close(bgcmd.fd);
+    bgcmd.fd = -1;
+    return;
+}
+
+/* There is output (or EOF) to read */
+void bgcmd_input(void) {
+    char buf[PIPE_CHUNK];
+
+    if (bgcmd.fd < 0) return;
+    ssize_t nr = read(bgcmd.fd, buf, sizeof(buf));
+    if ((nr < 0) && ((errno == EAGAIN) || (errno == EINTR))) return;
+    if (nr <= 0) {
+        bgcmd_end(FALSE);
+        return;
+    }
+    const char *cp = buf;
+    const char *ep = buf + nr;
+    while (cp < ep) {
+        const char *nlp = memchr(cp, '\n', (size_t)(ep - cp));
+        if (!nlp) {
+            db_appendn(bgcmd.part, cp, (int)(ep - cp));
+            break;
+        }
+        if (db_len(bgcmd.part)) {
+            db_appendn(bgcmd.part, cp, (int)(nlp - cp));
+            bgcmd_line(db_val(bgcmd.part), db_len(bgcmd.part));
+            db_clear(bgcmd.part);
+        }
+        else
+            bgcmd_line(cp, (int)(nlp - cp));
+        cp = nlp + 1;
+    }
+    return;
+}
+
+/* Stop any running command that is writing to bp (or any at all, for
+ * NULL) as the buffer is being cleared or deleted, or we are leaving.
+ */
+void bgcmd_stop(struct buffer *bp) {
+    if ((bgcmd.fd >= 0) && (!bp || (bp == bgcmd.bp))) bgcmd_end(TRUE);
+    return;
+}
+
+int pipecmd_background(int f, int n) {
+    UNUSED(f); UNUSED(n);
+    int s;
+    struct buffer *bp;
+    struct window *wp;
+    int pfd[2];
+
+/* Don't allow this command if restricted */
+    if (restflag) return resterr();
+
+    db_strdef(line);
+    if ((s = next_spawn_cmd(RXARG(pipecmd_background), "&", &line)) != TRUE)
+        goto exit;
+
+/* Get the (empty) buffer, stopping anything already writing to it */
+    bgcmd_stop(NULL);
+    if (((bp = bfind(BGPIPEBUF, TRUE, 0)) == NULL) || (bclear(bp) != TRUE)) {
+        s = FALSE;
+        goto exit;
+    }
+    bp->b_mode |= MDVIEW;
+
+    if (pipe(pfd) < 0) {
+        mlwrite("Cannot create pipe: %s", strerror(errno));
+        s = FALSE;
+        goto exit;
+    }
+    pid_t pid = fork();
+    if (pid < 0) {
+        mlwrite("Cannot fork: %s", strerror(errno));
+        close(pfd[0]);
+        close(pfd[1]);
+        s = FALSE;
+        goto exit;
+    }
+    if (pid == 0) {             /* Child - in its own process group */
+        setpgid(0, 0);
+        int nfd = open("/dev/null", O_RDONLY);
+        if (nfd >= 0) dup2(nfd, 0);
+        dup2(pfd[1], 1);
+        dup2(pfd[1], 2);
+        close(pfd[0]);
+        close(pfd[1]);
+        signal(SIGPIPE, SIG_DFL);
+        execl("/bin/sh", "sh", "-c", db_val(line), (char *)NULL);
+        _exit(127);
+    }
+    close(pfd[1]);
+    fcntl(pfd[0], F_SETFD, FD_CLOEXEC);
+    fcntl(pfd[0], F_SETFL, fcntl(pfd[0], F_GETFL) | O_NONBLOCK);
+    bgcmd.bp = bp;
+    bgcmd.pid = pid;
+    bgcmd.fd = pfd[0];
+
+/* Show it in another window (at its end, so following the output),
+ * leaving the current one alone.
  */
-    if (db_len(fltin) > 0) unlink(db_val(fltin));
-    if (db_len(fltout) > 0) unlink(db_val(fltout));
-    db_free(fltout);
-    db_free(fltin);
-    db_free(tmpnam);
+    if (bp->b_nwnd == 0) {
+        if ((wp = wpopup()) == NULL) goto exit;
+        struct buffer *obp = wp->w_bufp;
+        if (--obp->b_nwnd == 0) obp->b = wp->w;
+        wp->w_bufp = bp;
+        ++bp->b_nwnd;
+    }
+    for (wp = wheadp; wp != NULL; wp = wp->w_wndp) {
+        if (wp->w_bufp == bp) {
+            wp->w_linep = bp->b_linep;
+            wp->w.dotp = bp->b_linep;
+            wp->w.doto = 0;
+            wp->w.markp = NULL;
+            wp->w.marko = 0;
+            wp->w_flag |= WFMODE | WFHARD;
+        }
+    }
+    mlwrite(MLbkt("Running %s"), db_val(line));
+
+exit:
     db_free(line);
     return s;
 }
 
+int kill_pipe_command(int f, int n) {
+    UNUSED(f); UNUSED(n);
+    if (bgcmd.fd < 0) {
+        mlwrite_one("No background command running");
+        return FALSE;
+    }
+    bgcmd_stop(NULL);
+    return TRUE;
+}
+
 #ifdef DO_FREE
 /* Add a call to allow free() of normally-unfreed items here for, e.g,
  * valgrind usage.
@@ -177,7 +177,7 @@ int next_utf8_offset(const char *buf, int offs, int max_offset,
             int next_incr = utf8_to_unicode(buf, offs, max_offset, &c);
             if (!combining_type(c)) break;
             offs += next_incr;
-            if (offs >= max_offset) return -1;
+            if (offs >= max_offset) break;  /* Ends the text */
         }
     }
     return offs;
@@ -417,6 +417,30 @@ exit:
     return status;
 }
 
+/* Access to the char-replace settings for start-up snapshots.
+ * char_remap_get() returns the replacement char and sets *mp to the
+ * mapped ranges as start/end pairs, ending with UEM_NOCHAR (NULL if
+ * there are none).
+ * char_remap_set() replaces the settings with npairs such pairs (which
+ * must already be sorted, as they are from char_remap_get()).
+ */
+unicode_t char_remap_get(const unicode_t **mp) {
+    *mp = (const unicode_t *)remap;
+    return repchar;
+}
+void char_remap_set(unicode_t rc, const unicode_t *pairs, int npairs) {
+    Xfree_setnull(remap);
+    repchar = rc;
+    if (npairs == 0) return;
+    remap = Xmalloc((size_t)(npairs+1)*sizeof(struct repmap_t));
+    for (int ri = 0; ri < npairs; ri++) {
+        remap[ri].start = pairs[2*ri];
+        remap[ri].end = pairs[2*ri+1];
+    }
+    remap[npairs].start = remap[npairs].end = UEM_NOCHAR;
+    return;
+}
+
 /* Use the replacement char for mapped ones.
  * NOTE: that we might need two replacement chars!
  *  One for mapping chars that need to take up a column (normal)
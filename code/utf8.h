@@ -74,6 +74,8 @@ int same_grapheme(struct grapheme *, struct grapheme *, int);
 int combining_type(unicode_t);
 int char_replace(int, int);
 unicode_t display_for(unicode_t);
+unicode_t char_remap_get(const unicode_t **);
+void char_remap_set(unicode_t, const unicode_t *, int);
 
 int utf8_to_uclen(const char *, int, int);
 
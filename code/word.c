@@ -720,6 +720,41 @@ int wrapword(int f, int n) {
     return TRUE;
 }
 
+static int n_eos = 0;
+static db_strdef(eos_str);       /* String given by user */
+
+/* Set the end-of-sentence list from a string, or clear it if len is 0.
+ * Also used when restoring a start-up snapshot.
+ */
+void set_eos_list(const char *str, int len) {
+    if (len == 0) {
+        Xfree_setnull(eos_list);
+        n_eos = 0;
+        return;
+    }
+/* We'll get the buffer length in characters, then allocate that number of
+ * unicode chars. It might be more than we need (if there is a utf8
+ * multi-byte character in there) but it's not going to be that big.
+ * Actually we'll allocate one extra and put an illegal value at the end.
+ */
+    eos_list = Xreallocarray(eos_list, len + 1, sizeof(unicode_t));
+    int i = 0;
+    n_eos = 0;
+    while (i < len) {
+        unicode_t c;
+        i += utf8_to_unicode(str, i, len, &c);
+        eos_list[n_eos++] = c;
+    }
+    eos_list[n_eos] = UEM_NOCHAR;
+    db_setn(eos_str, str, len);
+    return;
+}
+
+/* The current end-of-sentence string, or NULL if there is none */
+const char *eos_setting(void) {
+    return n_eos? db_val(eos_str): NULL;
+}
+
 /* Set the GGR-added end-of-sentence list for use by fillpara and
  * justpara.
  * Allows utf8 punctuation, but does NOT cater for any zero-width
@@ -728,8 +763,6 @@ int wrapword(int f, int n) {
  *
  * int f, n;            arguments ignored
  */
-static int n_eos = 0;
-static db_strdef(eos_str);       /* String given by user */
 int eos_chars(int f, int n) {
     UNUSED(f); UNUSED(n);
     int status;
@@ -743,28 +776,10 @@ int eos_chars(int f, int n) {
           db_val(eos_str));
 
     status = mlreply(db_val(prompt), &buf, CMPLT_NONE);
-    if (status == FALSE) {      /* Empty response - remove item */
-        Xfree_setnull(eos_list);
-        n_eos = 0;
-    }
-    else if (status == TRUE) {  /* Some response - set item */
-/* We'll get the buffer length in characters, then allocate that number of
- * unicode chars. It might be more than we need (if there is a utf8
- * multi-byte character in there) but it's not going to be that big.
- * Actually we'll allocate one extra and put an illegal value at the end.
- */
-        int len = db_len(buf);
-        eos_list = Xreallocarray(eos_list, len + 1, sizeof(unicode_t));
-        int i = 0;
-        n_eos = 0;
-        while (i < len) {
-            unicode_t c;
-            i += utf8_to_unicode(db_val(buf), i, len, &c);
-            eos_list[n_eos++] = c;
-        }
-        eos_list[n_eos] = UEM_NOCHAR;
-        db_set(eos_str, db_val(buf));
-    }
+    if (status == FALSE)        /* Empty response - remove item */
+        set_eos_list("", 0);
+    else if (status == TRUE)    /* Some response - set item */
+        set_eos_list(db_val(buf), db_len(buf));
 /* Do nothing on anything else - allows you to abort once you've started. */
     db_free(prompt);
     db_free(buf);
@@ -0,0 +1,509 @@
+/* mkphash.c
+ *
+ * Produce an include file for uemacs (phash_tab.h) containing perfect
+ * hash tables for the built-in command names (names[] in names.c) and
+ * the default key bindings (init_keytab[] in ebind.h).
+ *
+ * This is run from the uemacs Makefile. Its inputs are the *preprocessed*
+ * names.c and ebind.h, so that any #ifdef'd entries (e.g. the
+ * NUMBERED_MACROS ones) are exactly as they are compiled, and so that
+ * the table indices match the compiled tables.
+ *
+ *  usage: mkphash names.i ebind.i >phash_tab.h
+ *
+ * The hashing functions come from phash.h, which the lookup code also
+ * uses.
+ * The tables use "hash and displace": each key hashes (with seed 0) to a
+ * bucket, and each bucket is given a seed (displacement) which puts all
+ * of its keys into distinct, unused slots. Buckets are placed largest
+ * first.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <limits.h>
+
+#include "phash.h"
+
+#define MAX_DISP 65535
+
+static const char *inname;      /* For error reports */
+
+static void die(const char *msg, const char *where) {
+    fprintf(stderr, "mkphash: %s: %s", inname, msg);
+    if (where) {
+        fprintf(stderr, " at: ");
+        for (int i = 0; i < 40 && where[i] && where[i] != '\n'; i++)
+            fputc(where[i], stderr);
+    }
+    fputc('\n', stderr);
+    exit(1);
+}
+
+/* Read a whole file into memory */
+static char *slurp(const char *fname) {
+    FILE *fh = fopen(fname, "r");
+    if (!fh) {
+        perror(fname);
+        exit(errno);
+    }
+    size_t alloc = 65536, used = 0, got;
+    char *buf = malloc(alloc);
+    while ((got = fread(buf + used, 1, alloc - used - 1, fh)) > 0) {
+        used += got;
+        if (alloc - used < 1024) buf = realloc(buf, alloc *= 2);
+    }
+    buf[used] = '\0';
+    fclose(fh);
+    return buf;
+}
+
+/* Skip whitespace and any preprocessor line markers */
+static const char *skipws(const char *p) {
+    for (;;) {
+        while (isspace((unsigned char)*p)) p++;
+        if (*p == '#') {
+            while (*p && *p != '\n') p++;
+            continue;
+        }
+        return p;
+    }
+}
+
+static const char *expect(const char *p, char c) {
+    p = skipws(p);
+    if (*p != c) {
+        char msg[32];
+        sprintf(msg, "expected '%c'", c);
+        die(msg, p);
+    }
+    return p + 1;
+}
+
+/* Find the start of the initializer list for the named array */
+static const char *find_table(const char *text, const char *name) {
+    size_t nlen = strlen(name);
+    for (const char *p = text; (p = strstr(p, name)) != NULL; p += nlen) {
+        if (p > text && (isalnum((unsigned char)p[-1]) || p[-1] == '_'))
+            continue;
+        const char *q = skipws(p + nlen);
+        if (*q++ != '[') continue;
+        q = skipws(q);
+        if (*q++ != ']') continue;
+        q = skipws(q);
+        if (*q++ != '=') continue;
+        return expect(q, '{');
+    }
+    die("cannot find table", name);
+    return NULL;
+}
+
+static const char *get_ident(const char *p, char *ident, size_t isize) {
+    p = skipws(p);
+    size_t i = 0;
+    if (!isalpha((unsigned char)*p) && *p != '_') die("expected identifier", p);
+    while (isalnum((unsigned char)*p) || *p == '_') {
+        if (i < isize - 1) ident[i++] = *p;
+        p++;
+    }
+    ident[i] = '\0';
+    return p;
+}
+
+/* Handle the escape at p (just after the \) */
+static const char *get_escape(const char *p, int *res) {
+    switch(*p) {
+    case 'n':  *res = '\n'; return p + 1;
+    case 't':  *res = '\t'; return p + 1;
+    case 'r':  *res = '\r'; return p + 1;
+    case 'a':  *res = '\a'; return p + 1;
+    case 'b':  *res = '\b'; return p + 1;
+    case 'f':  *res = '\f'; return p + 1;
+    case 'v':  *res = '\v'; return p + 1;
+    case 'x': {
+        char *ep;
+        *res = (int)strtol(p + 1, &ep, 16);
+        return ep;
+    }
+    default:
+        if (*p >= '0' && *p <= '7') {
+            int v = 0;
+            for (int i = 0; i < 3 && *p >= '0' && *p <= '7'; i++)
+                v = v*8 + (*p++ - '0');
+            *res = v;
+            return p;
+        }
+        *res = (unsigned char)*p;   /* \\ \' \" etc. */
+        return p + 1;
+    }
+}
+
+static const char *get_string(const char *p, char **res) {
+    p = expect(p, '"');
+    char *buf = malloc(strlen(p) + 1);
+    char *bp = buf;
+    while (*p != '"') {
+        if (*p == '\0') die("unterminated string", NULL);
+        if (*p == '\\') {
+            int c;
+            p = get_escape(p + 1, &c);
+            *bp++ = (char)c;
+        }
+        else *bp++ = *p++;
+    }
+    *bp = '\0';
+    *res = buf;
+    return p + 1;
+}
+
+/* A minimal constant-expression evaluator for the preprocessed key codes.
+ * These are just numbers and character constants or'ed together, with
+ * some (unicode_t) casts and parentheses from the macro expansions.
+ */
+static const char *get_expr(const char *p, unsigned int *res);
+
+static const char *get_term(const char *p, unsigned int *res) {
+    p = skipws(p);
+    if (*p == '(') {
+        const char *q = skipws(p + 1);
+        if (isalpha((unsigned char)*q) || *q == '_') {  /* A cast */
+            char ident[64];
+            q = get_ident(q, ident, sizeof(ident));
+            q = expect(q, ')');
+            return get_term(q, res);
+        }
+        p = get_expr(p + 1, res);
+        return expect(p, ')');
+    }
+    if (*p == '\'') {
+        int c;
+        p++;
+        if (*p == '\\') p = get_escape(p + 1, &c);
+        else            c = (unsigned char)*p++;
+        *res = (unsigned int)c;
+        return expect(p, '\'');
+    }
+    if (isdigit((unsigned char)*p)) {
+        char *ep;
+        *res = (unsigned int)strtoul(p, &ep, 0);
+        while (*ep == 'u' || *ep == 'U' || *ep == 'l' || *ep == 'L') ep++;
+        return ep;
+    }
+    die("cannot evaluate expression", p);
+    return NULL;
+}
+
+static const char *get_expr(const char *p, unsigned int *res) {
+    p = get_term(p, res);
+    for (;;) {
+        p = skipws(p);
+        if (*p != '|') return p;
+        unsigned int next;
+        p = get_term(p + 1, &next);
+        *res |= next;
+    }
+}
+
+/* Skip to the end of the current {...} entry (we are inside it) */
+static const char *end_of_entry(const char *p) {
+    int depth = 1;
+    while (depth) {
+        p = skipws(p);
+        if (*p == '\0') die("unterminated entry", NULL);
+        if (*p == '"') {
+            char *dummy;
+            p = get_string(p, &dummy);
+            free(dummy);
+            continue;
+        }
+        if (*p == '{') depth++;
+        else if (*p == '}') depth--;
+        p++;
+    }
+    p = skipws(p);
+    if (*p == ',') p++;
+    return p;
+}
+
+/* The data we collect */
+
+static char **name_str;         /* names[].n_name */
+static char **name_func;        /* names[].n_func (as a token) */
+static int n_names;
+
+static unsigned int *key_code;  /* init_keytab[].k_code */
+static char **key_func;         /* init_keytab[].k_fp (as a token) */
+static int n_keys;
+
+static void parse_names(const char *fname) {
+    inname = fname;
+    const char *p = find_table(slurp(fname), "names");
+    int alloc = 0;
+    for (;;) {
+        p = skipws(p);
+        if (*p == '}') break;
+        p = expect(p, '{');
+        if (n_names == alloc) {
+            alloc += 64;
+            name_str = realloc(name_str, (size_t)alloc*sizeof(char *));
+            name_func = realloc(name_func, (size_t)alloc*sizeof(char *));
+        }
+        char ident[128];
+        p = get_string(p, &name_str[n_names]);
+        p = expect(p, ',');
+        p = get_ident(p, ident, sizeof(ident));
+        name_func[n_names++] = strdup(ident);
+        p = end_of_entry(p);
+    }
+    if (n_names == 0) die("empty names table", NULL);
+}
+
+static void parse_keys(const char *fname) {
+    inname = fname;
+    const char *p = find_table(slurp(fname), "init_keytab");
+    int alloc = 0;
+    for (;;) {
+        p = skipws(p);
+        if (*p == '}') break;
+        p = expect(p, '{');
+        if (n_keys == alloc) {
+            alloc += 64;
+            key_code = realloc(key_code, (size_t)alloc*sizeof(unsigned int));
+            key_func = realloc(key_func, (size_t)alloc*sizeof(char *));
+        }
+        char ident[128];
+        p = get_expr(p, &key_code[n_keys]);
+        p = expect(p, ',');
+        p = get_ident(p, ident, sizeof(ident));
+        key_func[n_keys++] = strdup(ident);
+        p = end_of_entry(p);
+    }
+    if (n_keys == 0) die("empty init_keytab table", NULL);
+}
+
+/* Building the perfect hash */
+struct phash {
+    int nkeys;
+    unsigned int nbkt;          /* Power of 2 */
+    unsigned int nslot;         /* Power of 2 */
+    unsigned short *disp;       /* nbkt entries */
+    short *slot;                /* nslot entries, key index or -1 */
+};
+
+static unsigned int hash_key(int is_str, int ki, unsigned int seed) {
+    if (is_str) return ph_strhash(name_str[ki], seed);
+    return ph_inthash(key_code[ki], seed);
+}
+
+static unsigned int pow2_atleast(unsigned int n) {
+    unsigned int p = 1;
+    while (p < n) p <<= 1;
+    return p;
+}
+
+static int *bucket_size;        /* For by_size() */
+static int by_size(const void *a, const void *b) {
+    return bucket_size[*(const int *)b] - bucket_size[*(const int *)a];
+}
+
+static void build_phash(struct phash *ph, int is_str, int nkeys) {
+    ph->nkeys = nkeys;
+    ph->nbkt = pow2_atleast((unsigned int)(nkeys + 1)/2);
+    ph->nslot = pow2_atleast((unsigned int)nkeys + (unsigned int)nkeys/4);
+
+retry:
+    ph->disp = calloc(ph->nbkt, sizeof(unsigned short));
+    ph->slot = malloc(ph->nslot*sizeof(short));
+    for (unsigned int s = 0; s < ph->nslot; s++) ph->slot[s] = -1;
+
+/* Sort the keys into their buckets */
+    bucket_size = calloc(ph->nbkt, sizeof(int));
+    int *bkt_of = malloc((size_t)nkeys*sizeof(int));
+    for (int ki = 0; ki < nkeys; ki++) {
+        bkt_of[ki] = (int)(hash_key(is_str, ki, 0) & (ph->nbkt - 1));
+        bucket_size[bkt_of[ki]]++;
+    }
+    int *order = malloc(ph->nbkt*sizeof(int));
+    for (unsigned int b = 0; b < ph->nbkt; b++) order[b] = (int)b;
+    qsort(order, ph->nbkt, sizeof(int), by_size);
+
+/* Place each bucket, largest first */
+    unsigned int *tslot = malloc((size_t)nkeys*sizeof(unsigned int));
+    for (unsigned int bi = 0; bi < ph->nbkt; bi++) {
+        int b = order[bi];
+        if (bucket_size[b] == 0) break;
+        int placed = 0;
+        for (unsigned int d = 1; d <= MAX_DISP && !placed; d++) {
+            int nt = 0;
+            placed = 1;
+            for (int ki = 0; ki < nkeys && placed; ki++) {
+                if (bkt_of[ki] != b) continue;
+                unsigned int s = hash_key(is_str, ki, d) & (ph->nslot - 1);
+                if (ph->slot[s] != -1) placed = 0;
+                for (int j = 0; j < nt && placed; j++)
+                    if (tslot[j] == s) placed = 0;
+                tslot[nt++] = s;
+            }
+            if (!placed) continue;
+            nt = 0;
+            for (int ki = 0; ki < nkeys; ki++) {
+                if (bkt_of[ki] != b) continue;
+                ph->slot[tslot[nt++]] = (short)ki;
+            }
+            ph->disp[b] = (unsigned short)d;
+        }
+        if (!placed) {          /* Give ourselves more room and restart */
+            free(ph->disp);
+            free(ph->slot);
+            free(bucket_size);
+            free(bkt_of);
+            free(order);
+            free(tslot);
+            ph->nslot *= 2;
+            goto retry;
+        }
+    }
+    free(bucket_size);
+    free(bkt_of);
+    free(order);
+    free(tslot);
+}
+
+static void print_ushort_array(const char *type, const char *name,
+     const unsigned short *arr, unsigned int n) {
+    printf("static const %s %s[%u] = {", type, name, n);
+    for (unsigned int i = 0; i < n; i++)
+        printf("%s%5u,", (i % 10)? "": "\n   ", arr[i]);
+    printf("\n};\n");
+}
+
+static void print_short_array(const char *type, const char *name,
+     const short *arr, unsigned int n) {
+    printf("static const %s %s[%u] = {", type, name, n);
+    for (unsigned int i = 0; i < n; i++)
+        printf("%s%5d,", (i % 10)? "": "\n   ", arr[i]);
+    printf("\n};\n");
+}
+
+static int by_name(const void *a, const void *b) {
+    return strcmp(name_str[*(const int *)a], name_str[*(const int *)b]);
+}
+
+int main(int argc, char *argv[]) {
+
+    if (argc != 3) {
+        fprintf(stderr, "usage: %s names.i ebind.i\n", argv[0]);
+        return 1;
+    }
+    parse_names(argv[1]);
+    parse_keys(argv[2]);
+
+/* Duplicates would make a perfect hash impossible (and are errors in
+ * the tables anyway).
+ */
+    for (int i = 0; i < n_names; i++)
+        for (int j = i + 1; j < n_names; j++)
+            if (strcmp(name_str[i], name_str[j]) == 0) {
+                inname = argv[1];
+                die("duplicate name", name_str[i]);
+            }
+    for (int i = 0; i < n_keys; i++)
+        for (int j = i + 1; j < n_keys; j++)
+            if (key_code[i] == key_code[j]) {
+                inname = argv[2];
+                die("duplicate key code for", key_func[j]);
+            }
+
+/* The indices go out as shorts, so the counts must fit in one. */
+    if (n_names <= 0 || n_names > SHRT_MAX) {
+        inname = argv[1];
+        die("bad entry count for names[]", NULL);
+    }
+    if (n_keys <= 0 || n_keys > SHRT_MAX) {
+        inname = argv[2];
+        die("bad entry count for init_keytab[]", NULL);
+    }
+
+/* Map each default key handler to its names[] entry.
+ * Where a function has more than one name we use the first, which is
+ * what func_info() also returns.
+ */
+    short *key_name = malloc((size_t)n_keys*sizeof(short));
+    for (int i = 0; i < n_keys; i++) {
+        key_name[i] = -1;
+        for (int j = 0; j < n_names; j++) {
+            if (strcmp(key_func[i], name_func[j]) == 0) {
+                key_name[i] = (short)j;
+                break;
+            }
+        }
+        if (key_name[i] < 0) {
+            inname = argv[2];
+            die("key handler has no entry in names[]", key_func[i]);
+        }
+    }
+
+/* The sorted order of the names, and a next-in-order index */
+    int *order = malloc((size_t)n_names*sizeof(int));
+    for (int i = 0; i < n_names; i++) order[i] = i;
+    qsort(order, (size_t)n_names, sizeof(int), by_name);
+    short *s_order = malloc((size_t)n_names*sizeof(short));
+    short *s_next = malloc((size_t)n_names*sizeof(short));
+    for (int i = 0; i < n_names; i++) {
+        s_order[i] = (short)order[i];
+        s_next[order[i]] = (short)((i == n_names - 1)? -1: order[i+1]);
+    }
+
+    struct phash nph, kph;
+    build_phash(&nph, 1, n_names);
+    build_phash(&kph, 0, n_keys);
+
+    printf(
+"/* phash_tab.h\n"
+" * Perfect hash tables for names[] (names.c) and init_keytab[] (ebind.h).\n"
+" * Generated by mkphash (../tools/mkphash.c) - DO NOT EDIT.\n"
+" * The hash functions are in phash.h.\n"
+" */\n"
+"#ifndef PHASH_TAB_H_\n"
+"#define PHASH_TAB_H_\n"
+"\n");
+
+    printf("#ifdef NAMES_C\n");
+    printf("#define PH_NAME_COUNT %d\n", n_names);
+    printf("#define PH_NAME_NBKT %u\n", nph.nbkt);
+    printf("#define PH_NAME_NSLOT %u\n", nph.nslot);
+    print_ushort_array("unsigned short", "ph_name_disp", nph.disp, nph.nbkt);
+    printf("/* names[] index for each slot, -1 == empty */\n");
+    print_short_array("short", "ph_name_slot", nph.slot, nph.nslot);
+    printf("/* names[] indices in name order */\n");
+    print_short_array("int", "ph_name_order", s_order, (unsigned)n_names);
+    printf("/* The names[] index following each names[] entry in name order */\n");
+    print_short_array("int", "ph_name_next", s_next, (unsigned)n_names);
+    printf("#endif\n\n");
+
+    printf("#ifdef BIND_C\n");
+    printf("#define PH_KEY_COUNT %d\n", n_keys);
+    printf("#define PH_KEY_NBKT %u\n", kph.nbkt);
+    printf("#define PH_KEY_NSLOT %u\n", kph.nslot);
+    print_ushort_array("unsigned short", "ph_key_disp", kph.disp, kph.nbkt);
+    printf("/* init_keytab[] index for each slot, -1 == empty */\n");
+    print_short_array("short", "ph_key_slot", kph.slot, kph.nslot);
+    printf("/* The key code of each init_keytab[] entry */\n");
+    printf("static const unsigned int ph_key_code[%d] = {", n_keys);
+    for (int i = 0; i < n_keys; i++)
+        printf("%s0x%08x,", (i % 6)? " ": "\n    ", key_code[i]);
+    printf("\n};\n");
+    printf("#endif\n\n");
+
+    printf("#ifdef MAIN_C\n");
+    printf("#define PH_KEY_COUNT %d\n", n_keys);
+    printf("/* The names[] index of each init_keytab[] handler */\n");
+    print_short_array("short", "ph_key_name", key_name, (unsigned)n_keys);
+    printf("#endif\n\n");
+
+    printf("#endif  /* PHASH_TAB_H_ */\n");
+    return 0;
+}
@@ -0,0 +1,259 @@
+#!/bin/bash
+#
+# Time searches and replaces over some generated corpora.
+# Run from the code directory (as for read-speed.sh), or with
+# "make bench" there.
+#
+# Four corpora are written, with the same pseudo-random (so always
+# identical) text of ASCII words, with CJK words mixed in, with words
+# carrying combining marks and with all of it on very long lines.
+# The editor is run on each (with -P, so with no display) and times
+# itself (via shell-command) over these workloads:
+#
+#   literal     count-matches, Exact, no Magic
+#   folded      count-matches, no Exact, no Magic
+#   magic       count-matches, Magic
+#   group-repl  replace-string with group replacements, Magic
+#   replace-all replace-string, Exact, no Magic
+#
+# The match counts for the replaces are found with list-matches before
+# the timing starts. Each workload is run SS_RUNS times and the best
+# time is kept.
+#
+# The results are compared with those in SS_BASELINE, if it exists.
+# The script fails if any match count differs from it, or if any rate
+# has dropped by more than SS_THRESHOLD percent. If SS_SAVE is set the
+# results are written out as the new baseline instead.
+# Baselines depend on the machine, so none is supplied.
+#
+# Settings (from the environment):
+#   SS_MB           size of each corpus, in MB (default 16)
+#   SS_RUNS         runs of each corpus (default 3)
+#   SS_BASELINE     baseline file (default ../tools/search-speed.baseline)
+#   SS_THRESHOLD    allowed drop in MB/sec, in percent (default 15)
+#   SS_SAVE         set to save the results as the baseline
+
+mb=${SS_MB:-16}
+runs=${SS_RUNS:-3}
+baseline=${SS_BASELINE:-../tools/search-speed.baseline}
+threshold=${SS_THRESHOLD:-15}
+
+corpora="ascii cjk combining longline"
+times=search-speed.times
+rm -f $times
+
+# -+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-
+# Write out a corpus.
+# The generator is a Park-Miller one in the awk code, rather than
+# awk's rand(), so that every awk gives the same text.
+#
+make_corpus() {
+    awk -v kind=$1 -v size=$(($mb*1024*1024)) 'BEGIN {
+        nw = split("the quick brown fox jumps over a lazy dog station " \
+             "nation quite theme those quota question other then " \
+             "thorough queue three", words, " ")
+        if (kind == "cjk") {
+            nw += split("\346\235\261\344\272\254 " \
+                 "\346\227\245\346\234\254\350\252\236 " \
+                 "\346\244\234\347\264\242 \347\275\256\346\217\233 " \
+                 "\344\270\255\346\226\207 \355\225\234\352\265\255\354\226\264",
+                 cjk, " ")
+            for (i in cjk) words[nw - length(cjk) + i] = cjk[i]
+        }
+        if (kind == "combining") {
+            nw += split("cafe\314\201 nai\314\210ve e\314\201\314\243 " \
+                 "statio\314\202n the\314\201me qu\314\210ite " \
+                 "a\314\200\314\201\314\202", cmb, " ")
+            for (i in cmb) words[nw - length(cmb) + i] = cmb[i]
+        }
+        linelen = (kind == "longline")? 65536: 72
+        seed = 12345
+        done = 0
+        line = ""
+        while (done < size) {
+            seed = (seed * 16807) % 2147483647
+            if (seed % 17 == 0) {
+                w = sprintf("key%d=%d", seed % 1000, seed % 97)
+            }
+            else {
+                w = words[1 + (seed % nw)]
+            }
+            line = (line == "")? w: line " " w
+            if (length(line) >= linelen) {
+                print line
+                done += length(line) + 1
+                line = ""
+            }
+        }
+        if (line != "") print line
+    }' >search-speed-$1.tfile
+}
+
+# -+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-
+# Write out the uemacs start-up file for a corpus.
+# Each workload writes "<corpus> <workload> start|end <time>" and
+# "<corpus> <workload> count <n>" lines to the times file.
+#
+make_rc() {
+    sed -e "s/CORPUS/$1/g" -e "s/TIMES/$times/g" >uetest.rc <<'EOD'
+store-procedure stamp
+  shell-command &cat &cat "date +~"CORPUS " %wl &cat " " &cat %what " %s.%N~" >>TIMES"
+!endm
+
+; Put the number of matches for %pat into the times file.
+;
+store-procedure count
+  list-matches %pat
+  select-buffer //Matches
+  beginning-of-file
+  set .n &lef $line &sub &sin $line " " 1
+  shell-command &cat &cat "echo CORPUS " %wl &cat " count " &cat .n " >>TIMES"
+  select-buffer search-speed-CORPUS.tfile
+!endm
+
+; Time a count-matches of %pat, then count them
+;
+store-procedure time-count
+  set %what start
+  run stamp
+  count-matches %pat
+  set %what end
+  run stamp
+  run count
+!endm
+
+; Count the matches for %pat, then time replacing them with %repl
+;
+store-procedure time-replace
+  run count
+  beginning-of-file
+  set %what start
+  run stamp
+  replace-string %pat %repl
+  set %what end
+  run stamp
+!endm
+
+find-file search-speed-CORPUS.tfile
+
+set %wl literal
+add-mode Exact
+delete-mode Magic
+set %pat station
+run time-count
+
+set %wl folded
+delete-mode Exact
+set %pat STATION
+run time-count
+
+set %wl magic
+add-mode Exact
+add-mode Magic
+set %pat "(qu|th)\w+e"
+run time-count
+
+set %wl group-repl
+set %pat "key(\d+)=(\d+)"
+set %repl "${2}=yek${1}"
+run time-replace
+
+set %wl replace-all
+delete-mode Magic
+set %pat "the"
+set %repl "THE"
+run time-replace
+
+unmark-buffer
+exit-emacs
+EOD
+}
+
+[ -z "$UE2RUN" ] && UE2RUN="./uemacs -d etc"
+$UE2RUN -v
+
+for c in $corpora; do
+    make_corpus $c
+    echo "$c bytes `wc -c < search-speed-$c.tfile`" >>$times
+    make_rc $c
+    run=0
+    while [ $run -lt $runs ]; do
+        $UE2RUN -P -x ./uetest.rc
+        run=$(($run + 1))
+    done
+    rm -f search-speed-$c.tfile
+done
+rm -f uetest.rc
+
+# -+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-
+# Work out the rates, and compare them with (or save) the baseline.
+#
+SS_SAVE=$SS_SAVE perl -e '
+    my ($times, $baseline, $threshold) = @ARGV;
+    my (%bytes, %start, %best, %count, @order);
+    open(my $tf, "<", $times) or die "No times: $!\n";
+    while (<$tf>) {
+        my ($c, $w, $what, $val) = split;
+        if ($w eq "bytes") { $bytes{$c} = $what; next; }
+        my $k = "$c $w";
+        push @order, $k unless exists $count{$k} or exists $start{$k};
+        if    ($what eq "start") { $start{$k} = $val; }
+        elsif ($what eq "count") { $count{$k} = $val; }
+        elsif ($what eq "end") {
+            my $t = $val - $start{$k};
+            $t = 0.0001 if ($t < 0.0001);
+            $best{$k} = $t if (!exists $best{$k} or $t < $best{$k});
+        }
+    }
+    my (%bcount, %brate);
+    if (!$ENV{SS_SAVE} and open(my $bf, "<", $baseline)) {
+        while (<$bf>) {
+            next if /^#/;
+            my ($c, $w, $n, $rate) = split;
+            $bcount{"$c $w"} = $n;
+            $brate{"$c $w"} = $rate;
+        }
+    }
+    my $fails = 0;
+    my @lines;
+    printf "%-10s %-12s %9s %9s %12s\n",
+         "corpus", "workload", "matches", "MB/sec", "matches/sec";
+    for my $k (@order) {
+        my ($c) = split " ", $k;
+        my $t = $best{$k};
+        my $mbs = $bytes{$c}/$t/(1024*1024);
+        my $note = "";
+        if (exists $bcount{$k}) {
+            if ($count{$k} != $bcount{$k}) {
+                $note = " MATCHES CHANGED (was $bcount{$k})";
+                $fails++;
+            }
+            elsif ($mbs < $brate{$k}*(100 - $threshold)/100) {
+                $note = sprintf(" SLOWER (was %.2f)", $brate{$k});
+                $fails++;
+            }
+        }
+        printf "%-10s %-12s %9d %9.2f %12.0f%s\n",
+             split(" ", $k), $count{$k}, $mbs, $count{$k}/$t, $note;
+        push @lines, sprintf("%s %d %.2f\n", $k, $count{$k}, $mbs);
+    }
+    if ($ENV{SS_SAVE}) {
+        open(my $bf, ">", $baseline) or die "Cannot write $baseline: $!\n";
+        print $bf "# corpus workload matches MB/sec\n", @lines;
+        print "Baseline saved in $baseline\n";
+    }
+    elsif (!%brate) {
+        print "No baseline in $baseline (set SS_SAVE=1 to make one)\n";
+    }
+    elsif ($fails) {
+        print "$fails regression(s) against $baseline",
+             " (threshold $threshold%)\n";
+        exit 1;
+    }
+    else {
+        print "No regressions against $baseline (threshold $threshold%)\n";
+    }
+' $times $baseline $threshold
+status=$?
+rm -f $times
+exit $status
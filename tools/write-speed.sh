@@ -0,0 +1,63 @@
+#!/bin/bash
+#
+# The writing counterpart of read-speed.sh.
+# The file is read in and written out again, and the time for just
+# reading it (as in read-speed.sh) is subtracted to give the write rate.
+# Set UE_CRYPT to a key to time an encrypted write (which goes via the
+# write cache rather than writev()), and UE_CRYPT_MODE to the
+# $crypt_mode to use (default 0x3001).
+
+lc=1000
+rm -f write-speed.tfile write-speed.ofile
+while [ $lc -gt 0 ]; do
+    cat ../CHANGES search.c >> write-speed.tfile
+    let "lc=$lc - 1"
+done
+
+lines=`wc -l < write-speed.tfile`
+bytes=`wc -c < write-speed.tfile`
+
+# -+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-
+# Write out the uemacs start-up files, that will run the tests
+#
+cat >uetest-r.rc <<'EOD'
+
+find-file write-speed.tfile
+
+exit-emacs
+EOD
+
+cat >uetest-w.rc <<'EOD'
+
+find-file write-speed.tfile
+EOD
+[ -n "$UE_CRYPT" ] && cat >>uetest-w.rc <<EOD
+set \$crypt_mode ${UE_CRYPT_MODE:-0x3001}
+add-mode Crypt
+set-encryption-key $UE_CRYPT
+EOD
+cat >>uetest-w.rc <<'EOD'
+write-file write-speed.ofile
+
+exit-emacs
+EOD
+
+[ -z "$UE2RUN" ] && UE2RUN=./uemacs
+$UE2RUN -v
+rtime=`/usr/bin/time -f "%e" $UE2RUN -P -x  ./uetest-r.rc 2>&1`
+wtime=`/usr/bin/time -f "%e" $UE2RUN -P -x  ./uetest-w.rc 2>&1`
+
+rm -f write-speed.tfile write-speed.ofile uetest-r.rc uetest-w.rc
+
+(echo $rtime; echo $wtime; echo $lines; echo $bytes) | perl -e '
+    chomp (my $rtime = <>);
+    chomp (my $wtime = <>);
+    chomp (my $lc = <>);
+    chomp (my $bc = <>);
+    my $time = $wtime - $rtime;
+    $time = 0.01 if ($time < 0.01);
+    printf "Rate is %.2f lines/sec (%.2f MB/sec)\n",
+         $lc/$time, $bc/$time/(1024*1024);
+    printf "(Wrote %d lines in %.2fs - read+write %.2fs, read %.2fs)\n",
+         $lc, $time, $wtime, $rtime;
+'